@@ -52,33 +52,38 @@ def autoDelineate(thresh, outlet=None, moveOutlet=False):
     if _path=="" or _dem=="" or _taudem=="":
         return "Please run initialize() first!"
 
-    res = pitremove()
-    if res != 0:
-        return "pitremove failed with " + str(res)
-    res = d8flowdir()
-    if res != 0:
-        return "d8flowdir failed with " + str(res)
-    res = dinfflowdir()
-    if res != 0:
-        return "dinfflowdir failed with " + str(res)
-    res = aread8()
-    if res != 0:
-        return "aread8 failed with " + str(res)
-    res = areadinf()
-    if res != 0:
-        return "areadinf failed with " + str(res)
-    res = gridnet()
-    if res != 0:
-        return "gridnet failed with " + str(res)
-    res = peukerdouglas()
-    if res != 0:
-        return "peukerdouglas failed with " + str(res)
-    res = aread8_outlet(outlet)
-    if res != 0:
-        return "aread8_outlet failed with " + str(res)
-    res = threshold(thresh)
-    if res != 0:
-        return "threshold failed with " + str(res)
+    if _pipelineAvailable():
+        res = pipeline(thresh, outlet)
+        if res != 0:
+            return "taudem_pipeline failed with " + str(res)
+    else:
+        res = pitremove()
+        if res != 0:
+            return "pitremove failed with " + str(res)
+        res = d8flowdir()
+        if res != 0:
+            return "d8flowdir failed with " + str(res)
+        res = dinfflowdir()
+        if res != 0:
+            return "dinfflowdir failed with " + str(res)
+        res = aread8()
+        if res != 0:
+            return "aread8 failed with " + str(res)
+        res = areadinf()
+        if res != 0:
+            return "areadinf failed with " + str(res)
+        res = gridnet()
+        if res != 0:
+            return "gridnet failed with " + str(res)
+        res = peukerdouglas()
+        if res != 0:
+            return "peukerdouglas failed with " + str(res)
+        res = aread8_outlet(outlet)
+        if res != 0:
+            return "aread8_outlet failed with " + str(res)
+        res = threshold(thresh)
+        if res != 0:
+            return "threshold failed with " + str(res)
     if outlet!=None and moveOutlet:
         res = moveoutletstostreams(outlet)
         if res != 0:
@@ -122,6 +127,13 @@ def _outletarg(outlet):
 
 
 
+def _pipelineAvailable():
+    taudemPath = _taudem.strip('"')
+    return os.path.exists(os.path.join(taudemPath,"taudem_pipeline")) or \
+           os.path.exists(os.path.join(taudemPath,"taudem_pipeline.exe"))
+
+
+
 def _execute(cmd):
     """Executes a taudem command and handle errors accordingly."""
 
@@ -143,6 +155,17 @@ def _execute(cmd):
 
 
 
+def pipeline(thresh, outlet=None):
+    """Run pitremove to threshold in one process, keeping the grids in memory."""
+    cmd = "taudem_pipeline" + _argument("z", "") + _outletarg(outlet)
+    for grid in ["fel", "p", "sd8", "ang", "slp", "ad8", "sca",
+                 "plen", "tlen", "gord", "ss", "ssa", "src"]:
+        cmd += _argument(grid)
+    cmd += " -nc -thresh " + str(thresh)
+    return _execute(cmd)
+
+
+
 def pitremove():
     cmd = "pitremove" + _argument("z", "") + _argument("fel")
     return _execute(cmd)
@@ -161,6 +184,22 @@ def dinfflowdir():
 
 
 
+def flowdir():
+    """D8 and Dinf flow directions and slopes in one run of d8flowdir.
+
+    Builds without taudem_pipeline predate the -ang and -slp options of
+    d8flowdir, so they run d8flowdir and dinfflowdir separately."""
+    if not _pipelineAvailable():
+        res = d8flowdir()
+        if res != 0:
+            return res
+        return dinfflowdir()
+    cmd=  "d8flowdir" + _argument("fel") + _argument("p") + _argument("sd8")  \
+                     + _argument("ang") + _argument("slp")
+    return _execute(cmd)
+
+
+
 def aread8():
     cmd = "aread8" + _argument("p") + _argument("ad8") + " -nc"
     return _execute(cmd)
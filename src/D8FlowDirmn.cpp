@@ -48,9 +48,9 @@ email:  dtarb@usu.edu
 
 int main(int argc,char **argv)
 {
-  char demfile[MAXLN], pointfile[MAXLN], slopefile[MAXLN], flowfile[MAXLN];
+  char demfile[MAXLN], pointfile[MAXLN], slopefile[MAXLN], flowfile[MAXLN], angfile[MAXLN], slpfile[MAXLN];
   int err, i;
-    short useflowfile=0;
+    short useflowfile=0, useang=0, useslp=0;
 
    if(argc < 2)
     {  
@@ -99,6 +99,28 @@ int main(int argc,char **argv)
 			}
 			else goto errexit;
 		}
+		else if(strcmp(argv[i],"-ang")==0)  //  Also write the Dinf flow directions
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(angfile,argv[i]);
+				i++;
+				useang=1;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-slp")==0)  //  and Dinf slopes
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(slpfile,argv[i]);
+				i++;
+				useslp=1;
+			}
+			else goto errexit;
+		}
 		else if(strcmp(argv[i],"-sfdr")==0)
 		{
 			i++;
@@ -113,7 +135,7 @@ int main(int argc,char **argv)
 
 		else 
 		{
-			goto errexit;
+			if(!parseGridOption(argc,argv,i)) goto errexit;  //  Partition and grid file options
 		}
 	}
 	if( argc == 2) {
@@ -121,8 +143,10 @@ int main(int argc,char **argv)
 		nameadd(pointfile,argv[1],"p");
 		nameadd(slopefile,argv[1],"sd8");		
 	}
+	if( useang != useslp) goto errexit;
 
-    if((err=setdird8(demfile, pointfile, slopefile,flowfile,useflowfile)) != 0)
+    if((err=setdird8(demfile, pointfile, slopefile,flowfile,useflowfile,
+		useang ? angfile : NULL, useslp ? slpfile : NULL)) != 0)
         printf("setdird8 error %d\n",err);
 
 	return 0;
@@ -130,12 +154,15 @@ int main(int argc,char **argv)
 	errexit:
 	   printf("Simple Usage:\n %s <basefilename>\n",argv[0]);
 	   printf("Usage with specific file names:\n %s -fel <demfile>\n",argv[0]);
-       printf("-sd8 <slopefile> -p <angfile> [-sfdr <flowfile>]\n");
+       printf("-sd8 <slopefile> -p <angfile> [-sfdr <flowfile>] [-ang <angfile> -slp <slpfile>]\n");
 	   printf("<basefilename> is the name of the raw digital elevation model\n");
 	   printf("<demfile> is the pit filled or carved DEM input file.\n");
 	   printf("<slopefile> is the slope output file.\n");
 	   printf("<pointfile> is the output d8 flow direction file.\n");
        printf("[-sfdr <flowfile>] is the optional user imposed stream flow direction file.\n");
+       printf("[-ang <angfile> -slp <slpfile>] are the optional Dinf flow direction and slope output files,\n");
+       printf("evaluated from the same elevations as DinfFlowDir would, sharing the flat resolution.\n");
+       printGridOptions();
        printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
        printf("fel    carved or pit filled input elevation file\n");
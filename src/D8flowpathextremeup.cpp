@@ -228,24 +228,13 @@ MPI_Init(NULL,NULL);
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 		//Clear out borders
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = ssa->ringTerm(finished);
+		finished = ssa->collectiveTerm(finished);
 	}
 
 	//Stop timer
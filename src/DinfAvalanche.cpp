@@ -298,18 +298,7 @@ int avalancherunoutgrd(char *angfile, char *felfile, char *assfile, char *rzfile
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		//Clear out borders
 		neighbor->clearBorders();
@@ -317,7 +306,7 @@ int avalancherunoutgrd(char *angfile, char *felfile, char *assfile, char *rzfile
 
 		//Check if done
 		finished = que.empty();
-		finished = rz->ringTerm(finished);
+		finished = rz->collectiveTerm(finished);
 	}
 
 	//Stop timer
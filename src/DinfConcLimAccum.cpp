@@ -47,6 +47,7 @@ email:  dtarb@usu.edu
 #include "createpart.h"
 #include "tiffIO.h"
 #include "initneighbor.h"
+#include "threadqueue.h"
 using namespace std;
 
 
@@ -58,11 +59,70 @@ using namespace std;
 //const short d2[9] = { 0,1, 1, 0,-1,-1,-1,0,1};
 // moved to commonlib.h
 
+//  Flow algebra for concentration limited accumulation, used by the serial loop and by
+//  drainQueueThreaded.  evaluate(i,j) evaluates cell (i,j) in the partition, once all the
+//  cells that drain to it have been evaluated.
+class concLimCells {
+	public:
+		tdpartition *flowData, *ctpt, *dmData, *dgData, *qData;
+		linearpart<float> *flowL;
+		int contcheck;
+		float cSol;
+		void evaluate(long i, long j);
+		bool drainsTo(long i, long j, short k){return prop(flowL->getDataUnchecked(i,j), k) > 0.;}
+};
+
+void concLimCells::evaluate(long i, long j)
+{
+	long in,jn;
+	short k;
+	bool con;
+	float ctptt,angle,dmm,qq,Concentration,tempFloat;
+	short dgg;
+	double p;
+
+	if(qData->getData(i,j,tempFloat)>0.){
+		//  Initialize the result
+		con=false;  //  So far not edge contaminated
+		if ( dgData->getData(i,j,dgg) > 0) ctpt->setData(i,j,cSol);
+		else{
+			Concentration=0.0;				
+		//test if neighbor drains towards cell excluding boundaries 
+			for(k=1; k<=8; k++) {
+				in = i+d1[k];
+				jn = j+d2[k];
+				if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
+					con=true;
+				else{
+					flowData->getData(in,jn, angle);
+					p = prop(angle, (k+4)%8);
+					if(p>0.)
+					{
+						if(ctpt->isNodata(in,jn)||dmData->isNodata(in,jn)||qData->isNodata(in,jn))con=true;
+						else
+						{
+							ctpt->getData(in,jn,ctptt);
+							qData->getData(in,jn,qq);
+							dmData->getData(in,jn,dmm);
+							Concentration += p * ctptt * qq * dmm;
+						}
+					}
+				}
+			}
+			Concentration=Concentration/qData->getData(i,j,tempFloat);
+			ctpt->setData(i,j,Concentration);
+		}
+		if(con && contcheck==1)ctpt->setToNodata(i,j);
+	}
+	else ctpt->setToNodata(i,j);
+}
+
 int dsllArea(char* angfile,char* ctptfile,char* dmfile,char* shfile,char* qfile, char* dgfile, 
 		   int useOutlets, int contcheck, float cSol)
 {
 
-	MPI_Init(NULL,NULL);{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
 
 	//Only used for timing
 	int rank,size;
@@ -74,8 +134,7 @@ int dsllArea(char* angfile,char* ctptfile,char* dmfile,char* shfile,char* qfile,
 	int numOutlets=0;
 
  
-	float ctptt,angle,dmm,qq,Concentration;
-	short dgg;
+	float angle;
 	double p;
 
 	//  Keep track of time
@@ -178,12 +237,10 @@ int dsllArea(char* angfile,char* ctptfile,char* dmfile,char* shfile,char* qfile,
 	/*tdpartition *qq;
 	qq = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, -1.0f);*/
 
-	// con is used to check for contamination at the edges
 	long i,j;
 	short k;
 	long in,jn;
-	bool con=false, finished;
-	float tempFloat=0;
+	bool finished;
 	short tempShort=0;
 
 	tdpartition *neighbor;
@@ -204,10 +261,24 @@ int dsllArea(char* angfile,char* ctptfile,char* dmfile,char* shfile,char* qfile,
 
 	initNeighborDinfup(neighbor,flowData,&que,nx, ny, useOutlets, outletsX, outletsY, numOutlets);
 
+	concLimCells cells;
+	cells.flowData = flowData;
+	cells.ctpt = ctpt;
+	cells.dmData = dmData;
+	cells.dgData = dgData;
+	cells.qData = qData;
+	cells.flowL = dynamic_cast<linearpart<float>*>(flowData);
+	cells.contcheck = contcheck;
+	cells.cSol = cSol;
+	linearpart<short> *neighborL = dynamic_cast<linearpart<short>*>(neighbor);
+	int numThreads = getNumThreads();
 	finished = false;
 	
 	//Ring terminating while loop
 	while(!finished) {
+		//  With threads the queue is evaluated by drainQueueThreaded and the loop below is skipped
+		if(numThreads > 1 && cells.flowL != NULL && neighborL != NULL)
+			drainQueueThreaded(que, neighborL, cells, numThreads);
 		while(!que.empty()) 
 		{
 			//Takes next node with no contributing neighbors
@@ -216,39 +287,8 @@ int dsllArea(char* angfile,char* ctptfile,char* dmfile,char* shfile,char* qfile,
 			i = temp.x;
 			j = temp.y;
 			//  FLOW ALGEBRA EXPRESSION EVALUATION
-			if(flowData->isInPartition(i,j) && (qData->getData(i,j,tempFloat)>0.)){
-				//  Initialize the result
-				con=false;  //  So far not edge contaminated
-				if ( dgData->getData(i,j,dgg) > 0) ctpt->setData(i,j,cSol);
-				else{
-					Concentration=0.0;				
-		//test if neighbor drains towards cell excluding boundaries 
-					for(k=1; k<=8; k++) {
-						in = i+d1[k];
-						jn = j+d2[k];
-						if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
-							con=true;
-						else{
-							flowData->getData(in,jn, angle);
-							p = prop(angle, (k+4)%8);
-							if(p>0.)
-							{
-								if(ctpt->isNodata(in,jn)||dmData->isNodata(in,jn)||qData->isNodata(in,jn))con=true;
-								else
-								{
-									ctpt->getData(in,jn,ctptt);
-									qData->getData(in,jn,qq);
-									dmData->getData(in,jn,dmm);
-									Concentration += p * ctptt * qq * dmm;
-								}
-							}
-						}
-					}
-					Concentration=Concentration/qData->getData(i,j,tempFloat);
-					ctpt->setData(i,j,Concentration);
-				}
-				if(con && contcheck==1)ctpt->setToNodata(i,j);
-			}
+			if(flowData->isInPartition(i,j))
+				cells.evaluate(i,j);
 			else ctpt->setToNodata(i,j);
 			//  END FLOW ALGEBRA EXPRESSION EVALUATION
 						//  Decrement neighbor dependence of downslope cell
@@ -274,24 +314,13 @@ int dsllArea(char* angfile,char* ctptfile,char* dmfile,char* shfile,char* qfile,
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 		//Clear out borders
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = ctpt->ringTerm(finished);
+		finished = ctpt->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -318,26 +318,13 @@ int hdisttostreamgrd(char *angfile, char *wfile, char *srcfile, char *dtsfile, i
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dts->ringTerm(finished);
+		finished = dts->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -607,26 +594,13 @@ int vdroptostreamgrd(char *angfile, char *felfile, char *srcfile, char *dtsfile,
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dts->ringTerm(finished);
+		finished = dts->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -942,26 +916,13 @@ int pdisttostreamgrd(char *angfile, char *felfile, char *wfile, char *srcfile, c
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dtsh->ringTerm(finished);
+		finished = dtsh->collectiveTerm(finished);
 	}
 
 	//  Now compute the pythagorus difference
@@ -1274,26 +1235,13 @@ int sdisttostreamgrd(char *angfile, char *felfile, char *wfile,  char *srcfile,
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dts->ringTerm(finished);
+		finished = dts->collectiveTerm(finished);
 	}
 
 	//Stop timer
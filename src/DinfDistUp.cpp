@@ -269,26 +269,13 @@ int hdisttoridgegrd(char *angfile, char *wfile, char *rtrfile, int statmethod,
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dts->ringTerm(finished);
+		finished = dts->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -510,26 +497,13 @@ int vrisetoridgegrd(char *angfile, char *felfile, char *rtrfile, int statmethod,
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dts->ringTerm(finished);
+		finished = dts->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -800,26 +774,13 @@ int pdisttoridgegrd(char *angfile, char *felfile, char *wfile, char *rtrfile,
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dtsh->ringTerm(finished);
+		finished = dtsh->collectiveTerm(finished);
 	}
 
 	//  Now compute the pythagorus difference
@@ -1090,26 +1051,13 @@ int sdisttoridgegrd(char *angfile, char *felfile, char *wfile, char *rtrfile,
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0)
-			{
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = dts->ringTerm(finished);
+		finished = dts->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -117,7 +117,7 @@ int main(int argc,char **argv)
 
 		else 
 		{
-			goto errexit;
+			if(!parseGridOption(argc,argv,i)) goto errexit;  //  Partition and grid file options
 		}
 	}
 	if( argc == 2) {
@@ -138,6 +138,7 @@ int main(int argc,char **argv)
 	   printf("(The <slopefile> is the slope output file.\n");
 	   printf("(The <angfile> is the output D-infinity flow direction file.\n");
        printf("[-sfdr <flowfile>] is the optional user imposed stream flow direction file.\n");
+       printGridOptions();
        printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
        printf("fel    carved or pit filled input elevation file\n");
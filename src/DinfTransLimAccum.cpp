@@ -47,6 +47,7 @@ email:  dtarb@usu.edu
 #include "createpart.h"
 #include "tiffIO.h"
 #include "initneighbor.h"
+#include "threadqueue.h"
 using namespace std;
 
 
@@ -58,13 +59,100 @@ using namespace std;
 //const short d2[9] = { 0,1, 1, 0,-1,-1,-1,0,1};
 // moved to commonlib.h
 
+//  Flow algebra for transport limited accumulation, used by the serial loop and by
+//  drainQueueThreaded.  evaluate(i,j) evaluates cell (i,j) in the partition, once all the
+//  cells that drain to it have been evaluated.
+class transLimCells {
+	public:
+		tdpartition *flowData, *tsupData, *tcData, *cinData, *tla, *dep, *csout;
+		linearpart<float> *flowL;
+		int usec, contcheck;
+		void evaluate(long i, long j);
+		bool drainsTo(long i, long j, short k){return prop(flowL->getDataUnchecked(i,j), k) > 0.;}
+};
+
+void transLimCells::evaluate(long i, long j)
+{
+	long in,jn;
+	short k;
+	bool con;
+	float loadin,loadout,transin,transout,tsupp,tcc,angle,tempFloat;
+	double p;
+
+	if((!tsupData->isNodata(i,j)) && (!tcData->isNodata(i,j))){
+	  if(usec==0 || !cinData->isNodata(i,j)){
+		//  Initialize the result
+		transin=0.;
+		loadin=0. ;
+		con=false;  // not contaminated so far
+		for(k=1; k<=8; k++) {
+			in = i+d1[k];
+			jn = j+d2[k];
+			if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
+				con=true;
+			else{
+				flowData->getData(in,jn, angle);
+				p = prop(angle, (k+4)%8);
+				if(p>0.){
+					if(tla->isNodata(in,jn))con=true;
+					else transin=transin+p*tla->getData(in,jn,tempFloat);
+					if(usec==1)
+					{
+						if(csout->isNodata(in,jn))con=true;
+						else loadin=loadin+p*tempFloat*csout->getData(in,jn,tempFloat);
+					}
+				}
+			}
+		}
+		//  Local inputs
+		tsupData->getData(i,j,tsupp);
+		tcData->getData(i,j,tcc);
+		float depp;
+		if((transin+tsupp) > tcc)
+		{
+			transout=tcc;
+			depp=transin+tsupp-transout;
+		}
+		else
+		{
+			transout=transin+tsupp;
+			depp=0.;
+		}
+		tla->setData(i,j,transout);
+		dep->setData(i,j,depp);
+		if(usec==1)
+		{
+			
+			if(transout < transin) // no erosion from cell
+			{
+				if(transin > 0)loadout=loadin*transout/transin;
+				else loadout=0;
+			}
+			else
+				loadout=loadin+cinData->getData(i,j,tempFloat)*(transout-transin);
+			if(transout > 0.)
+				csout->setData(i,j,(float)(loadout/transout));
+			else
+				csout->setData(i,j,(float)(0.0));
+		}
+		if(con && contcheck == 1)
+		{
+			dep->setToNodata(i,j);
+			tla->setToNodata(i,j);
+			if(usec==1)csout->setToNodata(i,j);
+		}
+	  }
+	}
+}
+
 //Transport limited accumulation funciton
 int tlaccum(char *angfile, char *tsupfile, char *tcfile, char *tlafile, char *depfile, 
 			char *cinfile, char *coutfile, char *shfile, int useOutlets, int usec, 
 			int contcheck)
 {
 
-	MPI_Init(NULL,NULL);{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
 
 	//Only used for timing
 	int rank,size;
@@ -98,7 +186,7 @@ int tlaccum(char *angfile, char *tsupfile, char *tcfile, char *tlafile, char *de
 		}
 	}
 
-	float loadin,loadout,transin,transout,tsupp,tcc,angle;
+	float angle;
 	double p;
 
 	//  Keep track of time
@@ -150,7 +238,7 @@ int tlaccum(char *angfile, char *tsupfile, char *tcfile, char *tlafile, char *de
 	tc.read(xstart, ystart, tcData->getny(), tcData->getnx(), tcData->getGridPointer());
 
 	//if using concentration grid, get information from file	
-	tdpartition *cinData;
+	tdpartition *cinData = NULL;
 	if( usec == 1){		
 		tiffIO cin(cinfile, FLOAT_TYPE);
 		if(!ang.compareTiff(cin)) {
@@ -181,17 +269,15 @@ int tlaccum(char *angfile, char *tsupfile, char *tcfile, char *tlafile, char *de
 	tdpartition *dep;
 	dep = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy,  MISSINGFLOAT);
 	
-	tdpartition *csout;
+	tdpartition *csout = NULL;
 	if(usec==1){			
 			csout = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy,  MISSINGFLOAT);
 	}
 
-	// con is used to check for contamination at the edges
 	long i,j;
 	short k;
 	long in,jn;
-	bool con=false, finished;
-	float tempFloat=0;
+	bool finished;
 	short tempShort=0;
 
 	tdpartition *neighbor;
@@ -208,11 +294,27 @@ int tlaccum(char *angfile, char *tsupfile, char *tcfile, char *tlafile, char *de
 	queue<node> que;
 
 	initNeighborDinfup(neighbor,flowData,&que,nx, ny, useOutlets, outletsX, outletsY, numOutlets);
+
+	transLimCells cells;
+	cells.flowData = flowData;
+	cells.tsupData = tsupData;
+	cells.tcData = tcData;
+	cells.cinData = cinData;
+	cells.tla = tla;
+	cells.dep = dep;
+	cells.csout = csout;
+	cells.flowL = dynamic_cast<linearpart<float>*>(flowData);
+	cells.usec = usec;
+	cells.contcheck = contcheck;
+	linearpart<short> *neighborL = dynamic_cast<linearpart<short>*>(neighbor);
+	int numThreads = getNumThreads();
 	finished = false;
-	FILE *fp;
 	
 	//Ring terminating while loop
 	while(!finished) {
+		//  With threads the queue is evaluated by drainQueueThreaded and the loop below is skipped
+		if(numThreads > 1 && cells.flowL != NULL && neighborL != NULL)
+			drainQueueThreaded(que, neighborL, cells, numThreads);
 		while(!que.empty()) 
 		{
 			//Takes next node with no contributing neighbors
@@ -221,70 +323,8 @@ int tlaccum(char *angfile, char *tsupfile, char *tcfile, char *tlafile, char *de
 			i = temp.x;
 			j = temp.y;
 			//  FLOW ALGEBRA EXPRESSION EVALUATION			
-			if(flowData->isInPartition(i,j)  && (!tsupData->isNodata(i,j)) && (!tcData->isNodata(i,j))){
-			  if(usec==0 || !cinData->isNodata(i,j)){
-				//  Initialize the result
-				transin=0.;
-				loadin=0. ;
-				con=false;  // not contaminated so far
-				for(k=1; k<=8; k++) {
-					in = i+d1[k];
-					jn = j+d2[k];
-					if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
-						con=true;
-					else{
-						flowData->getData(in,jn, angle);
-						p = prop(angle, (k+4)%8);
-						if(p>0.){
-							if(tla->isNodata(in,jn))con=true;
-							else transin=transin+p*tla->getData(in,jn,tempFloat);
-							if(usec==1)
-							{
-								if(csout->isNodata(in,jn))con=true;
-								else loadin=loadin+p*tempFloat*csout->getData(in,jn,tempFloat);
-							}
-						}
-					}
-				}
-				//  Local inputs
-				tsupData->getData(i,j,tsupp);
-				tcData->getData(i,j,tcc);
-				float depp;
-				if((transin+tsupp) > tcc)
-				{
-					transout=tcc;
-					depp=transin+tsupp-transout;
-				}
-				else
-				{
-					transout=transin+tsupp;
-					depp=0.;
-				}
-				tla->setData(i,j,transout);
-				dep->setData(i,j,depp);
-				if(usec==1)
-				{
-					
-					if(transout < transin) // no erosion from cell
-					{
-						if(transin > 0)loadout=loadin*transout/transin;
-						else loadout=0;
-					}
-					else
-						loadout=loadin+cinData->getData(i,j,tempFloat)*(transout-transin);
-					if(transout > 0.)
-						csout->setData(i,j,(float)(loadout/transout));
-					else
-						csout->setData(i,j,(float)(0.0));
-				}
-				if(con && contcheck == 1)
-				{
-					dep->setToNodata(i,j);
-					tla->setToNodata(i,j);
-					if(usec==1)csout->setToNodata(i,j);
-				}
-			  }
-			}
+			if(flowData->isInPartition(i,j))
+				cells.evaluate(i,j);
 			//  END FLOW ALGEBRA EXPRESSION EVALUATION
 			//  Decrement neighbor dependence of downslope cell
 			flowData->getData(i, j, angle);
@@ -310,24 +350,13 @@ int tlaccum(char *angfile, char *tsupfile, char *tcfile, char *tlafile, char *de
 		neighbor->addBorders();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 		// Clear out borders
 		neighbor->clearBorders();
 
 		//Check if done
 		finished = que.empty();
-		finished = tla->ringTerm(finished);
+		finished = tla->collectiveTerm(finished);
 	}
 
 	//Stop timer
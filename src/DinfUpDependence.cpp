@@ -228,7 +228,7 @@ int depgrd(char* angfile, char* dgfile, char* depfile)
 				}
 			}
 		}
-		finished = dep->ringTerm(finished);
+		finished = dep->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -557,7 +557,7 @@ int dropan(char *areafile, char *dirfile, char *elevfile, char *ssafile, char *d
 		
 			//Check if done
 			finished = que.empty();
-			finished = orderOut->ringTerm(finished);
+			finished = orderOut->collectiveTerm(finished);
 		}
 	
 		// *** calculate and write results
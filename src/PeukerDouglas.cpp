@@ -47,64 +47,30 @@ email:  dtarb@usu.edu
 #include "linearpart.h"
 #include "createpart.h"
 #include "tiffIO.h"
+#include "stages.h"
 #include "ctime"
 
 using namespace std;
 
-int peukerdouglas(char *felfile, char *ssfile,float *p)
+//  Flags the upwards curved cells of elev in ss, a byte grid of the same size, with 1 and the other
+//  cells with 0, after smoothing elev with the weights p.  elev holds the smoothed elevations
+//  on return.
+void evaluatePeukerDouglas(tdpartition *elev, tdpartition *ss, float *p)
 {
-	MPI_Init(NULL,NULL);
-	{
-	int rank,size;
-	MPI_Comm_rank(MCW,&rank);
-	MPI_Comm_size(MCW,&size);
-	if(rank==0)printf("PeukerDouglas version %s\n",TDVERSION);
-
-	double begint = MPI_Wtime();
-
-	long x,y;
-	int k,ik,jk,jomax,iomax,bound;
-	float ndve,emax;
-	float* ndveptr;
-								/* Read elevation headers */
-	tiffIO felev(felfile, FLOAT_TYPE);			//input	 elevation	
-	long totalX = felev.getTotalX();			//Globabl x and y
-	long totalY = felev.getTotalY();
-	double dx = felev.getdx();				//cell x and y
-	double dy = felev.getdy();
-	if(rank==0)
-		{
-			float timeestimate=(1e-7*totalX*totalY/pow((double) size,1))/60+1;  // Time estimate in minutes
-			fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
-			fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
-			fflush(stderr);
-		}
-
-
-	ndveptr =  (float*)felev.getNodata();
-	ndve = *ndveptr;
-								//Create partition and read data
-	tdpartition *elev;
-	elev = CreateNewPartition(felev.getDatatype(), totalX, totalY, dx, dy, felev.getNodata());
+	long totalX = elev->gettotalx();
+	long totalY = elev->gettotaly();
+	double dx = elev->getdx();
+	double dy = elev->getdy();
 	int elevnx = elev->getnx();
 	int elevny = elev->getny();
-	int globalxstart, globalystart; 			
-	elev->localToGlobal(0, 0, globalxstart, globalystart);  
-
-	felev.read((long)globalxstart, (long)globalystart, (long)elevny, (long)elevnx, elev->getGridPointer());
+	long x,y;
+	int k,ik,jk,jomax,iomax,bound,gx,gy;
+	float emax;
 
-	//Record time reading files
-	double readt = MPI_Wtime();
-								
 //Create empty partition to store new information
 	tdpartition *selev;
-	selev = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, felev.getNodata());//selev is to smooth the elevation
+	selev = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, MISSINGFLOAT);//selev is to smooth the elevation
 
-//Create empty partition to store new information
-	tdpartition *ss;
-	short ssnodata =-2;
-	ss = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, ssnodata);//-2 nodata value
-	
 // SHARE elev to populate the borders
 	elev->share();
 							
@@ -113,24 +79,24 @@ int peukerdouglas(char *felfile, char *ssfile,float *p)
 	for(y=0; y<elevny; y++){
 		for(x=0; x <elevnx; x++)
 		{
-								//  NEED function in linearpart to evaluate whether is on edge. 
-								//  Suggestion **->isOnEdge(x,y) to return true if on edge of global domain or adjacent to a no data value, otherwise to return false.
-								//  FIX code below to if on a global edge or adjacent to a no-data value do first "if block"
+								//  Cells on the edge of the global domain, found from global coordinates so
+								//  that block partitions work, and cells with no data are not smoothed
+		  elev->localToGlobal((int)x, (int)y, gx, gy);
 
-		  if(rank == 0 && y == 0 || rank == (size-1) && y == (elevny-1) )
+		  if(gy == 0 || gy == (totalY-1) )
 		  {
 			  selev->setData(x,y,elev->getData(x, y,floatTemp1 ));
-			  ss->setData(x,y,(short)0);
+			  ss->setData(x,y,(uint8_t)0);
 		  }
-		  else if(x == 0 || x == (elevnx-1) ||  elev->isNodata(x,y))
+		  else if(gx == 0 || gx == (totalX-1) ||  elev->isNodata(x,y))
 		  {
 			  selev->setData(x,y,elev->getData(x, y,floatTemp1 ));
-			  ss->setData(x,y,(short)0);
+			  ss->setData(x,y,(uint8_t)0);
 		  }
 		  else
-		  {  						//  THIS is for all the remainder of cells
+		  {  						//  THIS is for all the remainder of cells
 
-			ss->setData((long)x, (long)y, (short)1);  								// Initializing to 1 for all non edge grid cells
+			ss->setData((long)x, (long)y, (uint8_t)1);  								// Initializing to 1 for all non edge grid cells
 							
 			float elevwsum = p[0] * elev->getData(x, y, floatTemp1 );
 			float wsum=p[0];
@@ -156,9 +122,9 @@ int peukerdouglas(char *felfile, char *ssfile,float *p)
 			selev->setData(x,y,elevwsum);
 		   }
 	 	 }
-	}			
-	
-	//-- Put smoothed elevations back in elevation grid--
+	}			
+	
+	//-- Put smoothed elevations back in elevation grid--
 	  for(y=0; y < elevny; y++)
 	  {
 		 for(x=0; x < elevnx; x++)
@@ -169,15 +135,18 @@ int peukerdouglas(char *felfile, char *ssfile,float *p)
 	elev->share();							
 	
 	//--Calculate Streams--
+	//  Groups of four that straddle a partition edge are evaluated on both sides of the edge
+	int xfirst = elev->hasAccess(-1,0) ? -1 : 0;
+	int xlast = elev->hasAccess(elevnx,0) ? elevnx-1 : elevnx-2;
   	  for(y=-1; y < elevny; y++){
-		  for(x=0; x < elevnx-1; x++)
+		  for(x=xfirst; x <= xlast; x++)
 		  {
 			  emax =elev->getData(x,y,floatTemp1); 
 			  iomax=0;
 			  jomax=0;   
-			  bound=0;  					/*  .false.  */
+			  bound=0;  					/*  .false.  */
 			
-									/*  --FIRST PASS FLAG MAX ELEVATION IN GROUP OF FOUR  */
+									/*  --FIRST PASS FLAG MAX ELEVATION IN GROUP OF FOUR  */
 			  for(ik=0; ik<2; ik++)
 				  for(jk=1-ik; jk < 2; jk++)
 				  {
@@ -190,35 +159,84 @@ int peukerdouglas(char *felfile, char *ssfile,float *p)
 						  jomax=jk;
 					  }
 				  }
-				 			/*  c---Unflag max pixel */
-			 ss->setData(x+jomax,y+iomax,(short)0);
-				/*  c---Unflag pixels where the group of 4 touches a boundary  */
+				 			/*  c---Unflag max pixel */
+			 ss->setData(x+jomax,y+iomax,(uint8_t)0);
+				/*  c---Unflag pixels where the group of 4 touches a boundary  */
 			  if(bound == 1)
 			  {
 				for(ik=0; ik < 2; ik++)
 				  for(jk=0; jk< 2; jk++)
 				  {
-				 	ss->setData(x+jk,y+ik,(short)0);
+				 	ss->setData(x+jk,y+ik,(uint8_t)0);
 				  }
 			  }else{
-										/*  i.e. unflag flats.  */
+										/*  i.e. unflag flats.  */
 				for(ik=0; ik < 2; ik++)
 				  for(jk=0; jk< 2; jk++)
 				  {
 					 if(elev->getData(x+jk,y+ik,floatTemp1) == emax)
 					 {
-						ss->setData(x+jk,y+ik,(short)0);
+						ss->setData(x+jk,y+ik,(uint8_t)0);
 					 }
 				  }
 			  }
 			
 		  }
 	}															
+	delete selev;
+}
+
+int peukerdouglas(char *felfile, char *ssfile,float *p)
+{
+	MPI_Init(NULL,NULL);
+	{
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+	if(rank==0)printf("PeukerDouglas version %s\n",TDVERSION);
+
+	double begint = MPI_Wtime();
+
+								/* Read elevation headers */
+	tiffIO felev(felfile, FLOAT_TYPE);			//input	 elevation	
+	long totalX = felev.getTotalX();			//Globabl x and y
+	long totalY = felev.getTotalY();
+	double dx = felev.getdx();				//cell x and y
+	double dy = felev.getdy();
+	if(rank==0)
+		{
+			float timeestimate=(1e-7*totalX*totalY/pow((double) size,1))/60+1;  // Time estimate in minutes
+			fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
+			fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
+			fflush(stderr);
+		}
+
+
+								//Create partition and read data
+	tdpartition *elev;
+	elev = CreateNewPartition(felev.getDatatype(), totalX, totalY, dx, dy, felev.getNodata());
+	int elevnx = elev->getnx();
+	int elevny = elev->getny();
+	int globalxstart, globalystart; 			
+	elev->localToGlobal(0, 0, globalxstart, globalystart);  
+
+	felev.read((long)globalxstart, (long)globalystart, (long)elevny, (long)elevnx, elev->getGridPointer());
+
+	//Record time reading files
+	double readt = MPI_Wtime();
+								
+//Create empty partition to store new information
+	tdpartition *ss;
+	uint8_t ssnodata = 255;
+	ss = CreateNewPartition(BIT_TYPE, totalX, totalY, dx, dy, ssnodata);//cells are 0 or 1 so the grid is bit packed
+	
+	evaluatePeukerDouglas(elev, ss, p);
+
 	//Stop timer
 	double computet = MPI_Wtime();
-	tiffIO outelev(ssfile,SHORT_TYPE,&ssnodata, felev);
+	tiffIO outelev(ssfile,BYTE_TYPE,&ssnodata, felev);
 	
-	outelev.write((long)globalxstart, (long)globalystart, (long)elevny, (long)elevnx, ss->getGridPointer());
+	outelev.write((long)globalxstart, (long)globalystart, (long)elevny, (long)elevnx, ss);
 	double writet = MPI_Wtime();
 	double dataRead, compute, write, total,temp;
         dataRead = readt-begint;
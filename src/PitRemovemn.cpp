@@ -54,6 +54,7 @@ int main(int argc,char **argv)
    bool is_4p = false; // four-point flow method versus eight-point, arb 5/31/11
    char maskfile[MAXLN]; // mask out actual depressions, arb 5/31/11
    bool use_mask = false; // flag to specify the optional mask file, arb 5/31/11
+   bool usePriorityFlood = false; // fill with priority-flood rather than Planchon-Darboux
    
    if(argc < 2)
     {  
@@ -125,9 +126,14 @@ int main(int argc,char **argv)
 			}
 			else goto errexit;
 		}
+		else if(strcmp(argv[i],"-pf")==0)  //  Fill depressions with priority-flood
+		{
+			i++;
+			usePriorityFlood=true;
+		}
 		else 
 		{
-			goto errexit;
+			if(!parseGridOption(argc,argv,i)) goto errexit;  //  Partition and grid file options
 		}
 	}
 	if( argc == 2) {
@@ -145,7 +151,7 @@ int main(int argc,char **argv)
 	}
 	useflowfile=0;  //  useflowfile not implemented
 
-	if((err=flood(demfile,newfile,flowfile,useflowfile,verbose,is_4p,use_mask,maskfile)) != 0)
+	if((err=flood(demfile,newfile,flowfile,useflowfile,verbose,is_4p,use_mask,maskfile,usePriorityFlood)) != 0)
         printf("PitRemove error %d\n",err);
 
 	return 0;
@@ -158,6 +164,9 @@ int main(int argc,char **argv)
 	   printf("<demfile> is the name of the input elevation grid file.\n");
 	   printf("<newfile> is the output elevation grid with pits filled.\n");
 	   printf("<flowfile> is the input grid of flow directions to be imposed.\n");
+	   printf("The flag -pf fills depressions with priority-flood, which gives the same result\n");
+	   printf("in fewer passes than the default Planchon-Darboux iterations on large flat areas.\n");
+	   printGridOptions();
 	   printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
        printf("fel    output elevation grid with pits filled.\n\n");
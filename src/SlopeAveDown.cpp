@@ -225,24 +225,13 @@ int sloped(char *pfile,char* felfile,char* slpdfile, double dn)
 			ed->share();
 			dd->share();
 			//If this created a cell with no contributing neighbors, put it on the queue
-			for(i=0; i<nx; i++){
-				if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-					temp.x = i;
-					temp.y = 0;
-					que.push(temp);
-				}
-				if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-					temp.x = i;
-					temp.y = ny-1;
-					que.push(temp); 
-				}
-			}
+			queueBorderCells(neighbor, &que);
 			//Clear out borders
 			neighbor->clearBorders();
 	
 			//Check if done
 			finished = que.empty();
-			finished = sd->ringTerm(finished);
+			finished = sd->collectiveTerm(finished);
 		}
 		//  This ends the internal loop for one iteration.  
 	}
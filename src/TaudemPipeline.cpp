@@ -0,0 +1,332 @@
+/*  Taudem pipeline
+
+  Runs the stages of PitRemove, D8FlowDir, DinfFlowDir, AreaD8, AreaDinf, GridNet, PeukerDouglas
+  and Threshold inside one MPI_Init, keeping the grids in memory between the stages.  A stage
+  only runs if a grid asked for depends on it, and each grid is deleted once the stages that
+  read it are done.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#include <mpi.h>
+#include <math.h>
+#include <string.h>
+#include "commonLib.h"
+#include "linearpart.h"
+#include "createpart.h"
+#include "tiffIO.h"
+#include "stages.h"
+#include "TaudemPipeline.h"
+using namespace std;
+
+//  Returns a float copy of grid, which holds cells of datatype, with its borders shared
+static tdpartition *floatCopy(tdpartition *grid, DATA_TYPE datatype, float nodata)
+{
+	tdpartition *copy = CreateNewPartition(FLOAT_TYPE, grid->gettotalx(), grid->gettotaly(),
+		grid->getdx(), grid->getdy(), nodata);
+	int nx = grid->getnx();
+	int ny = grid->getny();
+	float tempFloat;
+	double tempDouble;
+	long long tempInt64;
+	uint8_t tempByte;
+	for(long j=0; j<ny; j++)
+		for(long i=0; i<nx; i++) {
+			if(grid->isNodata(i,j)) copy->setToNodata(i,j);
+			else if(datatype == DOUBLE_TYPE) copy->setData(i,j,(float)grid->getData(i,j,tempDouble));
+			else if(datatype == INT64_TYPE) copy->setData(i,j,(float)grid->getData(i,j,tempInt64));
+			else if(datatype == BYTE_TYPE || datatype == BIT_TYPE) copy->setData(i,j,(float)grid->getData(i,j,tempByte));
+			else copy->setData(i,j,grid->getData(i,j,tempFloat));
+		}
+	copy->share();
+	return copy;
+}
+
+//  Writes grid to file, with the header of dem
+static void writeGrid(char *file, DATA_TYPE datatype, void *nodata, tiffIO &dem, tdpartition *grid)
+{
+	int xstart, ystart;
+	grid->localToGlobal(0, 0, xstart, ystart);
+	tiffIO out(file, datatype, nodata, dem);
+	out.write(xstart, ystart, grid->getny(), grid->getnx(), grid);
+}
+
+static void stageMessage(int rank, const char *stage)
+{
+	if(rank==0)
+	{
+		printf("Running %s\n",stage);
+		fflush(stdout);
+	}
+}
+
+int taudempipeline(char *demfile, char outfiles[][MAXLN], char *shfile, int useOutlets, float thresh,
+	float *p, int contcheck, bool usePriorityFlood)
+{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
+
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+	if(rank==0)printf("TauDEM pipeline version %s\n",TDVERSION);
+
+	double begint = MPI_Wtime();
+
+	//  Work back from the grids asked for to the stages that are needed
+	bool write[NUM_PIPELINE_GRIDS];
+	for(int g=0; g<NUM_PIPELINE_GRIDS; g++) write[g] = (outfiles[g][0] != '\0');
+	bool needSrc = write[SRC_GRID];
+	bool needSsa = write[SSA_GRID] || needSrc;
+	bool needSs = write[SS_GRID] || needSsa;
+	bool needGridnet = write[PLEN_GRID] || write[TLEN_GRID] || write[GORD_GRID];
+	bool needAd8 = write[AD8_GRID];
+	bool needSca = write[SCA_GRID];
+	bool needDinf = write[ANG_GRID] || write[SLP_GRID] || needSca;
+	bool needD8 = write[P_GRID] || write[SD8_GRID] || needAd8 || needGridnet || needSsa;
+
+	double *x, *y;
+	int numOutlets=0;
+	if( useOutlets == 1 && needSsa) {
+		if(rank==0){
+			if(readoutlets(shfile, &numOutlets, x, y)==0){
+				MPI_Bcast(&numOutlets, 1, MPI_INT, 0, MCW);
+				MPI_Bcast(x, numOutlets, MPI_DOUBLE, 0, MCW);
+				MPI_Bcast(y, numOutlets, MPI_DOUBLE, 0, MCW);
+			}
+			else {
+				printf("Error opening shapefile. Exiting \n");
+				MPI_Abort(MCW,5);
+			}
+		}
+		else {
+			MPI_Bcast(&numOutlets, 1, MPI_INT, 0, MCW);
+			x = new double[numOutlets];
+			y = new double[numOutlets];
+			MPI_Bcast(x, numOutlets, MPI_DOUBLE, 0, MCW);
+			MPI_Bcast(y, numOutlets, MPI_DOUBLE, 0, MCW);
+		}
+	}
+
+	//Create tiff object, read and store header info
+	tiffIO dem(demfile, FLOAT_TYPE);
+	long totalX = dem.getTotalX();
+	long totalY = dem.getTotalY();
+	double dx = dem.getdx();
+	double dy = dem.getdy();
+
+	//Convert geo coords to grid coords
+	int *outletsX=NULL, *outletsY=NULL;
+	if( useOutlets == 1 && needSsa) {
+		outletsX = new int[numOutlets];
+		outletsY = new int[numOutlets];
+		for( int i=0; i<numOutlets; i++)
+			dem.geoToGlobalXY(x[i], y[i], outletsX[i], outletsY[i]);
+	}
+
+	//Create partition and read data
+	tdpartition *elevDEM;
+	elevDEM = CreateInputPartition(dem);
+	int xstart, ystart;
+	int nx = elevDEM->getnx();
+	int ny = elevDEM->getny();
+	elevDEM->localToGlobal(0, 0, xstart, ystart);
+	dem.read(xstart, ystart, ny, nx, elevDEM);
+
+	double readt = MPI_Wtime();
+
+	//  Nodata values of the grids written
+	float felNodata = -3.0e38;
+	uint8_t byteNodata = 255;
+	float slopeNodata = -1.0f;
+	float angNodata = MISSINGFLOAT;
+	float areaNodata = -1.0f;
+	double areaNodataDouble = -1.;
+	long long areaNodataInt64 = -1;
+	short gordNodata = -1;
+
+	//  PitRemove
+	stageMessage(rank, "PitRemove");
+	tdpartition *fel;
+	fel = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, felNodata);
+	fillPits(elevDEM, NULL, fel, 1, false, usePriorityFlood);
+	delete elevDEM;
+	if(write[FEL_GRID]) writeGrid(outfiles[FEL_GRID], FLOAT_TYPE, &felNodata, dem, fel);
+
+	//  D8FlowDir and DinfFlowDir.  The slopes of both are evaluated before the flats of both are
+	//  resolved, so that the searches across the flats they have in common are done once.
+	tdpartition *flowDir = NULL;
+	long numFlatD8 = 0;
+	if(needD8) {
+		stageMessage(rank, "D8FlowDir");
+		flowDir = CreateNewPartition(BYTE_TYPE, totalX, totalY, dx, dy, byteNodata);
+		tdpartition *slope;
+		slope = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, slopeNodata);
+		numFlatD8 = setD8Slopes(fel, flowDir, slope, 0);
+		if(write[SD8_GRID]) writeGrid(outfiles[SD8_GRID], FLOAT_TYPE, &slopeNodata, dem, slope);
+		delete slope;
+	}
+	tdpartition *ang = NULL;
+	long numFlatDinf = 0;
+	if(needDinf) {
+		stageMessage(rank, "DinfFlowDir");
+		ang = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, angNodata);
+		tdpartition *slope;
+		slope = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, slopeNodata);
+		numFlatDinf = setPosDirDinf(fel, ang, slope, 0);
+		if(write[SLP_GRID]) writeGrid(outfiles[SLP_GRID], FLOAT_TYPE, &slopeNodata, dem, slope);
+		delete slope;
+	}
+	if(needD8 && needDinf)
+		resolveFlowFlats(fel, flowDir, numFlatD8, ang, numFlatDinf);
+	else if(needD8)
+		resolveD8Flats(fel, flowDir, numFlatD8);
+	else if(needDinf)
+		resolveDinfFlats(fel, ang, numFlatDinf);
+	if(needD8 && write[P_GRID]) writeGrid(outfiles[P_GRID], BYTE_TYPE, &byteNodata, dem, flowDir);
+	if(needDinf && write[ANG_GRID]) writeGrid(outfiles[ANG_GRID], FLOAT_TYPE, &angNodata, dem, ang);
+
+	//  PeukerDouglas
+	tdpartition *ss = NULL;
+	if(needSs) {
+		stageMessage(rank, "PeukerDouglas");
+		ss = CreateNewPartition(BIT_TYPE, totalX, totalY, dx, dy, byteNodata);
+		//  The elevations are smoothed in place, after the last stage that reads them
+		evaluatePeukerDouglas(fel, ss, p);
+		if(write[SS_GRID]) writeGrid(outfiles[SS_GRID], BYTE_TYPE, &byteNodata, dem, ss);
+	}
+	delete fel;
+
+	//  AreaDinf
+	if(needSca) {
+		stageMessage(rank, "AreaDinf");
+		DATA_TYPE areaDatatype = getWideAccumulation() ? DOUBLE_TYPE : FLOAT_TYPE;
+		tdpartition *sca;
+		sca = CreateNewPartition(areaDatatype, totalX, totalY, dx, dy, areaNodata);
+		evaluateAreaDinf(ang, NULL, sca, areaDatatype, 0, NULL, NULL, 0, 0, contcheck);
+		writeGrid(outfiles[SCA_GRID], areaDatatype, (areaDatatype == DOUBLE_TYPE) ? (void*)&areaNodataDouble : (void*)&areaNodata, dem, sca);
+		delete sca;
+	}
+	if(ang != NULL) delete ang;
+
+	//  AreaD8, GridNet and AreaD8 weighted by ss, in one sweep over the D8 directions.  The
+	//  weighted areas have a sweep of their own when they are only evaluated upslope of outlets.
+	DATA_TYPE ad8Datatype = getWideAccumulation() ? INT64_TYPE : FLOAT_TYPE;
+	DATA_TYPE ssaDatatype = getWideAccumulation() ? DOUBLE_TYPE : FLOAT_TYPE;
+	bool sweepSsa = needSsa && useOutlets != 1;
+	tdpartition *ad8 = NULL;
+	if(needAd8)
+		ad8 = CreateNewPartition(ad8Datatype, totalX, totalY, dx, dy, areaNodata);
+	tdpartition *plen = NULL, *tlen = NULL, *gord = NULL;
+	if(needGridnet) {
+		plen = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, areaNodata);
+		tlen = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, areaNodata);
+		gord = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, gordNodata);
+	}
+	tdpartition *ssa = NULL, *weightData = NULL;
+	if(needSsa) {
+		//  Weights are read as floats, as AreaD8 reads a weight file
+		weightData = floatCopy(ss, BIT_TYPE, (float)byteNodata);
+		ssa = CreateNewPartition(ssaDatatype, totalX, totalY, dx, dy, areaNodata);
+	}
+	if(needAd8 || needGridnet || sweepSsa) {
+		char stages[MAXLN] = "";
+		if(needAd8) strcat(stages, "AreaD8");
+		if(needGridnet) strcat(stages, (stages[0] != '\0') ? ", GridNet" : "GridNet");
+		if(sweepSsa) strcat(stages, (stages[0] != '\0') ? ", AreaD8 weighted by ss" : "AreaD8 weighted by ss");
+		stageMessage(rank, stages);
+		evaluateD8Accumulations(flowDir, ad8, ad8Datatype, weightData, sweepSsa ? ssa : NULL, ssaDatatype,
+			plen, tlen, gord, contcheck);
+	}
+	if(needSsa && !sweepSsa) {
+		stageMessage(rank, "AreaD8 weighted by ss");
+		evaluateAreaD8(flowDir, weightData, ssa, ssaDatatype, useOutlets, outletsX, outletsY, numOutlets, 1, contcheck);
+	}
+	if(needAd8) {
+		writeGrid(outfiles[AD8_GRID], ad8Datatype, (ad8Datatype == INT64_TYPE) ? (void*)&areaNodataInt64 : (void*)&areaNodata, dem, ad8);
+		delete ad8;
+	}
+	if(needGridnet) {
+		if(write[GORD_GRID]) writeGrid(outfiles[GORD_GRID], SHORT_TYPE, &gordNodata, dem, gord);
+		if(write[PLEN_GRID]) writeGrid(outfiles[PLEN_GRID], FLOAT_TYPE, &areaNodata, dem, plen);
+		if(write[TLEN_GRID]) writeGrid(outfiles[TLEN_GRID], FLOAT_TYPE, &areaNodata, dem, tlen);
+		delete plen;
+		delete tlen;
+		delete gord;
+	}
+	if(needSsa) {
+		delete weightData;
+		if(write[SSA_GRID]) writeGrid(outfiles[SSA_GRID], ssaDatatype, (ssaDatatype == DOUBLE_TYPE) ? (void*)&areaNodataDouble : (void*)&areaNodata, dem, ssa);
+	}
+	if(ss != NULL) delete ss;
+	if(flowDir != NULL) delete flowDir;
+
+	//  Threshold
+	if(needSrc) {
+		stageMessage(rank, "Threshold");
+		//  Threshold reads ssa as floats
+		if(ssaDatatype != FLOAT_TYPE) {
+			tdpartition *ssaFloat = floatCopy(ssa, ssaDatatype, areaNodata);
+			delete ssa;
+			ssa = ssaFloat;
+		}
+		tdpartition *src;
+		src = CreateNewPartition(BIT_TYPE, totalX, totalY, dx, dy, byteNodata);
+		evaluateThreshold(ssa, NULL, src, thresh);
+		writeGrid(outfiles[SRC_GRID], BYTE_TYPE, &byteNodata, dem, src);
+		delete src;
+	}
+	if(ssa != NULL) delete ssa;
+
+	double writet = MPI_Wtime();
+	double dataRead, compute, total, tempd;
+	dataRead = readt-begint;
+	compute = writet-readt;
+	total = writet-begint;
+
+	MPI_Allreduce (&dataRead, &tempd, 1, MPI_DOUBLE, MPI_SUM, MCW);
+	dataRead = tempd/size;
+	MPI_Allreduce (&compute, &tempd, 1, MPI_DOUBLE, MPI_SUM, MCW);
+	compute = tempd/size;
+	MPI_Allreduce (&total, &tempd, 1, MPI_DOUBLE, MPI_SUM, MCW);
+	total = tempd/size;
+
+	if( rank == 0)
+		printf("Processors: %d\nRead time: %f\nCompute and write time: %f\nTotal time: %f\n", size, dataRead, compute, total);
+
+	//Brackets force MPI-dependent objects to go out of scope before Finalize is called
+	}MPI_Finalize();
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*  Taudem pipeline
+
+  Runs the delineation tools from pit removal to stream sources in one process, passing the
+  grids between the stages in memory and writing only the grids that are asked for.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#ifndef TAUDEMPIPELINE_H
+#define TAUDEMPIPELINE_H
+
+#include "commonLib.h"
+
+//  The grids the pipeline can write, in the order of the stages that evaluate them
+enum PIPELINE_GRID {
+	FEL_GRID,   // pit filled elevations (PitRemove)
+	P_GRID,     // D8 flow directions (D8FlowDir)
+	SD8_GRID,   // D8 slopes (D8FlowDir)
+	ANG_GRID,   // Dinf flow angles (DinfFlowDir)
+	SLP_GRID,   // Dinf slopes (DinfFlowDir)
+	AD8_GRID,   // D8 contributing areas (AreaD8)
+	SCA_GRID,   // Dinf specific catchment areas (AreaDinf)
+	PLEN_GRID,  // longest upslope lengths (GridNet)
+	TLEN_GRID,  // total upslope lengths (GridNet)
+	GORD_GRID,  // Strahler orders (GridNet)
+	SS_GRID,    // upwards curved cells (PeukerDouglas)
+	SSA_GRID,   // upwards curved cells upslope, weighted by ss (AreaD8)
+	SRC_GRID,   // stream sources, where ssa is at least the threshold (Threshold)
+	NUM_PIPELINE_GRIDS
+};
+
+//  The option that names the file of each grid, without the "-"
+const char * const pipelineGridNames[NUM_PIPELINE_GRIDS] = {
+	"fel", "p", "sd8", "ang", "slp", "ad8", "sca", "plen", "tlen", "gord", "ss", "ssa", "src"};
+
+//  Evaluates the grids with a file name in outfiles from the elevations in demfile.  outfiles
+//  that are empty strings are not written, and only the stages needed for the others are run.
+//  shfile holds the outlets used for ssa if useOutlets is 1, thresh is the threshold for src,
+//  p the PeukerDouglas smoothing weights and contcheck 1 to check for edge contamination.
+int taudempipeline(char *demfile, char outfiles[][MAXLN], char *shfile, int useOutlets, float thresh,
+	float *p, int contcheck, bool usePriorityFlood);
+
+#endif
@@ -0,0 +1,206 @@
+/*  Taudem pipeline main program
+
+  Runs the delineation stages from a digital elevation model to stream sources in one process.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "commonLib.h"
+#include "TaudemPipeline.h"
+
+int main(int argc,char **argv)
+{
+   char demfile[MAXLN],shfile[MAXLN];
+   char outfiles[NUM_PIPELINE_GRIDS][MAXLN];
+   int err,useOutlets=0,contcheck=1,i,g;
+   bool anyOutput=false;
+   bool usePriorityFlood=false;
+   float thresh=100.0;
+   float p[3];
+   p[0]=0.4;  p[1]=0.1;  p[2]=0.05;
+   demfile[0]='\0';
+   for(g=0; g<NUM_PIPELINE_GRIDS; g++) outfiles[g][0]='\0';
+
+   if(argc < 2)
+    {
+       printf("Error: To run this program, use either the Simple Usage option or\n");
+	   printf("the Usage with Specific file names option\n");
+	   goto errexit;
+    }
+
+	if(argc > 2)
+	{
+		i = 1;
+	}
+	else {
+		i = 2;
+	}
+	while(argc > i)
+	{
+		if(strcmp(argv[i],"-z")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(demfile,argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-o")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(shfile,argv[i]);
+				useOutlets=1;
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-thresh")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				sscanf(argv[i],"%f",&thresh);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-par")==0)
+		{
+			i++;
+			if(argc > i+2)
+			{
+				sscanf(argv[i],"%f",&p[0]);
+				i++;
+				sscanf(argv[i],"%f",&p[1]);
+				i++;
+				sscanf(argv[i],"%f",&p[2]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-nc")==0)
+		{
+			i++;
+			contcheck=0;
+		}
+		else if(strcmp(argv[i],"-pf")==0)  //  Fill depressions with priority-flood
+		{
+			i++;
+			usePriorityFlood=true;
+		}
+		else if(strcmp(argv[i],"-acc64")==0)  //  Accumulate in 64 bit grids
+		{
+			i++;
+			setWideAccumulation(true);
+		}
+		else
+		{
+			//  An output grid, named by its option
+			for(g=0; g<NUM_PIPELINE_GRIDS; g++)
+				if(argv[i][0]=='-' && strcmp(argv[i]+1,pipelineGridNames[g])==0) break;
+			if(g == NUM_PIPELINE_GRIDS)
+			{
+				//  Partition and grid file options
+				if(!parseGridOption(argc,argv,i)) goto errexit;
+				continue;
+			}
+			i++;
+			if(argc > i)
+			{
+				strcpy(outfiles[g],argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+	}
+	if(useOutlets == 1 && getPartitionType() == BLOCK_PARTITION) {
+		printf("Outlets (-o) are not supported with block partitions.  Run without the -block option.\n");
+		goto errexit;
+	}
+	if( argc == 2) {
+		strcpy(demfile,argv[1]);
+		for(g=0; g<NUM_PIPELINE_GRIDS; g++)
+			nameadd(outfiles[g],argv[1],(char*)pipelineGridNames[g]);
+	}
+	for(g=0; g<NUM_PIPELINE_GRIDS; g++)
+		if(outfiles[g][0] != '\0') anyOutput=true;
+	if(demfile[0] == '\0' || !anyOutput) goto errexit;
+
+	if((err=taudempipeline(demfile,outfiles,shfile,useOutlets,thresh,p,contcheck,usePriorityFlood)) != 0)
+        printf("TauDEM pipeline error %d\n",err);
+
+	return 0;
+
+	errexit:
+	   printf("Simple Usage:\n %s <basefilename>\n",argv[0]);
+	   printf("Usage with specific file names:\n %s -z <demfile>\n",argv[0]);
+       printf("[-fel <felfile>] [-p <pfile>] [-sd8 <sd8file>] [-ang <angfile>] [-slp <slpfile>]\n");
+       printf("[-ad8 <ad8file>] [-sca <scafile>] [-plen <plenfile>] [-tlen <tlenfile>] [-gord <gordfile>]\n");
+       printf("[-ss <ssfile>] [-ssa <ssafile>] [-src <srcfile>] [-o <shfile>] [-thresh <threshold>]\n");
+       printf("[-par <weightMiddle> <weightSide> <weightDiagonal>]\n");
+	   printf("<basefilename> is the name of the raw digital elevation model.\n");
+	   printf("<demfile> is the name of the input elevation grid file.\n");
+	   printf("Each output grid is that of the tool of the same option, and at least one is needed.\n");
+	   printf("Only the stages that the output grids depend on are run, and the grids between them\n");
+	   printf("are kept in memory rather than written.\n");
+	   printf("<felfile> is the output elevation grid with pits filled (PitRemove).\n");
+	   printf("<pfile> and <sd8file> are the D8 flow directions and slopes (D8FlowDir).\n");
+	   printf("<angfile> and <slpfile> are the Dinf flow angles and slopes (DinfFlowDir).\n");
+	   printf("<ad8file> is the D8 contributing area (AreaD8).\n");
+	   printf("<scafile> is the Dinf specific catchment area (AreaDinf).\n");
+	   printf("<plenfile>, <tlenfile> and <gordfile> are the longest and total upslope lengths\n");
+	   printf("and the Strahler order (GridNet).\n");
+	   printf("<ssfile> is the grid of upwards curved cells (PeukerDouglas).\n");
+	   printf("<ssafile> is the D8 contributing area weighted by ss (AreaD8 -wg).\n");
+	   printf("<srcfile> is the grid of stream sources where ssa is at least threshold (Threshold).\n");
+	   printf("[-o <shfile>] is the optional outlet shape input file for ssa.\n");
+	   printf("The default threshold is 100 and the default weights are 0.4 0.1 0.05.\n");
+	   printf("The flag -nc overrides edge contamination checking in ad8, sca and ssa.\n");
+	   printf("The flag -pf fills depressions with priority-flood.\n");
+	   printGridOptions();
+	   printf("The flag -acc64 holds and writes areas as 64 bit grids, Int64 cell counts, or Float64\n");
+	   printf("for sca and ssa, in place of float, which counts cells exactly only up to 16777216.\n");
+	   printf("With the Simple Usage option every grid is written, with the following\n");
+	   printf("appended to the file names before the files are opened:\n");
+	   printf("fel, p, sd8, ang, slp, ad8, sca, plen, tlen, gord, ss, ssa and src.\n");
+       exit(0);
+}
@@ -44,8 +44,55 @@ email:  dtarb@usu.edu
 #include "linearpart.h"
 #include "createpart.h"
 #include "tiffIO.h"
+#include "stages.h"
 using namespace std;
 
+//  Sets src to 1 where ssaData is at least thresh, and maskData, if not NULL, is at least 0,
+//  and to 0 elsewhere.  src is a byte grid of the same size.
+void evaluateThreshold(tdpartition *ssaData, tdpartition *maskData, tdpartition *src, float thresh)
+{
+	int nx = ssaData->getnx();
+	int ny = ssaData->getny();
+	long i,j;
+	float tempssa=0;
+	float tempmask=0;
+	uint8_t tempsrc=0;
+	
+	//Share information and set borders to zero
+	ssaData->share();
+	if(maskData != NULL) maskData->share();
+	src->clearBorders();
+
+// Compute sa		
+	for(j=0; j<ny; j++) {
+			for(i=0; i<nx; i++ ) {
+				
+				if(maskData != NULL){					
+					if(ssaData->isNodata(i,j)) src->setToNodata(i,j);
+					else{
+						maskData->getData(i,j,tempmask);
+						ssaData->getData(i,j,tempssa);
+						tempsrc=((tempssa >= thresh) & (tempmask >= 0))?1:0;
+						src->setData(i,j,tempsrc);
+					}				
+				}
+				else{
+					if(ssaData->isNodata(i,j)) src->setToNodata(i,j);
+					else{
+						ssaData->getData(i,j,tempssa);
+						tempsrc=(tempssa >= thresh)?1:0;
+						src->setData(i,j,tempsrc);
+					}
+				}				
+			}
+	}
+		//Pass information
+		src->addBorders();		
+
+		//Clear out borders
+		src->clearBorders();
+}
+
 int threshold(char *ssafile,char *srcfile,char *maskfile, float thresh, int usemask)
 {
 	MPI_Init(NULL,NULL);{
@@ -82,7 +129,7 @@ int threshold(char *ssafile,char *srcfile,char *maskfile, float thresh, int usem
 	ssa.read(xstart, ystart, ny, nx, ssaData->getGridPointer());
 
 	//Mask 
-	tdpartition *maskData;
+	tdpartition *maskData = NULL;
 	if( usemask == 1){
 		tiffIO mask(maskfile, FLOAT_TYPE);
 		if(!ssa.compareTiff(mask)) return 1;  //And maybe an unhappy error message
@@ -95,46 +142,11 @@ int threshold(char *ssafile,char *srcfile,char *maskfile, float thresh, int usem
 
 	//Create empty partition to store new information
 	tdpartition *src;
-	src = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, -32768);
-
-	long i,j;
-	float tempssa=0;
-	float tempmask=0;
-	short tempsrc=0;
-	
-	//Share information and set borders to zero
-	ssaData->share();
-	if(usemask == 1) maskData->share();
-	src->clearBorders();
-
-// Compute sa		
-	for(j=0; j<ny; j++) {
-			for(i=0; i<nx; i++ ) {
-				
-				if(usemask == 1){					
-					if(ssaData->isNodata(i,j)) src->setToNodata(i,j);
-					else{
-						maskData->getData(i,j,tempmask);
-						ssaData->getData(i,j,tempssa);
-						tempsrc=((tempssa >= thresh) & (tempmask >= 0))?1:0;
-						src->setData(i,j,tempsrc);
-					}				
-				}
-				else{
-					if(ssaData->isNodata(i,j)) src->setToNodata(i,j);
-					else{
-						ssaData->getData(i,j,tempssa);
-						tempsrc=(tempssa >= thresh)?1:0;
-						src->setData(i,j,tempsrc);
-					}
-				}				
-			}
-	}
-		//Pass information
-		src->addBorders();		
+	//  Stream cells are 0 or 1, so the grid is bit packed
+	uint8_t srcNodata = 255;
+	src = CreateNewPartition(BIT_TYPE, totalX, totalY, dx, dy, srcNodata);
 
-		//Clear out borders
-		src->clearBorders();
+	evaluateThreshold(ssaData, maskData, src, thresh);
 
 	//Stop timer
 	end = MPI_Wtime();
@@ -150,9 +162,8 @@ int threshold(char *ssafile,char *srcfile,char *maskfile, float thresh, int usem
 
 
 	//Create and write TIFF file
-	short aNodata = -32768;
-	tiffIO srcc(srcfile, SHORT_TYPE, &aNodata, ssa);
-	srcc.write(xstart, ystart, ny, nx, src->getGridPointer());
+	tiffIO srcc(srcfile, BYTE_TYPE, &srcNodata, ssa);
+	srcc.write(xstart, ystart, ny, nx, src);
 
 	//Brackets force MPI-dependent objects to go out of scope before Finalize is called
 	}MPI_Finalize();
@@ -45,14 +45,147 @@ email:  dtarb@usu.edu
 #include "linearpart.h"
 #include "createpart.h"
 #include "tiffIO.h"
+#include "stages.h"
 #include <iostream>
 #include "initneighbor.h"
+#include "threadqueue.h"
+#include "d8cells.h"
 using namespace std;
 
 
+//  Evaluate the contributing area of every cell in aread8, a grid of areaType, from the flow
+//  directions in flowData, once neighbor holds the number of cells draining to each cell and que
+//  the cells with none
+template <class areaType>
+static void accumulateD8(tdpartition *flowData, tdpartition *aread8, tdpartition *weightData, tdpartition *neighbor,
+	queue<node> &que, int usew, int contcheck, int rank)
+{
+	long i,j;
+	short k;
+	long in,jn;
+	bool finished;
+	short tempShort=0;
+	node temp;
+
+	//  Typed views for the interior fast path.  These are NULL if the partitions are not
+	//  linear partitions of the expected type, in which case the general accessors are used.
+	linearpart<uint8_t> *flowL = dynamic_cast<linearpart<uint8_t>*>(flowData);
+	linearpart<areaType> *areaL = dynamic_cast<linearpart<areaType>*>(aread8);
+	linearpart<short> *neighborL = dynamic_cast<linearpart<short>*>(neighbor);
+	bool useFast = (flowL != NULL && areaL != NULL && neighborL != NULL);
+	
+	areaD8Cells<areaType> cells;
+	cells.flowData = flowData;
+	cells.aread8 = aread8;
+	cells.weightData = weightData;
+	cells.flowL = flowL;
+	cells.areaL = areaL;
+	cells.useFast = useFast;
+	cells.usew = usew;
+	cells.contcheck = contcheck;
+	cells.rank = rank;
+	int numThreads = getNumThreads();
+
+	finished = false;
+	//Ring terminating while loop
+	while(!finished) {
+		//  With threads the queue is evaluated by drainQueueThreaded and the loop below is skipped
+		if(numThreads > 1 && useFast)
+			drainQueueThreaded(que, neighborL, cells, numThreads);
+		while(!que.empty()){
+			//Takes next node with no contributing neighbors
+			temp = que.front();
+			que.pop();
+			i = temp.x;
+			j = temp.y;
+			
+			if(flowData->isInPartition(i,j))
+				cells.evaluate(i,j);
+			//  END FLOW ALGEBRA EXPRESSION
+			// Decrement neighbor dependence of downslope cell
+				
+			flowData->getData(i,j,k);
+			if(k>=1 && k <=8){
+				//continue;
+				in = i+d1[k];
+				jn = j+d2[k];
+				if(useFast && flowL->isInterior(i,j))
+				{
+					neighborL->addToDataUnchecked(in,jn,(short)-1);
+					tempShort=neighborL->getDataUnchecked(in,jn);
+				}
+				else
+				{
+					neighbor->addToData(in,jn,(short)-1);
+					neighbor->getData(in,jn,tempShort);
+				}
+				//Check if neighbor needs to be added to que
+				if(flowData->isInPartition(in,jn) && tempShort == 0 ){
+					temp.x=in;
+					temp.y=jn;
+					que.push(temp);
+				}
+			}
+		}
+
+		//Pass information.  The area borders are exchanged while neighbor borders are added.
+		aread8->shareBegin();
+		neighbor->addBorders();
+
+		//If this created a cell with no contributing neighbors, put it on the queue
+		queueBorderCells(neighbor, &que);
+		//Clear out borders
+		neighbor->clearBorders();
+
+		//Check if done.  The vote is taken while the area borders are completed.
+		aread8->termBegin(que.empty());
+		aread8->shareEnd();
+		finished = aread8->termEnd();
+	}
+}
+
+//  Evaluates the D8 contributing area of every cell in aread8 from the directions in flowData,
+//  or only of the cells upslope of the outlets if useOutlets is 1.  aread8 is an empty grid of
+//  areaDatatype, which is FLOAT_TYPE, DOUBLE_TYPE or INT64_TYPE, and weightData holds the
+//  weights if usew is 1.
+void evaluateAreaD8(tdpartition *flowData, tdpartition *weightData, tdpartition *aread8, DATA_TYPE areaDatatype,
+	int useOutlets, int *outletsX, int *outletsY, int numOutlets, int usew, int contcheck)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long totalX = flowData->gettotalx();
+	long totalY = flowData->gettotaly();
+	double dx = flowData->getdx();
+	double dy = flowData->getdy();
+	int nx = flowData->getnx();
+	int ny = flowData->getny();
+
+	tdpartition *neighbor;
+	neighbor = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, MISSINGSHORT);
+	
+	//Share information and set borders to zero
+	flowData->share();
+	if(usew==1) weightData->share();
+	aread8->clearBorders();
+	neighbor->clearBorders();
+
+	queue<node> que;
+
+	initNeighborD8up(neighbor,flowData,&que,nx, ny, useOutlets, outletsX, outletsY, numOutlets);
+
+	if(areaDatatype == DOUBLE_TYPE)
+		accumulateD8<double>(flowData, aread8, weightData, neighbor, que, usew, contcheck, rank);
+	else if(areaDatatype == INT64_TYPE)
+		accumulateD8<long long>(flowData, aread8, weightData, neighbor, que, usew, contcheck, rank);
+	else
+		accumulateD8<float>(flowData, aread8, weightData, neighbor, que, usew, contcheck, rank);
+	delete neighbor;
+}
+
 int aread8( char* pfile, char* afile, char *shfile, char *wfile, int useOutlets, int usew, int contcheck) {
 
-	MPI_Init(NULL,NULL);{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
 
 	int rank,size;
 	MPI_Comm_rank(MCW,&rank);
@@ -87,7 +220,7 @@ int aread8( char* pfile, char* afile, char *shfile, char *wfile, int useOutlets,
 	}
 
 	//Create tiff object, read and store header info
-	tiffIO p(pfile,SHORT_TYPE);
+	tiffIO p(pfile,BYTE_TYPE);
 	long totalX = p.getTotalX();
 	long totalY = p.getTotalY();
 	double dx = p.getdx();
@@ -104,15 +237,15 @@ int aread8( char* pfile, char* afile, char *shfile, char *wfile, int useOutlets,
 
 	//Create partition and read data
 	tdpartition *flowData;
-	flowData = CreateNewPartition(p.getDatatype(), totalX, totalY, dx, dy, p.getNodata());
+	flowData = CreateInputPartition(p);
 	int nx = flowData->getnx();
 	int ny = flowData->getny();
 	int xstart, ystart;
 	flowData->localToGlobal(0, 0, xstart, ystart);
-	p.read(xstart, ystart, ny, nx, flowData->getGridPointer());
+	p.read(xstart, ystart, ny, nx, flowData);
 
 	//if using weightData, get information from file
-	tdpartition *weightData;
+	tdpartition *weightData = NULL;
 	if( usew == 1){
 		tiffIO w(wfile,FLOAT_TYPE);
 		if(!p.compareTiff(w)){
@@ -121,7 +254,7 @@ int aread8( char* pfile, char* afile, char *shfile, char *wfile, int useOutlets,
 			return 1;  
 		} 
 		weightData = CreateNewPartition(w.getDatatype(), totalX, totalY, dx, dy, w.getNodata());
-		w.read(xstart, ystart, weightData->getny(), weightData->getnx(), weightData->getGridPointer());
+		w.read(xstart, ystart, weightData->getny(), weightData->getnx(), weightData);
 	}
 
 	//Begin timer
@@ -136,128 +269,27 @@ int aread8( char* pfile, char* afile, char *shfile, char *wfile, int useOutlets,
 			p.geoToGlobalXY(x[i], y[i], outletsX[i], outletsY[i]);
 	}
 
-	//Create empty partition to store new information
+	//Create empty partition to store new information.  With 64 bit accumulation areas are
+	//counts of cells, held as 64 bit integers, unless weights are used.
+	DATA_TYPE areaDatatype = FLOAT_TYPE;
+	if(getWideAccumulation()) areaDatatype = (usew == 1) ? DOUBLE_TYPE : INT64_TYPE;
 	tdpartition *aread8;
-	aread8 = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, -1.0f);
-
-	// con is used to check for contamination at the edges
-	long i,j;
-	short k;
-	long in,jn;
-	float area;
-	bool con=false, finished;
-	float tempFloat=0;
-	short tempShort=0;
-
-	tdpartition *neighbor;
-	neighbor = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, MISSINGSHORT);
-	
-	//Share information and set borders to zero
-	flowData->share();
-	if(usew==1) weightData->share();
-	aread8->clearBorders();
-	neighbor->clearBorders();
-
-	node temp;
-	queue<node> que;
+	aread8 = CreateNewPartition(areaDatatype, totalX, totalY, dx, dy, -1.0f);
 
-	initNeighborD8up(neighbor,flowData,&que,nx, ny, useOutlets, outletsX, outletsY, numOutlets);
-	
-	finished = false;
-	//Ring terminating while loop
-	while(!finished) {
-		while(!que.empty()){
-			//Takes next node with no contributing neighbors
-			temp = que.front();
-			que.pop();
-			i = temp.x;
-			j = temp.y;
-			
-			if(flowData->isInPartition(i,j)){
-				//  FLOW ALGEBRA Evaluation
-				//   Initialize
-				if( usew==1) 
-				{
-					if(!weightData->isNodata(i,j))
-						aread8->setData(i,j, weightData->getData(i,j,tempFloat));
-				}
-				else aread8->setData(i,j,(float)1);
-				con=false;  //  Initially not contaminated
-				for(k=1; k<=8; k++) {
-					in = i+d1[k];
-					jn = j+d2[k];
-					if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
-						con=true;
-					else
-					{
-						flowData->getData(in,jn,tempShort);
-						if(tempShort-k == 4 || tempShort-k == -4)
-						{
-							if(aread8->isNodata(in,jn))con=true;
-							else
-							{
-								aread8->addToData(i,j,aread8->getData(in,jn,tempFloat));
-							}
-						}
-					}
-				}
-				if(con && contcheck == 1)aread8->setToNodata(i,j);
-			}
-			//  END FLOW ALGEBRA EXPRESSION
-			// Decrement neighbor dependence of downslope cell
-				
-			flowData->getData(i,j,k);
-			if(k>=1 && k <=8){
-				//continue;
-				in = i+d1[k];
-				jn = j+d2[k];
-				neighbor->addToData(in,jn,(short)-1);
-				//Check if neighbor needs to be added to que
-				if(flowData->isInPartition(in,jn) && neighbor->getData(in, jn, tempShort) == 0 ){
-					temp.x=in;
-					temp.y=jn;
-					que.push(temp);
-				}
-			}else{
-				if(flowData->isNodata(i,j))
-					cout << "Warning: evaluating at location (most likely specified outlet) where flow direction is undefined. i = " << i << ", j = " << j <<  ", rank = " << rank << endl;
-				else
-					cout << "Warning: Invalid flow direction = " << k << " encountered at i = " << i << ", j = " << j <<  ", rank = " << rank << endl;
-			}
-		}
-
-		//Pass information
-		aread8->share();
-		neighbor->addBorders();
-
-		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
-		//Clear out borders
-		neighbor->clearBorders();
-	
-		//Check if done
-		finished = que.empty();
-		finished = aread8->ringTerm(finished);
-	}
+	evaluateAreaD8(flowData, weightData, aread8, areaDatatype, useOutlets, outletsX, outletsY, numOutlets, usew, contcheck);
 
 	//Stop timer
 	double computet = MPI_Wtime();
 
 	//Create and write TIFF file
 	float aNodata = -1.0f;
-	tiffIO a(afile, FLOAT_TYPE, &aNodata, p);
-	a.write(xstart, ystart, ny, nx, aread8->getGridPointer());
+	double aNodataDouble = -1.;
+	long long aNodataInt64 = -1;
+	void *aNodataPtr = &aNodata;
+	if(areaDatatype == DOUBLE_TYPE) aNodataPtr = &aNodataDouble;
+	else if(areaDatatype == INT64_TYPE) aNodataPtr = &aNodataInt64;
+	tiffIO a(afile, areaDatatype, aNodataPtr, p);
+	a.write(xstart, ystart, ny, nx, aread8);
 	double writet = MPI_Wtime();
 	if( rank == 0) 
 		printf("Size: %d\nRead time: %f\nCompute time: %f\nWrite time: %f\nTotal time: %f\n",
@@ -117,12 +117,21 @@ int main(int argc,char **argv)
 			i++;
 			contcheck=0;
 		}		
+	   else if(strcmp(argv[i],"-acc64")==0)  //  Accumulate in 64 bit grids
+		{
+			i++;
+			setWideAccumulation(true);
+		}
 	   else 
 		{
-			goto errexit;
+			if(!parseGridOption(argc,argv,i)) goto errexit;  //  Partition and grid file options
 		}
 	}
 
+	if(useOutlets == 1 && getPartitionType() == BLOCK_PARTITION) {
+		printf("Outlets (-o) are not supported with block partitions.  Run without the -block option.\n");
+		goto errexit;
+	}
 	if( argc == 2) {
 		nameadd(afile,argv[1],"ad8");
 		nameadd(pfile,argv[1],"p");
@@ -142,6 +151,9 @@ int main(int argc,char **argv)
 	   printf("[-o <shfile>] is the optional outlet shape input file.\n");
        printf("[-wg <wfile>] is the optional weight grid input file.\n");
        printf("The flag -nc overrides edge contamination checking\n");
+	   printGridOptions();
+	   printf("The flag -acc64 holds and writes areas as 64 bit grids, Int64 cell counts, or Float64\n");
+	   printf("with -wg, in place of float, which counts cells exactly only up to 16777216.\n");
 	   printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
        printf("ad8   D8 contributing area file (output)\n");
@@ -46,12 +46,220 @@ email:  dtarb@usu.edu
 #include "linearpart.h"
 #include "createpart.h"
 #include "tiffIO.h"
+#include "stages.h"
 #include "initneighbor.h"
+#include "threadqueue.h"
 using namespace std;
 
+//  Flow algebra for Dinf specific catchment area, used by the serial loop and by
+//  drainQueueThreaded.  evaluate(i,j) evaluates the specific catchment area of cell (i,j),
+//  once all the cells that drain to it have been evaluated.  areaType is the type of the area
+//  grid: float, or double for 64 bit accumulation.
+template <class areaType>
+class areaDinfCells {
+	public:
+		tdpartition *flowData, *areadinf, *weightData;
+		linearpart<float> *flowL;
+		linearpart<areaType> *areaL;
+		bool useFast;
+		int usew, contcheck;
+		double dx;
+		void evaluate(long i, long j);
+		bool drainsTo(long i, long j, short k){return prop(flowL->getDataUnchecked(i,j), k) > 0.;}
+};
+
+template <class areaType>
+void areaDinfCells<areaType>::evaluate(long i, long j)
+{
+	long in,jn;
+	short k;
+	bool con;
+	float angle, tempFloat;
+	areaType tempArea;
+	double p;
+	//  The typed views can be used if all eight neighbors are in this partition
+	bool interior = useFast && flowL->isInterior(i,j);
+
+	// initialize the result
+	areaType areares=0.;
+	con=false;  // not contaminated so far
+	if(interior)
+	{
+		//  All neighbors are in this partition so no access checks are needed
+		for(k=1; k<=8; k++) {
+			in = i+d1[k];
+			jn = j+d2[k];
+			if(flowL->isNodataUnchecked(in,jn))
+				con=true;
+			else{
+				angle=flowL->getDataUnchecked(in,jn);
+				p = prop(angle, (k+4)%8);
+				if(p>0.){
+					if(areaL->isNodataUnchecked(in,jn))con=true;
+					else areares=areares+p*areaL->getDataUnchecked(in,jn);
+				}
+			}
+		}
+	}
+	else for(k=1; k<=8; k++) {
+		in = i+d1[k];
+		jn = j+d2[k];
+		if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
+			con=true;
+		else{
+			flowData->getData(in,jn, angle);
+			p = prop(angle, (k+4)%8);
+			if(p>0.){
+				if(areadinf->isNodata(in,jn))con=true;
+				else{
+					areares=areares+p*areadinf->getData(in,jn,tempArea);
+				}
+			}
+		}
+	}
+	//  Local inputs
+	if( usew==1) areares=areares+weightData->getData(i,j,tempFloat);
+	else areares=areares+dx;
+	if(con && contcheck==1)
+		areadinf->setToNodata(i,j);
+	else 
+		areadinf->setData(i,j,areares);
+}
+
+//  Evaluate the specific catchment area of every cell in areadinf, a grid of areaType, from the
+//  flow angles in flowData, once neighbor holds the number of cells draining to each cell and que
+//  the cells with none
+template <class areaType>
+static void accumulateDinf(tdpartition *flowData, tdpartition *areadinf, tdpartition *weightData, tdpartition *neighbor,
+	queue<node> &que, int usew, int contcheck, double dx)
+{
+	long i,j;
+	short k;
+	long in,jn;
+	bool finished;
+	float angle;
+	double p;
+	short tempShort=0;
+	node temp;
+
+	//  Typed views for the interior fast path.  These are NULL if the partitions are not
+	//  linear partitions of the expected type, in which case the general accessors are used.
+	linearpart<float> *flowL = dynamic_cast<linearpart<float>*>(flowData);
+	linearpart<areaType> *areaL = dynamic_cast<linearpart<areaType>*>(areadinf);
+	linearpart<short> *neighborL = dynamic_cast<linearpart<short>*>(neighbor);
+	bool useFast = (flowL != NULL && areaL != NULL && neighborL != NULL);
+	bool interior;
+	areaDinfCells<areaType> cells;
+	cells.flowData = flowData;
+	cells.areadinf = areadinf;
+	cells.weightData = weightData;
+	cells.flowL = flowL;
+	cells.areaL = areaL;
+	cells.useFast = useFast;
+	cells.usew = usew;
+	cells.contcheck = contcheck;
+	cells.dx = dx;
+	int numThreads = getNumThreads();
+
+	finished = false;
+	//Ring terminating while loop
+	while(!finished) {
+		//  With threads the queue is evaluated by drainQueueThreaded and the loop below is skipped
+		if(numThreads > 1 && useFast)
+			drainQueueThreaded(que, neighborL, cells, numThreads);
+		while(!que.empty()) 
+		{
+			//Takes next node with no contributing neighbors
+			temp = que.front();
+			que.pop();
+			i = temp.x;
+			j = temp.y;
+			interior = useFast && flowL->isInterior(i,j);
+			//  FLOW ALGEBRA EXPRESSION EVALUATION
+			if(flowData->isInPartition(i,j))
+				cells.evaluate(i,j);
+			//  END FLOW ALGEBRA EXPRESSION EVALUATION
+			//  Decrement neighbor dependence of downslope cell
+			flowData->getData(i, j, angle);
+			for(k=1; k<=8; k++) {			
+				p = prop(angle, k);
+				if(p>0.0) {
+					in = i+d1[k];  jn = j+d2[k];
+					//Decrement the number of contributing neighbors in neighbor
+					if(interior)
+					{
+						neighborL->addToDataUnchecked(in,jn,(short)-1);
+						tempShort=neighborL->getDataUnchecked(in,jn);
+					}
+					else
+					{
+						neighbor->addToData(in,jn,(short)-1);
+						neighbor->getData(in,jn,tempShort);
+					}
+					//Check if neighbor needs to be added to que
+					if(flowData->isInPartition(in,jn) && tempShort == 0 ){
+						temp.x=in;
+						temp.y=jn;
+						que.push(temp);
+					}
+				}
+			}
+		}
+
+		//Pass information.  The area borders are exchanged while neighbor borders are added.
+		areadinf->shareBegin();
+		neighbor->addBorders();
+
+		//If this created a cell with no contributing neighbors, put it on the queue
+		queueBorderCells(neighbor, &que);
+		//Clear out borders
+		neighbor->clearBorders();
+
+		//Check if done.  The vote is taken while the area borders are completed.
+		areadinf->termBegin(que.empty());
+		areadinf->shareEnd();
+		finished = areadinf->termEnd();
+	}
+}
+
+//  Evaluates the Dinf specific catchment area of every cell in areadinf from the angles in
+//  flowData, or only of the cells upslope of the outlets if useOutlets is 1.  areadinf is an
+//  empty grid of areaDatatype, which is FLOAT_TYPE or DOUBLE_TYPE, and weightData holds the
+//  weights if usew is 1.
+void evaluateAreaDinf(tdpartition *flowData, tdpartition *weightData, tdpartition *areadinf, DATA_TYPE areaDatatype,
+	int useOutlets, int *outletsX, int *outletsY, int numOutlets, int usew, int contcheck)
+{
+	long totalX = flowData->gettotalx();
+	long totalY = flowData->gettotaly();
+	double dx = flowData->getdx();
+	double dy = flowData->getdy();
+	int nx = flowData->getnx();
+	int ny = flowData->getny();
+
+	tdpartition *neighbor;
+	neighbor = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, -32768);
+	
+	//Share information and set borders to zero
+	flowData->share();
+	if(usew==1) weightData->share();
+	areadinf->share();
+	neighbor->clearBorders();
+
+	queue<node> que;
+
+	initNeighborDinfup(neighbor,flowData,&que,nx, ny, useOutlets, outletsX, outletsY, numOutlets);
+
+	if(areaDatatype == DOUBLE_TYPE)
+		accumulateDinf<double>(flowData, areadinf, weightData, neighbor, que, usew, contcheck, dx);
+	else
+		accumulateDinf<float>(flowData, areadinf, weightData, neighbor, que, usew, contcheck, dx);
+	delete neighbor;
+}
+
 int area( char* angfile, char* scafile, char *shfile, char *wfile, int useOutlets, int usew, int contcheck) {
 
-	MPI_Init(NULL,NULL);{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
 
 	int rank,size;
 	MPI_Comm_rank(MCW,&rank);
@@ -87,9 +295,6 @@ int area( char* angfile, char* scafile, char *shfile, char *wfile, int useOutlet
 		}
 	}
 
-	float area,angle;
-	double p;
-
 	//Create tiff object, read and store header info
 	tiffIO ang(angfile,FLOAT_TYPE);
 	long totalX = ang.getTotalX();
@@ -107,20 +312,20 @@ int area( char* angfile, char* scafile, char *shfile, char *wfile, int useOutlet
 
 	//Create partition and read data
 	tdpartition *flowData;
-	flowData = CreateNewPartition(ang.getDatatype(), totalX, totalY, dx, dy, ang.getNodata());
+	flowData = CreateInputPartition(ang);
 	int nx = flowData->getnx();
 	int ny = flowData->getny();
 	int xstart, ystart;
 	flowData->localToGlobal(0, 0, xstart, ystart);
-	ang.read(xstart, ystart, ny, nx, flowData->getGridPointer());
+	ang.read(xstart, ystart, ny, nx, flowData);
 
 	//if using weightData, get information from file
-	tdpartition *weightData;
+	tdpartition *weightData = NULL;
 	if( usew == 1){
 		tiffIO w(wfile,FLOAT_TYPE);
 		if(!ang.compareTiff(w)) return 1;  //And maybe an unhappy error message
 		weightData = CreateNewPartition(w.getDatatype(), totalX, totalY, dx, dy, w.getNodata());
-		w.read(xstart, ystart, weightData->getny(), weightData->getnx(), weightData->getGridPointer());
+		w.read(xstart, ystart, weightData->getny(), weightData->getnx(), weightData);
 	}
 
 	//Begin timer
@@ -136,121 +341,20 @@ int area( char* angfile, char* scafile, char *shfile, char *wfile, int useOutlet
 	}
 
 	//Create empty partition to store new information
+	DATA_TYPE areaDatatype = getWideAccumulation() ? DOUBLE_TYPE : FLOAT_TYPE;
 	tdpartition *areadinf;
-	areadinf = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, -1.0f);
-
-	// con is used to check for contamination at the edges
-	long i,j;
-	short k;
-	long in,jn;
-	bool con=false, finished;
-	float tempFloat=0;
-	short tempShort=0;
-
-	tdpartition *neighbor;
-	neighbor = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, -32768);
-	
-	//Share information and set borders to zero
-	flowData->share();
-	if(usew==1) weightData->share();
-	areadinf->share();
-	neighbor->clearBorders();
-
-	node temp;
-	queue<node> que;
+	areadinf = CreateNewPartition(areaDatatype, totalX, totalY, dx, dy, -1.0f);
 
-	initNeighborDinfup(neighbor,flowData,&que,nx, ny, useOutlets, outletsX, outletsY, numOutlets);
-	finished = false;
-
-	//Ring terminating while loop
-	while(!finished) {
-		while(!que.empty()) 
-		{
-			//Takes next node with no contributing neighbors
-			temp = que.front();
-			que.pop();
-			i = temp.x;
-			j = temp.y;
-			//  FLOW ALGEBRA EXPRESSION EVALUATION
-			if(flowData->isInPartition(i,j)){
-				// initialize the result
-				float areares=0.;
-				con=false;  // not contaminated so far
-				for(k=1; k<=8; k++) {
-					in = i+d1[k];
-					jn = j+d2[k];
-					if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
-						con=true;
-					else{
-						flowData->getData(in,jn, angle);
-						p = prop(angle, (k+4)%8);
-						if(p>0.){
-							if(areadinf->isNodata(in,jn))con=true;
-							else{
-								areares=areares+p*areadinf->getData(in,jn,tempFloat);
-							}
-						}
-					}
-				}
-				//  Local inputs
-				if( usew==1) areares=areares+weightData->getData(i,j,tempFloat);
-				else areares=areares+dx;
-				if(con && contcheck==1)
-					areadinf->setToNodata(i,j);
-				else 
-					areadinf->setData(i,j,areares);
-			}
-			//  END FLOW ALGEBRA EXPRESSION EVALUATION
-			//  Decrement neighbor dependence of downslope cell
-			flowData->getData(i, j, angle);
-			for(k=1; k<=8; k++) {			
-				p = prop(angle, k);
-				if(p>0.0) {
-					in = i+d1[k];  jn = j+d2[k];
-					//Decrement the number of contributing neighbors in neighbor
-					neighbor->addToData(in,jn,(short)-1);				
-					//Check if neighbor needs to be added to que
-					if(flowData->isInPartition(in,jn) && neighbor->getData(in, jn, tempShort) == 0 ){
-						temp.x=in;
-						temp.y=jn;
-						que.push(temp);
-					}
-				}
-			}
-		}
-
-		//Pass information
-		areadinf->share();
-		neighbor->addBorders();
-
-		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
-		//Clear out borders
-		neighbor->clearBorders();
-	
-		//Check if done
-		finished = que.empty();
-		finished = areadinf->ringTerm(finished);
-	}
+	evaluateAreaDinf(flowData, weightData, areadinf, areaDatatype, useOutlets, outletsX, outletsY, numOutlets, usew, contcheck);
 
 	//Stop timer
 	double computet = MPI_Wtime();
 
 	//Create and write TIFF file
 	float scaNodata = -1.0f;
-	tiffIO sca(scafile, FLOAT_TYPE, &scaNodata, ang);
-	sca.write(xstart, ystart, ny, nx, areadinf->getGridPointer());
+	double scaNodataDouble = -1.;
+	tiffIO sca(scafile, areaDatatype, (areaDatatype == DOUBLE_TYPE) ? (void*)&scaNodataDouble : (void*)&scaNodata, ang);
+	sca.write(xstart, ystart, ny, nx, areadinf);
 
 	double writet = MPI_Wtime();
  	double dataRead, compute, write, total,tempd;
@@ -116,11 +116,20 @@ int main(int argc,char **argv)
 			i++;
 			contcheck=0;
 		}
+		else if(strcmp(argv[i],"-acc64")==0)  //  Accumulate in 64 bit grids
+		{
+			i++;
+			setWideAccumulation(true);
+		}
 		else 
 		{
-			goto errexit;
+			if(!parseGridOption(argc,argv,i)) goto errexit;  //  Partition and grid file options
 		}
 	}
+	if(useOutlets == 1 && getPartitionType() == BLOCK_PARTITION) {
+		printf("Outlets (-o) are not supported with block partitions.  Run without the -block option.\n");
+		goto errexit;
+	}
 	if( argc == 2) {
 		nameadd(afile,argv[1],"sca");
 		nameadd(pfile,argv[1],"ang");
@@ -142,6 +151,8 @@ errexit:
 	   printf("[-o <shfile>] is the optional outlet shape input file.\n");
        printf("[-wg <wfile>] is the optional weight grid input file.\n");
        printf("The flag -nc overrides edge contamination checking\n");
+	   printGridOptions();
+	   printf("The flag -acc64 holds and writes areas as 64 bit Float64 grids in place of float.\n");
 	   printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
        printf("sca   D-infinity contributing area file (output)\n");
@@ -0,0 +1,369 @@
+/*  Taudem parallel bit packed partition class
+
+  Partitions a grid of 0 and 1 values, such as a stream or mask grid, by rows, holding each
+  cell in two bits.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+
+#include "mpi.h"
+#include "partition.h"
+#include "commonLib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <exception>
+#include <stdint.h>
+#ifndef BITPART_H
+#define BITPART_H
+using namespace std;
+
+//  Rows are divided between processes and addressed as for linearpart, with rows y=-1 and y=ny
+//  holding the borders shared from the adjacent processes.  Cells are accessed as uint8_t (or
+//  short, see tdpartition::hasByteCells) and hold 0, 1 or the no data value.  Each cell is two
+//  bits, 0 or 1 for the values and 2 for no data, four cells to a byte, so a grid takes an
+//  eighth of the memory of a short grid and borders are exchanged as packed bytes.  Any nonzero
+//  value other than no data is stored as 1, and addToData combines values with a logical or.
+//  Cells in the same byte are not independent, so cells must not be written by several threads.
+//  There is no grid pointer, so grids are read and written as bytes through getRows and putRows.
+class bitpart : public tdpartition {
+	protected:
+		int rank, size;
+		long yoffset;   //  Global row of local row 0
+		uint8_t noData;
+		long rowBytes;  //  Bytes in a row of packed cells
+		//  ny+2 rows of rowBytes bytes, with the borders in the first and last rows as for
+		//  linearpart, so rows -1 to ny are at gridData+y*rowBytes
+		uint8_t *storage;
+		uint8_t *gridData;
+		uint8_t *topBorder;
+		uint8_t *bottomBorder;
+
+		int getCode(long x, long y){return (gridData[y*rowBytes+(x>>2)] >> ((x&3)*2)) & 3;}
+		void setCode(long x, long y, int code){
+			uint8_t &b = gridData[y*rowBytes+(x>>2)];
+			b = (uint8_t)((b & ~(3 << ((x&3)*2))) | (code << ((x&3)*2)));
+		}
+		bool inRange(long x, long y){return (x>=0 && x<nx && y>=-1 && y<=ny);}
+
+		//  Persistent requests and send buffer for exchanging borders, created on first use
+		MPI_Request exchangeRequests[4];
+		int numExchangeRequests;
+		uint8_t *sendBuffer;
+		void initExchange();
+		void startExchange(uint8_t *top, uint8_t *bottom);
+		void waitExchange();
+
+	public:
+		bitpart():tdpartition(){storage=NULL; sendBuffer=NULL; numExchangeRequests=-1;}
+		~bitpart();
+
+		void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, uint8_t nd);
+		bool isInPartition(int x, int y);
+		bool hasAccess(int x, int y);
+
+		void share();
+		void shareBegin();
+		void shareEnd();
+		void passBorders();
+		void passBordersBegin();
+		void passBordersEnd();
+		void addBorders();
+		void clearBorders();
+
+		bool globalToLocal(int globalX, int globalY, int &localX, int &localY);
+		void localToGlobal(int localX, int localY, int &globalX, int &globalY);
+
+		int getGridXY( int x,int y, int *i, int *j);
+		void transferPack( int *, int *, int *, int*);
+
+		bool hasByteCells(){return true;}
+		bool isNodata(long x, long y);
+		void setToNodata(long x, long y);
+		uint8_t getData(long x, long y, uint8_t &val);
+		void setData(long x, long y, uint8_t val);
+		void addToData(long x, long y, uint8_t val);
+
+		void getRows(long y, long numRows, void *dest);
+		void putRows(long y, long numRows, const void *source);
+};
+
+
+//Destructor.  Frees memory and the persistent communication requests.
+inline bitpart::~bitpart(){
+	int finalized;
+	MPI_Finalized(&finalized);
+	if(!finalized)
+		for(int i=0; i<numExchangeRequests; i++) MPI_Request_free(&exchangeRequests[i]);
+	delete [] storage;
+	delete [] sendBuffer;
+}
+
+//Init routine.  Takes the same arguments as linearpart::init.  The MPI datatype is not used since borders
+//are exchanged as packed bytes.  All cells start as no data.
+inline void bitpart::init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype, uint8_t nd){
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+
+	this->totalx = totalx;
+	this->totaly = totaly;
+	nx = totalx;
+	//  Use the row split set for this grid if there is one, otherwise divide rows evenly
+	if(!getRowSplit(totaly, rank, yoffset, ny)) {
+		ny = totaly / size;
+		yoffset = rank * ny;
+		if(rank == size-1)  ny += (totaly % size); //Add extra rows to the last process
+	}
+	dx = dx_in;
+	dy = dy_in;
+	noData = nd;
+	rowBytes = (nx+3)/4;
+
+	try
+	{
+		storage = new uint8_t[(uint64_t)rowBytes*(ny+2)];
+	}
+	catch(bad_alloc&)
+	{
+		fprintf(stdout,"Memory allocation error during partition initialization in process %d.\n",rank);
+		fprintf(stdout,"NCols: %ld, NRows: %ld\n",nx,ny);
+		fflush(stdout);
+		MPI_Abort(MCW,-999);
+	}
+	gridData = storage + rowBytes;
+	topBorder = storage;
+	bottomBorder = gridData + (uint64_t)rowBytes*ny;
+	//  0xAA is the no data code, 2, in each of the four cells of a byte
+	memset(storage, 0xAA, (uint64_t)rowBytes*(ny+2));
+
+	after1=after2=before1=before2=NULL;
+}
+
+//Returns true if (x,y) is in partition
+inline bool bitpart::isInPartition(int x, int y) {
+	return (x>=0 && x<nx && y>=0 && y<ny);
+}
+
+//Returns true if (x,y) is in or on borders of partition
+inline bool bitpart::hasAccess( int x, int y) {
+	if(x>=0 && x<nx && y>=0 && y<ny) return true;
+	else if(x>=0 && x<nx ) {
+		if(rank !=0 && y==-1) return true;
+		if(rank !=size-1 && y==ny) return true;
+	}
+	return false;
+}
+
+//Creates the persistent requests used to exchange borders with the adjacent processes, as for
+//linearpart but with packed rows
+inline void bitpart::initExchange() {
+	numExchangeRequests = 0;
+	if(size<=1) return;
+	sendBuffer = new uint8_t[2*rowBytes];
+	if(rank>0){
+		MPI_Recv_init(topBorder, rowBytes, MPI_BYTE, rank-1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+		MPI_Send_init(sendBuffer, rowBytes, MPI_BYTE, rank-1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+	}
+	if(rank<size-1){
+		MPI_Recv_init(bottomBorder, rowBytes, MPI_BYTE, rank+1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+		MPI_Send_init(sendBuffer+rowBytes, rowBytes, MPI_BYTE, rank+1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+	}
+}
+
+inline void bitpart::startExchange(uint8_t *top, uint8_t *bottom) {
+	if(size<=1) return;
+	if(numExchangeRequests<0) initExchange();
+	if(rank>0) memcpy(sendBuffer, top, rowBytes);
+	if(rank<size-1) memcpy(sendBuffer+rowBytes, bottom, rowBytes);
+	MPI_Startall(numExchangeRequests, exchangeRequests);
+}
+
+inline void bitpart::waitExchange() {
+	if(numExchangeRequests>0) MPI_Waitall(numExchangeRequests, exchangeRequests, MPI_STATUSES_IGNORE);
+}
+
+inline void bitpart::shareBegin() {
+	startExchange(gridData, gridData+(ny-1)*rowBytes);
+}
+
+inline void bitpart::shareEnd() {
+	waitExchange();
+}
+
+inline void bitpart::share() {
+	shareBegin();
+	shareEnd();
+}
+
+inline void bitpart::passBordersBegin() {
+	startExchange(topBorder, bottomBorder);
+}
+
+inline void bitpart::passBordersEnd() {
+	waitExchange();
+}
+
+inline void bitpart::passBorders() {
+	passBordersBegin();
+	passBordersEnd();
+}
+
+//Swaps border information between adjacent processes,
+//then adds the values from received borders to the local copies.
+//Borders that are not adjacent to another process are not added.
+inline void bitpart::addBorders(){
+	passBorders();
+
+	uint8_t val;
+	for(long i=0; i<nx; i++){
+		if(rank > 0){
+			if(isNodata(i,-1) || isNodata(i,0)) setToNodata(i, 0);
+			else addToData(i, 0, getData(i, -1, val));
+		}
+
+		if(rank < size-1){
+			if(isNodata(i, ny) || isNodata(i, ny-1)) setToNodata(i, ny-1);
+			else addToData(i, ny-1, getData(i, ny, val));
+		}
+	}
+}
+
+//Clears borders (sets them to zero).
+inline void bitpart::clearBorders(){
+	memset(topBorder, 0, rowBytes);
+	memset(bottomBorder, 0, rowBytes);
+}
+
+inline bool bitpart::globalToLocal(int globalX, int globalY, int &localX, int &localY){
+	localX = globalX;
+	localY = globalY - yoffset;
+	return isInPartition(localX, localY);
+}
+
+inline void bitpart::localToGlobal(int localX, int localY, int &globalX, int &globalY){
+	globalX = localX;
+	globalY = yoffset + localY;
+}
+
+inline int bitpart::getGridXY( int x, int y, int *i, int *j) {
+	*i = *j = -1;
+	int starty = yoffset;
+	int  endy = starty + ny;
+	if( x >= 0 && x < nx && y >= starty && y < endy) {
+		*i = x;
+		*j = y - starty;
+		return 1;
+	}
+	return 0;
+}
+
+//Sends countA ints of bufferAbove to the process above and countB ints of bufferBelow to the
+//process below, receiving into the same buffers, as for linearpart
+inline void bitpart::transferPack( int *countA, int *bufferAbove, int *countB, int *bufferBelow) {
+	MPI_Status status;
+	if(size==1) return;
+
+	int place;
+	int absize = *countA*sizeof(int)+MPI_BSEND_OVERHEAD;
+	int bbsize = *countB*sizeof(int)+MPI_BSEND_OVERHEAD;
+	char *abuf = new char[absize];
+	char *bbuf = new char[bbsize];
+
+	if( rank >0 ) {
+		MPI_Buffer_attach(abuf,absize);
+		MPI_Bsend( bufferAbove, *countA, MPI_INT, rank-1, 3, MCW );
+		MPI_Buffer_detach(&abuf,&place);
+	}
+	if( rank < size-1) {
+		MPI_Probe( rank+1,3,MCW, &status);
+		MPI_Get_count( &status, MPI_INT, countA);
+		MPI_Recv( bufferAbove, *countA,MPI_INT, rank+1,3,MCW,&status);
+		MPI_Buffer_attach(bbuf,bbsize);
+		MPI_Bsend( bufferBelow, *countB, MPI_INT, rank+1,3,MCW);
+		MPI_Buffer_detach(&bbuf,&place);
+	}
+	if( rank > 0 ) {
+		MPI_Probe( rank-1,3,MCW, &status);
+		MPI_Get_count( &status, MPI_INT, countB);
+		MPI_Recv( bufferBelow, *countB,MPI_INT, rank-1,3,MCW,&status);
+	}
+
+	delete [] abuf;
+	delete [] bbuf;
+}
+
+//Returns true if grid element (x,y) is no data.
+inline bool bitpart::isNodata(long x, long y){
+	if(inRange(x,y)) return getCode(x,y) == 2;
+	return true;
+}
+
+inline void bitpart::setToNodata(long x, long y){
+	if(inRange(x,y)) setCode(x, y, 2);
+}
+
+//Returns the element in the grid with coordinate (x,y): 0, 1 or the no data value.
+inline uint8_t bitpart::getData(long x, long y, uint8_t &val) {
+	if(inRange(x,y)) {
+		int code = getCode(x,y);
+		val = (code == 2) ? noData : (uint8_t)code;
+	}
+	return val;
+}
+
+inline void bitpart::setData(long x, long y, uint8_t val){
+	if(inRange(x,y)) setCode(x, y, (val == noData) ? 2 : (val != 0));
+}
+
+inline void bitpart::addToData(long x, long y, uint8_t val){
+	if(inRange(x,y) && val != noData && val != 0 && getCode(x,y) != 2) setCode(x, y, 1);
+}
+
+//Copies rows y to y+numRows-1 of the partition to dest as numRows by nx bytes
+inline void bitpart::getRows(long y, long numRows, void *dest){
+	uint8_t *out = (uint8_t*)dest;
+	for(long r=0; r<numRows; r++)
+		for(long x=0; x<nx; x++)
+			getData(x, y+r, out[r*nx+x]);
+}
+
+//Copies numRows by nx bytes from source to rows y to y+numRows-1 of the partition
+inline void bitpart::putRows(long y, long numRows, const void *source){
+	const uint8_t *in = (const uint8_t*)source;
+	for(long r=0; r<numRows; r++)
+		for(long x=0; x<nx; x++)
+			setData(x, y+r, in[r*nx+x]);
+}
+#endif
@@ -0,0 +1,465 @@
+/*  Taudem parallel block partition class
+
+  Partitions the grid in two dimensions over a grid of processes.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License 
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file 
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330, 
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into 
+other software that does not meet the GNU General Public License 
+conditions contact the author to request permission.
+David G. Tarboton  
+Utah State University 
+8200 Old Main Hill 
+Logan, UT 84322-8200 
+USA 
+http://www.engineering.usu.edu/dtarb/ 
+email:  dtarb@usu.edu 
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+
+#include "mpi.h"
+#include "partition.h"
+#include "commonLib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <exception>
+#include <stdint.h>
+#ifndef BLOCKPART_H
+#define BLOCKPART_H
+using namespace std;
+
+//  The processes are arranged in a grid of npx columns by npy rows, with rank = py*npx+px.
+//  Each process holds an nx by ny block of the grid, surrounded by a one cell border holding
+//  copies of the cells of the eight adjacent processes.  Borders are addressed with x=-1, x=nx,
+//  y=-1 and y=ny as for linearpart, including the corners.
+template <class datatype>
+class blockpart : public tdpartition {
+	protected:
+		int rank, size;
+		int npx, npy;          //  Size of the process grid
+		int px, py;            //  Position of this process in the process grid
+		long xoffset, yoffset; //  Global coordinates of local cell (0,0)
+		MPI_Datatype MPI_type;
+		datatype noData;
+		//  gridData holds the block contiguously.  topBorder and bottomBorder hold nx+2 cells
+		//  from x=-1 to x=nx, so include the corners.  leftBorder and rightBorder hold ny cells.
+		datatype *gridData;
+		datatype *topBorder;
+		datatype *bottomBorder;
+		datatype *leftBorder;
+		datatype *rightBorder;
+
+		//  Ranks of the adjacent processes indexed by direction k as for d1 and d2.
+		//  MPI_PROC_NULL where there is no adjacent process.
+		int neighborRank[9];
+
+		//  Persistent requests and send buffer for exchanging borders, created on first use
+		MPI_Request exchangeRequests[16];
+		int numExchangeRequests;
+		datatype *sendBuffer;
+		long sendOffset[9];
+		void initExchange();
+		void startExchange(bool fromBorders);
+		void waitExchange();
+		datatype *cellPointer(long x, long y);
+		datatype *haloSegment(int k);
+		long segmentLength(int k);
+		void addContribution(long x, long y, datatype val);
+
+	public:
+		blockpart():tdpartition(){gridData=NULL; topBorder=bottomBorder=leftBorder=rightBorder=NULL; sendBuffer=NULL; numExchangeRequests=-1;}
+		~blockpart();
+
+		void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd);
+		bool isInPartition(int x, int y);
+		bool hasAccess(int x, int y);
+
+		void share();
+		void shareBegin();
+		void shareEnd();
+		void passBorders();
+		void passBordersBegin();
+		void passBordersEnd();
+		void addBorders();
+		void clearBorders();
+
+		bool globalToLocal(int globalX, int globalY, int &localX, int &localY);
+		void localToGlobal(int localX, int localY, int &globalX, int &globalY);
+
+		int getGridXY( int x,int y, int *i, int *j);
+		void transferPack( int *, int *, int *, int*);
+
+		void* getGridPointer(){return gridData;}
+		bool hasByteCells(){return sizeof(datatype) == 1;}
+		bool isNodata(long x, long y);
+		void setToNodata(long x, long y);
+		datatype getData(long x, long y, datatype &val);
+		void setData(long x, long y, datatype val);
+		void addToData(long x, long y, datatype val);
+};
+
+//Destructor.  Frees memory and the persistent communication requests.
+template <class datatype>
+blockpart<datatype>::~blockpart(){
+	int finalized;
+	MPI_Finalized(&finalized);
+	if(!finalized)
+		for(int i=0; i<numExchangeRequests; i++) MPI_Request_free(&exchangeRequests[i]);
+	delete [] gridData;
+	delete [] topBorder;
+	delete [] bottomBorder;
+	delete [] leftBorder;
+	delete [] rightBorder;
+	delete [] sendBuffer;
+}
+
+//Init routine.  Takes the total number of rows and columns in the ENTIRE grid to be partitioned,
+//dx and dy for the grid, MPI datatype (should match the template declaration), and noData value.
+template <class datatype>
+void blockpart<datatype>::init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd){
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+
+	this->totalx = totalx;
+	this->totaly = totaly;
+	dx = dx_in;
+	dy = dy_in;
+	MPI_type = MPIt;
+	noData = nd;
+
+	//  Choose the process grid that gives blocks with the shortest border.  A grid with one
+	//  column is the same as the linear partition.
+	npx = 1;
+	npy = size;
+	double best = -1.;
+	for(int p=1; p<=size; p++){
+		if(size%p != 0) continue;
+		int q = size/p;
+		if(p > totalx || q > totaly) continue;
+		double border = (double)totalx/p + (double)totaly/q;
+		if(best < 0. || border < best){
+			best = border;
+			npx = p;
+			npy = q;
+		}
+	}
+	px = rank%npx;
+	py = rank/npx;
+
+	//  As for linearpart the last column and row of processes take the extra cells
+	nx = totalx/npx;
+	ny = totaly/npy;
+	xoffset = px*nx;
+	yoffset = py*ny;
+	if(px == npx-1) nx += totalx%npx;
+	if(py == npy-1) ny += totaly%npy;
+
+	for(int k=1; k<=8; k++){
+		int qx = px+d1[k];
+		int qy = py+d2[k];
+		if(qx>=0 && qx<npx && qy>=0 && qy<npy) neighborRank[k] = qy*npx+qx;
+		else neighborRank[k] = MPI_PROC_NULL;
+	}
+
+	uint64_t prod;
+	try
+	{
+		prod=nx*ny;
+		gridData = new datatype[prod];
+		topBorder = new datatype[nx+2];
+		bottomBorder = new datatype[nx+2];
+		leftBorder = new datatype[ny];
+		rightBorder = new datatype[ny];
+	}
+	catch(bad_alloc&)
+	{
+		fprintf(stdout,"Memory allocation error during partition initialization in process %d.\n",rank);
+		fprintf(stdout,"NCols: %ld, NRows: %ld, NCells: %ld\n",nx,ny,prod);
+		fflush(stdout);
+		MPI_Abort(MCW,-999);
+	}
+	for(uint64_t i=0; i<prod; i++) gridData[i] = noData;
+	for(long i=0; i<nx+2; i++) topBorder[i] = bottomBorder[i] = noData;
+	for(long i=0; i<ny; i++) leftBorder[i] = rightBorder[i] = noData;
+
+	after1=after2=before1=before2=NULL;
+}
+
+//Returns a pointer to the storage of cell (x,y), which may be in the partition or its border,
+//or NULL if (x,y) is neither.
+template <class datatype>
+datatype *blockpart<datatype>::cellPointer(long x, long y){
+	if(x>=0 && x<nx && y>=0 && y<ny) return gridData+x+y*nx;
+	if(x<-1 || x>nx) return NULL;
+	if(y==-1) return topBorder+x+1;
+	if(y==ny) return bottomBorder+x+1;
+	if(y<0 || y>ny) return NULL;
+	if(x==-1) return leftBorder+y;
+	return rightBorder+y;
+}
+
+//Returns true if (x,y) is in partition
+template <class datatype>
+bool blockpart<datatype>::isInPartition(int x, int y) {
+	return (x>=0 && x<nx && y>=0 && y<ny);
+}
+
+//Returns true if (x,y) is in the partition or in the border and held by an adjacent process
+template <class datatype>
+bool blockpart<datatype>::hasAccess(int x, int y) {
+	if(x>=0 && x<nx && y>=0 && y<ny) return true;
+	if(x<-1 || x>nx || y<-1 || y>ny) return false;
+	int kx = (x<0) ? -1 : ((x>=nx) ? 1 : 0);
+	int ky = (y<0) ? -1 : ((y>=ny) ? 1 : 0);
+	for(int k=1; k<=8; k++)
+		if(d1[k]==kx && d2[k]==ky) return (neighborRank[k] != MPI_PROC_NULL);
+	return false;
+}
+
+//Pointer to the border cells that are held by the adjacent process in direction k.
+//These are sent to that process by passBorders and received from it by share.
+template <class datatype>
+datatype *blockpart<datatype>::haloSegment(int k){
+	switch(k){
+		case 1: return rightBorder;
+		case 2: return topBorder+nx+1;
+		case 3: return topBorder+1;
+		case 4: return topBorder;
+		case 5: return leftBorder;
+		case 6: return bottomBorder;
+		case 7: return bottomBorder+1;
+		default: return bottomBorder+nx+1;
+	}
+}
+
+//Number of cells exchanged with the adjacent process in direction k
+template <class datatype>
+long blockpart<datatype>::segmentLength(int k){
+	if(k==1 || k==5) return ny;
+	if(k==3 || k==7) return nx;
+	return 1;
+}
+
+//Creates the persistent requests used to exchange borders with the adjacent processes.
+//Cells are sent from a preallocated buffer and received directly into the borders.  The tag
+//is the direction of the message from the sender, so the receiver expects the opposite
+//direction from the one in which the sender lies.
+template <class datatype>
+void blockpart<datatype>::initExchange() {
+	numExchangeRequests = 0;
+	if(size<=1) return;
+	long total = 0;
+	for(int k=1; k<=8; k++){
+		sendOffset[k] = total;
+		total += segmentLength(k);
+	}
+	sendBuffer = new datatype[total];
+	for(int k=1; k<=8; k++){
+		int opposite = (k+3)%8+1;
+		MPI_Recv_init(haloSegment(k), segmentLength(k), MPI_type, neighborRank[k], 100+opposite, MCW, &exchangeRequests[numExchangeRequests++]);
+		MPI_Send_init(sendBuffer+sendOffset[k], segmentLength(k), MPI_type, neighborRank[k], 100+k, MCW, &exchangeRequests[numExchangeRequests++]);
+	}
+}
+
+//Starts the exchange.  When fromBorders is false the edge cells of the partition are sent
+//(share), otherwise the border cells are sent back to the processes that hold them (passBorders).
+template <class datatype>
+void blockpart<datatype>::startExchange(bool fromBorders) {
+	if(size<=1) return;
+	if(numExchangeRequests<0) initExchange();
+	long y;
+	if(fromBorders){
+		for(int k=1; k<=8; k++)
+			memcpy(sendBuffer+sendOffset[k], haloSegment(k), segmentLength(k)*sizeof(datatype));
+	}else{
+		for(y=0; y<ny; y++){
+			sendBuffer[sendOffset[1]+y] = gridData[nx-1+y*nx];
+			sendBuffer[sendOffset[5]+y] = gridData[y*nx];
+		}
+		memcpy(sendBuffer+sendOffset[3], gridData, nx*sizeof(datatype));
+		memcpy(sendBuffer+sendOffset[7], gridData+(ny-1)*nx, nx*sizeof(datatype));
+		sendBuffer[sendOffset[2]] = gridData[nx-1];
+		sendBuffer[sendOffset[4]] = gridData[0];
+		sendBuffer[sendOffset[6]] = gridData[(ny-1)*nx];
+		sendBuffer[sendOffset[8]] = gridData[nx-1+(ny-1)*nx];
+	}
+	MPI_Startall(numExchangeRequests, exchangeRequests);
+}
+
+template <class datatype>
+void blockpart<datatype>::waitExchange() {
+	if(numExchangeRequests>0) MPI_Waitall(numExchangeRequests, exchangeRequests, MPI_STATUSES_IGNORE);
+}
+
+//Shares border information with the eight adjacent processes.  See linearpart for the
+//use of the Begin and End forms.
+template <class datatype>
+void blockpart<datatype>::shareBegin() {
+	startExchange(false);
+}
+
+template <class datatype>
+void blockpart<datatype>::shareEnd() {
+	waitExchange();
+}
+
+template <class datatype>
+void blockpart<datatype>::share() {
+	shareBegin();
+	shareEnd();
+}
+
+//Swaps border information between adjacent processes, so that afterwards the borders hold
+//the values that the adjacent processes had in their borders for the edge cells of this partition.
+template <class datatype>
+void blockpart<datatype>::passBordersBegin() {
+	startExchange(true);
+}
+
+template <class datatype>
+void blockpart<datatype>::passBordersEnd() {
+	waitExchange();
+}
+
+template <class datatype>
+void blockpart<datatype>::passBorders() {
+	passBordersBegin();
+	passBordersEnd();
+}
+
+//Adds a value received from an adjacent process to edge cell (x,y), or sets it to noData
+//if either is noData.
+template <class datatype>
+void blockpart<datatype>::addContribution(long x, long y, datatype val){
+	if(abs((float)(val-noData))<MINEPS || isNodata(x,y)) gridData[x+y*nx] = noData;
+	else gridData[x+y*nx] += val;
+}
+
+//Swaps border information between adjacent processes, then adds the values from received
+//borders to the edge cells.  Corner cells may receive values from three processes.
+template <class datatype>
+void blockpart<datatype>::addBorders(){
+	passBorders();
+	long i;
+	if(neighborRank[3] != MPI_PROC_NULL)
+		for(i=0; i<nx; i++) addContribution(i, 0, topBorder[i+1]);
+	if(neighborRank[7] != MPI_PROC_NULL)
+		for(i=0; i<nx; i++) addContribution(i, ny-1, bottomBorder[i+1]);
+	if(neighborRank[5] != MPI_PROC_NULL)
+		for(i=0; i<ny; i++) addContribution(0, i, leftBorder[i]);
+	if(neighborRank[1] != MPI_PROC_NULL)
+		for(i=0; i<ny; i++) addContribution(nx-1, i, rightBorder[i]);
+	if(neighborRank[4] != MPI_PROC_NULL) addContribution(0, 0, topBorder[0]);
+	if(neighborRank[2] != MPI_PROC_NULL) addContribution(nx-1, 0, topBorder[nx+1]);
+	if(neighborRank[6] != MPI_PROC_NULL) addContribution(0, ny-1, bottomBorder[0]);
+	if(neighborRank[8] != MPI_PROC_NULL) addContribution(nx-1, ny-1, bottomBorder[nx+1]);
+}
+
+//Clears borders (sets them to zero).
+template <class datatype>
+void blockpart<datatype>::clearBorders(){
+	long i;
+	for(i=0; i<nx+2; i++) topBorder[i] = bottomBorder[i] = 0;
+	for(i=0; i<ny; i++) leftBorder[i] = rightBorder[i] = 0;
+}
+
+//Converts global coordinates (for the whole grid) to local coordinates (for this
+//partition).  Function returns TRUE only if the coordinates are contained
+//in this partition.
+template <class datatype>
+bool blockpart<datatype>::globalToLocal(int globalX, int globalY, int &localX, int &localY){
+	localX = globalX - xoffset;
+	localY = globalY - yoffset;
+	return isInPartition(localX, localY);
+}
+
+//Converts local coordinates (for this partition) to the whole grid.
+template <class datatype>
+void blockpart<datatype>::localToGlobal(int localX, int localY, int &globalX, int &globalY){
+	globalX = localX + xoffset;
+	globalY = localY + yoffset;
+}
+
+template <class datatype>
+int blockpart<datatype>::getGridXY( int x, int y, int *i, int *j) {
+	*i = *j = -1;
+	if(x >= xoffset && x < xoffset+nx && y >= yoffset && y < yoffset+ny) {
+		*i = x - xoffset;
+		*j = y - yoffset;
+		return 1;
+	}
+	return 0;
+}
+
+//transferPack passes lists of columns to the processes above and below, which only has
+//meaning for a linear partition.  The tools that use it reject -block when their arguments are read.
+template <class datatype>
+void blockpart<datatype>::transferPack( int *, int *, int *, int *) {
+	if(size==1) return;
+	if(rank==0)
+	{
+		printf("This function is not supported with block partitions.  Run without the -block option.\n");
+		fflush(stdout);
+	}
+	MPI_Abort(MCW,44);
+}
+
+//Returns true if grid element (x,y) is equal to noData.
+template <class datatype>
+bool blockpart<datatype>::isNodata(long x, long y){
+	datatype *p = cellPointer(x,y);
+	if(p == NULL) return true;
+	return (abs((float)(*p-noData))<MINEPS);
+}
+
+//Sets the element in the grid to noData.
+template <class datatype>
+void blockpart<datatype>::setToNodata(long x, long y){
+	datatype *p = cellPointer(x,y);
+	if(p != NULL) *p = noData;
+}
+
+//Returns the element in the grid with coordinate (x,y).
+template <class datatype>
+datatype blockpart<datatype>::getData(long x, long y, datatype &val) {
+	datatype *p = cellPointer(x,y);
+	if(p != NULL) val = *p;
+	return val;
+}
+
+//Sets the element in the grid to the specified value.
+template <class datatype>
+void blockpart<datatype>::setData(long x, long y, datatype val){
+	datatype *p = cellPointer(x,y);
+	if(p != NULL) *p = val;
+}
+
+//Increments the element in the grid by the specified value.
+template <class datatype>
+void blockpart<datatype>::addToData(long x, long y, datatype val){
+	datatype *p = cellPointer(x,y);
+	if(p != NULL) *p += val;
+}
+#endif
@@ -0,0 +1,562 @@
+/*  Taudem parallel cached partition class
+
+  Partitions the grid by rows, holding the rows of each process in a bounded cache of tiles
+  backed by a scratch file, for grids larger than the memory of the processes.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+
+#include "mpi.h"
+#include "partition.h"
+#include "commonLib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <exception>
+#include <stdint.h>
+#include <list>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#ifndef CACHEDPART_H
+#define CACHEDPART_H
+using namespace std;
+
+//  Tiles of a cached partition are CACHE_TILE_SIZE by CACHE_TILE_SIZE cells
+const int CACHE_TILE_BITS = 8;
+const long CACHE_TILE_SIZE = 1L << CACHE_TILE_BITS;
+const long CACHE_TILE_CELLS = CACHE_TILE_SIZE*CACHE_TILE_SIZE;
+
+//  The rows of each process are divided as for linearpart and addressed the same way, with the
+//  rows y=-1 and y=ny holding the borders shared from the adjacent processes.  The border rows
+//  are held in memory.  Rows 0 to ny-1 are held as square tiles, of which at most the number
+//  that fit in the cache size (getCacheSize) are in memory.  When a tile is needed that is not
+//  in memory the least recently used tile is dropped, and written to a scratch file in TMPDIR
+//  (or /tmp) if it has changed.  Tiles are ordered for recency when the cell accessed moves
+//  from one tile to another, so tiles stay in memory around the cells being evaluated, the
+//  rows being scanned by a loop over the grid or the cells at the front of a queue.  Cells
+//  are only reached through the tdpartition accessors, so there is no grid pointer and the
+//  tools use their general paths for these partitions.  Grids are read and written a band of
+//  rows at a time with getRows and putRows (see tiffIO::read and tiffIO::write).  A cached
+//  partition is not thread safe, so getNumThreads is 1 when a cache size is set.
+template <class datatype>
+class cachedpart : public tdpartition {
+	protected:
+		int rank, size;
+		long yoffset;  //  Global row of local row 0
+		MPI_Datatype MPI_type;
+		datatype noData;
+		datatype *topBorder;
+		datatype *bottomBorder;
+
+		//  Tiles of the partition, tilesAcross by tilesDown, numbered by rows of tiles
+		long tilesAcross, tilesDown;
+		//  Tile memory, numSlots slots of CACHE_TILE_CELLS cells.  slotOfTile is the slot of
+		//  each tile, or -1 if the tile is not in memory, and tileOfSlot the tile in each slot.
+		datatype *slots;
+		long numSlots, numUsed;
+		vector<long> slotOfTile;
+		vector<long> tileOfSlot;
+		vector<bool> dirty;     //  Slot changed since the tile was loaded
+		vector<bool> onDisk;    //  Tile has been written to the scratch file
+		//  Slots in order of use, most recent first
+		list<long> recency;
+		vector<list<long>::iterator> recencyPos;
+		//  Tile and slot of the last cell accessed
+		long lastTile;
+		long lastSlot;
+		datatype *lastData;
+
+		MPI_File scratch;
+		bool scratchOpen;
+		char scratchName[MAXLN];
+
+		datatype *loadTile(long tile);
+		void evictSlot(long slot);
+		void openScratch();
+		datatype *cell(long x, long y, bool changed);
+
+		//  Persistent requests and send buffer for exchanging borders, created on first use
+		MPI_Request exchangeRequests[4];
+		int numExchangeRequests;
+		datatype *sendBuffer;
+		void initExchange();
+		void startExchange();
+		void waitExchange();
+
+	public:
+		cachedpart():tdpartition(){slots=NULL; topBorder=NULL; bottomBorder=NULL; sendBuffer=NULL; numExchangeRequests=-1; scratchOpen=false;}
+		~cachedpart();
+
+		void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd);
+		bool isInPartition(int x, int y);
+		bool hasAccess(int x, int y);
+
+		void share();
+		void shareBegin();
+		void shareEnd();
+		void passBorders();
+		void passBordersBegin();
+		void passBordersEnd();
+		void addBorders();
+		void clearBorders();
+
+		bool globalToLocal(int globalX, int globalY, int &localX, int &localY);
+		void localToGlobal(int localX, int localY, int &globalX, int &globalY);
+
+		int getGridXY( int x,int y, int *i, int *j);
+		void transferPack( int *, int *, int *, int*);
+
+		bool hasByteCells(){return sizeof(datatype) == 1;}
+		bool isNodata(long x, long y);
+		void setToNodata(long x, long y);
+		datatype getData(long x, long y, datatype &val);
+		void setData(long x, long y, datatype val);
+		void addToData(long x, long y, datatype val);
+
+		void getRows(long y, long numRows, void *dest);
+		void putRows(long y, long numRows, const void *source);
+};
+
+
+//Destructor.  Frees memory and closes the scratch file, which is deleted on close.
+template <class datatype>
+cachedpart<datatype>::~cachedpart(){
+	int finalized;
+	MPI_Finalized(&finalized);
+	if(!finalized) {
+		for(int i=0; i<numExchangeRequests; i++) MPI_Request_free(&exchangeRequests[i]);
+		if(scratchOpen) MPI_File_close(&scratch);
+	}
+	delete [] slots;
+	delete [] topBorder;
+	delete [] bottomBorder;
+	delete [] sendBuffer;
+}
+
+//Init routine.  Takes the same arguments as linearpart::init.  Only the tile slots for the cache
+//size and the border rows are allocated.  Tiles start as noData without being stored.
+template <class datatype>
+void cachedpart<datatype>::init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd){
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+
+	this->totalx = totalx;
+	this->totaly = totaly;
+	nx = totalx;
+	//  Use the row split set for this grid if there is one, otherwise divide rows evenly
+	if(!getRowSplit(totaly, rank, yoffset, ny)) {
+		ny = totaly / size;
+		yoffset = rank * ny;
+		if(rank == size-1)  ny += (totaly % size); //Add extra rows to the last process
+	}
+	dx = dx_in;
+	dy = dy_in;
+	MPI_type = MPIt;
+	noData = nd;
+
+	tilesAcross = (nx + CACHE_TILE_SIZE - 1) >> CACHE_TILE_BITS;
+	tilesDown = (ny + CACHE_TILE_SIZE - 1) >> CACHE_TILE_BITS;
+	long numTiles = tilesAcross*tilesDown;
+	//  Evaluating a cell uses the rows above and below it, so the cache holds at least two
+	//  rows of tiles whatever its size
+	numSlots = (long)(getCacheSize()*1048576./(CACHE_TILE_CELLS*sizeof(datatype)));
+	if(numSlots < 2*tilesAcross+2) numSlots = 2*tilesAcross+2;
+	if(numSlots > numTiles) numSlots = numTiles;
+	numUsed = 0;
+	try
+	{
+		slots = new datatype[(uint64_t)numSlots*CACHE_TILE_CELLS];
+		topBorder = new datatype[nx];
+		bottomBorder = new datatype[nx];
+	}
+	catch(bad_alloc&)
+	{
+		fprintf(stdout,"Memory allocation error during partition initialization in process %d.\n",rank);
+		fprintf(stdout,"NCols: %ld, NRows: %ld, cache tiles: %ld\n",nx,ny,numSlots);
+		fflush(stdout);
+		MPI_Abort(MCW,-999);
+	}
+	slotOfTile.assign(numTiles, -1);
+	tileOfSlot.assign(numSlots, -1);
+	dirty.assign(numSlots, false);
+	onDisk.assign(numTiles, false);
+	recencyPos.resize(numSlots);
+	lastTile = -1;
+	lastSlot = -1;
+	lastData = NULL;
+	for(long i=0; i<nx; i++) {
+		topBorder[i] = noData;
+		bottomBorder[i] = noData;
+	}
+	sprintf(scratchName, "%s/taudem%d_%d_%p.tmp", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", (int)getpid(), rank, (void*)this);
+
+	after1=after2=before1=before2=NULL;
+}
+
+//Opens the scratch file on the first write of a tile.  The file is deleted when it is closed.
+template <class datatype>
+void cachedpart<datatype>::openScratch(){
+	int file_error = MPI_File_open(MPI_COMM_SELF, scratchName, MPI_MODE_RDWR | MPI_MODE_CREATE | MPI_MODE_DELETE_ON_CLOSE, MPI_INFO_NULL, &scratch);
+	if(file_error != MPI_SUCCESS) {
+		printf("Error opening scratch file %s in process %d.\n", scratchName, rank);
+		fflush(stdout);
+		MPI_Abort(MCW,-999);
+	}
+	scratchOpen = true;
+}
+
+//Frees slot, writing its tile to the scratch file if it has changed
+template <class datatype>
+void cachedpart<datatype>::evictSlot(long slot){
+	long tile = tileOfSlot[slot];
+	if(dirty[slot]) {
+		if(!scratchOpen) openScratch();
+		MPI_Status status;
+		MPI_Offset offset = (MPI_Offset)tile*CACHE_TILE_CELLS*sizeof(datatype);
+		if(MPI_File_write_at(scratch, offset, slots+(uint64_t)slot*CACHE_TILE_CELLS, CACHE_TILE_CELLS*sizeof(datatype), MPI_BYTE, &status) != MPI_SUCCESS) {
+			printf("Error writing scratch file %s in process %d.\n", scratchName, rank);
+			fflush(stdout);
+			MPI_Abort(MCW,-999);
+		}
+		onDisk[tile] = true;
+		dirty[slot] = false;
+	}
+	slotOfTile[tile] = -1;
+	tileOfSlot[slot] = -1;
+	if(tile == lastTile) lastTile = -1;
+}
+
+//Returns the data of tile, loading it into the least recently used slot if it is not in memory,
+//and makes it the most recently used tile
+template <class datatype>
+datatype *cachedpart<datatype>::loadTile(long tile){
+	long slot = slotOfTile[tile];
+	if(slot >= 0) {
+		recency.splice(recency.begin(), recency, recencyPos[slot]);
+	}
+	else {
+		if(numUsed < numSlots) {
+			slot = numUsed++;
+			recency.push_front(slot);
+			recencyPos[slot] = recency.begin();
+		}
+		else {
+			slot = recency.back();
+			evictSlot(slot);
+			recency.splice(recency.begin(), recency, recencyPos[slot]);
+		}
+		datatype *data = slots+(uint64_t)slot*CACHE_TILE_CELLS;
+		if(onDisk[tile]) {
+			MPI_Status status;
+			MPI_Offset offset = (MPI_Offset)tile*CACHE_TILE_CELLS*sizeof(datatype);
+			MPI_File_read_at(scratch, offset, data, CACHE_TILE_CELLS*sizeof(datatype), MPI_BYTE, &status);
+		}
+		else
+			for(long i=0; i<CACHE_TILE_CELLS; i++) data[i] = noData;
+		slotOfTile[tile] = slot;
+		tileOfSlot[slot] = tile;
+	}
+	lastTile = tile;
+	lastSlot = slot;
+	lastData = slots+(uint64_t)slot*CACHE_TILE_CELLS;
+	return lastData;
+}
+
+//Returns a pointer to cell (x,y) for 0<=x<nx and 0<=y<ny.  changed marks the tile for writing
+//to the scratch file when it is dropped.
+template <class datatype>
+inline datatype *cachedpart<datatype>::cell(long x, long y, bool changed){
+	long tile = (y >> CACHE_TILE_BITS)*tilesAcross + (x >> CACHE_TILE_BITS);
+	if(tile != lastTile) loadTile(tile);
+	if(changed) dirty[lastSlot] = true;
+	return lastData + ((y & (CACHE_TILE_SIZE-1)) << CACHE_TILE_BITS) + (x & (CACHE_TILE_SIZE-1));
+}
+
+//Copies rows y to y+numRows-1 of the partition to dest, numRows by nx cells of datatype
+template <class datatype>
+void cachedpart<datatype>::getRows(long y, long numRows, void *dest){
+	datatype *out = (datatype*)dest;
+	for(long r=0; r<numRows; r++)
+		for(long x=0; x<nx; x+=CACHE_TILE_SIZE) {
+			long n = (nx-x < CACHE_TILE_SIZE) ? nx-x : CACHE_TILE_SIZE;
+			memcpy(out+r*nx+x, cell(x, y+r, false), n*sizeof(datatype));
+		}
+}
+
+//Copies numRows by nx cells of datatype from source to rows y to y+numRows-1 of the partition
+template <class datatype>
+void cachedpart<datatype>::putRows(long y, long numRows, const void *source){
+	const datatype *in = (const datatype*)source;
+	for(long r=0; r<numRows; r++)
+		for(long x=0; x<nx; x+=CACHE_TILE_SIZE) {
+			long n = (nx-x < CACHE_TILE_SIZE) ? nx-x : CACHE_TILE_SIZE;
+			memcpy(cell(x, y+r, true), in+r*nx+x, n*sizeof(datatype));
+		}
+}
+
+
+//Returns true if (x,y) is in partition
+template <class datatype>
+bool cachedpart<datatype>::isInPartition(int x, int y) {
+	if(x>=0 && x<nx && y>=0 && y<ny) return true;
+	else return false;
+}
+
+//Returns true if (x,y) is in or on borders of partition
+template <class datatype>
+bool cachedpart<datatype>::hasAccess( int x, int y) {
+	if(x>=0 && x<nx && y>=0 && y<ny) return true;
+	else if(x>=0 && x<nx ) {
+		if(rank !=0 && y==-1) return true;
+		if(rank !=size-1 && y==ny) return true;
+	}
+	return false;
+}
+
+//Creates the persistent requests used to exchange borders with the adjacent processes, as for
+//linearpart
+template <class datatype>
+void cachedpart<datatype>::initExchange() {
+	numExchangeRequests = 0;
+	if(size<=1) return;
+	sendBuffer = new datatype[2*nx];
+	if(rank>0){
+		MPI_Recv_init(topBorder, nx, MPI_type, rank-1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+		MPI_Send_init(sendBuffer, nx, MPI_type, rank-1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+	}
+	if(rank<size-1){
+		MPI_Recv_init(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+		MPI_Send_init(sendBuffer+nx, nx, MPI_type, rank+1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+	}
+}
+
+//Starts sending the rows in the send buffer to the processes above and below
+template <class datatype>
+void cachedpart<datatype>::startExchange() {
+	MPI_Startall(numExchangeRequests, exchangeRequests);
+}
+
+template <class datatype>
+void cachedpart<datatype>::waitExchange() {
+	if(numExchangeRequests>0) MPI_Waitall(numExchangeRequests, exchangeRequests, MPI_STATUSES_IGNORE);
+}
+
+//Shares border information between adjacent processes.  The first and last rows are copied
+//from the tiles to the send buffer and received into the border rows.
+template <class datatype>
+void cachedpart<datatype>::shareBegin() {
+	if(size<=1) return;
+	if(numExchangeRequests<0) initExchange();
+	if(rank>0) getRows(0, 1, sendBuffer);
+	if(rank<size-1) getRows(ny-1, 1, sendBuffer+nx);
+	startExchange();
+}
+
+template <class datatype>
+void cachedpart<datatype>::shareEnd() {
+	waitExchange();
+}
+
+template <class datatype>
+void cachedpart<datatype>::share() {
+	shareBegin();
+	shareEnd();
+}
+
+//Swaps border information between adjacent processes, as for linearpart
+template <class datatype>
+void cachedpart<datatype>::passBordersBegin() {
+	if(size<=1) return;
+	if(numExchangeRequests<0) initExchange();
+	if(rank>0) memcpy(sendBuffer, topBorder, nx*sizeof(datatype));
+	if(rank<size-1) memcpy(sendBuffer+nx, bottomBorder, nx*sizeof(datatype));
+	startExchange();
+}
+
+template <class datatype>
+void cachedpart<datatype>::passBordersEnd() {
+	waitExchange();
+}
+
+template <class datatype>
+void cachedpart<datatype>::passBorders() {
+	passBordersBegin();
+	passBordersEnd();
+}
+
+//Swaps border information between adjacent processes,
+//then adds the values from received borders to the local copies.
+//Borders that are not adjacent to another process are not added.
+template <class datatype>
+void cachedpart<datatype>::addBorders(){
+	passBorders();
+
+	long i;
+	for(i=0; i<nx; i++){
+		if(rank > 0){
+			if(isNodata(i,-1) || isNodata(i,0)) setData(i, 0, noData);
+			else addToData(i, 0, topBorder[i]);
+		}
+
+		if(rank < size-1){
+			if(isNodata(i, ny) || isNodata(i, ny-1)) setData(i, ny-1, noData);
+			else addToData(i, ny-1, bottomBorder[i]);
+		}
+	}
+}
+
+//Clears borders (sets them to zero).
+template <class datatype>
+void cachedpart<datatype>::clearBorders(){
+	for(long i=0; i<nx; i++){
+		topBorder[i] = 0;
+		bottomBorder[i] = 0;
+	}
+}
+
+
+template <class datatype>
+bool cachedpart<datatype>::globalToLocal(int globalX, int globalY, int &localX, int &localY){
+	localX = globalX;
+	localY = globalY - yoffset;
+	return isInPartition(localX, localY);
+}
+
+template <class datatype>
+void cachedpart<datatype>::localToGlobal(int localX, int localY, int &globalX, int &globalY){
+	globalX = localX;
+	globalY = yoffset + localY;
+}
+
+template <class datatype>
+int cachedpart<datatype>::getGridXY( int x, int y, int *i, int *j) {
+	*i = *j = -1;
+	int starty = yoffset;
+	int  endy = starty + ny;
+	if( x >= 0 && x < nx && y >= starty && y < endy) {
+		*i = x;
+		*j = y - starty;
+		return 1;
+	}
+	return 0;
+}
+
+//Sends countA ints of bufferAbove to the process above and countB ints of bufferBelow to the
+//process below, receiving into the same buffers, as for linearpart
+template <class datatype>
+void cachedpart<datatype>::transferPack( int *countA, int *bufferAbove, int *countB, int *bufferBelow) {
+	MPI_Status status;
+	if(size==1) return;
+
+	int place;
+	int absize = *countA*sizeof(int)+MPI_BSEND_OVERHEAD;
+	int bbsize = *countB*sizeof(int)+MPI_BSEND_OVERHEAD;
+	char *abuf = new char[absize];
+	char *bbuf = new char[bbsize];
+
+	if( rank >0 ) {
+		MPI_Buffer_attach(abuf,absize);
+		MPI_Bsend( bufferAbove, *countA, MPI_INT, rank-1, 3, MCW );
+		MPI_Buffer_detach(&abuf,&place);
+	}
+	if( rank < size-1) {
+		MPI_Probe( rank+1,3,MCW, &status);
+		MPI_Get_count( &status, MPI_INT, countA);
+		MPI_Recv( bufferAbove, *countA,MPI_INT, rank+1,3,MCW,&status);
+		MPI_Buffer_attach(bbuf,bbsize);
+		MPI_Bsend( bufferBelow, *countB, MPI_INT, rank+1,3,MCW);
+		MPI_Buffer_detach(&bbuf,&place);
+	}
+	if( rank > 0 ) {
+		MPI_Probe( rank-1,3,MCW, &status);
+		MPI_Get_count( &status, MPI_INT, countB);
+		MPI_Recv( bufferBelow, *countB,MPI_INT, rank-1,3,MCW,&status);
+	}
+
+	delete [] abuf;
+	delete [] bbuf;
+}
+
+//Returns true if grid element (x,y) is equal to noData.
+template <class datatype>
+bool cachedpart<datatype>::isNodata(long x, long y){
+	datatype val;
+	if(x<0 || x>=nx || y<-1 || y>ny) return true;
+	if(y == -1) val = topBorder[x];
+	else if(y == ny) val = bottomBorder[x];
+	else val = *cell(x, y, false);
+	return (abs((float)(val-noData))<MINEPS);
+}
+
+//Sets the element in the grid to noData.
+template <class datatype>
+void cachedpart<datatype>::setToNodata(long x, long y){
+	setData(x, y, noData);
+}
+
+//Returns the element in the grid with coordinate (x,y).
+template <class datatype>
+datatype cachedpart<datatype>::getData(long x, long y, datatype &val) {
+	if(x<0 || x>=nx || y<-1 || y>ny) return val;
+	if(y == -1) val = topBorder[x];
+	else if(y == ny) val = bottomBorder[x];
+	else val = *cell(x, y, false);
+	return val;
+}
+
+//Sets the element in the grid to the specified value.
+template <class datatype>
+void cachedpart<datatype>::setData(long x, long y, datatype val){
+	if(x<0 || x>=nx || y<-1 || y>ny) return;
+	if(y == -1) topBorder[x] = val;
+	else if(y == ny) bottomBorder[x] = val;
+	else *cell(x, y, true) = val;
+}
+
+//Increments the element in the grid by the specified value.
+template <class datatype>
+void cachedpart<datatype>::addToData(long x, long y, datatype val){
+	if(x<0 || x>=nx || y<-1 || y>ny) return;
+	if(y == -1) topBorder[x] += val;
+	else if(y == ny) bottomBorder[x] += val;
+	else *cell(x, y, true) += val;
+}
+#endif
@@ -41,10 +41,208 @@ email:  dtarb@usu.edu
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "commonLib.h"
+#include "tiffCodec.h"
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
+//  Partition type used by CreateNewPartition
+static PARTITION_TYPE partitionType = LINEAR_PARTITION;
 
+void setPartitionType(PARTITION_TYPE ptype)
+{
+	partitionType = ptype;
+}
+
+PARTITION_TYPE getPartitionType()
+{
+	return partitionType;
+}
+
+//  Compression of the grids written by tiffIO
+static COMPRESSION_TYPE outputCompression = NO_COMPRESSION;
+
+void setOutputCompression(COMPRESSION_TYPE ctype)
+{
+	outputCompression = ctype;
+}
+
+COMPRESSION_TYPE getOutputCompression()
+{
+	return outputCompression;
+}
+
+//  Tile size of the grids written by tiffIO, 0 for strips
+static long outputTileSize = 0;
+
+void setOutputTileSize(long size)
+{
+	outputTileSize = size;
+}
+
+long getOutputTileSize()
+{
+	return outputTileSize;
+}
+
+//  Memory mapping of input grids by CreateInputPartition
+static bool inputMapping = false;
+
+void setInputMapping(bool map)
+{
+	inputMapping = map;
+}
+
+bool getInputMapping()
+{
+	return inputMapping;
+}
+
+//  Cache size of cached partitions in megabytes, 0 for partitions held in memory
+static long cacheSize = 0;
+
+void setCacheSize(long megabytes)
+{
+	cacheSize = megabytes;
+}
+
+long getCacheSize()
+{
+	return cacheSize;
+}
+
+static bool wideAccumulation = false;
+
+void setWideAccumulation(bool wide)
+{
+	wideAccumulation = wide;
+}
+
+bool getWideAccumulation()
+{
+	return wideAccumulation;
+}
+
+//  First row of each process for BALANCED_PARTITION, with size+1 entries
+static long *rowSplit = NULL;
+static long rowSplitTotaly = -1;
+
+void setRowSplit(long totaly, double *rowWeight)
+{
+	int size;
+	MPI_Comm_size(MCW,&size);
+	delete [] rowSplit;
+	rowSplit = new long[size+1];
+	rowSplitTotaly = totaly;
+
+	double totalWeight = 0.;
+	for(long j=0; j<totaly; j++) totalWeight += rowWeight[j];
+
+	//  Process k starts at the first row where the cumulative weight reaches k/size of the 
+	//  total, while making sure every process gets at least one row if there are enough rows
+	double cumulative = 0.;
+	long j = 0;
+	rowSplit[0] = 0;
+	for(int k=1; k<size; k++) {
+		double target = totalWeight*k/size;
+		while(j < totaly && cumulative + rowWeight[j] <= target) {
+			cumulative += rowWeight[j];
+			j++;
+		}
+		long first = j;
+		if(totaly >= size) {
+			if(first < rowSplit[k-1]+1) first = rowSplit[k-1]+1;
+			if(first > totaly-(size-k)) first = totaly-(size-k);
+		}
+		while(j < first) cumulative += rowWeight[j++];
+		while(j > first) cumulative -= rowWeight[--j];
+		rowSplit[k] = first;
+	}
+	rowSplit[size] = totaly;
+}
+
+bool getRowSplit(long totaly, int rank, long &firstRow, long &numRows)
+{
+	if(rowSplit == NULL || totaly != rowSplitTotaly) return false;
+	firstRow = rowSplit[rank];
+	numRows = rowSplit[rank+1] - rowSplit[rank];
+	return true;
+}
+
+int getNumThreads()
+{
+#ifdef _OPENMP
+	int size, provided;
+	if(cacheSize > 0) return 1;
+	MPI_Comm_size(MCW,&size);
+	if(size == 1) return omp_get_max_threads();
+	//  With several processes threads are only used when asked for, since by default each process
+	//  would start a thread per core, and only if the threads may run alongside MPI calls.
+	MPI_Query_thread(&provided);
+	if(getenv("OMP_NUM_THREADS") != NULL && provided >= MPI_THREAD_FUNNELED) return omp_get_max_threads();
+#endif
+	return 1;
+}
+
+int parseGridOption(int argc, char **argv, int &i)
+{
+	if(strcmp(argv[i],"-block")==0)  //  Use a two dimensional block domain partition
+		setPartitionType(BLOCK_PARTITION);
+	else if(strcmp(argv[i],"-balance")==0)  //  Balance rows over processes by the number of valid cells
+		setPartitionType(BALANCED_PARTITION);
+	else if(strcmp(argv[i],"-mmap")==0)  //  Map input grids into memory rather than reading them
+		setInputMapping(true);
+	else if(argc > i+1 && strcmp(argv[i],"-compress")==0)  //  Write compressed tiled output grids
+	{
+		i++;
+		if(strcmp(argv[i],"deflate")==0) setOutputCompression(DEFLATE_COMPRESSION);
+		else if(strcmp(argv[i],"zstd")==0) setOutputCompression(ZSTD_COMPRESSION);
+		else return 0;
+		short compression = (getOutputCompression() == ZSTD_COMPRESSION) ? COMPRESS_ZSTD : COMPRESS_DEFLATE;
+		if(!encoderAvailable(compression)) {
+			printf("This build is unable to write %s compressed files.\n",argv[i]);
+			return 0;
+		}
+	}
+	else if(argc > i+1 && strcmp(argv[i],"-tile")==0)  //  Write tiled output grids
+	{
+		i++;
+		long tileSize = atol(argv[i]);
+		if(tileSize <= 0 || tileSize % 16 != 0) return 0;
+		setOutputTileSize(tileSize);
+	}
+	else if(argc > i+1 && strcmp(argv[i],"-cache")==0)  //  Hold at most a cache size of each grid in memory
+	{
+		i++;
+		long megabytes = atol(argv[i]);
+		if(megabytes <= 0) return 0;
+		setCacheSize(megabytes);
+	}
+	else return 0;
+	i++;
+	//  Tiles are assembled from grids held in memory
+	if(cacheSize > 0 && (outputTileSize > 0 || outputCompression != NO_COMPRESSION)) {
+		printf("Tiled or compressed output (-tile, -compress) is not supported with -cache.\n");
+		return 0;
+	}
+	return 1;
+}
+
+void printGridOptions()
+{
+	printf("The flag -block uses a two dimensional block partition of the grid.\n");
+	printf("The flag -balance divides rows so that processes have similar numbers of valid cells.\n");
+	printf("The option -compress deflate or -compress zstd writes compressed tiled output files.\n");
+	printf("The option -tile <size> writes tiled output files with tiles of size by size cells,\n");
+	printf("where size is a multiple of 16.  Compressed files have 256 by 256 tiles by default.\n");
+	printf("The flag -mmap maps uncompressed input grids into memory rather than reading them.\n");
+	printf("The option -cache <MB> holds at most MB megabytes of each grid in memory per process,\n");
+	printf("keeping the rest in scratch files in TMPDIR, for grids larger than memory.\n");
+	printf("It cannot be used with -tile or -compress, which are written from grids held in memory.\n");
+}
 
 //==================================
 /*  Nameadd(..)  Utility for adding suffixes to file names prior to
@@ -217,7 +415,7 @@ void initNeighborDinfup(tdpartition* neighbor,tdpartition* flowData,queue<node>
 					toBeEvaled.push(temp);
 				}
 			}
-			finished = neighbor->ringTerm( finished );
+			finished = neighbor->collectiveTerm( finished );
 		}
 
 		delete bufferAbove;
@@ -356,7 +554,7 @@ void initNeighborD8up(tdpartition* neighbor,tdpartition* flowData,queue<node> *q
 					toBeEvaled.push(temp);
 				}
 			}
-			finished = neighbor->ringTerm( finished );
+			finished = neighbor->collectiveTerm( finished );
 		}
 		delete bufferAbove;
 		delete bufferBelow;
@@ -373,3 +571,39 @@ bool pointsToMe(long col, long row, long ncol, long nrow, tdpartition *dirData){
 	}
 	return false;
 }
+
+//  After neighbor->addBorders(), puts on the queue the cells on the edges of the partition that
+//  received a contribution from another process and now have no contributing neighbors.
+//  A border cell contributes to the edge cell nearest to it, so a corner cell of a block
+//  partition can receive contributions from three processes.
+void queueBorderCells(tdpartition *neighbor, queue<node> *que)
+{
+	long nx = neighbor->getnx();
+	long ny = neighbor->getny();
+	long i,j,step;
+	node temp;
+	for(j=0; j<ny; j++){
+		//  Every cell of the first and last rows, and the first and last cells of other rows
+		step = (j==0 || j==ny-1) ? 1 : nx-1;
+		if(step < 1) step = 1;
+		for(i=0; i<nx; i+=step){
+			bool contributed = false;
+			for(int k=1; k<=8 && !contributed; k++){
+				long in = i+d1[k];
+				long jn = j+d2[k];
+				if(neighbor->isInPartition(in,jn) || !neighbor->hasAccess(in,jn)) continue;
+				//  Only border cells nearest to (i,j) contribute to it
+				if(d1[k] != 0 && in >= 0 && in < nx) continue;
+				if(d2[k] != 0 && jn >= 0 && jn < ny) continue;
+				short tempShort = 0;
+				if(neighbor->getData(in,jn,tempShort) != 0) contributed = true;
+			}
+			short tempShort = 0;
+			if(contributed && neighbor->getData(i,j,tempShort) == 0){
+				temp.x = i;
+				temp.y = j;
+				que->push(temp);
+			}
+		}
+	}
+}
@@ -64,10 +64,77 @@ enum DATA_TYPE
 	  LONG_TYPE,
 	  FLOAT_TYPE,
 	  DOUBLE_TYPE,
+	  BYTE_TYPE,      //  uint8_t
+	  BIT_TYPE,       //  0 or 1 in a bit packed partition (bitpart), read and written as BYTE_TYPE
+	  INT64_TYPE,     //  long long, which is 64 bits where long is not
 	  UNKNOWN_TYPE,
 	  INVALID_DATA_TYPE = -1
 	};
 
+//  Partition types that CreateNewPartition can create.  LINEAR_PARTITION divides the grid
+//  by rows.  BLOCK_PARTITION divides it in two dimensions over a grid of processes.
+//  BALANCED_PARTITION divides the grid by rows, sized so that each process has about the
+//  same number of valid cells in the first grid read.
+enum PARTITION_TYPE
+	{ LINEAR_PARTITION,
+	  BLOCK_PARTITION,
+	  BALANCED_PARTITION
+	};
+void setPartitionType(PARTITION_TYPE ptype);
+PARTITION_TYPE getPartitionType();
+
+//  Compression of output grids.  Compressed grids are written as tiles, each process compressing
+//  the tiles in its part of the grid.
+enum COMPRESSION_TYPE
+	{ NO_COMPRESSION,
+	  DEFLATE_COMPRESSION,
+	  ZSTD_COMPRESSION
+	};
+void setOutputCompression(COMPRESSION_TYPE ctype);
+COMPRESSION_TYPE getOutputCompression();
+
+//  Width and length of the tiles of output grids.  0, the default, writes uncompressed grids as
+//  strips of rows and compressed grids with tiles of a default size.
+void setOutputTileSize(long size);
+long getOutputTileSize();
+
+//  Input mapping.  When set, CreateInputPartition backs linear partitions of input grids with
+//  memory mappings of the files where the files allow.
+void setInputMapping(bool map);
+bool getInputMapping();
+
+//  Cache size in megabytes.  When set, CreateNewPartition creates cached partitions (cachedpart)
+//  that hold at most this much of each grid of a process in memory, and the rest in scratch
+//  files, in place of linear and balanced partitions.  0, the default, holds grids in memory.
+void setCacheSize(long megabytes);
+long getCacheSize();
+
+//  64 bit accumulation.  When set, the accumulation tools hold and write their results as 64
+//  bit grids, Int64 (INT64_TYPE) for counts of cells and Float64 (DOUBLE_TYPE) otherwise, in
+//  place of the default float grids, which count cells exactly only up to 2^24.
+void setWideAccumulation(bool wide);
+bool getWideAccumulation();
+
+//  Row split used by linear partitions of a grid with totaly rows.  setRowSplit computes the
+//  split from a weight for each row, the same on all processes.  getRowSplit returns false
+//  if no split has been set for a grid with totaly rows, in which case rows are divided evenly.
+void setRowSplit(long totaly, double *rowWeight);
+bool getRowSplit(long totaly, int rank, long &firstRow, long &numRows);
+
+//  Number of threads used by the threaded evaluation paths, set by OMP_NUM_THREADS.  Threads
+//  are used for single process runs, and for multiple process runs when OMP_NUM_THREADS is set
+//  and MPI was initialized with MPI_Init_thread at MPI_THREAD_FUNNELED.  This is 1 without OpenMP
+//  and when a cache size is set, since cached partitions are not thread safe.
+int getNumThreads();
+
+//  Options that set the partition and grid file state above, common to the tools that take them:
+//  -block, -balance, -compress deflate|zstd, -tile <size>, -mmap and -cache <MB>.  If argv[i] is
+//  one of them parseGridOption sets it, moves i past it and its value and returns 1.  It returns 0
+//  if argv[i] is not one of them, its value is invalid or it cannot be used with an option already
+//  given.  printGridOptions prints their usage lines.
+int parseGridOption(int argc, char **argv, int &i);
+void printGridOptions();
+
 //TODO: revisit this structure to see where it is used
 struct node {
 	int x;
@@ -96,6 +163,7 @@ int readoutlets(char *outletsfile, int *noutlets, double*& x, double*& y, int*&
 #include "linearpart.h"
 
 bool pointsToMe(long col, long row, long ncol, long nrow, tdpartition *dirData);
+void queueBorderCells(tdpartition *neighbor, queue<node> *que);
 
 /* void initNeighborDinfup(tdpartition* neighbor,tdpartition* flowData,queue<node> *que,
 					  int nx,int ny,int useOutlets, int *outletsX,int *outletsY,long numOutlets);
@@ -44,23 +44,56 @@ email:  dtarb@usu.edu
 #include "commonLib.h"
 #include "partition.h"
 #include "linearpart.h"
+#include "blockpart.h"
+#include "cachedpart.h"
+#include "bitpart.h"
+#include "tiffIO.h"
 
-tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, double dx, double dy, void* nodata){
-	//Currently, this just creates a new linear partition
-	//In the future, this could create any kind of partition, possibly using
-	//a "partition_type" flag as an argument
+inline tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, double dx, double dy, void* nodata){
+	//Creates a new partition of the type selected with setPartitionType (a linear partition
+	//by default).  Linear and balanced partitions are cached partitions when a cache size is
+	//set (setCacheSize).  Bit grids (BIT_TYPE) hold only 0, 1 and no data, and are bit packed
+	//partitions (bitpart) unless block or cached partitions are selected.
 	//Also note that any data types that can be used must be listed here
 
 	tdpartition* ptr = NULL;
+	bool block = (getPartitionType() == BLOCK_PARTITION);
+	bool cached = (!block && getCacheSize() > 0);
 	if(datatype == SHORT_TYPE){
-		ptr = new linearpart<short>;
+		if(block) ptr = new blockpart<short>;
+		else if(cached) ptr = new cachedpart<short>;
+		else ptr = new linearpart<short>;
 		ptr->init(totalx, totaly, dx, dy, MPI_SHORT, *((short*)nodata));
 	}else if(datatype == LONG_TYPE){
-		ptr = new linearpart<long>;
+		if(block) ptr = new blockpart<long>;
+		else if(cached) ptr = new cachedpart<long>;
+		else ptr = new linearpart<long>;
 		ptr->init(totalx, totaly, dx, dy, MPI_LONG, *((long*)nodata));
 	}else if(datatype == FLOAT_TYPE){
-		ptr = new linearpart<float>;
+		if(block) ptr = new blockpart<float>;
+		else if(cached) ptr = new cachedpart<float>;
+		else ptr = new linearpart<float>;
 		ptr->init(totalx, totaly, dx, dy, MPI_FLOAT, *((float*)nodata));
+	}else if(datatype == DOUBLE_TYPE){
+		if(block) ptr = new blockpart<double>;
+		else if(cached) ptr = new cachedpart<double>;
+		else ptr = new linearpart<double>;
+		ptr->init(totalx, totaly, dx, dy, MPI_DOUBLE, *((double*)nodata));
+	}else if(datatype == INT64_TYPE){
+		if(block) ptr = new blockpart<long long>;
+		else if(cached) ptr = new cachedpart<long long>;
+		else ptr = new linearpart<long long>;
+		ptr->init(totalx, totaly, dx, dy, MPI_LONG_LONG, *((long long*)nodata));
+	}else if(datatype == BYTE_TYPE){
+		if(block) ptr = new blockpart<uint8_t>;
+		else if(cached) ptr = new cachedpart<uint8_t>;
+		else ptr = new linearpart<uint8_t>;
+		ptr->init(totalx, totaly, dx, dy, MPI_UINT8_T, *((uint8_t*)nodata));
+	}else if(datatype == BIT_TYPE){
+		if(block) ptr = new blockpart<uint8_t>;
+		else if(cached) ptr = new cachedpart<uint8_t>;
+		else ptr = new bitpart;
+		ptr->init(totalx, totaly, dx, dy, MPI_UINT8_T, *((uint8_t*)nodata));
 	}
 	return ptr;
 }
@@ -70,16 +103,82 @@ tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, do
 	//Overloaded template version of the function
 	//Takes a constant as the nodata parameter, rather than a void pointer
 	tdpartition* ptr = NULL;
+	bool block = (getPartitionType() == BLOCK_PARTITION);
+	bool cached = (!block && getCacheSize() > 0);
 	if(datatype == SHORT_TYPE){
-		ptr = new linearpart<short>;
+		if(block) ptr = new blockpart<short>;
+		else if(cached) ptr = new cachedpart<short>;
+		else ptr = new linearpart<short>;
 		ptr->init(totalx, totaly, dx, dy, MPI_SHORT, (short)nodata);
 	}else if(datatype == LONG_TYPE){
-		ptr = new linearpart<long>;
+		if(block) ptr = new blockpart<long>;
+		else if(cached) ptr = new cachedpart<long>;
+		else ptr = new linearpart<long>;
 		ptr->init(totalx, totaly, dx, dy, MPI_LONG, (long)nodata);
 	}else if(datatype == FLOAT_TYPE){
-		ptr = new linearpart<float>;
+		if(block) ptr = new blockpart<float>;
+		else if(cached) ptr = new cachedpart<float>;
+		else ptr = new linearpart<float>;
 		ptr->init(totalx, totaly, dx, dy, MPI_FLOAT, (float)nodata);
+	}else if(datatype == DOUBLE_TYPE){
+		if(block) ptr = new blockpart<double>;
+		else if(cached) ptr = new cachedpart<double>;
+		else ptr = new linearpart<double>;
+		ptr->init(totalx, totaly, dx, dy, MPI_DOUBLE, (double)nodata);
+	}else if(datatype == INT64_TYPE){
+		if(block) ptr = new blockpart<long long>;
+		else if(cached) ptr = new cachedpart<long long>;
+		else ptr = new linearpart<long long>;
+		ptr->init(totalx, totaly, dx, dy, MPI_LONG_LONG, (long long)nodata);
+	}else if(datatype == BYTE_TYPE){
+		if(block) ptr = new blockpart<uint8_t>;
+		else if(cached) ptr = new cachedpart<uint8_t>;
+		else ptr = new linearpart<uint8_t>;
+		ptr->init(totalx, totaly, dx, dy, MPI_UINT8_T, (uint8_t)nodata);
+	}else if(datatype == BIT_TYPE){
+		if(block) ptr = new blockpart<uint8_t>;
+		else if(cached) ptr = new cachedpart<uint8_t>;
+		else ptr = new bitpart;
+		ptr->init(totalx, totaly, dx, dy, MPI_UINT8_T, (uint8_t)nodata);
 	}
 	return ptr;
 }
+
+//  Create a partition for an input grid of file that is read and then only read, or changed in
+//  few places.  With input mapping on (setInputMapping) a linear partition is backed by a private
+//  memory mapping of the file where the file allows (see tiffIO::mapRows), so the grid is not
+//  copied into memory and each process only touches the pages of its rows.  The read of the grid
+//  into the partition then returns without reading.  Mapped input grids are paged by the system,
+//  so they are not cached when a cache size is set.  Otherwise this is CreateNewPartition with
+//  the datatype and nodata value of file.
+inline tdpartition *CreateInputPartition(tiffIO &file){
+	if(getInputMapping() && getPartitionType() != BLOCK_PARTITION){
+		if(file.getDatatype() == SHORT_TYPE){
+			linearpart<short> *part = new linearpart<short>;
+			if(part->initMapped(file, MPI_SHORT, *((short*)file.getNodata()))) return part;
+			delete part;
+		}else if(file.getDatatype() == LONG_TYPE){
+			linearpart<long> *part = new linearpart<long>;
+			if(part->initMapped(file, MPI_LONG, *((long*)file.getNodata()))) return part;
+			delete part;
+		}else if(file.getDatatype() == FLOAT_TYPE){
+			linearpart<float> *part = new linearpart<float>;
+			if(part->initMapped(file, MPI_FLOAT, *((float*)file.getNodata()))) return part;
+			delete part;
+		}else if(file.getDatatype() == BYTE_TYPE){
+			linearpart<uint8_t> *part = new linearpart<uint8_t>;
+			if(part->initMapped(file, MPI_UINT8_T, *((uint8_t*)file.getNodata()))) return part;
+			delete part;
+		}else if(file.getDatatype() == DOUBLE_TYPE){
+			linearpart<double> *part = new linearpart<double>;
+			if(part->initMapped(file, MPI_DOUBLE, *((double*)file.getNodata()))) return part;
+			delete part;
+		}else if(file.getDatatype() == INT64_TYPE){
+			linearpart<long long> *part = new linearpart<long long>;
+			if(part->initMapped(file, MPI_LONG_LONG, *((long long*)file.getNodata()))) return part;
+			delete part;
+		}
+	}
+	return CreateNewPartition(file.getDatatype(), file.getTotalX(), file.getTotalY(), file.getdx(), file.getdy(), file.getNodata());
+}
 #endif
@@ -43,6 +43,9 @@ email:  dtarb@usu.edu
 #include "createpart.h"
 #include "commonLib.h"
 #include "tiffIO.h"
+#include "stages.h"
+#include "flats.h"
+#include "flowkernels.h"
 #include "Node.h"
 
 using namespace std;
@@ -120,7 +123,7 @@ void setFlow(int i, int j, tdpartition *flowDir, tdpartition *elevDEM, tdpartiti
 		if( aneigh > amax && slope >= 0 ) {
 			amax = aneigh;
 			dirnb = flowDir->getData(in,jn,tempShort);
-			if( dirnb > 0 && abs( dirnb -k ) != 4 ) {
+			if( dirnb > 0 && dirnb <= 8 && abs( dirnb -k ) != 4 ) {
 				flowDir->setData( i,j, k);
 			}
 		}
@@ -148,6 +151,70 @@ void setFlow(int i, int j, tdpartition *flowDir, tdpartition *elevDEM, tdpartiti
 	}
 }
 
+//  Versions of dontCross and setFlow for cells where isInterior is true, using the typed views
+//  of the partitions so that neighbors are accessed without virtual calls or border checks.
+static inline int dontCrossInterior( int k, long i, long j, linearpart<uint8_t> *flowL) {
+	switch(k){
+		case 2:
+			return (flowL->getDataUnchecked(i+d1[1],j+d2[1]) == 4 || flowL->getDataUnchecked(i+d1[3],j+d2[3]) == 8);
+		case 4:
+			return (flowL->getDataUnchecked(i+d1[3],j+d2[3]) == 6 || flowL->getDataUnchecked(i+d1[5],j+d2[5]) == 2);
+		case 6:
+			return (flowL->getDataUnchecked(i+d1[7],j+d2[7]) == 4 || flowL->getDataUnchecked(i+d1[5],j+d2[5]) == 8);
+		case 8:
+			return (flowL->getDataUnchecked(i+d1[1],j+d2[1]) == 6 || flowL->getDataUnchecked(i+d1[7],j+d2[7]) == 2);
+		default: break;
+	}
+	return 0;
+}
+
+static void setFlowInterior(long i, long j, linearpart<uint8_t> *flowL, linearpart<float> *elevL, linearpart<long> *areaL, int useflowfile) {
+	float slope,smax=0;
+	long in,jn;
+	short k,dirnb;
+	int aneigh = -1;
+	int amax=0;
+	float elev = elevL->getDataUnchecked(i,j);
+
+	for(k=1; k<=8 && !flowL->isNodataUnchecked(i,j); k+=2) {
+		in=i+d1[k];
+		jn=j+d2[k];
+
+		slope = fact[k] * ( elev - elevL->getDataUnchecked(in,jn) );
+		if( useflowfile == 1) {	
+			aneigh = areaL->getDataUnchecked(in,jn);
+		}
+		if( aneigh > amax && slope >= 0 ) {
+			amax = aneigh;
+			dirnb = flowL->getDataUnchecked(in,jn);
+			if( dirnb > 0 && dirnb <= 8 && abs( dirnb -k ) != 4 ) {
+				flowL->setDataUnchecked( i,j, k);
+			}
+		}
+		if( slope > smax ) {
+			smax=slope;
+			dirnb=flowL->getDataUnchecked(in,jn);
+			if( dirnb >0 && abs(dirnb-k) == 4)
+				flowL->setDataUnchecked(i,j,flowL->getNodataValue());
+			else flowL->setDataUnchecked(i,j,k);
+		}
+	}
+	for(k=2;k<=8 && !flowL->isNodataUnchecked(i,j) ; k+=2) {
+		in=i+d1[k];
+		jn=j+d2[k];
+
+		slope = fact[k] * ( elev - elevL->getDataUnchecked(in,jn) );
+
+		if( slope > smax  && dontCrossInterior(k,i,j,flowL)==0 ) {
+			smax = slope;
+			dirnb = flowL->getDataUnchecked(in,jn);
+			if( dirnb >0 && abs(dirnb-k) == 4)
+				flowL->setDataUnchecked(i,j,flowL->getNodataValue());
+			else flowL->setDataUnchecked(i,j,k);
+		}
+	}
+}
+
 //Calculate the slope information of flowDir to slope
 void calcSlope( tdpartition *flowDir, tdpartition *elevDEM, tdpartition *slope) {
 	float elevDiff, tempFloat;
@@ -157,7 +224,32 @@ void calcSlope( tdpartition *flowDir, tdpartition *elevDEM, tdpartition *slope)
 	int nx = elevDEM->getnx();
 	int ny = elevDEM->getny();
 
+	//  Typed views for the interior fast path
+	linearpart<uint8_t> *flowL = dynamic_cast<linearpart<uint8_t>*>(flowDir);
+	linearpart<float> *elevL = dynamic_cast<linearpart<float>*>(elevDEM);
+	linearpart<float> *slopeL = dynamic_cast<linearpart<float>*>(slope);
+	bool useFast = (flowL != NULL && elevL != NULL && slopeL != NULL);
+
+	//  Each cell depends only on flowDir and elevDEM so rows are shared out between threads
+	#pragma omp parallel for schedule(static) num_threads(getNumThreads()) private(elevDiff,tempFloat,in,jn,tempShort)
 	for( int j = 0; j < ny; j++) {
+		if(useFast && j > 0 && j < ny-1) {
+			//  Rows with all neighbors in the partition.  Only the first and last columns need the checks below.
+			uint8_t *flowRow = flowL->getRowPointer(j);
+			float *elevRow = elevL->getRowPointer(j);
+			float *slopeRow = slopeL->getRowPointer(j);
+			slope->setData(0,j,-1.0f);
+			for( int i=1; i < nx-1; i++ ) {
+				if(flowL->isNodataUnchecked(i,j)) slopeRow[i] = -1.0f;
+				else {
+					tempShort = flowRow[i];
+					elevDiff = elevRow[i] - elevL->getDataUnchecked(i+d1[tempShort],j+d2[tempShort]);
+					slopeRow[i] = float(elevDiff*fact[tempShort]);
+				}
+			}
+			if(nx > 1) slope->setData(nx-1,j,-1.0f);
+			continue;
+		}
 		for( int i=0; i < nx; i++ ) {
 			//If i,j is on the border or flowDir has no data, set slope(i,j) to slopeNoData 
 			if ( flowDir->isNodata(i,j) || !flowDir->hasAccess(i-1,j) || !flowDir->hasAccess(i+1,j) || 
@@ -176,10 +268,74 @@ void calcSlope( tdpartition *flowDir, tdpartition *elevDEM, tdpartition *slope)
 }
 
 
+//  Sets the flow directions of elevDEM where there is a positive slope, and the slope of every
+//  cell in slope.  flowDir holds any imposed directions on entry and the borders of elevDEM must
+//  have been shared.  Returns the number of flat cells in this partition.
+long setD8Slopes(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slope, int useflowfile)
+{
+	tdpartition *area;
+	area = CreateNewPartition(LONG_TYPE, elevDEM->gettotalx(), elevDEM->gettotaly(), elevDEM->getdx(), elevDEM->getdy(), long(-1));
+	long numFlat = setPosDir(elevDEM, flowDir, area, useflowfile);
+	delete area;
+	calcSlope( flowDir, elevDEM, slope);
+	return numFlat;
+}
+
+//  Sets the flow directions of the numFlat flat cells left by setD8Slopes
+void resolveD8Flats(tdpartition *elevDEM, tdpartition *flowDir, long numFlat)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long totalNumFlat;
+
+	MPI_Allreduce(&numFlat,&totalNumFlat,1,MPI_LONG,MPI_SUM,MCW);
+	if(rank==0)
+	{
+		fprintf(stderr,"All slopes evaluated. %ld flats to resolve.\n",totalNumFlat);
+		fflush(stderr);
+	}
+
+	if( totalNumFlat > 0)
+		resolveflats(elevDEM, flowDir);
+}
+
+//  Sets the directions of the flat cells left by setD8Slopes and setPosDirDinf in d8Dir and
+//  dinfDir, numFlatD8 and numFlatDinf in this partition, sharing the searches they have in common
+void resolveFlowFlats(tdpartition *elevDEM, tdpartition *d8Dir, long numFlatD8, tdpartition *dinfDir, long numFlatDinf)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long numFlat[2] = {numFlatD8, numFlatDinf};
+	long totalNumFlat[2];
+
+	MPI_Allreduce(numFlat,totalNumFlat,2,MPI_LONG,MPI_SUM,MCW);
+	if(rank==0)
+	{
+		fprintf(stderr,"All slopes evaluated. %ld D8 and %ld Dinf flats to resolve.\n",totalNumFlat[0],totalNumFlat[1]);
+		fflush(stderr);
+	}
+
+	tdpartition *flowDir[2];
+	const flatDirections *dirs[2];
+	int numGrids = 0;
+	if( totalNumFlat[0] > 0) {
+		flowDir[numGrids] = d8Dir;
+		dirs[numGrids++] = &d8Directions;
+	}
+	if( totalNumFlat[1] > 0) {
+		flowDir[numGrids] = dinfDir;
+		dirs[numGrids++] = &dinfDirections;
+	}
+	if( numGrids > 0)
+		resolveFlats(elevDEM, flowDir, dirs, numGrids);
+}
+
 //Open files, Initialize grid memory, makes function calls to set flowDir, slope, and resolvflats, writes files
-int setdird8( char* demfile, char* pointfile, char *slopefile, char *flowfile, int useflowfile) {
+//  With angfile and slpfile, which may be NULL, the Dinf directions and slopes are evaluated as well
+int setdird8( char* demfile, char* pointfile, char *slopefile, char *flowfile, int useflowfile, char *angfile, char *slpfile) {
 
-	MPI_Init(NULL,NULL);{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
 
 	//Only needed to output time
 	int rank,size;
@@ -201,7 +357,7 @@ int setdird8( char* demfile, char* pointfile, char *slopefile, char *flowfile, i
 	double dy = dem.getdy();
 	
 	tdpartition *elevDEM;
-	elevDEM = CreateNewPartition(dem.getDatatype(), totalX, totalY, dx, dy, dem.getNodata());
+	elevDEM = CreateInputPartition(dem);
 	int xstart, ystart;
 	int nx = elevDEM->getnx();
 	int ny = elevDEM->getny();
@@ -218,24 +374,24 @@ int setdird8( char* demfile, char* pointfile, char *slopefile, char *flowfile, i
 	}
 
 
-	dem.read(xstart, ystart, ny, nx, elevDEM->getGridPointer());
-	elevDEM->share();
+	dem.read(xstart, ystart, ny, nx, elevDEM);
+	//  Exchange borders while the other partitions are created
+	elevDEM->shareBegin();
 
 	double readt = MPI_Wtime();
 	
 	//Creates empty partition to store new flow direction 
 	tdpartition *flowDir;
-	short flowDirNodata = MISSINGSHORT;
-	flowDir = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, flowDirNodata);
+	//  Directions are 1 to 8 (0 while a cell is flat) so they are held as bytes
+	uint8_t flowDirNodata = 255;
+	flowDir = CreateNewPartition(BYTE_TYPE, totalX, totalY, dx, dy, flowDirNodata);
 
 //	flowDir = new linearpart<short>;
 
 //	flowDir->init(totalX, totalY, dx, dy, MPI_SHORT, short(-32768));
 
 	//If using flowfile is enabled, read it in
-	tdpartition *imposedflow, *area;
-	area = new linearpart<long>;
-	area->init(totalX, totalY, dx, dy, MPI_LONG, long(-1));
+	tdpartition *imposedflow;
 
 	if( useflowfile == 1) {
 		tiffIO flow(flowfile,SHORT_TYPE);
@@ -266,58 +422,57 @@ int setdird8( char* demfile, char* pointfile, char *slopefile, char *flowfile, i
 		//darea( &flowDir, &area, NULL, NULL, 0, 1, NULL, 0, 0 );
 	}
 
-	long numFlat, totalNumFlat, lastNumFlat;
+	long numFlat, numFlatDinf = 0;
+
+	//  Dinf directions from the same elevations, so that the DEM is read and the flats are searched once
+	tdpartition *ang = NULL;
+	float angNodata = MISSINGFLOAT;
+	if( angfile != NULL)
+		ang = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, angNodata);
 
 	double computeSlopet;
 	{
 		//Creates empty partition to store new slopes
-		tdpartition *slope;
+		tdpartition *slope, *slp = NULL;
 		float slopeNodata = -1.0f;
 		slope = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, slopeNodata);
+		if( ang != NULL)
+			slp = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, slopeNodata);
 	
-		numFlat = setPosDir(elevDEM, flowDir, area, useflowfile);
-		calcSlope( flowDir, elevDEM, slope);
+		elevDEM->shareEnd();
+		numFlat = setD8Slopes(elevDEM, flowDir, slope, useflowfile);
+		if( ang != NULL)
+			numFlatDinf = setPosDirDinf(elevDEM, ang, slp, 0);
 
 		//Stop timer
 		computeSlopet = MPI_Wtime();
 
 		tiffIO slopeIO(slopefile, FLOAT_TYPE, &slopeNodata, dem);
-		slopeIO.write(xstart, ystart, ny, nx, slope->getGridPointer());
+		slopeIO.write(xstart, ystart, ny, nx, slope);
+		if( slp != NULL) {
+			tiffIO slpIO(slpfile, FLOAT_TYPE, &slopeNodata, dem);
+			slpIO.write(xstart, ystart, ny, nx, slp);
+			delete slp;
+		}
 	}  // This bracket intended to destruct slope partition and release memory
 
 	double writeSlopet = MPI_Wtime();
 
-	MPI_Allreduce(&numFlat,&totalNumFlat,1,MPI_LONG,MPI_SUM,MCW);
-	if(rank==0)
-	{
-		fprintf(stderr,"All slopes evaluated. %ld flats to resolve.\n",totalNumFlat);
-		fflush(stderr);
-	}
-
-	queue<node> que;  //  que to be used in resolveflats
-	bool first=true;  //  Variable to be used in iteration to know whether first or subsequent iteration
-	if( totalNumFlat > 0)
-	{
-		lastNumFlat=totalNumFlat;
-		totalNumFlat = resolveflats(elevDEM, flowDir, &que, first);  
-		//Repeatedly call resolve flats until there is no change 
-		while(totalNumFlat > 0  && totalNumFlat < lastNumFlat)
-		{
-			if(rank==0)
-			{
-				fprintf(stderr,"Iteration complete. Number of flats remaining: %ld\n",totalNumFlat);
-				fflush(stderr);
-			}
-			lastNumFlat=totalNumFlat;
-			totalNumFlat = resolveflats(elevDEM, flowDir, &que, first);
-		}
-	}
+	if( ang != NULL)
+		resolveFlowFlats(elevDEM, flowDir, numFlat, ang, numFlatDinf);
+	else
+		resolveD8Flats(elevDEM, flowDir, numFlat);
 
 	//Timing info
 	double computeFlatt = MPI_Wtime();
 
-	tiffIO pointIO(pointfile, SHORT_TYPE, &flowDirNodata, dem);
-	pointIO.write(xstart, ystart, ny, nx, flowDir->getGridPointer());
+	tiffIO pointIO(pointfile, BYTE_TYPE, &flowDirNodata, dem);
+	pointIO.write(xstart, ystart, ny, nx, flowDir);
+	if( ang != NULL) {
+		tiffIO angIO(angfile, FLOAT_TYPE, &angNodata, dem);
+		angIO.write(xstart, ystart, ny, nx, ang);
+		delete ang;
+	}
 	double writet = MPI_Wtime();
  	double headerRead, dataRead, computeSlope, writeSlope, computeFlat,writeFlat, write, total,temp;
         headerRead = headert-begint;
@@ -367,9 +522,60 @@ long setPosDir(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *area, in
 		fact[k] = (double) (1./sqrt(d1[k]*dx*d1[k]*dx + d2[k]*d2[k]*dy*dy));
 	}
 
+	//  Typed views for the interior fast path
+	linearpart<uint8_t> *flowL = dynamic_cast<linearpart<uint8_t>*>(flowDir);
+	linearpart<float> *elevL = dynamic_cast<linearpart<float>*>(elevDEM);
+	linearpart<long> *areaL = dynamic_cast<linearpart<long>*>(area);
+	bool useFast = (flowL != NULL && elevL != NULL && areaL != NULL);
+
+	//  Without imposed directions the slopes of interior rows are found by the row kernel.  Only
+	//  the diagonal directions then depend on the directions already set, through dontCross.
+	//  Neighbors only flow to a cell lower than themselves, so the check in setFlow for a
+	//  neighbor flowing back is never true here.
+	bool useKernel = useFast && useflowfile == 0 && nx > 2;
+	vector<float> cardMax, diag;
+	vector<int> cardDir;
+	if(useKernel) {
+		cardMax.resize(nx-2);
+		cardDir.resize(nx-2);
+		diag.resize(4*(nx-2));
+	}
+
 	tempShort = 0;
 	for( j = 0; j < ny; j++) {
+		bool kernelRow = useKernel && j > 0 && j < ny-1;
+		if(kernelRow)
+			d8RowSlopes(elevL->getRowPointer(j-1)+1, elevL->getRowPointer(j)+1, elevL->getRowPointer(j+1)+1,
+				nx-2, fact, &cardMax[0], &cardDir[0], &diag[0]);
 		for( i=0; i < nx; i++ ) {
+			if(useFast && elevL->isInterior(i,j)) {
+				if(elevL->isNodataUnchecked(i,j)) continue;
+				con = 0;
+				for( k=1;k<=8 && con != -1;k++)
+					if( elevL->isNodataUnchecked(i+d1[k],j+d2[k]) ) con=-1;
+				if( con == -1 ) flowL->setDataUnchecked(i,j,flowL->getNodataValue());
+				else if(kernelRow) {
+					float smax = cardMax[i-1];
+					int dir = cardDir[i-1];
+					for( k=2; k<=8; k+=2) {
+						float slope = diag[(k/2-1)*(nx-2)+i-1];
+						if( slope > smax && dontCrossInterior(k,i,j,flowL)==0 ) {
+							smax = slope;
+							dir = k;
+						}
+					}
+					flowL->setDataUnchecked(i,j,(uint8_t)dir);
+					if( dir == 0)
+						numFlat++;
+				}
+				else {
+					flowL->setDataUnchecked(i,j,(uint8_t)0);
+					setFlowInterior( i,j, flowL, elevL, areaL, useflowfile);
+					if( flowL->getDataUnchecked(i,j)==0)
+						numFlat++;
+				}
+				continue;
+			}
 			//FlowDir is nodata if it is on the border OR elevDEM has no data
 			if ( elevDEM->isNodata(i,j) || !elevDEM->hasAccess(i-1,j) || !elevDEM->hasAccess(i+1,j) || 
 						!elevDEM->hasAccess(i,j-1) || !elevDEM->hasAccess(i,j+1) )  {
@@ -408,12 +614,13 @@ void setFlow2(int i,int j, tdpartition *flowDir, tdpartition *elevDEM, tdpartiti
 	A.  The neighbor is outside the flat set
 	B.  The neighbor is in the flat set.
 	In the case of A the input elevations are used and if a draining neighbor is found it is selected.  
-	Case B requires slope to be positive.  Remaining flats are removed by iterating this process*/
+	Case B requires slope to be positive.  Remaining flats are removed by drainFlats*/
 
 	float slope,smax,ed;
-	short in,jn,k;
+	long in,jn;
+	short k;
 	smax=0.;
-	short tempShort;
+	long tempLong;
 	float tempFloat;
 	short order[8]={1,3,5,7,2,4,6,8};
 	for(int ii=0;ii<8;ii++)  //k=1; k<=8; k=k+1)
@@ -421,10 +628,14 @@ void setFlow2(int i,int j, tdpartition *flowDir, tdpartition *elevDEM, tdpartiti
 		k=order[ii];
 		jn=j+d2[k];  //y
 		in=i+d1[k];  //x
-		dn->getData(in,jn,tempShort);
-		if(tempShort > 0)  // In flat
+		tempLong = 0;
+		dn->getData(in,jn,tempLong);
+		if(tempLong > 0)  // In flat
 		{
-			slope = fact[k]*(elev2->getData(i,j,tempShort)-elev2->getData(in,jn,tempShort));
+			long e1 = 0, e2 = 0;
+			elev2->getData(i,j,e1);
+			elev2->getData(in,jn,e2);
+			slope = fact[k]*(e1-e2);
 			if(slope > smax)
 			{
 				flowDir->setData(i,j,k);
@@ -445,226 +656,40 @@ void setFlow2(int i,int j, tdpartition *flowDir, tdpartition *elevDEM, tdpartiti
 
 //************************************************************************
 
-//Resolve flat cells according to Garbrecht and Martz
-long resolveflats( tdpartition *elevDEM, tdpartition *flowDir, queue<node> *que, bool &first) {
-	elevDEM->share();
-	flowDir->share();
-	//Header data
-	long totalx = elevDEM->gettotalx();
-	long totaly = elevDEM->gettotaly();
-	long nx = elevDEM->getnx();
-	long ny = elevDEM->getny();
-	double dx = elevDEM->getdx();
-	double dy = elevDEM->getdy();
-
-	int rank;
-	MPI_Comm_rank(MCW,&rank);
-
-	long i,j,k,in,jn;
-	bool doNothing, done;
-	long numFlat;
+//  Tests on D8 flow directions for flat resolution
+static bool isFlatD8(tdpartition *flowDir, long i, long j)
+{
 	short tempShort;
-	long tempLong;
-	float tempFloat;
-	long numInc, numIncOld, numIncTotal;
-
-	//create and initialize temporary storage for Garbrecht and Martz
-	tdpartition *elev2, *dn, *s;
-	elev2 = CreateNewPartition(SHORT_TYPE, totalx, totaly, dx, dy, 1);
-	   //  The assumption here is that resolving a flat does not increment a cell value 
-	   //  more than fits in a short
-	dn = CreateNewPartition(SHORT_TYPE, totalx, totaly, dx, dy, 0);
-
-	node temp;
-	long nflat=0, iflat;
-	//  First time through add flat grid cells indicated by flowdir = 0 on to queue
-	//  The queue is retained for later passes so this only needs be done at beginning
-	if(first)
-	{
-		first=false;
-		for(j=0; j<ny; j++){
-			for(i=0; i<nx; i++){
-				if(flowDir->getData(i,j,tempShort)==0)
-				{
-					temp.x=i; temp.y=j; que->push(temp); nflat++;
-				}
-			}
-		}
-	}
-	else
- 		nflat=que->size();
-	dn->share();
-	elev2->share();
-
-	//incfall - drain toward lower ground
-	// Setting up while loop to calculate elev2 - the grid draining to lower ground
-	done = false;
-	numIncOld = -1; //holds number of grid cells incremented on previous iteration 
-	//  use -1 to force inequality on first pass through
-	short st = 1; // used to indicate the level to which elev2 has been incremented 
-	float elevDiff;
-	numIncTotal = 0; 
-	if(rank==0)
-	{
-		fprintf(stderr,"Draining flats towards lower adjacent terrain\n");  
-		fflush(stderr);
-	}
-
-	while(numIncTotal != numIncOld){  // Continue to loop as long as grid cells are being incremented
-		numInc = 0;
-		numIncOld = numIncTotal;
-		for(iflat=0; iflat < nflat; iflat++)
-		{
-			temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
-
-				doNothing=false;
-				for(k=1; k<=8; k++){
-					if(dontCross(k,i,j, flowDir)==0){
-						jn = j + d2[k];
-						in = i + d1[k];
-						elevDiff = elevDEM->getData(i,j,tempFloat) - elevDEM->getData(in,jn,tempFloat);
-						tempShort=flowDir->getData(in,jn,tempShort); 
-						if(elevDiff >= 0 && tempShort > 0 && tempShort < 9) //adjacent cell drains and is equal or lower in elevation so this is a low boundary
-								doNothing = true;
-						else if(elevDiff == 0) //if neighbor is in flat
-							if(elev2->getData(in,jn,tempShort) >=0 && elev2->getData(in,jn,tempShort)<st) //neighbor is not being incremented
-								doNothing = true;
-					}
-				}
-				if(!doNothing){
-					elev2->addToData(i,j,short(1));
-					numInc++;
-				}
-		}
-		elev2->share();
-		MPI_Allreduce(&numInc, &numIncTotal, 1, MPI_LONG, MPI_SUM, MCW);
-		//  only break from while when total from all processes is no longer converging
-		st++;
-		if(rank==0)
-		{
-			fprintf(stderr,".");  // print a . at each pass to give an indication of progress
-			fflush(stderr);
-		}
-	}
-	if(numIncTotal > 0)  // Not all grid cells were resolved - pits remain
-		// Remaining grid cells are unresolvable pits
-	{
-		//There are pits remaining - set direction to no data
-		for(iflat=0; iflat < nflat; iflat++)
-		{
-			temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
-			doNothing=false;
-				for(k=1; k<=8; k++){
-					if(dontCross(k,i,j, flowDir)==0){
-						jn = j + d2[k];
-						in = i + d1[k];
-						elevDiff = elevDEM->getData(i,j,tempFloat) - elevDEM->getData(in,jn,tempFloat);
-						tempShort=flowDir->getData(in,jn,tempShort); 
-						if(elevDiff >= 0 && tempShort > 0 && tempShort < 9) //adjacent cell drains and is equal or lower in elevation so this is a low boundary
-								doNothing = true;
-						else if(elevDiff == 0) //if neighbor is in flat
-							if(elev2->getData(in,jn,tempShort) >=0 && elev2->getData(in,jn,tempShort)<st) //neighbor is not being incremented
-								doNothing = true;
-					}
-				}
-				if(!doNothing)
-					flowDir->setToNodata(i,j);  // mark pit
-					//flowDir->setData(i,j,short(9));  // mark pit
-		}
-		flowDir->share();
-		
-		//
-		//long total = 0;
-		//MPI_Allreduce(&allDone, &total, 1, MPI_LONG, MPI_SUM, MCW);
-		//if(total != 0)
-		//	done = false;
-		//if(numIncOld == 0)
-		//	done = true;
-	}
-	//  DGT moved from above - write directly into elev2
-	s = CreateNewPartition(SHORT_TYPE, totalx, totaly, dx, dy, 0);  //  Use 0 as no data to avoid need to initialize
-
-	//incrise - drain away from higher ground
-	done = false;
-	numIncOld = 0;
-	if(rank==0)
-	{
-		fprintf(stderr,"\nDraining flats away from higher adjacent terrain\n");  
-		fflush(stderr);
-	}
-
-	while(!done){
-		numInc = 0;
-		for(iflat=0; iflat < nflat; iflat++)
-		{
-				temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
-				for(k=1; k<=8; k++){
-					jn = j + d2[k];
-					in = i + d1[k];
-					if(elevDEM->getData(i,j,tempFloat) - elevDEM->getData(in,jn,tempFloat)<0)	//adjacent cell is higher
-						dn->setData(i,j,short(1));
-					if(dn->getData(in,jn,tempShort)>0 && s->getData(in,jn,tempShort)>0) //adjacent cell has been marked already
-						dn->setData(i,j,short(1));
-				}
-		} 
-		dn->share();
-		for(j=0; j<ny; j++){
-			for(i=0; i<nx; i++){
-				dn->getData(i,j,tempShort);
-				s->addToData(i,j,(tempShort>0 ? short(1) : short(0)));
-				if(tempShort>0) numInc++;
-			}
-		}
-		s->share();
-		dn->share();
-		MPI_Allreduce(&numInc, &numIncTotal, 1, MPI_LONG, MPI_SUM, MCW);
-		if(numIncTotal==numIncOld) done=true;
-		numIncOld = numIncTotal;
-		if(rank==0)
-		{
-			fprintf(stderr,".");  // print a . at each pass to give an indication of progress
-			fflush(stderr);
-		}
-	}
+	return flowDir->getData(i,j,tempShort) == 0;
+}
 
-	for(iflat=0; iflat < nflat; iflat++)
-	{
-			temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
+static bool drainsD8(tdpartition *flowDir, long i, long j)
+{
+	short tempShort;
+	flowDir->getData(i,j,tempShort);
+	return tempShort > 0 && tempShort < 9;
+}
 
-			elev2->addToData(i,j,s->getData(i,j,tempShort));
-	}
-	elev2->share();
+static void setPitD8(tdpartition *flowDir, long i, long j)
+{
+	flowDir->setToNodata(i,j);
+}
 
-	long localStillFlat = 0;
-	long totalStillFlat = 0;
+static void setDirectionD8(tdpartition *flowDir, long i, long j, int k)
+{
+	flowDir->setData(i,j,(short)k);
+}
 
-	if(rank==0)
-	{
-		fprintf(stderr,"\nSetting directions\n");  
-		fflush(stderr);
-	}
-	for(iflat=0; iflat < nflat; iflat++)
-	{
-				temp=que->front(); que->pop(); i=temp.x; j=temp.y; //  Do not push que on this last one - so que is empty at end
+static void setFromElevationsD8(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *elev2, tdpartition *dn,
+	long i, long j)
+{
+	setFlow2(i, j, flowDir, elevDEM, elev2, dn);
+}
 
-				setFlow2( i, j, flowDir, elevDEM, elev2, dn) ;
-				if(flowDir->getData(i,j,tempShort) == 0)
-				{
-					que->push(temp);
-					localStillFlat++;
-				}
-	}
+const flatDirections d8Directions = {isFlatD8, drainsD8, dontCross, setPitD8, setDirectionD8, setFromElevationsD8};
 
-	MPI_Allreduce(&localStillFlat, &totalStillFlat, 1, MPI_LONG, MPI_SUM, MCW);
-	if(totalStillFlat >0)  //  We will have to iterate again so overwrite original elevation with the modified ones and hope for the best
-	{
-		for(j=0; j<ny; j++)
-			for(i=0; i<nx; i++){
-				elevDEM->setData(i,j,(float)elev2->getData(i,j,tempShort));//set/add change jjn friday
-			}
-	}
-	delete elev2;  //  to avoid memory leaks
-	delete dn;
-	delete s;
-	return totalStillFlat;
+//Resolve flat cells according to Garbrecht and Martz
+void resolveflats( tdpartition *elevDEM, tdpartition *flowDir) {
+	const flatDirections *dirs = &d8Directions;
+	resolveFlats(elevDEM, &flowDir, &dirs, 1);
 }
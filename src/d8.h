@@ -4,8 +4,8 @@
 void writeSlope(tdpartition *flowDir, tdpartition *elevDEM, tdpartition* slopefile);
 
 //Open files, initialize grid memory....
-int setdird8( char* demfile, char* pointfile, char *slopefile, char *flowfile, int useflowfile);
+int setdird8( char* demfile, char* pointfile, char *slopefile, char *flowfile, int useflowfile, char *angfile, char *slpfile);
 
 long setPosDir( tdpartition *elevDEM, tdpartition *flowDir, tdpartition *flow, int useflowfile);
-long resolveflats( tdpartition *elevDEM, tdpartition *flowDir, queue<node> *que, bool &first);
+void resolveflats( tdpartition *elevDEM, tdpartition *flowDir);
 //int resolveflats( tdpartition *elevDEM, tdpartition *flowDir);
@@ -0,0 +1,249 @@
+/*  Taudem D8 accumulation
+
+  AreaD8, weighted AreaD8 and GridNet of the same D8 directions, evaluated together in one
+  topological sweep for taudem_pipeline.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#include <mpi.h>
+#include <math.h>
+#include <queue>
+#include <vector>
+#include "commonLib.h"
+#include "linearpart.h"
+#include "createpart.h"
+#include "stages.h"
+#include "initneighbor.h"
+#include "threadqueue.h"
+#include "d8cells.h"
+using namespace std;
+
+//  One of the flow algebras of d8cells.h, evaluated with others in the same sweep
+class d8Algebra {
+	public:
+		virtual ~d8Algebra() {}
+		virtual void evaluate(long i, long j) = 0;
+};
+
+template <class cellType>
+class d8AlgebraOf : public d8Algebra {
+	public:
+		cellType cells;
+		void evaluate(long i, long j) {cells.evaluate(i,j);}
+};
+
+//  The flow algebras evaluated at each cell, in the form drainQueueThreaded takes
+class d8AlgebraList {
+	public:
+		vector<d8Algebra*> algebras;
+		linearpart<uint8_t> *flowL;
+		void evaluate(long i, long j){
+			for(size_t a=0; a<algebras.size(); a++)
+				algebras[a]->evaluate(i,j);
+		}
+		bool drainsTo(long i, long j, short k){return flowL->getDataUnchecked(i,j) == k;}
+};
+
+//  The AreaD8 algebra for area, a grid of areaType
+template <class areaType>
+static d8Algebra *areaAlgebra(tdpartition *flowData, tdpartition *area, tdpartition *weightData,
+	int contcheck, int rank)
+{
+	d8AlgebraOf<areaD8Cells<areaType> > *algebra = new d8AlgebraOf<areaD8Cells<areaType> >;
+	areaD8Cells<areaType> &cells = algebra->cells;
+	cells.flowData = flowData;
+	cells.aread8 = area;
+	cells.weightData = weightData;
+	cells.flowL = dynamic_cast<linearpart<uint8_t>*>(flowData);
+	cells.areaL = dynamic_cast<linearpart<areaType>*>(area);
+	cells.useFast = (cells.flowL != NULL && cells.areaL != NULL);
+	cells.usew = (weightData != NULL) ? 1 : 0;
+	cells.contcheck = contcheck;
+	cells.rank = rank;
+	return algebra;
+}
+
+static d8Algebra *areaAlgebra(tdpartition *flowData, tdpartition *area, DATA_TYPE areaDatatype,
+	tdpartition *weightData, int contcheck, int rank)
+{
+	if(areaDatatype == DOUBLE_TYPE)
+		return areaAlgebra<double>(flowData, area, weightData, contcheck, rank);
+	else if(areaDatatype == INT64_TYPE)
+		return areaAlgebra<long long>(flowData, area, weightData, contcheck, rank);
+	return areaAlgebra<float>(flowData, area, weightData, contcheck, rank);
+}
+
+//  Evaluates AreaD8 and GridNet of the directions in flowData in one sweep.  The cells draining
+//  to each cell are counted once, and each cell taken off the queue is evaluated by every flow
+//  algebra asked for, so that the grids are exchanged in the same rounds.
+void evaluateD8Accumulations(tdpartition *flowData, tdpartition *aread8, DATA_TYPE areaDatatype,
+	tdpartition *weightData, tdpartition *ssa, DATA_TYPE ssaDatatype,
+	tdpartition *plen, tdpartition *tlen, tdpartition *gord, int contcheck)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long totalX = flowData->gettotalx();
+	long totalY = flowData->gettotaly();
+	double dx = flowData->getdx();
+	double dy = flowData->getdy();
+	int nx = flowData->getnx();
+	int ny = flowData->getny();
+	long i,j;
+	short k;
+	long in,jn;
+	bool finished;
+	short tempShort=0;
+	node temp;
+
+	/*  Calculate Distances  */
+	float dist[9];
+	for(i=1; i<=8; i++){
+		dist[i]=sqrt(d1[i]*d1[i]*dy*dy+d2[i]*d2[i]*dx*dx);
+	}
+
+	tdpartition *neighbor;
+	neighbor = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, MISSINGSHORT);
+
+	//  The grids evaluated, and the flow algebras that evaluate them
+	vector<tdpartition*> grids;
+	d8AlgebraList cells;
+	cells.flowL = dynamic_cast<linearpart<uint8_t>*>(flowData);
+	if(aread8 != NULL) {
+		grids.push_back(aread8);
+		cells.algebras.push_back(areaAlgebra(flowData, aread8, areaDatatype, NULL, contcheck, rank));
+	}
+	if(ssa != NULL) {
+		grids.push_back(ssa);
+		cells.algebras.push_back(areaAlgebra(flowData, ssa, ssaDatatype, weightData, contcheck, rank));
+	}
+	if(gord != NULL) {
+		grids.push_back(plen);
+		grids.push_back(tlen);
+		grids.push_back(gord);
+		d8AlgebraOf<gridnetCells> *algebra = new d8AlgebraOf<gridnetCells>;
+		algebra->cells.flowData = flowData;
+		algebra->cells.maskData = NULL;
+		algebra->cells.plen = plen;
+		algebra->cells.tlen = tlen;
+		algebra->cells.gord = gord;
+		algebra->cells.thresh = 0;
+		algebra->cells.dist = dist;
+		cells.algebras.push_back(algebra);
+
+		//Treat gord like area in aread8.  Initialize to 1
+		for(j=0; j<ny; j++)
+			for(i=0; i<nx; i++)
+				if(!flowData->isNodata(i,j))
+					gord->setData(i,j,(short)1);
+	}
+
+	//Share information and set borders to zero
+	flowData->share();
+	if(weightData != NULL) weightData->share();
+	for(size_t g=0; g<grids.size(); g++)
+		grids[g]->clearBorders();
+	neighbor->clearBorders();
+
+	queue<node> que;
+	initNeighborD8up(neighbor,flowData,&que,nx, ny, 0, NULL, NULL, 0);
+
+	linearpart<uint8_t> *flowL = cells.flowL;
+	linearpart<short> *neighborL = dynamic_cast<linearpart<short>*>(neighbor);
+	bool useFast = (flowL != NULL && neighborL != NULL);
+	int numThreads = getNumThreads();
+
+	finished = false;
+	//Ring terminating while loop
+	while(!finished) {
+		//  With threads the queue is evaluated by drainQueueThreaded and the loop below is skipped
+		if(numThreads > 1 && useFast)
+			drainQueueThreaded(que, neighborL, cells, numThreads);
+		while(!que.empty()){
+			//Takes next node with no contributing neighbors
+			temp = que.front();
+			que.pop();
+			i = temp.x;
+			j = temp.y;
+
+			if(flowData->isInPartition(i,j))
+				cells.evaluate(i,j);
+
+			// Decrement neighbor dependence of downslope cell
+			flowData->getData(i,j,k);
+			if(k>=1 && k <=8){
+				in = i+d1[k];
+				jn = j+d2[k];
+				if(useFast && flowL->isInterior(i,j))
+				{
+					neighborL->addToDataUnchecked(in,jn,(short)-1);
+					tempShort=neighborL->getDataUnchecked(in,jn);
+				}
+				else
+				{
+					neighbor->addToData(in,jn,(short)-1);
+					neighbor->getData(in,jn,tempShort);
+				}
+				//Check if neighbor needs to be added to que
+				if(flowData->isInPartition(in,jn) && tempShort == 0 ){
+					temp.x=in;
+					temp.y=jn;
+					que.push(temp);
+				}
+			}
+		}
+
+		//Pass information.  The borders of all the grids are exchanged while neighbor borders are added.
+		//grids holds the same grids in the same order on every process, as the exchanges require
+		//(see tdpartition::shareBegin).
+		for(size_t g=0; g<grids.size(); g++)
+			grids[g]->shareBegin();
+		neighbor->addBorders();
+
+		//If this created a cell with no contributing neighbors, put it on the queue
+		queueBorderCells(neighbor, &que);
+		//Clear out borders
+		neighbor->clearBorders();
+
+		//Check if done.  The vote is taken while the borders are completed.
+		neighbor->termBegin(que.empty());
+		for(size_t g=0; g<grids.size(); g++)
+			grids[g]->shareEnd();
+		finished = neighbor->termEnd();
+	}
+
+	for(size_t a=0; a<cells.algebras.size(); a++)
+		delete cells.algebras[a];
+	delete neighbor;
+}
@@ -0,0 +1,153 @@
+/*  Taudem D8 flow algebra cells
+
+  The flow algebra of AreaD8 and GridNet for one cell, evaluated once the cells that drain to
+  it have been evaluated, by the queue loops of each tool, by drainQueueThreaded, and together
+  in one sweep by evaluateD8Accumulations.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#ifndef D8CELLS_H
+#define D8CELLS_H
+
+#include <iostream>
+#include "commonLib.h"
+#include "linearpart.h"
+using namespace std;
+
+//  Flow algebra for D8 contributing area, used by the serial loop and by drainQueueThreaded.
+//  evaluate(i,j) evaluates the contributing area of cell (i,j), once all the cells that drain
+//  to it have been evaluated.  areaType is the type of the area grid: float, or double or
+//  long long for 64 bit accumulation.
+template <class areaType>
+class areaD8Cells {
+	public:
+		tdpartition *flowData, *aread8, *weightData;
+		linearpart<uint8_t> *flowL;
+		linearpart<areaType> *areaL;
+		bool useFast;
+		int usew, contcheck, rank;
+		void evaluate(long i, long j);
+		bool drainsTo(long i, long j, short k){return flowL->getDataUnchecked(i,j) == k;}
+};
+
+template <class areaType>
+void areaD8Cells<areaType>::evaluate(long i, long j)
+{
+	long in,jn;
+	short k;
+	bool con;
+	float tempFloat=0;
+	areaType tempArea=0;
+	short tempShort=0;
+
+	//  FLOW ALGEBRA Evaluation
+	//   Initialize
+	if( usew==1) 
+	{
+		if(!weightData->isNodata(i,j))
+			aread8->setData(i,j, (areaType)weightData->getData(i,j,tempFloat));
+	}
+	else aread8->setData(i,j,(areaType)1);
+	con=false;  //  Initially not contaminated
+	if(useFast && flowL->isInterior(i,j))
+	{
+		//  All neighbors are in this partition so no access checks are needed
+		for(k=1; k<=8; k++) {
+			in = i+d1[k];
+			jn = j+d2[k];
+			if(flowL->isNodataUnchecked(in,jn))
+				con=true;
+			else
+			{
+				tempShort=flowL->getDataUnchecked(in,jn);
+				if(tempShort-k == 4 || tempShort-k == -4)
+				{
+					if(areaL->isNodataUnchecked(in,jn))con=true;
+					else areaL->addToDataUnchecked(i,j,areaL->getDataUnchecked(in,jn));
+				}
+			}
+		}
+	}
+	else for(k=1; k<=8; k++) {
+		in = i+d1[k];
+		jn = j+d2[k];
+		if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
+			con=true;
+		else
+		{
+			flowData->getData(in,jn,tempShort);
+			if(tempShort-k == 4 || tempShort-k == -4)
+			{
+				if(aread8->isNodata(in,jn))con=true;
+				else
+				{
+					aread8->addToData(i,j,aread8->getData(in,jn,tempArea));
+				}
+			}
+		}
+	}
+	if(con && contcheck == 1)aread8->setToNodata(i,j);
+
+	flowData->getData(i,j,k);
+	if(k < 1 || k > 8)
+	{
+		#pragma omp critical
+		{
+			if(flowData->isNodata(i,j))
+				cout << "Warning: evaluating at location (most likely specified outlet) where flow direction is undefined. i = " << i << ", j = " << j <<  ", rank = " << rank << endl;
+			else
+				cout << "Warning: Invalid flow direction = " << k << " encountered at i = " << i << ", j = " << j <<  ", rank = " << rank << endl;
+		}
+	}
+}
+
+//  Flow algebra for path lengths and Strahler order, used by the serial loop and by
+//  drainQueueThreaded.  evaluate(i,j) evaluates cell (i,j), once all the cells that drain to it
+//  have been evaluated.  Cells are only counted where maskData is at least thresh, or every cell
+//  if maskData is NULL.
+class gridnetCells {
+	public:
+		tdpartition *flowData, *maskData, *plen, *tlen, *gord;
+		int thresh;
+		float *dist;
+		void evaluate(long i, long j);
+		bool drainsTo(long i, long j, short k){
+			short tempShort;
+			return flowData->getData(i,j,tempShort) == k && flowData->hasAccess(i+d1[k],j+d2[k]) &&
+				!flowData->isNodata(i+d1[k],j+d2[k]);
+		}
+};
+
+#endif
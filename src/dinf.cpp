@@ -43,17 +43,20 @@ email:  dtarb@usu.edu
 #include "createpart.h"
 #include "commonLib.h"
 #include "tiffIO.h"
+#include "stages.h"
+#include "flats.h"
+#include "flowkernels.h"
 #include <math.h>
 #include "Node.h"
 using namespace std;
 
-double fact[9];
+static double fact[9];
 
 //int setPosDirDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slope, tdpartition *area, int useflowfile);
 long setPosDirDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slope, int useflowfile);
-long resolveflats( tdpartition *elevDEM, tdpartition *flowDir, queue<node> *que, bool &first);
+static void resolveflats( tdpartition *elevDEM, tdpartition *flowDir);
 //Checks if cells cross
-int dontCross( int k, int i, int j, tdpartition *flowDir) {
+static int dontCross( int k, int i, int j, tdpartition *flowDir) {
 	long n1, n2, c1, c2, ans=0;
 	long in1,jn1,in2,jn2;
 	short tempShort;
@@ -102,11 +105,28 @@ int dontCross( int k, int i, int j, tdpartition *flowDir) {
 	return(ans);
 }
 
-//Set positive flowdirections of elevDEM
+//  Sets the flow directions of the numFlat flat cells left by setPosDirDinf
+void resolveDinfFlats(tdpartition *elevDEM, tdpartition *flowDir, long numFlat)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long totalNumFlat;
+
+	MPI_Allreduce(&numFlat,&totalNumFlat,1,MPI_LONG,MPI_SUM,MCW);
+	if(rank==0)
+	{
+		fprintf(stderr,"All slopes evaluated. %ld flats to resolve.\n",totalNumFlat);
+		fflush(stderr);
+	}
+
+	if( totalNumFlat > 0)
+		resolveflats(elevDEM, flowDir);
+}
 
 int setdir( char* demfile, char* angfile, char *slopefile, char *flowfile, int useflowfile) {
 
-	MPI_Init(NULL,NULL);{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
 
 	//Only needed to output time
 	int rank,size;
@@ -129,7 +149,7 @@ int setdir( char* demfile, char* angfile, char *slopefile, char *flowfile, int u
 	double dy = dem.getdy();
 	
 	tdpartition *elevDEM;
-	elevDEM = CreateNewPartition(dem.getDatatype(), totalX, totalY, dx, dy, dem.getNodata());
+	elevDEM = CreateInputPartition(dem);
 	int xstart, ystart;
 	int nx = elevDEM->getnx();
 	int ny = elevDEM->getny();
@@ -146,8 +166,8 @@ int setdir( char* demfile, char* angfile, char *slopefile, char *flowfile, int u
 	}
 
 
-	dem.read(xstart, ystart, ny, nx, elevDEM->getGridPointer());
-	elevDEM->share();
+	dem.read(xstart, ystart, ny, nx, elevDEM);
+	//  Borders of elevDEM are shared in setPosDirDinf
 
 	double readt = MPI_Wtime();
 	
@@ -191,7 +211,7 @@ int setdir( char* demfile, char* angfile, char *slopefile, char *flowfile, int u
 	//}
 
 	//Creates empty partition to store new slopes
-	long numFlat, totalNumFlat, lastNumFlat;
+	long numFlat;
 	double computeSlopet;
 	{
 	tdpartition *slope;
@@ -204,43 +224,19 @@ int setdir( char* demfile, char* angfile, char *slopefile, char *flowfile, int u
 	//Stop timer
 	computeSlopet = MPI_Wtime();
 	tiffIO slopeIO(slopefile, FLOAT_TYPE, &slopeNodata, dem);
-	slopeIO.write(xstart, ystart, ny, nx, slope->getGridPointer());
+	slopeIO.write(xstart, ystart, ny, nx, slope);
 	}  // This bracket intended to destruct slope partition and release memory
 
 	double writeSlopet = MPI_Wtime();
 
-	MPI_Allreduce(&numFlat,&totalNumFlat,1,MPI_LONG,MPI_SUM,MCW);
-	if(rank==0)
-	{
-		fprintf(stderr,"All slopes evaluated. %ld flats to resolve.\n",totalNumFlat);
-		fflush(stderr);
-	}
-
-	queue<node> que;  //  que to be used in resolveflats
-	bool first=true;  //  Variable to be used in iteration to know whether first or subsequent iteration
-	if( totalNumFlat > 0)
-	{
-		lastNumFlat=totalNumFlat;
-		totalNumFlat = resolveflats(elevDEM, flowDir, &que, first);  
-		//Repeatedly call resolve flats until there is no change 
-		while(totalNumFlat > 0  && totalNumFlat < lastNumFlat)
-		{
-			if(rank==0)
-			{
-				fprintf(stderr,"Iteration complete. Number of flats remaining: %ld\n",totalNumFlat);
-				fflush(stderr);
-			}
-			lastNumFlat=totalNumFlat;
-			totalNumFlat = resolveflats(elevDEM, flowDir, &que, first);
-		}
-	}
+	resolveDinfFlats(elevDEM, flowDir, numFlat);
 
 	//Timing info
 	double computeFlatt = MPI_Wtime();
 //	printf("Before angwrite rank: %d\n",rank);
 	float flowDirNodata=MISSINGFLOAT;
 	tiffIO flowIO(angfile, FLOAT_TYPE, &flowDirNodata, dem);
-	flowIO.write(xstart, ystart, ny, nx, flowDir->getGridPointer());
+	flowIO.write(xstart, ystart, ny, nx, flowDir);
 
 	double writet = MPI_Wtime();
 
@@ -278,34 +274,6 @@ int setdir( char* demfile, char* angfile, char *slopefile, char *flowfile, int u
 	MPI_Finalize();
 	return 0;
 }
-void   VSLOPE(float E0,float E1, float E2,
-			  float D1,float D2,float DD,
-			  float *S,float *A)
-{
-	//SUBROUTINE TO RETURN THE SLOPE AND ANGLE ASSOCIATED WITH A DEM PANEL 
-	float S1,S2,AD;
-	if(D1!=0)
-		S1=(E0-E1)/D1;
-	if(D2!=0)
-		S2=(E1-E2)/D2;
-
-	if(S2==0 && S1==0) *A=0;
-	else
-		*A= (float) atan2(S2,S1);
-	AD= (float) atan2(D2,D1);
-	if(*A  <   0.)
-	{
-		*A=0.;
-		*S=S1;
-	}
-	else if(*A > AD)
-	{
-		*A=AD;
-		*S=(E0-E2)/DD;
-	}
-	else
-		*S= (float) sqrt(S1*S1+S2*S2);
-}
 // Sets only flowDir only where there is a positive slope
 // Returns number of cells which are flat
 
@@ -370,7 +338,7 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 	float ANGLE[9];
 	float SMAX=0.0;
 	float tempFloat;
-	short tempShort, tempShort1, tempShort2;
+	long tempLong, tempLong1, tempLong2;
 	int K;
 	int KD=0;
 
@@ -386,9 +354,11 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 
 	for(K=1; K<=8; K++)
 	{
-		dn->getData(J+J1[K],I+I1[K],tempShort1);//Check each square to see if it is in the flat.  If it is in the flat, use artifical elevations if not use real elevations
-		dn->getData(J+J2[K],I+I2[K],tempShort2);//dn = 0 if it is not in the flat.  dn = 1 if in flat.
-		if(tempShort1 <= 0 && tempShort2 <= 0) { //Both E1 and E2 are outside the flat get slope and angle
+		tempLong1 = 0;
+		tempLong2 = 0;
+		dn->getData(J+J1[K],I+I1[K],tempLong1);//Check each square to see if it is in the flat.  If it is in the flat, use artifical elevations if not use real elevations
+		dn->getData(J+J2[K],I+I2[K],tempLong2);//dn = 0 if it is not in the flat.  dn = 1 if in flat.
+		if(tempLong1 <= 0 && tempLong2 <= 0) { //Both E1 and E2 are outside the flat get slope and angle
 			float a=elevDEM->getData(J,I,tempFloat);
 			float b=elevDEM->getData(J+J1[K],I+I1[K],tempFloat);
 			float c=elevDEM->getData(J+J2[K],I+I2[K],tempFloat);
@@ -419,7 +389,7 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 				}
 			}
 
-		}else if(tempShort1 <= 0 && tempShort2 >0){//E1 is outside of the flat and E2 is inside the flat. Use DEM elevations. tempShort2/E2 is in the artificial grid
+		}else if(tempLong1 <= 0 && tempLong2 >0){//E1 is outside of the flat and E2 is inside the flat. Use DEM elevations. tempLong2/E2 is in the artificial grid
 			float a=elevDEM->getData(J,I,tempFloat);
 			float b=elevDEM->getData(J+J1[K],I+I1[K],tempFloat);
 
@@ -430,9 +400,9 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 				KD=K;
 				break;
 			}
-			short a1=elev2->getData(J,I,tempShort);
-			short c1=elev2->getData(J+J2[K],I+I2[K],tempShort);
-			short b1=max(a1,c1);
+			long a1=elev2->getData(J,I,tempLong);
+			long c1=elev2->getData(J+J2[K],I+I2[K],tempLong);
+			long b1=max(a1,c1);
 			VSLOPE(
 				(float)a1,//felevg.d[J][I],
 				(float)b1,//[felevg.d[J+J1[K]][I+I1[K]],
@@ -447,7 +417,7 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 				SMAX=SK[K];
 				KD=K;
 			}
-		}else if(tempShort1 > 0 && tempShort2 <= 0){//E2 is out side of the flat and E1 is inside the flat, use DEM elevations
+		}else if(tempLong1 > 0 && tempLong2 <= 0){//E2 is out side of the flat and E1 is inside the flat, use DEM elevations
 			float a=elevDEM->getData(J,I,tempFloat);
 			//float b=elevDEM->getData(J+J1[K],I+I1[K],tempFloat);
 			float c=elevDEM->getData(J+J2[K],I+I2[K],tempFloat);
@@ -463,9 +433,9 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 			}
 			else
 			{
-				short a1=elev2->getData(J,I,tempShort);
-				short b1=elev2->getData(J+J1[K],I+I1[K],tempShort);
-				short c1=max(a1,b1);
+				long a1=elev2->getData(J,I,tempLong);
+				long b1=elev2->getData(J+J1[K],I+I1[K],tempLong);
+				long c1=max(a1,b1);
 				VSLOPE(
 					(float)a1,//felevg.d[J][I],
 					(float)b1,//[felevg.d[J+J1[K]][I+I1[K]],
@@ -483,7 +453,7 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 
 			}
 		}else{//Both E1 and E2 are in the flat. Use artificial elevation to get slope and angle
-			short a, b,c;
+			long a, b,c;
 			a = elev2->getData(J,I,a);
 			b = elev2->getData(J+J1[K],I+I1[K],b);
 			c = elev2->getData(J+J2[K],I+I2[K],c);
@@ -518,6 +488,43 @@ void   SET2(int I, int J,float *DXX,float DD, tdpartition *elevDEM, tdpartition
 			flowDir->setData(J,I,tempFloat);//set the angle in the flowPartition
 	}
 }
+//  Sets the directions and slopes of the cells of row j away from the partition edges, as SET2
+//  does, with the row kernel.  Returns the number of cells which are flat.
+static long setRowDinf(long j, linearpart<float> *elevL, linearpart<float> *flowL, linearpart<float> *slopeL)
+{
+	double dx = elevL->getdx();
+	double dy = elevL->getdy();
+	long nx = elevL->getnx();
+	long numFlat = 0;
+	int k, con;
+	float DXX[3] = {0,(float)dx,(float)dy};
+	float DD = sqrt(dx*dx+dy*dy);
+
+	//  Cells 1 to nx-2 of the row
+	float *flowRow = flowL->getRowPointer(j)+1;
+	float *slopeRow = slopeL->getRowPointer(j)+1;
+	vector<float> ang(nx-2);
+	dinfRowDirections(elevL->getRowPointer(j-1)+1, elevL->getRowPointer(j)+1, elevL->getRowPointer(j+1)+1,
+		nx-2, DXX, DD, &ang[0], slopeRow);
+
+	//  The slopes of cells that are no data or next to no data are put back to no data
+	for( long i=1; i < nx-1; i++) {
+		con = 0;
+		if( elevL->isNodataUnchecked(i,j)) con = 1;
+		else
+			for( k=1; k<=8 && con == 0; k++)
+				if( elevL->isNodataUnchecked(i+d1[k],j+d2[k])) con = -1;
+		if( con != 0) slopeRow[i-1] = slopeL->getNodataValue();
+		if( con == 1) continue;
+		if( con == -1) flowRow[i-1] = flowL->getNodataValue();
+		else {
+			flowRow[i-1] = ang[i-1];
+			if( ang[i-1] == -1) numFlat++;
+		}
+	}
+	return numFlat;
+}
+
 //int setPosDirDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slope, tdpartition *area, int useflowfile)
 long setPosDirDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slope, int useflowfile) {
 	double dx = elevDEM->getdx();
@@ -533,9 +540,27 @@ long setPosDirDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slop
 		fact[k] = (double) (1./sqrt(d1[k]*dx*d1[k]*dx + d2[k]*d2[k]*dy*dy));
 	}
 
+	//  Typed views for the row kernel, which evaluates the cells away from the partition edges
+	linearpart<float> *elevL = dynamic_cast<linearpart<float>*>(elevDEM);
+	linearpart<float> *flowL = dynamic_cast<linearpart<float>*>(flowDir);
+	linearpart<float> *slopeL = dynamic_cast<linearpart<float>*>(slope);
+	bool useFast = (elevL != NULL && flowL != NULL && slopeL != NULL);
+
+	//  Each cell depends only on elevDEM, so cells away from the partition edges are evaluated
+	//  while the borders are being exchanged, then the cells on the edges.  Rows are shared out
+	//  between threads.
+	elevDEM->shareBegin();
 	tempFloat = 0;
+	for( int jpass = 0; jpass < 2; jpass++) {
+	if( jpass == 1) elevDEM->shareEnd();
+	#pragma omp parallel for schedule(static) num_threads(getNumThreads()) private(i,k,in,jn,con,tempFloat) reduction(+:numFlat)
 	for( j = 0; j < ny; j++) {
+		if( useFast && jpass == 0 && j > 0 && j < ny-1) {
+			if( nx > 2) numFlat += setRowDinf(j, elevL, flowL, slopeL);
+			continue;
+		}
 		for( i=0; i < nx; i++ ) {
+			if( (j == 0 || j == ny-1 || i == 0 || i == nx-1) != (jpass == 1)) continue;
 			//FlowDir is nodata if it is on the border OR elevDEM has no data
 			if ( elevDEM->isNodata(i,j) || !elevDEM->hasAccess(i-1,j) || !elevDEM->hasAccess(i+1,j) || 
 						!elevDEM->hasAccess(i,j-1) || !elevDEM->hasAccess(i,j+1) )  {
@@ -571,234 +596,52 @@ long setPosDirDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slop
 			}	
 		}
 	}
+	}
 	return numFlat;
 }
 
-//Resolve flat cells according to Garbrecht and Martz
-long resolveflats( tdpartition *elevDEM, tdpartition *flowDir, queue<node> *que, bool &first) {
-	elevDEM->share();
-	flowDir->share();
-	//Header data
-	long totalx = elevDEM->gettotalx();
-	long totaly = elevDEM->gettotaly();
-	long nx = elevDEM->getnx();
-	long ny = elevDEM->getny();
-	double dx = elevDEM->getdx();
-	double dy = elevDEM->getdy();
-
-	int rank;
-	MPI_Comm_rank(MCW,&rank);
-
-	long i,j,k,in,jn;
-	bool doNothing, done;
-	long numFlat;
-	short tempShort;
-	long tempLong;
+//  Tests on Dinf flow directions for flat resolution.  Flat cells are -1.
+static bool isFlatDinf(tdpartition *flowDir, long i, long j)
+{
 	float tempFloat;
-	long numInc, numIncOld, numIncTotal;
-
-	//create and initialize temporary storage for Garbrecht and Martz
-	tdpartition *elev2, *dn, *s;
-	elev2 = CreateNewPartition(SHORT_TYPE, totalx, totaly, dx, dy, 1);
-	   //  The assumption here is that resolving a flat does not increment a cell value 
-	   //  more than fits in a short
-	dn = CreateNewPartition(SHORT_TYPE, totalx, totaly, dx, dy, 0);
-
-	node temp;
-	long nflat=0, iflat;
-	//  First time through add flat grid cells indicated by flowdir = 0 on to queue
-	//  The queue is retained for later passes so this only needs be done at beginning
-	if(first)
-	{
-		first=false;
-		for(j=0; j<ny; j++){
-			for(i=0; i<nx; i++){
-				if(!flowDir->isNodata(i,j))
-				{
-					if(flowDir->getData(i,j,tempFloat) < 0.0)
-					{
-						temp.x=i; temp.y=j; que->push(temp);
-					}
-				}
-			}
-		}
-	}
- 	nflat=que->size();
-	dn->share();
-	elev2->share();
-
-	//incfall - drain toward lower ground
-	// Setting up while loop to calculate elev2 - the grid draining to lower ground
-	done = false;
-	numIncOld = -1; //holds number of grid cells incremented on previous iteration 
-	//  use -1 to force inequality on first pass through
-	short st = 1; // used to indicate the level to which elev2 has been incremented 
-	float elevDiff;
-	numIncTotal = 0; 
-	if(rank==0)
-	{
-		fprintf(stderr,"Draining flats towards lower adjacent terrain\n");  
-		fflush(stderr);
-	}
-
-	while(numIncTotal != numIncOld){  // Continue to loop as long as grid cells are being incremented
-		numInc = 0;
-		numIncOld = numIncTotal;
-		for(iflat=0; iflat < nflat; iflat++)
-		{
-			temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
-
-				doNothing=false;
-				for(k=1; k<=8; k++){
-					if(dontCross(k,i,j, flowDir)==0){
-						jn = j + d2[k];
-						in = i + d1[k];
-					elevDiff = elevDEM->getData(i,j,tempFloat) - elevDEM->getData(in,jn,tempFloat);// get elevations and elevation difference.
-					flowDir->getData(in,jn,tempFloat); //get current flow direction...
-					if(elevDiff >= 0 && tempFloat >= 0.0) //adjacent cell drains and is equal or lower in elevation so this is a low boundary
-						doNothing = true;//I don't have to do anything move on...
-					else if(elevDiff == 0) //if neighbor is in flat
-						if(elev2->getData(in,jn,tempShort) >=0 && elev2->getData(in,jn,tempShort)<st) //neighbor is not being incremented
-							doNothing = true;//I don't have to do anything
-				}
-			}
-			if(!doNothing){//if I still have to do something...
-				elev2->addToData(i,j,short(1));//increment the s partition in this cell by one.
-					numInc++;
-				}
-		}
-
-		elev2->share();
-		MPI_Allreduce(&numInc, &numIncTotal, 1, MPI_LONG, MPI_SUM, MCW);
-		//  only break from while when total from all processes is no longer converging
-		st++;
-		if(rank==0)
-		{
-			fprintf(stderr,".");  // print a . at each pass to give an indication of progress
-			fflush(stderr);
-		}
-	}
-	if(numIncTotal > 0)  // Not all grid cells were resolved - pits remain
-		// Remaining grid cells are unresolvable pits
-	{
-//			There are pits remaining - set direction to no data
-		for(iflat=0; iflat < nflat; iflat++)
-		{
-			temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
-			doNothing=false;
-				for(k=1; k<=8; k++){
-					if(dontCross(k,i,j, flowDir)==0){
-						jn = j + d2[k];
-						in = i + d1[k];
-						elevDiff = elevDEM->getData(i,j,tempFloat) - elevDEM->getData(in,jn,tempFloat);
-						flowDir->getData(in,jn,tempFloat); 
-						if(elevDiff >= 0 && tempFloat >= 0.) //adjacent cell drains and is equal or lower in elevation so this is a low boundary
-								doNothing = true;
-						else if(elevDiff == 0) //if neighbor is in flat
-							if(elev2->getData(in,jn,tempShort) >=0 && elev2->getData(in,jn,tempShort)<st) //neighbor is not being incremented
-								doNothing = true;
-					}
-				}
-				if(!doNothing)
-					flowDir->setData(i,j,MISSINGFLOAT);  // mark pit
-			}
-			flowDir->share();
-		
-		//numIncOld = numIncTotal;
-		//int total = 0;
-		//	MPI_Allreduce(&allDone, &total, 1, MPI_INT, MPI_SUM, MCW);//see if anybody as done any work.
-		//if(total != 0)//Somebody did some work.
-		//	done = false;
-		//if(numIncOld == 0)//Nobody did any work! we are done.
-		//	done = true;
-	}
-	//  DGT moved from above - write directly into elev2
-	s = CreateNewPartition(SHORT_TYPE, totalx, totaly, dx, dy, 0);  //  Use 0 as no data to avoid need to initialize
-
-	//incrise - drain away from higher ground
-	done = false;
-	numIncOld = 0;
-	if(rank==0)
-	{
-		fprintf(stderr,"\nDraining flats away from higher adjacent terrain\n");  
-		fflush(stderr);
-	}
-
-	while(!done){
-		numInc = 0;
-		for(iflat=0; iflat < nflat; iflat++)
-		{
-				temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
-				for(k=1; k<=8; k++){
-					jn = j + d2[k];
-					in = i + d1[k];
-					if(elevDEM->getData(i,j,tempFloat) - elevDEM->getData(in,jn,tempFloat)<0)	//adjacent cell is higher
-						dn->setData(i,j,short(1));//cell in flat
-					if(dn->getData(in,jn,tempShort)>0 && s->getData(in,jn,tempShort)>0) //adjacent cell has been marked already
-						dn->setData(i,j,short(1));
-				}
-		} 
-		dn->share();
-		for(j=0; j<ny; j++){
-			for(i=0; i<nx; i++){//add dn values to s
-				dn->getData(i,j,tempShort);
-				s->addToData(i,j,(tempShort>0 ? short(1) : short(0)));
-				if(tempShort>0) numInc++;
-			}
-		}
-		s->share();
-		dn->share();
-		MPI_Allreduce(&numInc, &numIncTotal, 1, MPI_LONG, MPI_SUM, MCW);
-		if(numIncTotal==numIncOld) done=true;
-		numIncOld = numIncTotal;
-		if(rank==0)
-		{
-			fprintf(stderr,".");  // print a . at each pass to give an indication of progress
-			fflush(stderr);
-		}
-	}
+	return !flowDir->isNodata(i,j) && flowDir->getData(i,j,tempFloat) < 0.0;
+}
 
-	for(iflat=0; iflat < nflat; iflat++)
-	{
-			temp=que->front(); que->pop(); i=temp.x; j=temp.y; que->push(temp);
+static bool drainsDinf(tdpartition *flowDir, long i, long j)
+{
+	float tempFloat;
+	return flowDir->getData(i,j,tempFloat) >= 0.0;
+}
 
-			elev2->addToData(i,j,s->getData(i,j,tempShort));
-	}
-	elev2->share();
+static void setPitDinf(tdpartition *flowDir, long i, long j)
+{
+	flowDir->setData(i,j,MISSINGFLOAT);
+}
 
-	long localStillFlat = 0;
-	long totalStillFlat = 0;
+//  The angle of the direction to neighbor k, counter clockwise from east
+static void setDirectionDinf(tdpartition *flowDir, long i, long j, int k)
+{
+	double angle = atan2(-d2[k]*flowDir->getdy(), d1[k]*flowDir->getdx());
+	if(angle < 0.) angle += 2*PI;
+	flowDir->setData(i,j,(float)angle);
+}
 
+static void setFromElevationsDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *elev2, tdpartition *dn,
+	long i, long j)
+{
+	double dx = elevDEM->getdx();
+	double dy = elevDEM->getdy();
 	float DXX[3] = {0,dx,dy};//tardemlib.cpp ln 1291
 	float DD = sqrt(dx*dx+dy*dy);//tardemlib.cpp ln 1293
-	if(rank==0)
-	{
-		fprintf(stderr,"\nSetting directions\n");  
-		fflush(stderr);
-	}
-	for(iflat=0; iflat < nflat; iflat++)
-	{
-			temp=que->front(); que->pop(); i=temp.x; j=temp.y; //  Do not push que on this last one - so que is empty at end
-				//  The logic here was to replace SETFLOW2 from D8 with SET2 so that it computes a DINF flow 
-				//  direction based on the artificial elevations 
-			SET2(j,i,DXX,DD,elevDEM,elev2,flowDir,dn);	//use new elevations to calculate flowDir.	
-			if(!flowDir->isNodata(i,j)&& flowDir->getData(i,j,tempFloat)< 0.) //this is still a flat
-			{
-				que->push(temp);
-				localStillFlat++;
-			}
-	}
+	//  The logic here was to replace SETFLOW2 from D8 with SET2 so that it computes a DINF flow 
+	//  direction based on the artificial elevations 
+	SET2(j,i,DXX,DD,elevDEM,elev2,flowDir,dn);	//use new elevations to calculate flowDir.	
+}
 
-	MPI_Allreduce(&localStillFlat, &totalStillFlat, 1, MPI_LONG, MPI_SUM, MCW);
-	if(totalStillFlat >0)  //  We will have to iterate again so overwrite original elevation with the modified ones and hope for the best
-	{
-		for(j=0; j<ny; j++)
-			for(i=0; i<nx; i++){
-				elevDEM->setData(i,j,(float)elev2->getData(i,j,tempShort));//set/add change jjn friday
-			}
-	}
-	delete elev2;  //  to avoid memory leaks
-	delete dn;
-	delete s;
-	return totalStillFlat;
+const flatDirections dinfDirections = {isFlatDinf, drainsDinf, dontCross, setPitDinf, setDirectionDinf, setFromElevationsDinf};
+
+//Resolve flat cells according to Garbrecht and Martz
+static void resolveflats( tdpartition *elevDEM, tdpartition *flowDir) {
+	const flatDirections *dirs = &dinfDirections;
+	resolveFlats(elevDEM, &flowDir, &dirs, 1);
 }
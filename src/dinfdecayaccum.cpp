@@ -47,6 +47,7 @@ email:  dtarb@usu.edu
 #include "createpart.h"
 #include "tiffIO.h"
 #include "initneighbor.h"
+#include "threadqueue.h"
 using namespace std;
 
 
@@ -58,11 +59,62 @@ using namespace std;
 //const short d2[9] = { 0,1, 1, 0,-1,-1,-1,0,1};
 // moved to commonlib.h
 
+//  Flow algebra for decayed specific catchment area, used by the serial loop and by
+//  drainQueueThreaded.  evaluate(i,j) evaluates cell (i,j) in the partition, once all the
+//  cells that drain to it have been evaluated.
+class decayCells {
+	public:
+		tdpartition *flowData, *daccum, *dmData, *weightData;
+		linearpart<float> *flowL;
+		int usew, contcheck;
+		double dx;
+		void evaluate(long i, long j);
+		bool drainsTo(long i, long j, short k){return prop(flowL->getDataUnchecked(i,j), k) > 0.;}
+};
+
+void decayCells::evaluate(long i, long j)
+{
+	long in,jn;
+	short k;
+	bool con;
+	float area,angle,dm,tempFloat;
+	double p;
+
+	//  Initialize the result
+	if( usew==1) daccum->setData(i,j,(weightData->getData(i,j,tempFloat)));
+	else daccum->setData(i,j,(float)dx);
+	con=false;  //  So far not edge contaminated
+	//test if neighbor drains towards cell excluding boundaries 
+	for(k=1; k<=8; k++) {
+		in = i+d1[k];
+		jn = j+d2[k];
+		//TODO - streamlining here
+		if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
+			con=true;
+		else{
+			flowData->getData(in,jn, angle);
+			p = prop(angle, (k+4)%8);
+			if(p>0.)
+			{
+				if(daccum->isNodata(in,jn)||dmData->isNodata(in,jn))con=true;
+				else
+				{
+					dmData->getData(in, jn, dm);
+					daccum->getData(in,jn,area);
+					daccum->addToData(i,j,(float)(dm*area*p));
+				}
+			}
+		}
+	}
+	if(con && contcheck==1)daccum->setToNodata(i,j);
+}
+
 int dmarea(char* angfile,char* adecfile,char* dmfile,char* shfile,char* wfile,
 		   int useOutlets,int usew,int contcheck)
 {
 
-	MPI_Init(NULL,NULL);{
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
 
 	//Only used for timing
 	int rank,size;
@@ -98,7 +150,7 @@ int dmarea(char* angfile,char* adecfile,char* dmfile,char* shfile,char* wfile,
 		}
 	}
  
-	float area,angle,dm=0.0;
+	float angle;
 	double p;
 
 	//Create tiff object, read and store header info
@@ -136,7 +188,7 @@ int dmarea(char* angfile,char* adecfile,char* dmfile,char* shfile,char* wfile,
 	dmm.read(xstart, ystart, dmData->getny(), dmData->getnx(), dmData->getGridPointer());
 
 	//if using weightData, get information from file
-	tdpartition *weightData;
+	tdpartition *weightData = NULL;
 	if( usew == 1){
 		tiffIO w(wfile, FLOAT_TYPE);
 		if(!ang.compareTiff(w)) {
@@ -164,12 +216,10 @@ int dmarea(char* angfile,char* adecfile,char* dmfile,char* shfile,char* wfile,
 	tdpartition *daccum;
 	daccum = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, MISSINGFLOAT);
 
-	// con is used to check for contamination at the edges
 	long i,j;
 	short k;
 	long in,jn;
-	bool con=false, finished;
-	float tempFloat=0;
+	bool finished;
 	short tempShort=0;
 
 	tdpartition *neighbor;
@@ -185,10 +235,25 @@ int dmarea(char* angfile,char* adecfile,char* dmfile,char* shfile,char* wfile,
 	queue<node> que;
 
 	initNeighborDinfup(neighbor,flowData,&que,nx, ny, useOutlets, outletsX, outletsY, numOutlets);
+
+	decayCells cells;
+	cells.flowData = flowData;
+	cells.daccum = daccum;
+	cells.dmData = dmData;
+	cells.weightData = weightData;
+	cells.flowL = dynamic_cast<linearpart<float>*>(flowData);
+	cells.usew = usew;
+	cells.contcheck = contcheck;
+	cells.dx = dx;
+	linearpart<short> *neighborL = dynamic_cast<linearpart<short>*>(neighbor);
+	int numThreads = getNumThreads();
 	finished = false;
 	
 	//Ring terminating while loop
 	while(!finished) {
+		//  With threads the queue is evaluated by drainQueueThreaded and the loop below is skipped
+		if(numThreads > 1 && cells.flowL != NULL && neighborL != NULL)
+			drainQueueThreaded(que, neighborL, cells, numThreads);
 		while(!que.empty()) 
 		{
 			//Takes next node with no contributing neighbors
@@ -197,35 +262,8 @@ int dmarea(char* angfile,char* adecfile,char* dmfile,char* shfile,char* wfile,
 			i = temp.x;
 			j = temp.y;
 			//  FLOW ALGEBRA EXPRESSION EVALUATION
-			if(flowData->isInPartition(i,j)){
-				//  Initialize the result
-				if( usew==1) daccum->setData(i,j,(weightData->getData(i,j,tempFloat)));
-				else daccum->setData(i,j,(float)dx);
-				con=false;  //  So far not edge contaminated
-		//test if neighbor drains towards cell excluding boundaries 
-				for(k=1; k<=8; k++) {
-					in = i+d1[k];
-					jn = j+d2[k];
-					//TODO - streamlining here
-					if(!flowData->hasAccess(in,jn) || flowData->isNodata(in,jn))
-						con=true;
-					else{
-						flowData->getData(in,jn, angle);
-						p = prop(angle, (k+4)%8);
-						if(p>0.)
-						{
-							if(daccum->isNodata(in,jn)||dmData->isNodata(in,jn))con=true;
-							else
-							{
-								dmData->getData(in, jn, dm);
-								daccum->getData(in,jn,area);
-								daccum->addToData(i,j,(float)(dm*area*p));
-							}
-						}
-					}
-				}
-				if(con && contcheck==1)daccum->setToNodata(i,j);
-			}
+			if(flowData->isInPartition(i,j))
+				cells.evaluate(i,j);
 			else daccum->setToNodata(i,j);
 			//  END FLOW ALGEBRA EXPRESSION EVALUATION
 			//  Decrement neighbor dependence of downslope cell
@@ -253,24 +291,13 @@ int dmarea(char* angfile,char* adecfile,char* dmfile,char* shfile,char* wfile,
 		//daccum->share();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 		//Clear out borders
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = daccum->ringTerm(finished);
+		finished = daccum->collectiveTerm(finished);
 	}
 
 	//Stop timer
@@ -0,0 +1,508 @@
+/*  Taudem flat resolution
+
+  Artificial elevations across flats for D8FlowDir and DinfFlowDir, after Garbrecht and Martz
+  (1997), found by breadth first searches as in Barnes, Lehman and Mulla (2014).  The distances
+  are held as long integers, so flats of any size are resolved in one pass.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#include <mpi.h>
+#include <math.h>
+#include <algorithm>
+#include "commonLib.h"
+#include "linearpart.h"
+#include "createpart.h"
+#include "flats.h"
+using namespace std;
+
+//  The passes of Garbrecht and Martz increment a flat cell until it is next to a cell that has
+//  stopped, so the number of increments is the distance of the cell from the edge of the flat
+//  where the increments start.  Those distances are kept as levels, with the edge cells at level
+//  1, and the levels are spread one step at a time from the cells at each level.
+
+const long LEVEL_NOT_FLAT = 0;  //  level of cells that are not flat
+const long LEVEL_UNSET = -1;  //  level of flat cells not yet reached
+
+struct levelCell {
+	long level;
+	node cell;
+};
+
+static bool levelLess(const levelCell &a, const levelCell &b)
+{
+	return a.level < b.level;
+}
+
+struct flatSearch {
+	tdpartition *elevDEM, *flowDir, *level;
+	const flatDirections *dirs;
+	bool towardsLower;  //  spread only between cells of equal elevation that do not cross a flow
+	long nx, ny;
+};
+
+//  True if the level of flat cell (i,j) spreads to its neighbor k, which is also flat
+static bool linked(flatSearch &fs, long i, long j, int k)
+{
+	if(!fs.towardsLower) return true;
+	float tempFloat;
+	if(fs.dirs->dontCross(k,i,j,fs.flowDir) != 0) return false;
+	return fs.elevDEM->getData(i,j,tempFloat) - fs.elevDEM->getData(i+d1[k],j+d2[k],tempFloat) == 0;
+}
+
+//  Spreads the levels of the seed cells, which have been set, to the flat cells of this partition.
+//  Cells reached at more than one level keep the lowest.
+static void spreadLevels(flatSearch &fs, vector<levelCell> &seeds)
+{
+	sort(seeds.begin(), seeds.end(), levelLess);
+	vector<node> frontier, next;
+	size_t iseed = 0;
+	long lev = 0, tempLong;
+	node temp;
+	while(iseed < seeds.size() || !frontier.empty())
+	{
+		if(frontier.empty()) lev = seeds[iseed].level;
+		for(; iseed < seeds.size() && seeds[iseed].level == lev; iseed++)
+			frontier.push_back(seeds[iseed].cell);
+		for(size_t n = 0; n < frontier.size(); n++)
+		{
+			long i = frontier[n].x, j = frontier[n].y;
+			if(fs.level->getData(i,j,tempLong) != lev) continue;  //  since reached at a lower level
+			for(int k = 1; k <= 8; k++)
+			{
+				long in = i + d1[k], jn = j + d2[k];
+				if(in < 0 || jn < 0 || in >= fs.nx || jn >= fs.ny) continue;
+				fs.level->getData(in,jn,tempLong);
+				if(tempLong == LEVEL_NOT_FLAT || (tempLong != LEVEL_UNSET && tempLong <= lev+1)) continue;
+				if(!linked(fs,i,j,k)) continue;
+				fs.level->setData(in,jn,lev+1);
+				temp.x = in; temp.y = jn;
+				next.push_back(temp);
+			}
+		}
+		frontier.swap(next);
+		next.clear();
+		lev++;
+	}
+	seeds.clear();
+}
+
+//  Spreads the levels of the seed cells to the flat cells of all partitions.  After each search
+//  the borders are exchanged and the flat cells on the edges of this partition continue from the
+//  levels reached in the neighboring partitions, until no level changes.  Returns the highest
+//  level over all partitions, or 0 if no cell was reached.
+static long searchLevels(flatSearch &fs, vector<levelCell> &seeds, vector<node> &edgeFlats, vector<node> &flats)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long numChanged, totalChanged, tempLong;
+	levelCell seed;
+	do {
+		spreadLevels(fs, seeds);
+		fs.level->share();
+		for(size_t n = 0; n < edgeFlats.size(); n++)
+		{
+			long i = edgeFlats[n].x, j = edgeFlats[n].y;
+			long lev = fs.level->getData(i,j,tempLong);
+			long best = lev;
+			for(int k = 1; k <= 8; k++)
+			{
+				long in = i + d1[k], jn = j + d2[k];
+				if(in >= 0 && jn >= 0 && in < fs.nx && jn < fs.ny) continue;  //  not in a border
+				if(!fs.level->hasAccess(in,jn)) continue;
+				fs.level->getData(in,jn,tempLong);
+				if(tempLong <= 0 || !linked(fs,i,j,k)) continue;
+				if(best == LEVEL_UNSET || tempLong+1 < best) best = tempLong+1;
+			}
+			if(best != lev)
+			{
+				fs.level->setData(i,j,best);
+				seed.level = best;
+				seed.cell = edgeFlats[n];
+				seeds.push_back(seed);
+			}
+		}
+		numChanged = seeds.size();
+		MPI_Allreduce(&numChanged, &totalChanged, 1, MPI_LONG, MPI_SUM, MCW);
+		if(rank==0)
+		{
+			fprintf(stderr,".");  // print a . at each search to give an indication of progress
+			fflush(stderr);
+		}
+	} while(totalChanged > 0);
+
+	long maxLevel = 0, totalMaxLevel;
+	for(size_t n = 0; n < flats.size(); n++)
+		maxLevel = max(maxLevel, fs.level->getData(flats[n].x,flats[n].y,tempLong));
+	MPI_Allreduce(&maxLevel, &totalMaxLevel, 1, MPI_LONG, MPI_MAX, MCW);
+	return totalMaxLevel;
+}
+
+//  Finds the flat cells of fs.flowDir, and leaves their levels unset
+static void findFlats(flatSearch &fs, vector<node> &flats, vector<node> &edgeFlats)
+{
+	node temp;
+	for(long j=0; j<fs.ny; j++){
+		for(long i=0; i<fs.nx; i++){
+			if(fs.dirs->isFlat(fs.flowDir,i,j))
+			{
+				fs.level->setData(i,j,LEVEL_UNSET);
+				temp.x=i; temp.y=j; flats.push_back(temp);
+				if(i==0 || j==0 || i==fs.nx-1 || j==fs.ny-1) edgeFlats.push_back(temp);
+			}
+		}
+	}
+	fs.level->share();
+}
+
+//incfall - drain toward lower ground
+//  A flat cell next to a cell that drains and is equal or lower in elevation is at level 1.  A
+//  cell of equal elevation outside the flats that does not drain is never incremented, so it
+//  acts as a cell at level 1.  Returns the highest level.
+static long searchTowardsLower(flatSearch &fs, vector<node> &flats, vector<node> &edgeFlats)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long i, j, k, in, jn, lev, tempLong;
+	float tempFloat, elevDiff;
+	levelCell seed;
+	if(rank==0)
+	{
+		fprintf(stderr,"Draining flats towards lower adjacent terrain\n");
+		fflush(stderr);
+	}
+	vector<levelCell> seeds;
+	for(size_t n = 0; n < flats.size(); n++)
+	{
+		i = flats[n].x; j = flats[n].y;
+		lev = LEVEL_UNSET;
+		for(k=1; k<=8; k++){
+			if(fs.dirs->dontCross(k,i,j,fs.flowDir)==0){
+				in = i + d1[k];
+				jn = j + d2[k];
+				elevDiff = fs.elevDEM->getData(i,j,tempFloat) - fs.elevDEM->getData(in,jn,tempFloat);
+				if(elevDiff >= 0 && fs.dirs->drains(fs.flowDir,in,jn))
+				{
+					lev = 1;
+					break;
+				}
+				if(elevDiff == 0 && fs.level->getData(in,jn,tempLong) == LEVEL_NOT_FLAT)
+					lev = 2;
+			}
+		}
+		if(lev != LEVEL_UNSET)
+		{
+			fs.level->setData(i,j,lev);
+			seed.level = lev;
+			seed.cell = flats[n];
+			seeds.push_back(seed);
+		}
+	}
+	fs.towardsLower = true;
+	return searchLevels(fs, seeds, edgeFlats, flats);
+}
+
+//  Sets elev2 to the levels towards lower terrain, and leaves the levels unset for the search away
+//  from higher terrain.  Cells not reached are unresolvable pits.  The passes would have
+//  incremented them until the pass after the last level, which is at least 2.
+static void setTowardsLower(flatSearch &fs, vector<node> &flats, tdpartition *elev2, long maxLevel)
+{
+	long i, j, lev, tempLong;
+	long pitLevel = max(maxLevel,1L) + 2;
+	for(size_t n = 0; n < flats.size(); n++)
+	{
+		i = flats[n].x; j = flats[n].y;
+		lev = fs.level->getData(i,j,tempLong);
+		if(lev == LEVEL_UNSET)
+		{
+			fs.dirs->setPit(fs.flowDir,i,j);
+			lev = pitLevel;
+		}
+		elev2->setData(i,j,lev);
+		fs.level->setData(i,j,LEVEL_UNSET);
+	}
+	fs.flowDir->share();
+	fs.level->share();
+}
+
+//incrise - drain away from higher ground
+//  A flat cell next to a higher cell is at level 1, and levels spread between all adjacent
+//  flat cells.  Returns the highest level.
+static long searchAwayFromHigher(flatSearch &fs, vector<node> &flats, vector<node> &edgeFlats)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long i, j, k;
+	float tempFloat;
+	levelCell seed;
+	if(rank==0)
+	{
+		fprintf(stderr,"\nDraining flats away from higher adjacent terrain\n");
+		fflush(stderr);
+	}
+	vector<levelCell> seeds;
+	for(size_t n = 0; n < flats.size(); n++)
+	{
+		i = flats[n].x; j = flats[n].y;
+		for(k=1; k<=8; k++){
+			if(fs.elevDEM->getData(i,j,tempFloat) - fs.elevDEM->getData(i+d1[k],j+d2[k],tempFloat) < 0)
+			{
+				fs.level->setData(i,j,1L);
+				seed.level = 1;
+				seed.cell = flats[n];
+				seeds.push_back(seed);
+				break;
+			}
+		}
+	}
+	fs.towardsLower = false;
+	return searchLevels(fs, seeds, edgeFlats, flats);
+}
+
+//  Sets dn, which holds the levels, to the gradient away from higher terrain and adds it to elev2.
+//  The passes add the number of passes after a cell was reached, including the last pass that
+//  reaches no cell.
+static void setAwayFromHigher(flatSearch &fs, vector<node> &flats, tdpartition *elev2, long maxLevel)
+{
+	long i, j, lev, tempLong;
+	tdpartition *dn = fs.level;
+	for(size_t n = 0; n < flats.size(); n++)
+	{
+		i = flats[n].x; j = flats[n].y;
+		lev = dn->getData(i,j,tempLong);
+		if(lev > 0)
+		{
+			dn->setData(i,j,maxLevel + 2 - lev);
+			elev2->addToData(i,j,maxLevel + 2 - lev);
+		}
+		else
+			dn->setData(i,j,LEVEL_NOT_FLAT);
+	}
+	elev2->share();
+	dn->share();
+}
+
+//  True on all processes if the searches of two grids give the same levels, either away from
+//  higher terrain, which depends only on the flat cells and the elevations, or towards lower
+//  terrain, which also depends on the tests of the flat cells and their neighbors
+static bool sameLevels(flatSearch *fs, vector<node> *flats, bool towardsLower)
+{
+	int same = 1, allSame;
+	if(flats[0].size() != flats[1].size()) same = 0;
+	for(size_t n = 0; n < flats[0].size() && same == 1; n++)
+	{
+		long i = flats[0][n].x, j = flats[0][n].y;
+		if(flats[1][n].x != i || flats[1][n].y != j) same = 0;
+		for(int k = 1; k <= 8 && same == 1 && towardsLower; k++)
+		{
+			if((fs[0].dirs->dontCross(k,i,j,fs[0].flowDir) != 0) != (fs[1].dirs->dontCross(k,i,j,fs[1].flowDir) != 0))
+				same = 0;
+			if(fs[0].dirs->drains(fs[0].flowDir,i+d1[k],j+d2[k]) != fs[1].dirs->drains(fs[1].flowDir,i+d1[k],j+d2[k]))
+				same = 0;
+		}
+	}
+	MPI_Allreduce(&same, &allSame, 1, MPI_INT, MPI_MIN, MCW);
+	return allSame == 1;
+}
+
+static void copyLevels(tdpartition *from, tdpartition *to, vector<node> &flats)
+{
+	long tempLong;
+	for(size_t n = 0; n < flats.size(); n++)
+		to->setData(flats[n].x, flats[n].y, from->getData(flats[n].x, flats[n].y, tempLong));
+}
+
+//  Finds the flat cells of each grid, and sets their artificial elevations in elev2, a long grid
+//  initialized to 1.  dn, a long grid initialized to 0, is set to the gradient away from higher
+//  terrain for the cells that drain away from higher terrain.  Flat cells that cannot drain to
+//  lower terrain are marked with setPit.  The borders of elevDEM and flowDir must have been
+//  shared, and those of elev2 and dn are shared on return.
+static void flatElevations(tdpartition *elevDEM, tdpartition **flowDir, const flatDirections **dirs,
+	tdpartition **elev2, tdpartition **dn, vector<node> *flats, int numGrids)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	flatSearch fs[2];
+	vector<node> edgeFlats[2];
+	long maxLevel[2];
+	int g;
+	for(g=0; g<numGrids; g++)
+	{
+		fs[g].elevDEM = elevDEM;
+		fs[g].flowDir = flowDir[g];
+		fs[g].dirs = dirs[g];
+		fs[g].nx = elevDEM->getnx();
+		fs[g].ny = elevDEM->getny();
+		fs[g].level = dn[g];  //  dn holds the levels until the gradients are found
+		findFlats(fs[g], flats[g], edgeFlats[g]);
+	}
+
+	//  The levels of the second grid are copied from the first where the search would be the same
+	bool sameAway = numGrids == 2 && sameLevels(fs, flats, false);
+	bool sameTowards = sameAway && sameLevels(fs, flats, true);
+	if(rank==0 && sameAway)
+	{
+		fprintf(stderr,"The grids have the same flats, so the search%s done once\n",
+			sameTowards ? "es are" : " away from higher terrain is");
+		fflush(stderr);
+	}
+
+	for(g=0; g<numGrids; g++)
+	{
+		if(g == 1 && sameTowards)
+		{
+			copyLevels(dn[0], dn[1], flats[1]);
+			maxLevel[1] = maxLevel[0];
+		}
+		else maxLevel[g] = searchTowardsLower(fs[g], flats[g], edgeFlats[g]);
+	}
+	for(g=0; g<numGrids; g++)
+		setTowardsLower(fs[g], flats[g], elev2[g], maxLevel[g]);
+
+	for(g=0; g<numGrids; g++)
+	{
+		if(g == 1 && sameAway)
+		{
+			copyLevels(dn[0], dn[1], flats[1]);
+			maxLevel[1] = maxLevel[0];
+		}
+		else maxLevel[g] = searchAwayFromHigher(fs[g], flats[g], edgeFlats[g]);
+	}
+	for(g=0; g<numGrids; g++)
+		setAwayFromHigher(fs[g], flats[g], elev2[g], maxLevel[g]);
+}
+
+//  The artificial elevations are the sum of the gradients towards lower and away from higher
+//  terrain, and they leave flat a cell whose steps towards lower terrain also go towards higher
+//  terrain.  Such a cell drains to an adjacent cell of the same flat one step closer to lower
+//  terrain, along the steepest descent of twice the gradient towards lower terrain plus the
+//  gradient away from higher terrain, as in Barnes, Lehman and Mulla (2014).  That descent is at
+//  least 1 to such a cell, and the cells it leads to are closer to lower terrain, so no loops are
+//  formed.  As in the searches, a D8 diagonal is not set across two cells that flow across it.
+static long drainFlats(tdpartition *elevDEM, tdpartition *flowDir, const flatDirections &dirs,
+	tdpartition *elev2, tdpartition *dn, vector<node> &flats)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	double dx = elevDEM->getdx();
+	double dy = elevDEM->getdy();
+	long i, j, k, in, jn, tempLong;
+	float tempFloat;
+	double fact[9];
+	for(k=1; k<=8; k++)
+		fact[k] = 1./sqrt(d1[k]*dx*d1[k]*dx + d2[k]*dy*d2[k]*dy);
+	short order[8]={1,3,5,7,2,4,6,8};
+
+	long numSet = 0, totalSet;
+	for(size_t n = 0; n < flats.size(); n++)
+	{
+		i = flats[n].x; j = flats[n].y;
+		if(!dirs.isFlat(flowDir,i,j)) continue;
+		long away = dn->getData(i,j,tempLong);
+		long lower = elev2->getData(i,j,tempLong) - away;
+		double slope, smax = 0.;
+		int kmax = 0;
+		for(int ii=0; ii<8; ii++)
+		{
+			k = order[ii];
+			if(dirs.dontCross(k,i,j,flowDir) != 0) continue;
+			in = i + d1[k];
+			jn = j + d2[k];
+			long awayn = dn->getData(in,jn,tempLong);
+			if(awayn <= 0) continue;
+			if(elev2->getData(in,jn,tempLong) - awayn != lower - 1) continue;
+			if(elevDEM->getData(i,j,tempFloat) - elevDEM->getData(in,jn,tempFloat) != 0) continue;
+			slope = fact[k]*(2 + away - awayn);
+			if(slope > smax)
+			{
+				smax = slope;
+				kmax = k;
+			}
+		}
+		if(kmax > 0)
+		{
+			dirs.setDirection(flowDir,i,j,kmax);
+			numSet++;
+		}
+	}
+	MPI_Allreduce(&numSet, &totalSet, 1, MPI_LONG, MPI_SUM, MCW);
+	if(rank==0 && totalSet > 0)
+	{
+		fprintf(stderr,"Directions set towards lower terrain for %ld cells left flat\n",totalSet);
+		fflush(stderr);
+	}
+	return totalSet;
+}
+
+void resolveFlats(tdpartition *elevDEM, tdpartition **flowDir, const flatDirections **dirs, int numGrids)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	long totalx = elevDEM->gettotalx();
+	long totaly = elevDEM->gettotaly();
+	double dx = elevDEM->getdx();
+	double dy = elevDEM->getdy();
+	int g;
+
+	elevDEM->share();
+	//create and initialize temporary storage for Garbrecht and Martz
+	tdpartition *elev2[2], *dn[2];
+	vector<node> flats[2];
+	for(g=0; g<numGrids; g++)
+	{
+		flowDir[g]->share();
+		elev2[g] = CreateNewPartition(LONG_TYPE, totalx, totaly, dx, dy, 1L);
+		dn[g] = CreateNewPartition(LONG_TYPE, totalx, totaly, dx, dy, 0L);
+	}
+
+	flatElevations(elevDEM, flowDir, dirs, elev2, dn, flats, numGrids);
+
+	if(rank==0)
+	{
+		fprintf(stderr,"\nSetting directions\n");
+		fflush(stderr);
+	}
+	for(g=0; g<numGrids; g++)
+	{
+		for(size_t n = 0; n < flats[g].size(); n++)
+			dirs[g]->setFromElevations(elevDEM, flowDir[g], elev2[g], dn[g], flats[g][n].x, flats[g][n].y);
+		drainFlats(elevDEM, flowDir[g], *dirs[g], elev2[g], dn[g], flats[g]);
+	}
+
+	for(g=0; g<numGrids; g++)
+	{
+		delete elev2[g];  //  to avoid memory leaks
+		delete dn[g];
+	}
+}
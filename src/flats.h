@@ -0,0 +1,71 @@
+/*  Taudem flat resolution
+
+  Artificial elevations across flats for D8FlowDir and DinfFlowDir, after Garbrecht and Martz
+  (1997).  The gradients towards lower and away from higher terrain are found by breadth first
+  searches from the edges of the flats, as in Barnes, Lehman and Mulla (2014), rather than by
+  passes over every flat cell.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#ifndef FLATS_H
+#define FLATS_H
+
+#include <vector>
+#include "commonLib.h"
+#include "linearpart.h"
+using namespace std;
+
+//  Tests on and settings of the cells of a D8 or Dinf flow direction grid
+struct flatDirections {
+	bool (*isFlat)(tdpartition *flowDir, long i, long j);  //  direction not yet set
+	bool (*drains)(tdpartition *flowDir, long i, long j);  //  direction set
+	int (*dontCross)(int k, int i, int j, tdpartition *flowDir);
+	void (*setPit)(tdpartition *flowDir, long i, long j);  //  mark an unresolvable flat cell
+	void (*setDirection)(tdpartition *flowDir, long i, long j, int k);  //  flow to neighbor k
+	//  set the direction of a flat cell from the artificial elevations elev2 and the gradient dn
+	void (*setFromElevations)(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *elev2, tdpartition *dn,
+		long i, long j);
+};
+
+//  The directions of D8FlowDir (d8.cpp) and DinfFlowDir (dinf.cpp)
+extern const flatDirections d8Directions;
+extern const flatDirections dinfDirections;
+
+//  Sets the directions of the flat cells of numGrids, 1 or 2, direction grids of elevDEM.  With
+//  2 grids, such as the D8 and Dinf directions of the same elevations, a search for the
+//  artificial elevations that would give the same levels for both grids is only done once.
+void resolveFlats(tdpartition *elevDEM, tdpartition **flowDir, const flatDirections **dirs, int numGrids);
+
+#endif
@@ -44,97 +44,264 @@ email:  dtarb@usu.edu
 #include "linearpart.h"
 #include "createpart.h"
 #include "tiffIO.h"
+#include "stages.h"
 #include <stack>
+#include <map>
+#include <vector>
 using namespace std;
 
-int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbose, 
-           bool is_4Point,bool use_mask,char *maskfile)  // these three added by arb, 5/31/11
+//  Returns the lowest planchon value of the neighbors of (i,j) that this process has access to.
+//  planL is a typed view of planchon used to skip the access checks for interior cells, or NULL.
+static inline float lowestNeighbor(tdpartition *planchon, linearpart<float> *planL, long i, long j, int step)
 {
-
-	MPI_Init(NULL,NULL);{
-
-	int rank,size;
-	MPI_Comm_rank(MCW,&rank);
-	MPI_Comm_size(MCW,&size);
-	if(rank==0)
+	float tempFloat, neighborFloat = FLT_MAX;
+	long in,jn;
+	short k;
+	if(planL != NULL && planL->isInterior(i,j))
 	{
-		printf("PitRemove version %s\n",TDVERSION);
-		fflush(stdout);
+		for(k=1; k<=8; k+=step){
+			tempFloat = planL->getDataUnchecked(i+d1[k],j+d2[k]);
+			if(tempFloat < neighborFloat) neighborFloat = tempFloat;
+		}
+		return neighborFloat;
 	}
+	for(k=1; k<=8; k+=step){
+		in = i+d1[k];
+		jn = j+d2[k];
+		if(planchon->hasAccess(in,jn) && planchon->getData(in,jn,tempFloat) < neighborFloat)
+				//Get neighbor data and store as planchon for self
+				planchon->getData(in,jn, neighborFloat);
+	}
+	return neighborFloat;
+}
 
-	double begint = MPI_Wtime();
-
-  //logic for 4-way flow or 8-way flow
-  int step=1;
-  if (is_4Point)
-    step=2;
-
-	//Create tiff object, read and store header info
-	tiffIO dem(demfile,FLOAT_TYPE);
-  tiffIO *depmask;
-  if (use_mask) {
-	  depmask=new tiffIO(maskfile,SHORT_TYPE); // arb added, 5/31/11
-    if (!dem.compareTiff(*depmask))
-    {
-      if (rank==0) {
-        printf("Error: depression mask and input DEM are not similar. Files must have the same number of rows/columns.\n");
-        fflush(stdout);
-      }
-      return 1;
-    }
-  }
-	long totalX = dem.getTotalX();
-	long totalY = dem.getTotalY();
-	double dx = dem.getdx();
-	double dy = dem.getdy();
-
-	//Create partition and read data
-	tdpartition* elevDEM=NULL;
-  tdpartition* maskPartition=NULL;
-	elevDEM = CreateNewPartition(dem.getDatatype(), totalX, totalY, dx, dy, dem.getNodata());
-  if (use_mask)
-    maskPartition=CreateNewPartition(depmask->getDatatype(), totalX, totalY, dx, dy, depmask->getNodata());
-
-	int nx = elevDEM->getnx();
-	int ny = elevDEM->getny();
-	int xstart, ystart;
-	elevDEM->localToGlobal(0, 0, xstart, ystart);
-
-	double headert = MPI_Wtime();
-
-	if(rank==0)
-	{
-		float timeestimate=(1.5e-6*totalX*totalY/pow((double) size,0.5))/60+1;  // Time estimate in minutes
-		fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
-		fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
-		fflush(stderr);
+//  A cell on the priority queue of priorityFlood.  seq orders cells of equal elevation by the
+//  order they were added, so that the result does not depend on the queue implementation.
+struct pfCell {
+	float z;
+	long seq;
+	int x;
+	int y;
+};
+struct pfCellGreater {
+	bool operator()(const pfCell &a, const pfCell &b) const {
+		return a.z > b.z || (a.z == b.z && a.seq > b.seq);
+	}
+};
+
+//  Priority-flood pit filling (Barnes et al. 2014) with the spill elevations between partitions
+//  resolved in one global graph step (Barnes 2016).  On entry planchon has been initialized and
+//  shared, so cells where planchon equals elevDEM are outlets (grid edge, next to no data, or
+//  masked) and other valid cells hold FLT_MAX.  On return planchon holds the same filled
+//  elevations as the Planchon-Darboux iterations.
+//  1. Each partition floods from its outlets and from its perimeter cells (the cells next to
+//     another partition).  Outlets have label 0 and each perimeter cell a label of its own that
+//     is passed on to the cells flooded from it.
+//  2. Where cells with different labels meet, the labels are joined in a graph by an edge with
+//     the larger of the two flooded elevations.  The graph is gathered on rank 0, which floods
+//     it from label 0 to get the spill elevation of each label.
+//  3. The filled elevation of each cell is the larger of its own flooded elevation and the
+//     spill elevation of its label.
+static void priorityFlood(tdpartition *elevDEM, tdpartition *planchon, int step, int rank, int size, bool verbose)
+{
+	long totalX = elevDEM->gettotalx();
+	long totalY = elevDEM->gettotaly();
+	double dx = elevDEM->getdx();
+	double dy = elevDEM->getdy();
+	int nx = planchon->getnx();
+	int ny = planchon->getny();
+	long i,j,in,jn;
+	short k;
+	float elev, fill, tempFloat;
+	long label, labelN;
+
+	//  Labels of the flooded cells, no data until a cell is reached
+	tdpartition *labels = CreateNewPartition(LONG_TYPE, totalX, totalY, dx, dy, -1L);
+
+	//  Number the perimeter cells so that labels are unique over all processes
+	long numLocal = 0, offset = 0, numLabels = 0;
+	for(j=0; j<ny; j++) for(i=0; i<nx; i++) {
+		if(elevDEM->isNodata(i,j) || planchon->getData(i,j,tempFloat) == elevDEM->getData(i,j,elev)) continue;
+		for(k=1; k<=8; k+=step)
+			if(elevDEM->hasAccess(i+d1[k],j+d2[k]) && !elevDEM->isInPartition(i+d1[k],j+d2[k])) {
+				numLocal++;
+				break;
+			}
+	}
+	MPI_Exscan(&numLocal, &offset, 1, MPI_LONG, MPI_SUM, MCW);
+	if(rank == 0) offset = 0;  //  MPI_Exscan leaves the result undefined on rank 0
+	MPI_Allreduce(&numLocal, &numLabels, 1, MPI_LONG, MPI_SUM, MCW);
+
+	//  Seed the queue with the outlets and the perimeter cells
+	priority_queue<pfCell, vector<pfCell>, pfCellGreater> open;
+	queue<pfCell> pit;
+	pfCell c;
+	long seq = 0;
+	label = offset;
+	for(j=0; j<ny; j++) for(i=0; i<nx; i++) {
+		if(elevDEM->isNodata(i,j)) continue;
+		elevDEM->getData(i,j,elev);
+		if(planchon->getData(i,j,tempFloat) == elev)
+			labels->setData(i,j,0L);
+		else {
+			for(k=1; k<=8; k+=step)
+				if(elevDEM->hasAccess(i+d1[k],j+d2[k]) && !elevDEM->isInPartition(i+d1[k],j+d2[k])) break;
+			if(k > 8) continue;
+			label++;
+			labels->setData(i,j,label);
+			planchon->setData(i,j,elev);
+		}
+		c.z = elev;  c.seq = seq++;  c.x = i;  c.y = j;
+		open.push(c);
 	}
 
-	if(verbose)  // debug writes
-	{
-		printf("Header read\n");
-		printf("Process: %d, totalX: %d, totalY: %d\n",rank,totalX,totalY);
-		printf("Process: %d, nx: %d, ny: %d\n",rank,nx,ny);
-		printf("Process: %d, xstart: %d, ystart: %d\n",rank,xstart,ystart);
-    if (use_mask)
-    {
-      printf("Process: %d, Using depression mask data...\n",rank);
-    }
-		fflush(stdout);
+	//  Flood the partition.  Cells that are filled to the level of the cell they are reached
+	//  from go on the pit queue, which is emptied first since they can not be lower.
+	while(!open.empty() || !pit.empty()) {
+		if(!pit.empty()) {
+			c = pit.front();
+			pit.pop();
+		}
+		else {
+			c = open.top();
+			open.pop();
+		}
+		labels->getData(c.x,c.y,label);
+		for(k=1; k<=8; k+=step) {
+			in = c.x+d1[k];
+			jn = c.y+d2[k];
+			if(!elevDEM->isInPartition(in,jn) || elevDEM->isNodata(in,jn) || !labels->isNodata(in,jn)) continue;
+			labels->setData(in,jn,label);
+			elevDEM->getData(in,jn,elev);
+			if(elev <= c.z) {
+				planchon->setData(in,jn,c.z);
+				pfCell n = {c.z, seq++, (int)in, (int)jn};
+				pit.push(n);
+			}
+			else {
+				planchon->setData(in,jn,elev);
+				pfCell n = {elev, seq++, (int)in, (int)jn};
+				open.push(n);
+			}
+		}
+	}
+	planchon->share();
+	labels->share();
+
+	//  Spill graph edges, keeping the lowest edge between each pair of labels
+	map< pair<long,long>, float > edges;
+	map< pair<long,long>, float >::iterator e;
+	for(j=0; j<ny; j++) for(i=0; i<nx; i++) {
+		if(labels->isNodata(i,j)) continue;
+		labels->getData(i,j,label);
+		planchon->getData(i,j,fill);
+		for(k=1; k<=8; k+=step) {
+			in = i+d1[k];
+			jn = j+d2[k];
+			if(!labels->hasAccess(in,jn) || labels->isNodata(in,jn)) continue;
+			labels->getData(in,jn,labelN);
+			if(labelN <= label) continue;  //  each pair is recorded from the lower label
+			planchon->getData(in,jn,tempFloat);
+			if(tempFloat < fill) tempFloat = fill;
+			e = edges.find(make_pair(label,labelN));
+			if(e == edges.end()) edges[make_pair(label,labelN)] = tempFloat;
+			else if(tempFloat < e->second) e->second = tempFloat;
+		}
 	}
 
-	dem.read(xstart, ystart, ny, nx, elevDEM->getGridPointer());	
-  if (use_mask)
-	  depmask->read(xstart, ystart, ny, nx, maskPartition->getGridPointer());	
+	//  Gather the graph on rank 0
+	int numEdges = edges.size();
+	vector<long> edgeFrom, edgeTo;
+	vector<float> edgeZ;
+	for(e = edges.begin(); e != edges.end(); e++) {
+		edgeFrom.push_back(e->first.first);
+		edgeTo.push_back(e->first.second);
+		edgeZ.push_back(e->second);
+	}
+	edges.clear();
+	int *counts = new int[size];
+	int *displs = new int[size];
+	MPI_Gather(&numEdges, 1, MPI_INT, counts, 1, MPI_INT, 0, MCW);
+	int totalEdges = 0;
+	if(rank == 0)
+		for(int r=0; r<size; r++) {
+			displs[r] = totalEdges;
+			totalEdges += counts[r];
+		}
+	vector<long> allFrom(totalEdges+1), allTo(totalEdges+1);
+	vector<float> allZ(totalEdges+1);
+	MPI_Gatherv(numEdges > 0 ? &edgeFrom[0] : NULL, numEdges, MPI_LONG, &allFrom[0], counts, displs, MPI_LONG, 0, MCW);
+	MPI_Gatherv(numEdges > 0 ? &edgeTo[0] : NULL, numEdges, MPI_LONG, &allTo[0], counts, displs, MPI_LONG, 0, MCW);
+	MPI_Gatherv(numEdges > 0 ? &edgeZ[0] : NULL, numEdges, MPI_FLOAT, &allZ[0], counts, displs, MPI_FLOAT, 0, MCW);
+
+	//  Flood the graph from label 0 on rank 0.  Labels that are not reached keep FLT_MAX, as
+	//  cells not reached by Planchon-Darboux do.
+	vector<float> spill(numLabels+2, FLT_MAX);
+	if(rank == 0) {
+		vector< vector< pair<long,float> > > adj(numLabels+1);
+		for(long ie=0; ie<totalEdges; ie++) {
+			adj[allFrom[ie]].push_back(make_pair(allTo[ie], allZ[ie]));
+			adj[allTo[ie]].push_back(make_pair(allFrom[ie], allZ[ie]));
+		}
+		priority_queue< pair<float,long>, vector< pair<float,long> >, greater< pair<float,long> > > gq;
+		spill[0] = -FLT_MAX;
+		gq.push(make_pair(spill[0], 0L));
+		while(!gq.empty()) {
+			fill = gq.top().first;
+			label = gq.top().second;
+			gq.pop();
+			if(fill > spill[label]) continue;
+			for(size_t ia=0; ia<adj[label].size(); ia++) {
+				tempFloat = adj[label][ia].second;
+				if(tempFloat < fill) tempFloat = fill;
+				labelN = adj[label][ia].first;
+				if(tempFloat < spill[labelN]) {
+					spill[labelN] = tempFloat;
+					gq.push(make_pair(tempFloat, labelN));
+				}
+			}
+		}
+		if(verbose) {
+			printf("Priority-flood graph labels: %ld, edges: %d\n", numLabels, totalEdges);
+			fflush(stdout);
+		}
+	}
 
-/////////////////////////////////
-// begin timer
-	double readt = MPI_Wtime();
+	//  Send each process the spill elevations of its labels
+	int numLocalInt = numLocal;
+	MPI_Gather(&numLocalInt, 1, MPI_INT, counts, 1, MPI_INT, 0, MCW);
+	if(rank == 0)
+		for(int r=0, d=0; r<size; r++) {
+			displs[r] = d;
+			d += counts[r];
+		}
+	MPI_Scatterv(&spill[1], counts, displs, MPI_FLOAT, rank == 0 ? MPI_IN_PLACE : &spill[offset+1],
+		numLocalInt, MPI_FLOAT, 0, MCW);
+	delete[] counts;
+	delete[] displs;
+
+	//  Raise each cell to the spill elevation of its label
+	for(j=0; j<ny; j++) for(i=0; i<nx; i++) {
+		if(labels->isNodata(i,j)) continue;
+		labels->getData(i,j,label);
+		if(label == 0) continue;
+		if(planchon->getData(i,j,fill) < spill[label]) planchon->setData(i,j,spill[label]);
+	}
+	delete labels;
+}
 
-	//Create empty partition to store new information
-	tdpartition *planchon;
-	float felNodata = -3.0e38;
-	planchon = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, felNodata);
+//  Fills the pits of elevDEM, writing the filled elevations to planchon, a float partition of the
+//  same grid.  maskPartition is a depression mask, or NULL, step is 2 for four-way flow and 1
+//  for eight-way flow, and the borders of elevDEM need not have been shared.
+void fillPits(tdpartition *elevDEM, tdpartition *maskPartition, tdpartition *planchon, int step,
+	bool verbose, bool usePriorityFlood)
+{
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+	int nx = elevDEM->getnx();
+	int ny = elevDEM->getny();
+	bool use_mask = (maskPartition != NULL);
 
 	long i,j;
 	short k;
@@ -143,16 +310,6 @@ int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbo
 	int scan=0;
 	float tempFloat=0, neighborFloat=0;
 
-	if(verbose)
-	{
-		printf("Data read\n");
-		long nxm=nx/2;
-		long nym=ny/2;
-		elevDEM->getData(nxm,nym,tempFloat);
-		printf("Midpoint of partition: %d, nxm: %d, nym: %d, value: %f\n",rank,nxm,nym,tempFloat);
-		fflush(stdout);
-	}
-	
 	//These will be used to scan in different directions
 	const int X0[8] = {  0, nx-1,   0, nx-1, nx-1,    0,    0, nx-1};
 	const int Y0[8] = {  0, ny-1,   0, ny-1,    0, ny-1, ny-1,    0};
@@ -235,13 +392,31 @@ int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbo
 
 /////////////////////////////////////////
   short tmpshort=0;
-	//Fill the border arrays across the partitions
-	elevDEM->share();   
+	//Fill the border arrays across the partitions.  Each cell of the new grid depends only on
+	//elevDEM, so cells away from the partition edges are initialized while the borders are
+	//being exchanged, with rows shared out between threads.
+	elevDEM->shareBegin();   
   if (use_mask)
-    maskPartition->share();
+    maskPartition->shareBegin();
+	//  Typed views for the interior fast path.  These are NULL if the partitions are not
+	//  linear float partitions, in which case the general accessors are used.
+	linearpart<float> *elevL = dynamic_cast<linearpart<float>*>(elevDEM);
+	linearpart<float> *planL = dynamic_cast<linearpart<float>*>(planchon);
+	if(elevL == NULL) planL = NULL;
+	bool interior;
+
 	//Initialize the new grid
+	for(int jpass=0; jpass<2; jpass++){
+	if(jpass==1){
+		elevDEM->shareEnd();
+		if (use_mask)
+			maskPartition->shareEnd();
+	}
+	#pragma omp parallel for schedule(static) num_threads(getNumThreads()) private(i,k,in,jn,con,interior,tempFloat,tmpshort)
 	for(j=0; j<ny; j++){
 		for(i=0; i<nx; i++){
+			if((j==0 || j==ny-1 || i==0 || i==nx-1) != (jpass==1)) continue;
+			interior = (planL != NULL && planL->isInterior(i,j));
 			//If elevDEM has no data, planchon has no data.
 			if(elevDEM->isNodata(i,j)) 
 				planchon->setToNodata(i,j);
@@ -250,11 +425,17 @@ int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbo
         planchon->setData(i,j,elevDEM->getData(i,j,tempFloat));
 
 			//If i,j is on the border, set planchon(i,j) to elevDEM(i,j)
-			else if (!elevDEM->hasAccess(i-1,j) || !elevDEM->hasAccess(i+1,j) ||
-					 !elevDEM->hasAccess(i,j-1) || !elevDEM->hasAccess(i,j+1))
+			else if (!interior && (!elevDEM->hasAccess(i-1,j) || !elevDEM->hasAccess(i+1,j) ||
+					 !elevDEM->hasAccess(i,j-1) || !elevDEM->hasAccess(i,j+1)))
 				planchon->setData(i,j, elevDEM->getData(i,j,tempFloat));
 			//Check if cell is "contaminated" (neighbors have no data)
 			//  set planchon to elevDEM(i,j) if it is, else set to FLT_MAX
+			else if(interior){
+				con = false;
+				for(k=1; k<=8 && !con; k+=step)
+					if(elevL->isNodataUnchecked(i+d1[k],j+d2[k])) con=true;
+				planL->setDataUnchecked(i,j,con ? elevL->getDataUnchecked(i,j) : FLT_MAX);
+			}
 			else{ 
 				con = false;
 				for(k=1; k<=8 && !con; k+=step) {
@@ -269,6 +450,7 @@ int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbo
 			}
 		}
 	}
+	}
 	//Done initializing grid
 	//Make sure everyone has updated subgirds
 	planchon->share();
@@ -278,206 +460,298 @@ int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbo
 		fflush(stdout);
 	}
 	
-//////////////////////////////////////		
-	//First pass - put unresolved grid cells on a stack
-//	finished = false;
-//	while( finished == false ) {
-	finished = true;
-	i = X0[scan];
-	j = Y0[scan];
-
-	stack<long> s1, s2;
-	long pass=0;
-	long stacksize=100;  // Stack size above which verbose message is written
-	while(planchon->isInPartition(i,j)) { 
-		//If statement - only enter if there is data there OR
-		// there is "water" on planchon
-		if(!planchon->isNodata(i,j) && planchon->getData(i,j,tempFloat) > elevDEM->getData(i,j,neighborFloat)){
-			//Checks each direction...
-			neighborFloat = FLT_MAX;
-			for(k=1; k<=8; k+=step){
-				in = i+d1[k];
-				jn = j+d2[k];
-				if(planchon->hasAccess(in,jn) && planchon->getData(in,jn,tempFloat) < neighborFloat)
-						//Get neighbor data and store as planchon for self
-						planchon->getData(in,jn, neighborFloat);
-			}
-//				if( neighborFloat < FLT_MAX ) {  //DGT This check is redundant - because scans start from the side
-				//Set the grid to either elevDEM, all "water" can be taken off"
-			if(elevDEM->getData(i,j, tempFloat) >= neighborFloat ){
-				planchon->setData(i,j, elevDEM->getData(i,j,tempFloat));
-				finished = false;  
-			}
-			// or some water can be taken off
-			else 
-			{				
-				s1.push(i);
-				s1.push(j);
-				if(verbose)
-				{
-					if(s1.size()>stacksize)
-					{
-						long psz=s1.size();
-						printf("Rank: %d, Stack size: %ld\n",rank,psz);
-						fflush(stdout);
-						stacksize=stacksize+100000;
-					}			
-				}
-				//  DGT.  The second part of the condition below is redundant
-				if(planchon->getData(i,j,tempFloat) > neighborFloat /* && elevDEM->getData(i,j,tempFloat) < neighborFloat */){
-					planchon->setData(i,j,neighborFloat);
-					finished = false;
+	if(usePriorityFlood)
+		priorityFlood(elevDEM, planchon, step, rank, size, verbose);
+	else {
+	//////////////////////////////////////		
+		//First pass - put unresolved grid cells on a stack
+	//	finished = false;
+	//	while( finished == false ) {
+		finished = true;
+		i = X0[scan];
+		j = Y0[scan];
+
+		stack<long> s1, s2;
+		long pass=0;
+		long stacksize=100;  // Stack size above which verbose message is written
+		while(planchon->isInPartition(i,j)) { 
+			//If statement - only enter if there is data there OR
+			// there is "water" on planchon
+			if(!planchon->isNodata(i,j) && planchon->getData(i,j,tempFloat) > elevDEM->getData(i,j,neighborFloat)){
+				//Checks each direction...
+				neighborFloat = lowestNeighbor(planchon, planL, i, j, step);
+	//				if( neighborFloat < FLT_MAX ) {  //DGT This check is redundant - because scans start from the side
+					//Set the grid to either elevDEM, all "water" can be taken off"
+				if(elevDEM->getData(i,j, tempFloat) >= neighborFloat ){
+					planchon->setData(i,j, elevDEM->getData(i,j,tempFloat));
+					finished = false;  
 				}
-			} 
-//				}
-//				else   //DGT code used to verify that above if was redundant
-//					printf("I am here - should never be\n");
-		}
-		//Now we need to set i,j to the next one to evaluate
-		i += dX[scan];
-		j += dY[scan];
-		if(!planchon->isInPartition(i,j) ) {
-			i+= fX[scan];
-			j+= fY[scan];
-		}
-	}
-	planchon->share();
-	//  progress and debug prints
-	if(verbose)
-	{
-		pass=pass+1;
-		stacksize=100;  // reset stacksize
-		long remaining=s1.size();
-		printf("Process: %d, Pass: %ld, Remaining: %ld\n",rank,pass,remaining);
-		fflush(stdout);
-	}
-	//  This step is to check if all processes are finished in which case while loop is skipped for all processes
-	finished = planchon->ringTerm(finished);
-// Now repeat the scanning but pulling off stack and putting on new stack
-	while(!finished){
-		finished=true;
-		while(!s1.empty()){
-			j=s1.top();
-			s1.pop();
-			i=s1.top();
-			s1.pop();
-			neighborFloat = FLT_MAX;
-			for(k=1; k<=8; k+=step){
-				in = i+d1[k];
-				jn = j+d2[k];
-				if(planchon->hasAccess(in,jn) && planchon->getData(in,jn,tempFloat) < neighborFloat)
-						//Get neighbor data and store as planchon for self
-						planchon->getData(in,jn, neighborFloat);
+				// or some water can be taken off
+				else 
+				{				
+					s1.push(i);
+					s1.push(j);
+					if(verbose)
+					{
+						if(s1.size()>stacksize)
+						{
+							long psz=s1.size();
+							printf("Rank: %d, Stack size: %ld\n",rank,psz);
+							fflush(stdout);
+							stacksize=stacksize+100000;
+						}			
+					}
+					//  DGT.  The second part of the condition below is redundant
+					if(planchon->getData(i,j,tempFloat) > neighborFloat /* && elevDEM->getData(i,j,tempFloat) < neighborFloat */){
+						planchon->setData(i,j,neighborFloat);
+						finished = false;
+					}
+				} 
+	//				}
+	//				else   //DGT code used to verify that above if was redundant
+	//					printf("I am here - should never be\n");
 			}
-	//				if( neighborFloat < FLT_MAX ) {  //DGT This check is redundant - because scans start from the side
-				//Set the grid to either elevDEM, all "water" can be taken off"
-			if(elevDEM->getData(i,j, tempFloat) >= neighborFloat ){
-				planchon->setData(i,j, elevDEM->getData(i,j,tempFloat));
-				finished = false;
+			//Now we need to set i,j to the next one to evaluate
+			i += dX[scan];
+			j += dY[scan];
+			if(!planchon->isInPartition(i,j) ) {
+				i+= fX[scan];
+				j+= fY[scan];
 			}
-			// or some water can be taken off
-			else 
-			{   // Keep grid cell on scan list because still above original elevation
-				s2.push(i);
-				s2.push(j);
-				if(verbose)
-				{
-					if(s2.size()>stacksize)
-					{
-						long psz=s2.size();
-						printf("Rank: %d, Stack 2 size: %ld\n",rank,psz);
-						fflush(stdout);
-						stacksize=stacksize+100000;
-					}			
-				}
-				//  condition below is commented out for efficiency.  It has already passed this test from if above
-				if(planchon->getData(i,j,tempFloat) > neighborFloat /*&& elevDEM->getData(i,j,tempFloat) < neighborFloat */)
-				{
-					planchon->setData(i,j,neighborFloat);
-					finished = false;
-				}
-			} 
 		}
+		//  This step is to check if all processes are finished in which case while loop is skipped for all processes.
+		//  The vote is taken while borders are shared.
+		planchon->termBegin(finished);
 		planchon->share();
-
 		//  progress and debug prints
 		if(verbose)
 		{
 			pass=pass+1;
-			long remaining=s2.size();
-			stacksize=100;  //  reset stack size
+			stacksize=100;  // reset stacksize
+			long remaining=s1.size();
 			printf("Process: %d, Pass: %ld, Remaining: %ld\n",rank,pass,remaining);
 			fflush(stdout);
 		}
-
-        //  Repeat but with stacks interchanged
-		finished=true;
-		while(!s2.empty()){
-			j=s2.top();
-			s2.pop();
-			i=s2.top();
-			s2.pop();
-			neighborFloat = FLT_MAX;
-			for(k=1; k<=8; k+=step){
-				in = i+d1[k];
-				jn = j+d2[k];
-				if(planchon->hasAccess(in,jn) && planchon->getData(in,jn,tempFloat) < neighborFloat)
-						//Get neighbor data and store as planchon for self
-						planchon->getData(in,jn, neighborFloat);
+		finished = planchon->termEnd();
+	// Now repeat the scanning but pulling off stack and putting on new stack
+		while(!finished){
+			finished=true;
+			while(!s1.empty()){
+				j=s1.top();
+				s1.pop();
+				i=s1.top();
+				s1.pop();
+				neighborFloat = lowestNeighbor(planchon, planL, i, j, step);
+		//				if( neighborFloat < FLT_MAX ) {  //DGT This check is redundant - because scans start from the side
+					//Set the grid to either elevDEM, all "water" can be taken off"
+				if(elevDEM->getData(i,j, tempFloat) >= neighborFloat ){
+					planchon->setData(i,j, elevDEM->getData(i,j,tempFloat));
+					finished = false;
+				}
+				// or some water can be taken off
+				else 
+				{   // Keep grid cell on scan list because still above original elevation
+					s2.push(i);
+					s2.push(j);
+					if(verbose)
+					{
+						if(s2.size()>stacksize)
+						{
+							long psz=s2.size();
+							printf("Rank: %d, Stack 2 size: %ld\n",rank,psz);
+							fflush(stdout);
+							stacksize=stacksize+100000;
+						}			
+					}
+					//  condition below is commented out for efficiency.  It has already passed this test from if above
+					if(planchon->getData(i,j,tempFloat) > neighborFloat /*&& elevDEM->getData(i,j,tempFloat) < neighborFloat */)
+					{
+						planchon->setData(i,j,neighborFloat);
+						finished = false;
+					}
+				} 
 			}
-	//				if( neighborFloat < FLT_MAX ) {  //DGT This check is redundant - because scans start from the side
-				//Set the grid to either elevDEM, all "water" can be taken off"
-			if(elevDEM->getData(i,j, tempFloat) >= neighborFloat ){
-				planchon->setData(i,j, elevDEM->getData(i,j,tempFloat));
-				finished = false;
+			planchon->share();
+
+			//  progress and debug prints
+			if(verbose)
+			{
+				pass=pass+1;
+				long remaining=s2.size();
+				stacksize=100;  //  reset stack size
+				printf("Process: %d, Pass: %ld, Remaining: %ld\n",rank,pass,remaining);
+				fflush(stdout);
 			}
-			// or some water can be taken off
-			else 
-			{   // Keep grid cell on scan list because still above original elevation
-				s1.push(i);
-				s1.push(j);
-				if(verbose)
-				{
-					if(s1.size()>stacksize)
-					{
-						long psz=s1.size();
-						printf("Rank: %d, Stack 1 size: %ld\n",rank,psz);
-						fflush(stdout);
-						stacksize=stacksize+100000;
-					}			
-				}
-				//  condition below is commented out for efficiency.  It has already passed this test from if above
-				if(planchon->getData(i,j,tempFloat) > neighborFloat /*&& elevDEM->getData(i,j,tempFloat) < neighborFloat */)
-				{
-					planchon->setData(i,j,neighborFloat);
+
+	        //  Repeat but with stacks interchanged
+			finished=true;
+			while(!s2.empty()){
+				j=s2.top();
+				s2.pop();
+				i=s2.top();
+				s2.pop();
+				neighborFloat = lowestNeighbor(planchon, planL, i, j, step);
+		//				if( neighborFloat < FLT_MAX ) {  //DGT This check is redundant - because scans start from the side
+					//Set the grid to either elevDEM, all "water" can be taken off"
+				if(elevDEM->getData(i,j, tempFloat) >= neighborFloat ){
+					planchon->setData(i,j, elevDEM->getData(i,j,tempFloat));
 					finished = false;
 				}
-			} 
+				// or some water can be taken off
+				else 
+				{   // Keep grid cell on scan list because still above original elevation
+					s1.push(i);
+					s1.push(j);
+					if(verbose)
+					{
+						if(s1.size()>stacksize)
+						{
+							long psz=s1.size();
+							printf("Rank: %d, Stack 1 size: %ld\n",rank,psz);
+							fflush(stdout);
+							stacksize=stacksize+100000;
+						}			
+					}
+					//  condition below is commented out for efficiency.  It has already passed this test from if above
+					if(planchon->getData(i,j,tempFloat) > neighborFloat /*&& elevDEM->getData(i,j,tempFloat) < neighborFloat */)
+					{
+						planchon->setData(i,j,neighborFloat);
+						finished = false;
+					}
+				} 
+			}
+			planchon->termBegin(finished);
+
+			//scan++;
+			//if(scan == 8) {
+			//	scan=0;
+			//	//Terminate if nothing had been done
+			//	// only check every 8 scans to reduce message passing
+			//	finished = planchon->collectiveTerm(finished);
+			//	////////////////////////////
+			//}
+			//else finished = false;
+			planchon->share();
+			finished = planchon->termEnd();
+
+			//  progress and debug prints
+			if(verbose)
+			{
+				pass=pass+1;
+				long remaining=s1.size();
+				stacksize=100;  // reset stack size
+				printf("Process: %d, Pass: %ld, Remaining: %ld\n",rank,pass,remaining);
+				fflush(stdout);
+			}
 		}
-		finished = planchon->ringTerm(finished);
-
-		//scan++;
-		//if(scan == 8) {
-		//	scan=0;
-		//	//Terminate if nothing had been done
-		//	// only check every 8 scans to reduce message passing
-		//	finished = planchon->ringTerm(finished);
-		//	////////////////////////////
-		//}
-		//else finished = false;
-		planchon->share();
+	}
+}
 
-		//  progress and debug prints
-		if(verbose)
-		{
-			pass=pass+1;
-			long remaining=s1.size();
-			stacksize=100;  // reset stack size
-			printf("Process: %d, Pass: %ld, Remaining: %ld\n",rank,pass,remaining);
-			fflush(stdout);
-		}
+int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbose, 
+           bool is_4Point,bool use_mask,char *maskfile,  // these three added by arb, 5/31/11
+           bool usePriorityFlood)
+{
+
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
+
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+	if(rank==0)
+	{
+		printf("PitRemove version %s\n",TDVERSION);
+		fflush(stdout);
 	}
 
+	double begint = MPI_Wtime();
+
+  //logic for 4-way flow or 8-way flow
+  int step=1;
+  if (is_4Point)
+    step=2;
+
+	//Create tiff object, read and store header info
+	tiffIO dem(demfile,FLOAT_TYPE);
+  tiffIO *depmask;
+  if (use_mask) {
+	  depmask=new tiffIO(maskfile,SHORT_TYPE); // arb added, 5/31/11
+    if (!dem.compareTiff(*depmask))
+    {
+      if (rank==0) {
+        printf("Error: depression mask and input DEM are not similar. Files must have the same number of rows/columns.\n");
+        fflush(stdout);
+      }
+      return 1;
+    }
+  }
+	long totalX = dem.getTotalX();
+	long totalY = dem.getTotalY();
+	double dx = dem.getdx();
+	double dy = dem.getdy();
+
+	//Create partition and read data
+	tdpartition* elevDEM=NULL;
+  tdpartition* maskPartition=NULL;
+	elevDEM = CreateInputPartition(dem);
+  if (use_mask)
+    maskPartition=CreateNewPartition(depmask->getDatatype(), totalX, totalY, dx, dy, depmask->getNodata());
+
+	int nx = elevDEM->getnx();
+	int ny = elevDEM->getny();
+	int xstart, ystart;
+	elevDEM->localToGlobal(0, 0, xstart, ystart);
+
+	double headert = MPI_Wtime();
+
+	if(rank==0)
+	{
+		float timeestimate=(1.5e-6*totalX*totalY/pow((double) size,0.5))/60+1;  // Time estimate in minutes
+		fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
+		fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
+		fflush(stderr);
+	}
+
+	if(verbose)  // debug writes
+	{
+		printf("Header read\n");
+		printf("Process: %d, totalX: %d, totalY: %d\n",rank,totalX,totalY);
+		printf("Process: %d, nx: %d, ny: %d\n",rank,nx,ny);
+		printf("Process: %d, xstart: %d, ystart: %d\n",rank,xstart,ystart);
+    if (use_mask)
+    {
+      printf("Process: %d, Using depression mask data...\n",rank);
+    }
+		fflush(stdout);
+	}
+
+	dem.read(xstart, ystart, ny, nx, elevDEM);	
+  if (use_mask)
+	  depmask->read(xstart, ystart, ny, nx, maskPartition);	
+
+/////////////////////////////////
+// begin timer
+	double readt = MPI_Wtime();
+
+	//Create empty partition to store new information
+	tdpartition *planchon;
+	float felNodata = -3.0e38;
+	planchon = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, felNodata);
+
+	float tempFloat=0;
+
+	if(verbose)
+	{
+		printf("Data read\n");
+		long nxm=nx/2;
+		long nym=ny/2;
+		elevDEM->getData(nxm,nym,tempFloat);
+		printf("Midpoint of partition: %d, nxm: %d, nym: %d, value: %f\n",rank,nxm,nym,tempFloat);
+		fflush(stdout);
+	}
+
+	fillPits(elevDEM, maskPartition, planchon, step, verbose, usePriorityFlood);
+
 	//Stop timer
 	double computet = MPI_Wtime();
 	if(verbose)
@@ -492,7 +766,7 @@ int flood( char* demfile, char* felfile, char *sfdrfile, int usesfdr, bool verbo
 
 	//Create and write TIFF file
 	tiffIO fel(felfile, FLOAT_TYPE, &felNodata, dem);
-	fel.write(xstart, ystart, ny, nx, planchon->getGridPointer());
+	fel.write(xstart, ystart, ny, nx, planchon);
 
 	if(verbose)printf("Partition: %d, written\n",rank);
 	double headerRead, dataRead, compute, write, total,temp;
@@ -0,0 +1,391 @@
+/*  Taudem flow direction kernels
+
+  Slopes of the cells of a row to their neighbors for D8FlowDir and DinfFlowDir, evaluated
+  several cells at a time with AVX2 or AVX-512 where the processor has them.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "commonLib.h"
+#include "flowkernels.h"
+using namespace std;
+
+//  The vector kernels are compiled for their instruction sets function by function, so the rest
+//  of the program runs on any x86 processor
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+static int selectKernelLevel()
+{
+	int level = KERNEL_SCALAR;
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f")) level = KERNEL_AVX512;
+	else if(__builtin_cpu_supports("avx2")) level = KERNEL_AVX2;
+#endif
+	const char *simd = getenv("TAUDEM_SIMD");
+	if(simd != NULL) {
+		if(strcmp(simd,"scalar") == 0) level = KERNEL_SCALAR;
+		else if(strcmp(simd,"avx2") == 0 && level > KERNEL_AVX2) level = KERNEL_AVX2;
+	}
+	return level;
+}
+
+int getKernelLevel()
+{
+	static const int level = selectKernelLevel();
+	return level;
+}
+
+void   VSLOPE(float E0,float E1, float E2,
+			  float D1,float D2,float DD,
+			  float *S,float *A)
+{
+	//SUBROUTINE TO RETURN THE SLOPE AND ANGLE ASSOCIATED WITH A DEM PANEL
+	float S1,S2,AD;
+	if(D1!=0)
+		S1=(E0-E1)/D1;
+	if(D2!=0)
+		S2=(E1-E2)/D2;
+
+	if(S2==0 && S1==0) *A=0;
+	else
+		*A= (float) atan2(S2,S1);
+	AD= (float) atan2(D2,D1);
+	if(*A  <   0.)
+	{
+		*A=0.;
+		*S=S1;
+	}
+	else if(*A > AD)
+	{
+		*A=AD;
+		*S=(E0-E2)/DD;
+	}
+	else
+		*S= (float) sqrt(S1*S1+S2*S2);
+}
+
+//  The facets of SET2.  E1 of facet K is at row offset I1[K] and column offset J1[K], and E2 at
+//  I2[K] and J2[K].  The sides of the facet are DXX[ID1[K]] and DXX[ID2[K]].
+static const int ID1[]= {0,1,2,2,1,1,2,2,1 };
+static const int ID2[]= {0,2,1,1,2,2,1,1,2};
+static const int I1[] = {0,0,-1,-1,0,0,1,1,0 };
+static const int I2[] = {0,-1,-1,-1,-1,1,1,1,1};
+static const int J1[] = {0,1,0,0,-1,-1,0,0,1};
+static const int J2[] = {0,1,1,-1,-1,-1,-1,1,1};
+static const float  ANGC[]={0,0.,1.,1.,2.,2.,3.,3.,4.};
+static const float  ANGF[]={0,1.,-1.,1.,-1.,1.,-1.,1.,-1.};
+
+//  VSLOPE chooses the slope of a facet from the angle of (S1,S2), which the vector kernels find
+//  from the sign of S2*D1-S1*D2 instead of atan2.  Facets where that is within FACET_MARGIN of
+//  0, relative to the size of the terms, are left to VSLOPE so that the choice is the same.
+const float FACET_MARGIN = 1e-4f;
+//  atan2(S2,S1) is rounded to -0 rather than made negative if S2 is this small relative to S1
+const float FACET_TINY = 1e-30f;
+
+static inline void facetSlope(const float *const *rows, long i, int K, const float *DXX, float DD,
+	float *S, float *A)
+{
+	VSLOPE(rows[1][i], rows[1+I1[K]][i+J1[K]], rows[1+I2[K]][i+J2[K]], DXX[ID1[K]], DXX[ID2[K]], DD, S, A);
+}
+
+//  The first facet with the steepest positive slope, or 0
+static int steepestFacet(const float *const *rows, long i, const float *DXX, float DD)
+{
+	float SK, A, SMAX = 0.;
+	int K, KD = 0;
+	for(K=1; K<=8; K++) {
+		facetSlope(rows, i, K, DXX, DD, &SK, &A);
+		if(SK > SMAX) {
+			SMAX = SK;
+			KD = K;
+		}
+	}
+	return KD;
+}
+
+static inline void d8CellSlopes(const float *const *rows, long i, long n, const double *fact,
+	float *cardMax, int *cardDir, float *diag)
+{
+	float slope, smax = 0;
+	int k, dir = 0;
+	for(k=1; k<=8; k++) {
+		slope = fact[k] * ( rows[1][i] - rows[1+d2[k]][i+d1[k]] );
+		if(k%2 == 0) diag[(k/2-1)*n+i] = slope;
+		else if(slope > smax) {
+			smax = slope;
+			dir = k;
+		}
+	}
+	cardMax[i] = smax;
+	cardDir[i] = dir;
+}
+
+#ifdef KERNELS_X86
+//  Each vector kernel evaluates as many cells as fill its vectors and returns the number done.
+//  Comparisons are ordered, so that a NaN slope is never the steepest, as in the scalar code.
+
+__attribute__((target("avx2")))
+static long d8RowSlopesAvx2(const float *const *rows, long n, const double *fact,
+	float *cardMax, int *cardDir, float *diag)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	long i;
+	for(i=0; i+8<=n; i+=8) {
+		__m256 e0 = _mm256_loadu_ps(rows[1]+i);
+		__m256 smax = zero;
+		__m256i dir = _mm256_setzero_si256();
+		for(int k=1; k<=8; k++) {
+			//  fact[k]*drop is evaluated in double then rounded, as in setFlow
+			__m256 drop = _mm256_sub_ps(e0, _mm256_loadu_ps(rows[1+d2[k]]+i+d1[k]));
+			__m256d f = _mm256_set1_pd(fact[k]);
+			__m128 lo = _mm256_cvtpd_ps(_mm256_mul_pd(f, _mm256_cvtps_pd(_mm256_castps256_ps128(drop))));
+			__m128 hi = _mm256_cvtpd_ps(_mm256_mul_pd(f, _mm256_cvtps_pd(_mm256_extractf128_ps(drop, 1))));
+			__m256 slope = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+			if(k%2 == 0) _mm256_storeu_ps(diag+(k/2-1)*n+i, slope);
+			else {
+				__m256 steeper = _mm256_cmp_ps(slope, smax, _CMP_GT_OQ);
+				smax = _mm256_blendv_ps(smax, slope, steeper);
+				dir = _mm256_blendv_epi8(dir, _mm256_set1_epi32(k), _mm256_castps_si256(steeper));
+			}
+		}
+		_mm256_storeu_ps(cardMax+i, smax);
+		_mm256_storeu_si256((__m256i*)(cardDir+i), dir);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static long dinfFacetsAvx2(const float *const *rows, long n, const float *DXX, float DD, int *facet)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 dd = _mm256_set1_ps(DD);
+	const __m256 margin = _mm256_set1_ps(FACET_MARGIN);
+	const __m256 tiny = _mm256_set1_ps(FACET_TINY);
+	long i;
+	for(i=0; i+8<=n; i+=8) {
+		__m256 e0 = _mm256_loadu_ps(rows[1]+i);
+		__m256 smax = zero;
+		__m256i kd = _mm256_setzero_si256();
+		for(int K=1; K<=8; K++) {
+			__m256 e1 = _mm256_loadu_ps(rows[1+I1[K]]+i+J1[K]);
+			__m256 e2 = _mm256_loadu_ps(rows[1+I2[K]]+i+J2[K]);
+			__m256 D1 = _mm256_set1_ps(DXX[ID1[K]]);
+			__m256 D2 = _mm256_set1_ps(DXX[ID2[K]]);
+			__m256 s1 = _mm256_div_ps(_mm256_sub_ps(e0, e1), D1);
+			__m256 s2 = _mm256_div_ps(_mm256_sub_ps(e1, e2), D2);
+			__m256 sk = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(s1, s1), _mm256_mul_ps(s2, s2)));
+			__m256 sdiag = _mm256_div_ps(_mm256_sub_ps(e0, e2), dd);
+
+			__m256 s1pos = _mm256_cmp_ps(s1, zero, _CMP_GT_OQ);
+			__m256 s1neg = _mm256_cmp_ps(s1, zero, _CMP_LT_OQ);
+			__m256 s1nonpos = _mm256_cmp_ps(s1, zero, _CMP_LE_OQ);
+			__m256 s2pos = _mm256_cmp_ps(s2, zero, _CMP_GT_OQ);
+			__m256 s2neg = _mm256_cmp_ps(s2, zero, _CMP_LT_OQ);
+			__m256 s2zero = _mm256_cmp_ps(s2, zero, _CMP_EQ_OQ);
+			__m256 s2sign = _mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(s2), 31));
+			__m256 t = _mm256_sub_ps(_mm256_mul_ps(s2, D1), _mm256_mul_ps(s1, D2));
+			__m256 bound = _mm256_mul_ps(margin, _mm256_add_ps(_mm256_mul_ps(s1, D1), _mm256_mul_ps(s2, D2)));
+			__m256 above = _mm256_cmp_ps(t, bound, _CMP_GT_OQ);
+			__m256 below = _mm256_cmp_ps(t, _mm256_sub_ps(zero, bound), _CMP_LT_OQ);
+
+			//  Angle above the diagonal, and below 0, which includes atan2(-0,S1) = -pi for S1 < 0
+			__m256 diag = _mm256_or_ps(_mm256_and_ps(s2pos, _mm256_or_ps(s1nonpos, above)),
+				_mm256_andnot_ps(s2sign, _mm256_and_ps(s2zero, s1neg)));
+			__m256 neg = _mm256_or_ps(s2neg, _mm256_and_ps(s2sign, _mm256_and_ps(s2zero, s1neg)));
+			__m256 unsure = _mm256_or_ps(
+				_mm256_andnot_ps(_mm256_or_ps(above, below), _mm256_and_ps(s1pos, s2pos)),
+				_mm256_and_ps(_mm256_and_ps(s2neg, s1pos), _mm256_cmp_ps(_mm256_mul_ps(tiny, s1), _mm256_sub_ps(zero, s2), _CMP_GT_OQ)));
+			sk = _mm256_blendv_ps(sk, s1, neg);
+			sk = _mm256_blendv_ps(sk, sdiag, diag);
+			int unsureMask = _mm256_movemask_ps(unsure);
+			if(unsureMask) {
+				float S[8], A;
+				_mm256_storeu_ps(S, sk);
+				for(int l=0; l<8; l++)
+					if(unsureMask & (1 << l)) facetSlope(rows, i+l, K, DXX, DD, &S[l], &A);
+				sk = _mm256_loadu_ps(S);
+			}
+
+			__m256 steeper = _mm256_cmp_ps(sk, smax, _CMP_GT_OQ);
+			smax = _mm256_blendv_ps(smax, sk, steeper);
+			kd = _mm256_blendv_epi8(kd, _mm256_set1_epi32(K), _mm256_castps_si256(steeper));
+		}
+		_mm256_storeu_si256((__m256i*)(facet+i), kd);
+	}
+	return i;
+}
+
+__attribute__((target("avx512f")))
+static long d8RowSlopesAvx512(const float *const *rows, long n, const double *fact,
+	float *cardMax, int *cardDir, float *diag)
+{
+	const __m512 zero = _mm512_setzero_ps();
+	long i;
+	for(i=0; i+16<=n; i+=16) {
+		__m512 e0 = _mm512_loadu_ps(rows[1]+i);
+		__m512 smax = zero;
+		__m512i dir = _mm512_setzero_si512();
+		for(int k=1; k<=8; k++) {
+			__m512 drop = _mm512_sub_ps(e0, _mm512_loadu_ps(rows[1+d2[k]]+i+d1[k]));
+			__m512d f = _mm512_set1_pd(fact[k]);
+			__m256 lo = _mm512_cvtpd_ps(_mm512_mul_pd(f, _mm512_cvtps_pd(_mm512_castps512_ps256(drop))));
+			__m256 hi = _mm512_cvtpd_ps(_mm512_mul_pd(f, _mm512_cvtps_pd(
+				_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(drop), 1)))));
+			__m512 slope = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)),
+				_mm256_castps_pd(hi), 1));
+			if(k%2 == 0) _mm512_storeu_ps(diag+(k/2-1)*n+i, slope);
+			else {
+				__mmask16 steeper = _mm512_cmp_ps_mask(slope, smax, _CMP_GT_OQ);
+				smax = _mm512_mask_blend_ps(steeper, smax, slope);
+				dir = _mm512_mask_blend_epi32(steeper, dir, _mm512_set1_epi32(k));
+			}
+		}
+		_mm512_storeu_ps(cardMax+i, smax);
+		_mm512_storeu_si512(cardDir+i, dir);
+	}
+	return i;
+}
+
+__attribute__((target("avx512f")))
+static long dinfFacetsAvx512(const float *const *rows, long n, const float *DXX, float DD, int *facet)
+{
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512i zeroi = _mm512_setzero_si512();
+	const __m512 dd = _mm512_set1_ps(DD);
+	const __m512 margin = _mm512_set1_ps(FACET_MARGIN);
+	const __m512 tiny = _mm512_set1_ps(FACET_TINY);
+	long i;
+	for(i=0; i+16<=n; i+=16) {
+		__m512 e0 = _mm512_loadu_ps(rows[1]+i);
+		__m512 smax = zero;
+		__m512i kd = zeroi;
+		for(int K=1; K<=8; K++) {
+			__m512 e1 = _mm512_loadu_ps(rows[1+I1[K]]+i+J1[K]);
+			__m512 e2 = _mm512_loadu_ps(rows[1+I2[K]]+i+J2[K]);
+			__m512 D1 = _mm512_set1_ps(DXX[ID1[K]]);
+			__m512 D2 = _mm512_set1_ps(DXX[ID2[K]]);
+			__m512 s1 = _mm512_div_ps(_mm512_sub_ps(e0, e1), D1);
+			__m512 s2 = _mm512_div_ps(_mm512_sub_ps(e1, e2), D2);
+			//  Rounded forms, which the compiler does not contract to fused multiply adds
+			__m512 sk = _mm512_sqrt_ps(_mm512_add_round_ps(_mm512_mul_round_ps(s1, s1, _MM_FROUND_CUR_DIRECTION),
+				_mm512_mul_round_ps(s2, s2, _MM_FROUND_CUR_DIRECTION), _MM_FROUND_CUR_DIRECTION));
+			__m512 sdiag = _mm512_div_ps(_mm512_sub_ps(e0, e2), dd);
+
+			__mmask16 s1pos = _mm512_cmp_ps_mask(s1, zero, _CMP_GT_OQ);
+			__mmask16 s1neg = _mm512_cmp_ps_mask(s1, zero, _CMP_LT_OQ);
+			__mmask16 s1nonpos = _mm512_cmp_ps_mask(s1, zero, _CMP_LE_OQ);
+			__mmask16 s2pos = _mm512_cmp_ps_mask(s2, zero, _CMP_GT_OQ);
+			__mmask16 s2neg = _mm512_cmp_ps_mask(s2, zero, _CMP_LT_OQ);
+			__mmask16 s2zero = _mm512_cmp_ps_mask(s2, zero, _CMP_EQ_OQ);
+			__mmask16 s2sign = _mm512_cmp_epi32_mask(_mm512_castps_si512(s2), zeroi, _MM_CMPINT_LT);
+			__m512 t = _mm512_sub_ps(_mm512_mul_ps(s2, D1), _mm512_mul_ps(s1, D2));
+			__m512 bound = _mm512_mul_ps(margin, _mm512_add_ps(_mm512_mul_ps(s1, D1), _mm512_mul_ps(s2, D2)));
+			__mmask16 above = _mm512_cmp_ps_mask(t, bound, _CMP_GT_OQ);
+			__mmask16 below = _mm512_cmp_ps_mask(t, _mm512_sub_ps(zero, bound), _CMP_LT_OQ);
+
+			__mmask16 diag = (s2pos & (s1nonpos | above)) | (s2zero & s1neg & ~s2sign);
+			__mmask16 neg = s2neg | (s2zero & s1neg & s2sign);
+			__mmask16 unsure = (s1pos & s2pos & ~(above | below)) |
+				(s2neg & s1pos & _mm512_cmp_ps_mask(_mm512_mul_ps(tiny, s1), _mm512_sub_ps(zero, s2), _CMP_GT_OQ));
+			sk = _mm512_mask_blend_ps(neg, sk, s1);
+			sk = _mm512_mask_blend_ps(diag, sk, sdiag);
+			if(unsure) {
+				float S[16], A;
+				_mm512_storeu_ps(S, sk);
+				for(int l=0; l<16; l++)
+					if(unsure & (1 << l)) facetSlope(rows, i+l, K, DXX, DD, &S[l], &A);
+				sk = _mm512_loadu_ps(S);
+			}
+
+			__mmask16 steeper = _mm512_cmp_ps_mask(sk, smax, _CMP_GT_OQ);
+			smax = _mm512_mask_blend_ps(steeper, smax, sk);
+			kd = _mm512_mask_blend_epi32(steeper, kd, _mm512_set1_epi32(K));
+		}
+		_mm512_storeu_si512(facet+i, kd);
+	}
+	return i;
+}
+#endif
+
+void d8RowSlopes(const float *above, const float *row, const float *below, long n, const double *fact,
+	float *cardMax, int *cardDir, float *diag)
+{
+	const float *rows[3] = {above, row, below};
+	long i = 0;
+#ifdef KERNELS_X86
+	int level = getKernelLevel();
+	if(level == KERNEL_AVX512) i = d8RowSlopesAvx512(rows, n, fact, cardMax, cardDir, diag);
+	else if(level == KERNEL_AVX2) i = d8RowSlopesAvx2(rows, n, fact, cardMax, cardDir, diag);
+#endif
+	for(; i<n; i++) d8CellSlopes(rows, i, n, fact, cardMax, cardDir, diag);
+}
+
+void dinfRowDirections(const float *above, const float *row, const float *below, long n, const float *DXX,
+	float DD, float *ang, float *slope)
+{
+	const float *rows[3] = {above, row, below};
+	if(n <= 0) return;
+	vector<int> facet(n);
+	long i = 0;
+#ifdef KERNELS_X86
+	int level = getKernelLevel();
+	if(level == KERNEL_AVX512) i = dinfFacetsAvx512(rows, n, DXX, DD, &facet[0]);
+	else if(level == KERNEL_AVX2) i = dinfFacetsAvx2(rows, n, DXX, DD, &facet[0]);
+#endif
+	for(; i<n; i++) facet[i] = steepestFacet(rows, i, DXX, DD);
+
+	//  The angle is only needed on the steepest facet
+	float S, A;
+	int K;
+	for(i=0; i<n; i++) {
+		K = facet[i];
+		if(K > 0) {
+			facetSlope(rows, i, K, DXX, DD, &S, &A);
+			ang[i] = (float) (ANGC[K]*(PI/2)+ANGF[K]*A);
+			slope[i] = S;
+		}
+		else {
+			ang[i] = -1.;
+			slope[i] = 0.;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+/*  Taudem flow direction kernels
+
+  Slopes of the cells of a row of a DEM to their neighbors, for the cells away from the edges of
+  a partition, used by D8FlowDir and DinfFlowDir.  Several cells are evaluated at once with AVX2
+  or AVX-512 instructions where the processor has them, chosen when first called, and otherwise
+  one at a time.  All give the same results.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#ifndef FLOWKERNELS_H
+#define FLOWKERNELS_H
+
+//  Instruction sets used by the kernels.  The highest the processor has is used, unless the
+//  environment variable TAUDEM_SIMD is set to scalar or avx2 to use a lower one.
+enum kernelLevel { KERNEL_SCALAR = 0, KERNEL_AVX2 = 1, KERNEL_AVX512 = 2 };
+int getKernelLevel();
+
+//  Slope and angle of the Dinf facet with corner elevations E0, E1 and E2, sides D1 and D2 and
+//  diagonal DD (Tarboton 1997)
+void VSLOPE(float E0, float E1, float E2, float D1, float D2, float DD, float *S, float *A);
+
+//  In both row kernels below, above, row and below point at the first of n cells of three
+//  consecutive rows, and the cells either side of the n cells must be valid.  Values of cells
+//  that are no data or next to no data are meaningless.
+
+//  D8 slopes, fact[k]*(drop to neighbor k) as in setFlow.  cardMax and cardDir are set to the
+//  steepest positive slope of the cardinal directions 1, 3, 5 and 7, the first if there are
+//  several, and its direction, or 0 and 0 if there is none.  diag holds the slopes of the
+//  diagonal directions 2, 4, 6 and 8, as 4 rows of n.
+void d8RowSlopes(const float *above, const float *row, const float *below, long n, const double *fact,
+	float *cardMax, int *cardDir, float *diag);
+
+//  Dinf directions and slopes, as SET2 sets them, with DXX and DD as in SET2.  ang is -1 where
+//  there is no positive slope, with slope 0.
+void dinfRowDirections(const float *above, const float *row, const float *below, long n, const float *DXX,
+	float DD, float *ang, float *slope);
+
+#endif
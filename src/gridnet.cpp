@@ -46,136 +46,90 @@ email:  dtarb@usu.edu
 #include "linearpart.h"
 #include "createpart.h"
 #include "tiffIO.h"
+#include "stages.h"
+#include "threadqueue.h"
+#include "d8cells.h"
 using namespace std;
 
 
 
 
-int gridnet( char *pfile, char *plenfile, char *tlenfile, char *gordfile, char *maskfile,
-		char *shfile, int useMask, int useOutlets, int thresh) 
-{//1
-
-	MPI_Init(NULL,NULL);{
-
-	int rank,size;
-	MPI_Comm_rank(MCW,&rank);//returns the rank of the calling processes in a communicator
-	MPI_Comm_size(MCW,&size);//returns the number of processes in a communicator
-	if(rank==0)printf("GridNet version %s\n",TDVERSION);
-		
-	double *x, *y;
-	int numOutlets=0;
-	bool usingShapeFile=false;
-
-	double begint = MPI_Wtime();
-	if( useOutlets == 1) {//3
-		if(rank==0){//4
-			if(readoutlets(shfile, &numOutlets, x, y)==0){
-//				for(int i=0; i< numOutlets; i++)
-//					printf("rank: %d, X: %lf, Y: %lf\n",rank,x[i],y[i]);
-				usingShapeFile=true;
-			//	printf("Rank: %d, numOutlets: %d\n",rank,numOutlets);
-				MPI_Bcast(&numOutlets, 1, MPI_INT, 0, MCW);
-				MPI_Bcast(x, numOutlets, MPI_DOUBLE, 0, MCW);
-				MPI_Bcast(y, numOutlets, MPI_DOUBLE, 0, MCW);
-				//printf("after bcast\n"); fflush(stdout);
-			}//5
-			else {
-				printf("Error opening shapefile. Exiting \n");
-				MPI_Abort(MCW,5);
+void gridnetCells::evaluate(long i, long j)
+{
+	long in,jn;
+	short k;
+	float tempFloat;
+	short tempShort;
+	long tempLong;
+
+	//  Here is where the flow algebra is evaluated
+	short a1,a2;
+	float ld;
+	if(maskData == NULL || maskData->getData(i,j,tempLong)>=thresh)
+	{
+		tempFloat=0.0f;  //  Initialize to 0
+		tlen->setData(i,j,tempFloat);  
+		plen->setData(i,j,tempFloat);
+		a1=0;
+		a2=0;	
+		for(k=1; k<=8; k++)
+		{  
+			in=i+d1[k];
+			jn=j+d2[k];
+		   /* test if neighbor drains towards cell excluding boundaries */
+			short sdir = flowData->getData(in,jn,tempShort);
+			if(sdir > 0) 
+			{
+				if( (maskData == NULL || maskData->getData(in,jn,tempLong)>=thresh) && (sdir-k==4 || sdir-k==-4))
+				{
+					//  Implement Strahler ordering 
+					if(gord->getData(in,jn,tempShort) >= a1)
+					{
+						a2=a1;
+						a1=gord->getData(in,jn,tempShort);
+					}
+					else if ( gord->getData(in,jn,tempShort) > a2 )
+						a2=gord->getData(in,jn,tempShort);
+					//  Length calculations
+					ld= plen->getData(in,jn,tempFloat) + dist[sdir];
+					tlen->addToData(i,j,(float)(tlen->getData(in,jn,tempFloat)+dist[sdir]));
+					if( ld > plen->getData(i,j,tempFloat))
+						plen->setData(i,j,ld);
+				}
 			}
-	}//4
-		else {
-			//int countPts;
-			//MPI_Bcast(&countPts, 1, MPI_INT, 0, MCW);
-			MPI_Bcast(&numOutlets, 1, MPI_INT, 0, MCW);
-
-			//x = (double*) malloc( sizeof( double ) * numOutlets );
-			//y = (double*) malloc( sizeof( double ) * numOutlets );
-			x = new double[numOutlets];
-			y = new double[numOutlets];
-
-			MPI_Bcast(x, numOutlets, MPI_DOUBLE, 0, MCW);
-			MPI_Bcast(y, numOutlets, MPI_DOUBLE, 0, MCW);
-			usingShapeFile=true;
-			//printf("Rank: %d, numOutlets: %d\n",rank,numOutlets);
-		}
-	}//3
-	//printf("Rank: %d, Numoutlets: %d\n",rank,numOutlets); fflush(stdout);
-//	for(int i=0; i< numOutlets; i++)
-//		printf("rank: %d, X: %lf, Y: %lf\n",rank,x[i],y[i]);
-
-	//Create tiff object, read and store header info
-	tiffIO p(pfile,SHORT_TYPE);
-	long totalX = p.getTotalX();
-	long totalY = p.getTotalY();
-	double dx = p.getdx();
-	double dy = p.getdy();
-	if(rank==0)
-		{
-			float timeestimate=(1.2e-6*totalX*totalY/pow((double) size,0.65))/60+1;  // Time estimate in minutes
-			fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
-			fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
-			fflush(stderr);
 		}
+		if(a2+1 > a1) gord->setData(i,j,(short)(a2+1));
+		else gord->setData(i,j,(short)a1);
+	}
+}
 
-	//printf("After header read %d\n",rank);   fflush(stdout);
-
-	//Create partition and read data
-	tdpartition *flowData;
-	flowData = CreateNewPartition(p.getDatatype(), totalX, totalY, dx, dy, p.getNodata());
+//  Evaluates the longest upslope length plen, total upslope length tlen and Strahler order gord
+//  of every cell from the directions in flowData, or only of the cells upslope of the outlets if
+//  useOutlets is 1.  Cells are only counted where maskData is at least thresh.  If maskData is
+//  NULL every cell is counted.
+void evaluateGridNet(tdpartition *flowData, tdpartition *maskData, int thresh, int useOutlets,
+	int *outletsX, int *outletsY, int numOutlets, tdpartition *plen, tdpartition *tlen, tdpartition *gord)
+{
+	int size;
+	MPI_Comm_size(MCW,&size);
+	long totalX = flowData->gettotalx();
+	long totalY = flowData->gettotaly();
+	double dx = flowData->getdx();
+	double dy = flowData->getdy();
 	int nx = flowData->getnx();
 	int ny = flowData->getny();
-	int xstart, ystart;
-	flowData->localToGlobal(0, 0, xstart, ystart);
-	p.read(xstart, ystart, ny, nx, flowData->getGridPointer());
-	//printf("Pfile read");  fflush(stdout);
-
-	//if using Mask, create partion and read it
-	tdpartition *maskData;
-	if( useMask == 1){
-		tiffIO mask(maskfile,LONG_TYPE);
-		if(!p.compareTiff(mask)) {
-			printf("File sizes do not match\n%s\n",maskfile);
-			MPI_Abort(MCW,5);
-			return 1;  
-		}
-		maskData = CreateNewPartition(mask.getDatatype(), totalX, totalY, dx, dy, mask.getNodata());
-		mask.read(xstart, ystart, maskData->getny(), maskData->getnx(), maskData->getGridPointer());
-	}
-	else
+	bool ownMask = (maskData == NULL);
+	if(ownMask)
 	{
 		maskData = CreateNewPartition(LONG_TYPE, totalX, totalY, dx, dy, 1);
 		thresh=0;  //  Here we have a partition filled with ones and a 0 threshold so mask condition is always satisfied
 	}
-	//Begin timer
-	double readt = MPI_Wtime();
-	//printf("Read time %lf\n",readt);
-	//fflush(stdout);
-
-	//Convert geo coords to grid coords
-	int *outletsX, *outletsY;
-	if(usingShapeFile) {
-		outletsX = new int[numOutlets];
-		outletsY = new int[numOutlets];
-		for( int i=0; i<numOutlets; i++)
-			p.geoToGlobalXY(x[i], y[i], outletsX[i], outletsY[i]);
-	}
 
-	//Create empty partition to store new information
-	tdpartition *plen;
-	tdpartition *tlen;
-	tdpartition *gord;
-	plen = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, -1.0f);
-	tlen = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, -1.0f);
-	gord = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, -1);
-
-	// con is used to check for contamination at the edges
 	long i,j;
 	short k;
 	long in,jn;
 	float area;
-	bool con=false, finished;
-	float tempFloat=0.0;
+	bool finished;
 	short tempShort=0;
 	long tempLong=0;
 
@@ -200,7 +154,7 @@ int gridnet( char *pfile, char *plenfile, char *tlenfile, char *gordfile, char *
 	node temp;
 	queue<node> que;
 
-	if(!usingShapeFile) {
+	if(useOutlets != 1) {
 		//Treat gord like area in aread8.  Initialize to 1
 		for(j=0; j<ny; j++) {
 			for(i=0; i<nx; i++ ) {
@@ -341,61 +295,37 @@ int gridnet( char *pfile, char *plenfile, char *tlenfile, char *gordfile, char *
 					toBeEvaled.push(temp);
 				}
 			}
-			finished = neighbor->ringTerm( finished );
+			finished = neighbor->collectiveTerm( finished );
 		}
 
 	}
 
+	linearpart<uint8_t> *flowL = dynamic_cast<linearpart<uint8_t>*>(flowData);
+	linearpart<short> *neighborL = dynamic_cast<linearpart<short>*>(neighbor);
+	gridnetCells cells;
+	cells.flowData = flowData;
+	cells.maskData = maskData;
+	cells.plen = plen;
+	cells.tlen = tlen;
+	cells.gord = gord;
+	cells.thresh = thresh;
+	cells.dist = dist;
+	int numThreads = getNumThreads();
+
 	finished = false;
 	//Ring terminating while loop
 	while(!finished) {
+		//  With threads the queue is evaluated by drainQueueThreaded and the loop below is skipped
+		if(numThreads > 1 && flowL != NULL && neighborL != NULL)
+			drainQueueThreaded(que, neighborL, cells, numThreads);
 		while(!que.empty()){
 			//Takes next node with no contributing neighbors
 			temp = que.front();
 			que.pop();
 			i = temp.x;
 			j = temp.y;	
-			if(flowData->isInPartition(i,j)){   // DGT thinks this is redundant - nothing should be on queue that is not in partition - but does no harm
-				//  Here is where the flow algebra is evaluated
-				short a1,a2;
-				float ld;
-				if(maskData->getData(i,j,tempLong)>=thresh)
-				{
-					tempFloat=0.0f;  //  Initialize to 0
-					tlen->setData(i,j,tempFloat);  
-					plen->setData(i,j,tempFloat);
-					a1=0;
-					a2=0;	
-					for(k=1; k<=8; k++)
-					{  
-						in=i+d1[k];
-						jn=j+d2[k];
-					   /* test if neighbor drains towards cell excluding boundaries */
-						short sdir = flowData->getData(in,jn,tempShort);
-						if(sdir > 0) 
-						{
-							if( maskData->getData(in,jn,tempLong)>=thresh && (sdir-k==4 || sdir-k==-4))
-							{
-								//  Implement Strahler ordering 
-								if(gord->getData(in,jn,tempShort) >= a1)
-								{
-									a2=a1;
-									a1=gord->getData(in,jn,tempShort);
-								}
-								else if ( gord->getData(in,jn,tempShort) > a2 )
-									a2=gord->getData(in,jn,tempShort);
-								//  Length calculations
-								ld= plen->getData(in,jn,tempFloat) + dist[sdir];
-								tlen->addToData(i,j,(float)(tlen->getData(in,jn,tempFloat)+dist[sdir]));
-								if( ld > plen->getData(i,j,tempFloat))
-									plen->setData(i,j,ld);
-							}
-						}
-					}
-					if(a2+1 > a1) gord->setData(i,j,(short)(a2+1));
-					else gord->setData(i,j,(short)a1);
-				}
-			}
+			if(flowData->isInPartition(i,j))   // DGT thinks this is redundant - nothing should be on queue that is not in partition - but does no harm
+				cells.evaluate(i,j);
 
 			//  End of evaluation of flow algebra
 			// Drain cell into surrounding neighbors
@@ -422,25 +352,133 @@ int gridnet( char *pfile, char *plenfile, char *tlenfile, char *gordfile, char *
 		tlen->share();
 
 		//If this created a cell with no contributing neighbors, put it on the queue
-		for(i=0; i<nx; i++){
-			if(neighbor->getData(i, -1, tempShort)!=0 && neighbor->getData(i, 0, tempShort)==0){
-				temp.x = i;
-				temp.y = 0;
-				que.push(temp);
-			}
-			if(neighbor->getData(i, ny, tempShort)!=0 && neighbor->getData(i, ny-1, tempShort)==0){
-				temp.x = i;
-				temp.y = ny-1;
-				que.push(temp); 
-			}
-		}
+		queueBorderCells(neighbor, &que);
 		//Clear out borders
 		neighbor->clearBorders();
 	
 		//Check if done
 		finished = que.empty();
-		finished = gord->ringTerm(finished);
+		finished = gord->collectiveTerm(finished);
 	}
+	delete neighbor;
+	if(ownMask) delete maskData;
+}
+
+int gridnet( char *pfile, char *plenfile, char *tlenfile, char *gordfile, char *maskfile,
+		char *shfile, int useMask, int useOutlets, int thresh) 
+{//1
+
+	int threadSupport;
+	MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&threadSupport);{
+
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);//returns the rank of the calling processes in a communicator
+	MPI_Comm_size(MCW,&size);//returns the number of processes in a communicator
+	if(rank==0)printf("GridNet version %s\n",TDVERSION);
+		
+	double *x, *y;
+	int numOutlets=0;
+	bool usingShapeFile=false;
+
+	double begint = MPI_Wtime();
+	if( useOutlets == 1) {//3
+		if(rank==0){//4
+			if(readoutlets(shfile, &numOutlets, x, y)==0){
+//				for(int i=0; i< numOutlets; i++)
+//					printf("rank: %d, X: %lf, Y: %lf\n",rank,x[i],y[i]);
+				usingShapeFile=true;
+			//	printf("Rank: %d, numOutlets: %d\n",rank,numOutlets);
+				MPI_Bcast(&numOutlets, 1, MPI_INT, 0, MCW);
+				MPI_Bcast(x, numOutlets, MPI_DOUBLE, 0, MCW);
+				MPI_Bcast(y, numOutlets, MPI_DOUBLE, 0, MCW);
+				//printf("after bcast\n"); fflush(stdout);
+			}//5
+			else {
+				printf("Error opening shapefile. Exiting \n");
+				MPI_Abort(MCW,5);
+			}
+	}//4
+		else {
+			//int countPts;
+			//MPI_Bcast(&countPts, 1, MPI_INT, 0, MCW);
+			MPI_Bcast(&numOutlets, 1, MPI_INT, 0, MCW);
+
+			//x = (double*) malloc( sizeof( double ) * numOutlets );
+			//y = (double*) malloc( sizeof( double ) * numOutlets );
+			x = new double[numOutlets];
+			y = new double[numOutlets];
+
+			MPI_Bcast(x, numOutlets, MPI_DOUBLE, 0, MCW);
+			MPI_Bcast(y, numOutlets, MPI_DOUBLE, 0, MCW);
+			usingShapeFile=true;
+			//printf("Rank: %d, numOutlets: %d\n",rank,numOutlets);
+		}
+	}//3
+	//printf("Rank: %d, Numoutlets: %d\n",rank,numOutlets); fflush(stdout);
+//	for(int i=0; i< numOutlets; i++)
+//		printf("rank: %d, X: %lf, Y: %lf\n",rank,x[i],y[i]);
+
+	//Create tiff object, read and store header info
+	tiffIO p(pfile,BYTE_TYPE);
+	long totalX = p.getTotalX();
+	long totalY = p.getTotalY();
+	double dx = p.getdx();
+	double dy = p.getdy();
+	if(rank==0)
+		{
+			float timeestimate=(1.2e-6*totalX*totalY/pow((double) size,0.65))/60+1;  // Time estimate in minutes
+			fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
+			fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
+			fflush(stderr);
+		}
+
+	//printf("After header read %d\n",rank);   fflush(stdout);
+
+	//Create partition and read data
+	tdpartition *flowData;
+	flowData = CreateNewPartition(p.getDatatype(), totalX, totalY, dx, dy, p.getNodata());
+	int nx = flowData->getnx();
+	int ny = flowData->getny();
+	int xstart, ystart;
+	flowData->localToGlobal(0, 0, xstart, ystart);
+	p.read(xstart, ystart, ny, nx, flowData->getGridPointer());
+	//printf("Pfile read");  fflush(stdout);
+
+	//if using Mask, create partion and read it
+	tdpartition *maskData = NULL;
+	if( useMask == 1){
+		tiffIO mask(maskfile,LONG_TYPE);
+		if(!p.compareTiff(mask)) {
+			printf("File sizes do not match\n%s\n",maskfile);
+			MPI_Abort(MCW,5);
+			return 1;  
+		}
+		maskData = CreateNewPartition(mask.getDatatype(), totalX, totalY, dx, dy, mask.getNodata());
+		mask.read(xstart, ystart, maskData->getny(), maskData->getnx(), maskData->getGridPointer());
+	}
+	//Begin timer
+	double readt = MPI_Wtime();
+	//printf("Read time %lf\n",readt);
+	//fflush(stdout);
+
+	//Convert geo coords to grid coords
+	int *outletsX, *outletsY;
+	if(usingShapeFile) {
+		outletsX = new int[numOutlets];
+		outletsY = new int[numOutlets];
+		for( int i=0; i<numOutlets; i++)
+			p.geoToGlobalXY(x[i], y[i], outletsX[i], outletsY[i]);
+	}
+
+	//Create empty partition to store new information
+	tdpartition *plen;
+	tdpartition *tlen;
+	tdpartition *gord;
+	plen = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, -1.0f);
+	tlen = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dx, dy, -1.0f);
+	gord = CreateNewPartition(SHORT_TYPE, totalX, totalY, dx, dy, -1);
+
+	evaluateGridNet(flowData, maskData, thresh, useOutlets, outletsX, outletsY, numOutlets, plen, tlen, gord);
 
 	//Stop timer
 	double computet = MPI_Wtime();
@@ -60,25 +60,48 @@ class linearpart : public tdpartition {
 		//long nx, ny;
 		//double dx, dy;
 		int rank, size;
+		long yoffset;  //  Global row of local row 0
 		MPI_Datatype MPI_type;
 		datatype noData;
+		//  The partition is stored in one allocation of ny+2 rows.  The first and last rows
+		//  hold the borders shared from the adjacent processes, so that rows -1 to ny can be
+		//  addressed as gridData+y*nx.  topBorder and bottomBorder point to these rows.
+		datatype *storage;
 		datatype *gridData;
 		datatype *topBorder;
 		datatype *bottomBorder;
+		//  Memory mapping holding storage for partitions made by initMapped, otherwise NULL,
+		//  and the function that unmaps it
+		void *mapBase;
+		size_t mapLength;
+		void (*unmapStorage)(void *mapBase, size_t mapLength);
+		void setRows(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd);
+
+		//  Persistent requests and send buffer for exchanging borders, created on first use
+		MPI_Request exchangeRequests[4];
+		int numExchangeRequests;
+		datatype *sendBuffer;
+		void initExchange();
+		void startExchange(datatype *top, datatype *bottom);
+		void waitExchange();
 
 	public:
-		linearpart():tdpartition(){}
+		linearpart():tdpartition(){storage=NULL; sendBuffer=NULL; numExchangeRequests=-1; mapBase=NULL;}
 		~linearpart();
 
 		void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd);
+		template <class fileType> bool initMapped(fileType &file, MPI_Datatype MPIt, datatype nd);
 		bool isInPartition(int x, int y);
 		bool hasAccess(int x, int y);
 
 		void share();
+		void shareBegin();
+		void shareEnd();
 		void passBorders();
+		void passBordersBegin();
+		void passBordersEnd();
 		void addBorders();
 		void clearBorders();
-		int ringTerm(int isFinished);
 		
 		bool globalToLocal(int globalX, int globalY, int &localX, int &localY);
 		void localToGlobal(int localX, int localY, int &globalX, int &globalY);
@@ -92,11 +115,33 @@ class linearpart : public tdpartition {
 		//int gettotalx(){return totalx;}
 		//int gettotaly(){return totaly;}
 		void* getGridPointer(){return gridData;}
+		bool hasByteCells(){return sizeof(datatype) == 1;}
 		bool isNodata(long x, long y);
 		void setToNodata(long x, long y);
 		datatype getData(long x, long y, datatype &val);
 		void setData(long x, long y, datatype val);
 		void addToData(long x, long y, datatype val);
+
+		//Typed, non-virtual accessors for hot loops.  getRowPointer returns a pointer to
+		//row y of the partition, where y=-1 and y=ny give the border rows shared from the
+		//adjacent processes.  The Unchecked accessors do no bounds or border tests and
+		//must only be used for 0<=x<nx and -1<=y<=ny.  isInterior is true when all
+		//eight neighbors of (x,y) are within the partition.
+		datatype* getRowPointer(long y){return gridData+y*nx;}
+		bool isInterior(long x, long y){return (x>0 && x<nx-1 && y>0 && y<ny-1);}
+		datatype getNodataValue(){return noData;}
+		bool isNodataUnchecked(long x, long y){return (abs((float)(gridData[x+y*nx]-noData))<MINEPS);}
+		datatype getDataUnchecked(long x, long y){return gridData[x+y*nx];}
+		void setDataUnchecked(long x, long y, datatype val){gridData[x+y*nx]=val;}
+		void addToDataUnchecked(long x, long y, datatype val){gridData[x+y*nx]+=val;}
+		//Atomic version of addToDataUnchecked for threaded evaluation.  Returns the new value.
+		datatype addToDataAtomic(long x, long y, datatype val){
+			datatype *cell = gridData+x+y*nx;
+			datatype result;
+			#pragma omp atomic capture seq_cst
+			{ *cell += val; result = *cell; }
+			return result;
+		}
 				
 		//void areaD(queue<node> *que);
 
@@ -112,15 +157,20 @@ class linearpart : public tdpartition {
 //Destructor.  Just frees up memory.
 template <class datatype>
 linearpart<datatype>::~linearpart(){
-	delete [] gridData;
-	delete [] bottomBorder;
-	delete [] topBorder;
+	int finalized;
+	MPI_Finalized(&finalized);
+	if(!finalized)
+		for(int i=0; i<numExchangeRequests; i++) MPI_Request_free(&exchangeRequests[i]);
+	if(mapBase != NULL)
+		unmapStorage(mapBase, mapLength);
+	else
+		delete [] storage;
+	delete [] sendBuffer;
 }
 
-//Init routine.  Takes the total number of rows and columns in the ENTIRE grid to be partitioned,
-//dx and dy for the grid, MPI datatype (should match the template declaration), and noData value.
+//Sets the rows of this process and the other member data set by init and initMapped
 template <class datatype>
-void linearpart<datatype>::init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd){
+void linearpart<datatype>::setRows(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd){
 	MPI_Comm_rank(MCW,&rank);
 	MPI_Comm_size(MCW,&size);
 
@@ -128,41 +178,73 @@ void linearpart<datatype>::init(long totalx, long totaly, double dx_in, double d
 	this->totalx = totalx;
 	this->totaly = totaly;
 	nx = totalx;
-	ny = totaly / size;
-	if(rank == size-1)  ny += (totaly % size); //Add extra rows to the last process
+	//  Use the row split set for this grid if there is one, otherwise divide rows evenly
+	if(!getRowSplit(totaly, rank, yoffset, ny)) {
+		ny = totaly / size;
+		yoffset = rank * ny;
+		if(rank == size-1)  ny += (totaly % size); //Add extra rows to the last process
+	}
 	dx = dx_in;
 	dy = dy_in;
 	MPI_type = MPIt;
 	noData = nd;
+}
+
+//Init routine.  Takes the total number of rows and columns in the ENTIRE grid to be partitioned,
+//dx and dy for the grid, MPI datatype (should match the template declaration), and noData value.
+template <class datatype>
+void linearpart<datatype>::init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd){
+	setRows(totalx, totaly, dx_in, dy_in, MPIt, nd);
 
 	//Allocate memory for data and fill with noData value.  Catch exceptions
 	uint64_t prod;  //   use long 64 bit number to hold the product to allocate
 	try
 	{
 		prod=nx*ny;
-		gridData = new datatype[prod];
-		topBorder = new datatype[nx];
-		bottomBorder = new datatype[nx];
+		storage = new datatype[(uint64_t)nx*(ny+2)];
 	}
 	catch(bad_alloc&)
 	{
 	//  DGT added clause below to try trap for insufficient memory in the computer.
 		fprintf(stdout,"Memory allocation error during partition initialization in process %d.\n",rank);
 		fprintf(stdout,"NCols: %ld, NRows: %ld, NCells: %ld\n",nx,ny,prod);
+		fprintf(stdout,"The -cache option holds grids larger than memory in scratch files.\n");
 		fflush(stdout);
 		MPI_Abort(MCW,-999);
 	}
 
-	for(uint64_t j=0; j<nx; j++){
-		for(uint64_t i=0; i<ny; i++) gridData[i*nx+j] = noData;
-		topBorder[j] = noData;
-		bottomBorder[j] = noData;
-	}
+	gridData = storage + nx;
+	topBorder = storage;
+	bottomBorder = gridData + prod;
+	for(uint64_t i=0; i<(uint64_t)nx*(ny+2); i++) storage[i] = noData;
 
 	//TODO: find out what these are for
 	after1=after2=before1=before2=NULL;
 }
 
+//Init for the grid of file, a tiffIO, with the storage a private memory mapping of the rows of
+//this process in the file (see tiffIO::mapRows) rather than allocated.  The grid is then in the
+//partition without reading it.  The border rows are set to noData as by init.  Returns false,
+//leaving the partition without storage, if the file cannot be mapped.
+template <class datatype>
+template <class fileType>
+bool linearpart<datatype>::initMapped(fileType &file, MPI_Datatype MPIt, datatype nd){
+	setRows(file.getTotalX(), file.getTotalY(), file.getdx(), file.getdy(), MPIt, nd);
+	storage = (datatype*)file.mapRows(yoffset, ny, mapBase, mapLength);
+	if(storage == NULL) return false;
+	unmapStorage = fileType::unmapRows;
+
+	gridData = storage + nx;
+	topBorder = storage;
+	bottomBorder = gridData + (uint64_t)nx*ny;
+	for(long i=0; i<nx; i++) {
+		topBorder[i] = noData;
+		bottomBorder[i] = noData;
+	}
+	after1=after2=before1=before2=NULL;
+	return true;
+}
+
 
 //Returns true if (x,y) is in partition
 template <class datatype>
@@ -187,127 +269,83 @@ bool linearpart<datatype>::hasAccess( int x, int y) {
 	return false;
 }
 
-//Shares border information between adjacent processes.  Border information is stored
-//in the "topBorder" and "bottomBorder" arrays of each process.
+//Creates the persistent requests used to exchange borders with the adjacent processes.
+//Rows are sent from a preallocated buffer and received directly into the border rows,
+//so the same requests serve both share and passBorders.
 template <class datatype>
-void linearpart<datatype>::share() {
-	MPI_Status status;
-	if(size<=1) return; //if there is only one process, we're all done sharing
-
-
-	datatype *ptr;
-	int place;
-	datatype *buf;
-	int bsize=nx*sizeof(datatype)+MPI_BSEND_OVERHEAD; 
-	buf = new datatype[bsize];
-
-	if(rank<size-1){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(gridData+((ny-1)*nx), nx, MPI_type, rank+1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank >0)	MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
+void linearpart<datatype>::initExchange() {
+	numExchangeRequests = 0;
+	if(size<=1) return;
+	sendBuffer = new datatype[2*nx];
 	if(rank>0){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(gridData, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank<size-1) MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-
-	delete [] buf;   // added by dww -- why not elsewhere?
-
-/*
-	if(rank == 0){ //Top partition in grid - only send and receive the bottom
-		
-//		cout << rank << " 1" << endl;
-		MPI_Bsend(gridData+((ny-1)*nx), nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-//		cout << rank << " end" << endl;
+		MPI_Recv_init(topBorder, nx, MPI_type, rank-1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+		MPI_Send_init(sendBuffer, nx, MPI_type, rank-1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+	}
+	if(rank<size-1){
+		MPI_Recv_init(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+		MPI_Send_init(sendBuffer+nx, nx, MPI_type, rank+1, 0, MCW, &exchangeRequests[numExchangeRequests++]);
+	}
+}
 
-	}else if(rank == size-1){ //Bottom partition - only send and receive top
-		MPI_Bsend(gridData, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-//		cout << rank << " end" << endl;
+//Starts sending the rows top and bottom to the processes above and below.  The rows are
+//copied to the send buffer so the partition may be modified while the exchange is in flight.
+template <class datatype>
+void linearpart<datatype>::startExchange(datatype *top, datatype *bottom) {
+	if(size<=1) return; //if there is only one process, we're all done sharing
+	if(numExchangeRequests<0) initExchange();
+	if(rank>0) memcpy(sendBuffer, top, nx*sizeof(datatype));
+	if(rank<size-1) memcpy(sendBuffer+nx, bottom, nx*sizeof(datatype));
+	MPI_Startall(numExchangeRequests, exchangeRequests);
+}
 
-	}else{ //Send and receive top and bottom
-		MPI_Bsend(gridData+((ny-1)*nx), nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
+//Waits for the exchange started by shareBegin or passBordersBegin to complete.
+template <class datatype>
+void linearpart<datatype>::waitExchange() {
+	if(numExchangeRequests>0) MPI_Waitall(numExchangeRequests, exchangeRequests, MPI_STATUSES_IGNORE);
+}
 
-		MPI_Buffer_detach(&ptr,&place);
-		MPI_Buffer_attach(buf,bsize);
+//Shares border information between adjacent processes.  Border information is received
+//directly into the "topBorder" and "bottomBorder" rows of each process.
+//shareBegin starts the exchange and shareEnd completes it.  Between the two calls the
+//border rows must not be used, but the rest of the partition may be read and written.
+template <class datatype>
+void linearpart<datatype>::shareBegin() {
+	startExchange(gridData, gridData+(ny-1)*nx);
+}
 
-		MPI_Bsend(gridData, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-//		cout << rank << " end" << endl;
+template <class datatype>
+void linearpart<datatype>::shareEnd() {
+	waitExchange();
+}
 
-	}
-	MPI_Buffer_detach(&ptr,&place);
-*/
+template <class datatype>
+void linearpart<datatype>::share() {
+	shareBegin();
+	shareEnd();
 }
 
 //Swaps border information between adjacent processes.  In this way, no data is
 //overwritten.  If this function is called a second time, the original state is
-//restored.
+//restored.  passBordersBegin and passBordersEnd split the exchange as for share.
 template <class datatype>
-void linearpart<datatype>::passBorders() {
-	MPI_Status status;
-	if(size<=1) return; //if there is only one process, we're all done sharing
-
-	datatype *ptr;
-	int place;
-	datatype *buf;
-	datatype *tempBorder;
-	int bsize=nx*sizeof(datatype)+MPI_BSEND_OVERHEAD; 
-	buf = new datatype[bsize];
-	tempBorder = new datatype[nx];
-
-	if(rank<size-1){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(bottomBorder, nx, MPI_type, rank+1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank >0)	MPI_Recv(tempBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-	if(rank>0){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(topBorder, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank<size-1) MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-	memmove(topBorder,tempBorder,nx*sizeof(datatype)); 
-
-	delete [] buf;   // added by dww -- why not elsewhere?
-	delete [] tempBorder;
-
-
-/*
-
-
-	if(rank == 0){ //Top partition in grid - only send and receive the bottom
-		MPI_Bsend(bottomBorder, nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
+void linearpart<datatype>::passBordersBegin() {
+	startExchange(topBorder, bottomBorder);
+}
 
-	}else if(rank == size-1){ //Bottom partition - only send and receive top
-		MPI_Bsend(topBorder, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
+template <class datatype>
+void linearpart<datatype>::passBordersEnd() {
+	waitExchange();
+}
 
-	}else{ //Send and receive top and bottom
-		MPI_Bsend(bottomBorder, nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-
-		MPI_Buffer_detach(&ptr,&place);
-		MPI_Buffer_attach(buf,bsize);
-
-		MPI_Bsend(topBorder, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-	}
-	MPI_Buffer_detach(&ptr,&place);
-*/
-
-
+template <class datatype>
+void linearpart<datatype>::passBorders() {
+	passBordersBegin();
+	passBordersEnd();
 }
 
 //Swaps border information between adjacent processes,
 //then adds the values from received borders to the local copies.
+//Borders that are not adjacent to another process are not added.
 template <class datatype>
 void linearpart<datatype>::addBorders(){
 	//Start by calling passBorders to get information.
@@ -316,12 +354,15 @@ void linearpart<datatype>::addBorders(){
 	uint64_t i;
 	for(i=0; i<nx; i++){
 		//Add the values passed in from other process
-		if(isNodata(i,-1) || isNodata(i,0)) setData(i, 0, noData);
-		else addToData(i, 0, topBorder[i]);
-
-		if(isNodata(i, ny) || isNodata(i, ny-1)) setData(i, ny-1, noData);
-		else addToData(i, ny-1, bottomBorder[i]);
+		if(rank > 0){
+			if(isNodata(i,-1) || isNodata(i,0)) setData(i, 0, noData);
+			else addToData(i, 0, topBorder[i]);
+		}
 
+		if(rank < size-1){
+			if(isNodata(i, ny) || isNodata(i, ny-1)) setData(i, ny-1, noData);
+			else addToData(i, ny-1, bottomBorder[i]);
+		}
 	}
 }
 
@@ -336,63 +377,13 @@ void linearpart<datatype>::clearBorders(){
 }
 
 
-//TODO: revisit the way this function works.  I don't like it.
-//      It really shouldn't even be here.
-template <class datatype>
-int linearpart<datatype>::ringTerm(int isFinished) {
-	int ringBool = isFinished;
-	//The parameter isFinished tells us if the que is empty.
-	MPI_Status status;
-	//Ring termination check
-//	cout << rank << " ring Term begin" << endl;
-	if(size>1) {
-		//First processor will send a token.  It will tell the next proc if it is done or not
-		if( rank==0 ) {
-		//	cout << rank << " sending..." << endl;
-			MPI_Send( &ringBool, 1, MPI_INT, rank+1 ,1,MCW);
-			//cout << rank << " reciving..." << endl;
-			MPI_Recv( &ringBool, 1,MPI_INT, size-1,1,MCW,&status);
-			//cout << rank << " finished ..." << endl;
-		}
-		//The rest of the processors recv, if they are not finished, they change the token to NOTFINISHED
-		else {
-			//cout << rank << " reciving ..." << endl;
- 			MPI_Recv( &ringBool, 1,MPI_INT, rank-1,1,MCW,&status);
-			//cout << rank << " sending ..." << endl;
-			if( isFinished == NOTFINISHED ) ringBool = NOTFINISHED;
-			MPI_Send( &ringBool, 1,MPI_INT, (rank+1)%size, 1, MCW);
-			//cout << rank << " finished ..." << endl;
-		}
-
-		//If the token came back as FINISHED, all ranks may quit, but first they need to know they can quit.
-		// First proc sends ringBool=FINISHED or NOTFINISHED, each processor sends it on until the last recieves it
-		if( rank==0 ) {
-			//cout << " distribute results" << endl;
-			MPI_Send( &ringBool, 1, MPI_INT, rank+1 ,1,MCW);
-		}
-		else {
-			//cout << " recive results" << endl;
-			MPI_Recv( &ringBool, 1,MPI_INT, rank-1,1,MCW,&status);
-			if( rank!=size-1)
-				MPI_Send( &ringBool, 1,MPI_INT, (rank+1)%size, 1, MCW);
-		}
-	}
-	//cout << rank <<" ring term end" << endl;
-	return ringBool; 
-}
-
 //Converts global coordinates (for the whole grid) to local coordinates (for this
 //partition).  Function returns TRUE only if the coordinates are contained
 //in this partition.
 template <class datatype>
 bool linearpart<datatype>::globalToLocal(int globalX, int globalY, int &localX, int &localY){
 	localX = globalX;
-	localY = globalY - rank * ny;
-	//  For the last process ny is greater than the size of the other partitions so rank*ny does not get the row right.
-	//  totaly%size was added to ny for the last partition, so the size of partitions above is actually 
-	//  ny - totaly%size  (the remainder from dividing totaly by size).
-	if(rank == size-1) 
-		localY = globalY - rank * (ny - totaly%size); 
+	localY = globalY - yoffset;
 	return isInPartition(localX, localY);
 } 
 
@@ -400,9 +391,7 @@ bool linearpart<datatype>::globalToLocal(int globalX, int globalY, int &localX,
 template <class datatype>
 void linearpart<datatype>::localToGlobal(int localX, int localY, int &globalX, int &globalY){
 	globalX = localX;
-	globalY = rank * ny + localY;
-	if(rank == size-1) 
-		globalY = rank * (ny - totaly%size) + localY;
+	globalY = yoffset + localY;
 }
 
 //TODO: Figure out what this function is actually for.
@@ -410,11 +399,8 @@ void linearpart<datatype>::localToGlobal(int localX, int localY, int &globalX, i
 template <class datatype>
 int linearpart<datatype>::getGridXY( int x, int y, int *i, int *j) {
 	*i = *j = -1;
-	int numRowsPerProc = ny/size;
-	int starty = numRowsPerProc*rank;
-	if( rank == size-1)
-		numRowsPerProc += (totaly%size);
-	int  endy = starty + numRowsPerProc;
+	int starty = yoffset;
+	int  endy = starty + ny;
 	if( x >= 0 && x < nx && y >= starty && y < endy) {
 		*i = x;
 		*j = y - starty;
@@ -471,12 +457,8 @@ bool linearpart<datatype>::isNodata(long inx, long iny){
 	x = inx;
 	y = iny;
 //DGT to avoid nested calls and type inconsistency
-	if(x>=0 && x<nx && y>=0 && y<ny)return (abs((float)(gridData[x+y*nx]-noData))<MINEPS);  
-//	if(isInPartition(x,y)) return (abs(gridData[x+y*nx]-noData)<MINEPS);
-	else if(x>=0 && x<nx){
-		if(y==-1) return (abs((float)(topBorder[x]-noData))<MINEPS);
-		else if(y==ny) return (abs((float)(bottomBorder[x]-noData))<MINEPS);
-	}
+	//  Rows -1 and ny are the borders, stored contiguously with the partition
+	if(x>=0 && x<nx && y>=-1 && y<=ny)return (abs((float)(gridData[x+y*nx]-noData))<MINEPS);  
 	return true;
 }
 
@@ -486,12 +468,7 @@ void linearpart<datatype>::setToNodata(long inx, long iny){
 	int64_t x, y;
 	x = inx;
 	y = iny;
-	if(x>=0 && x<nx && y>=0 && y<ny) gridData[x+y*nx] = noData;
-//	if(isInPartition(x,y)) gridData[x+y*nx] = noData;
-	else if(x>=0 && x<nx){
-		if(y==-1) topBorder[x] = noData;
-		else if(y==ny) bottomBorder[x] = noData;
-	}
+	if(x>=0 && x<nx && y>=-1 && y<=ny) gridData[x+y*nx] = noData;
 }
 
 //Returns the element in the grid with coordinate (x,y).
@@ -500,12 +477,7 @@ datatype linearpart<datatype>::getData(long inx, long iny, datatype &val) {
 	int64_t x, y;
 	x = inx;
 	y = iny;
-//	if(isInPartition(x,y)) val = gridData[x+y*nx];
-	if(x>=0 && x<nx && y>=0 && y<ny) val = gridData[x+y*nx];
-	else if(x>=0 && x<nx){
-		if(y==-1) val = topBorder[x];
-		else if(y==ny) val = bottomBorder[x];
-	}
+	if(x>=0 && x<nx && y>=-1 && y<=ny) val = gridData[x+y*nx];
 	return val;
 }
 
@@ -515,12 +487,7 @@ void linearpart<datatype>::setData(long inx, long iny, datatype val){
 	int64_t x, y;
 	x = inx;
 	y = iny;
-//	if(isInPartition(x,y)) gridData[x+y*nx] = val;
-	if(x>=0 && x<nx && y>=0 && y<ny) gridData[x+y*nx] = val;
-	else if(x>=0 && x<nx){
-		if(y==-1) topBorder[x] = val;
-		else if(y==ny) bottomBorder[x] = val;
-	}
+	if(x>=0 && x<nx && y>=-1 && y<=ny) gridData[x+y*nx] = val;
 }
 
 //Increments the element in the grid by the specified value.
@@ -529,11 +496,6 @@ void linearpart<datatype>::addToData(long inx, long iny, datatype val){
 	int64_t x, y;
 	x = inx;
 	y = iny;
-//	if(isInPartition(x,y)) gridData[x+y*nx] += val;
-	if(x>=0 && x<nx && y>=0 && y<ny) gridData[x+y*nx] += val;
-	else if(x>=0 && x<nx){
-		if(y==-1) topBorder[x] += val;
-		else if(y==ny) bottomBorder[x] += val;
-	}
+	if(x>=0 && x<nx && y>=-1 && y<=ny) gridData[x+y*nx] += val;
 }
 #endif
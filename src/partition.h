@@ -40,6 +40,7 @@ email:  dtarb@usu.edu
 
 #include "commonLib.h"
 #include <stdio.h>
+#include <stdint.h>
 #ifndef PARTITION_H
 #define PARTITION_H
 
@@ -49,19 +50,51 @@ class tdpartition{
 		long nx, ny;
 		double dx, dy;
 
+		//  State of a pending nonblocking termination vote
+		MPI_Request termRequest;
+		int termVote, termResult;
+
 	public:
-		tdpartition(){}
+		tdpartition(){termRequest=MPI_REQUEST_NULL;}
 		virtual ~tdpartition(){}
 
 		virtual bool isInPartition(int, int) = 0;
  		virtual bool hasAccess(int, int) = 0;
 		virtual bool isNodata(long x, long y) = 0;
 
+		//Border exchanges of all partitions use the same tags with the same adjacent processes,
+		//so when the exchanges of several partitions are in flight at once (shareBegin and
+		//passBordersBegin before the matching End calls), every process must begin them for the
+		//same partitions in the same order.  Messages between two processes with the same tag
+		//are matched in the order they are sent, which is all that pairs each receive with the
+		//send of the same partition.  A mismatch is not detected.
 		virtual void share() = 0;
+		virtual void shareBegin() = 0;
+		virtual void shareEnd() = 0;
 		virtual void passBorders() = 0;
+		virtual void passBordersBegin() = 0;
+		virtual void passBordersEnd() = 0;
 		virtual void addBorders() = 0;
 		virtual void clearBorders() = 0;
-		virtual int ringTerm(int isFinished) = 0;
+
+		//Termination check for iterative algorithms.  Returns FINISHED only if isFinished is
+		//FINISHED (nonzero) on every process.  This is a collective call.
+		int collectiveTerm(int isFinished){
+			termVote = (isFinished == NOTFINISHED) ? NOTFINISHED : FINISHED;
+			MPI_Allreduce(&termVote, &termResult, 1, MPI_INT, MPI_MIN, MCW);
+			return termResult;
+		}
+		//Nonblocking form of collectiveTerm.  termBegin casts the vote and termEnd returns the
+		//result, so a process may keep working (for example exchanging borders or draining
+		//local work that does not change its vote) while the vote is pending.
+		void termBegin(int isFinished){
+			termVote = (isFinished == NOTFINISHED) ? NOTFINISHED : FINISHED;
+			MPI_Iallreduce(&termVote, &termResult, 1, MPI_INT, MPI_MIN, MCW, &termRequest);
+		}
+		int termEnd(){
+			MPI_Wait(&termRequest, MPI_STATUS_IGNORE);
+			return termResult;
+		}
 
 		virtual bool globalToLocal(int globalX, int globalY, int &localX, int &localY) = 0;
 		virtual void localToGlobal(int localX, int localY, int &globalX, int &globalY) = 0;
@@ -85,13 +118,33 @@ class tdpartition{
 		//from tdpartition can be template classes.  These classes MUST declare as
 		//their template type one of the types declared for these functions.
 		virtual void* getGridPointer(){return (void*)NULL;}
+		//Partitions without a grid pointer copy rows to and from arrays of their datatype
+		//with these, so that grids can be read and written a band of rows at a time.
+		virtual void getRows(long, long, void*){
+			printf("Attempt to copy rows from a partition with a grid pointer\n");
+			MPI_Abort(MCW,47);
+		}
+		virtual void putRows(long, long, const void*){
+			printf("Attempt to copy rows to a partition with a grid pointer\n");
+			MPI_Abort(MCW,48);
+		}
 		virtual void setToNodata(long x, long y) = 0;
 
 		virtual void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, short nd){}
 		virtual void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, long nd){}
 		virtual void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, float nd){}
+		virtual void init(long, long, double, double, MPI_Datatype, uint8_t){}
+		virtual void init(long, long, double, double, MPI_Datatype, double){}
+		virtual void init(long, long, double, double, MPI_Datatype, long long){}
+
+		//Byte grids (uint8_t) may also be accessed with the short functions, so that flow
+		//directions held as bytes are read and written with short variables.  Values written
+		//must be byte values.
+		virtual bool hasByteCells(){return false;}
 
-		virtual short getData(long, long, short&){
+		virtual short getData(long x, long y, short &val){
+			uint8_t byteVal = 0;
+			if(hasByteCells()) return val = getData(x, y, byteVal);
 			printf("Attempt to access short grid with incorrect data type\n");
 			MPI_Abort(MCW,41);return 0;
 		}
@@ -103,14 +156,32 @@ class tdpartition{
 			printf("Attempt to access float grid with incorrect data type\n");
 			MPI_Abort(MCW,43);return 0;
 		}
+		virtual uint8_t getData(long, long, uint8_t&){
+			printf("Attempt to access byte grid with incorrect data type\n");
+			MPI_Abort(MCW,44);return 0;
+		}
+		virtual double getData(long, long, double&){
+			printf("Attempt to access double grid with incorrect data type\n");
+			MPI_Abort(MCW,45);return 0;
+		}
+		virtual long long getData(long, long, long long&){
+			printf("Attempt to access 64 bit integer grid with incorrect data type\n");
+			MPI_Abort(MCW,46);return 0;
+		}
 
-		virtual void setData(long, long, short){}
+		virtual void setData(long x, long y, short val){if(hasByteCells()) setData(x, y, (uint8_t)val);}
 		virtual void setData(long, long, long){}
 		virtual void setData(long, long, float){}
+		virtual void setData(long, long, uint8_t){}
+		virtual void setData(long, long, double){}
+		virtual void setData(long, long, long long){}
 
-		virtual void addToData(long, long, short){}
+		virtual void addToData(long x, long y, short val){if(hasByteCells()) addToData(x, y, (uint8_t)val);}
 		virtual void addToData(long, long, long){}
 		virtual void addToData(long, long, float){}
+		virtual void addToData(long, long, uint8_t){}
+		virtual void addToData(long, long, double){}
+		virtual void addToData(long, long, long long){}
 };
 #endif
 
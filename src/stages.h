@@ -0,0 +1,87 @@
+/*  Taudem stage functions
+
+  The computations of the tools that taudem_pipeline runs in one process, on partitions held in
+  memory.  Each tool reads its input files into partitions, calls its stage function and writes
+  the partitions it fills.  The caller creates the output partitions and calls MPI_Init and
+  MPI_Finalize.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#ifndef STAGES_H
+#define STAGES_H
+
+#include "commonLib.h"
+
+//  PitRemove (flood.cpp).  planchon is a float grid, maskPartition a depression mask or NULL.
+void fillPits(tdpartition *elevDEM, tdpartition *maskPartition, tdpartition *planchon, int step,
+	bool verbose, bool usePriorityFlood);
+
+//  D8FlowDir (d8.cpp).  flowDir is a byte grid and slope a float grid.  The borders of elevDEM
+//  must have been shared.
+long setD8Slopes(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slope, int useflowfile);
+void resolveD8Flats(tdpartition *elevDEM, tdpartition *flowDir, long numFlat);
+
+//  DinfFlowDir (dinf.cpp).  flowDir and slope are float grids.
+long setPosDirDinf(tdpartition *elevDEM, tdpartition *flowDir, tdpartition *slope, int useflowfile);
+void resolveDinfFlats(tdpartition *elevDEM, tdpartition *flowDir, long numFlat);
+
+//  D8 and Dinf directions of the same elevations (d8.cpp), with the flat searches they have in
+//  common done once.  numFlatD8 and numFlatDinf are the counts setD8Slopes and setPosDirDinf return.
+void resolveFlowFlats(tdpartition *elevDEM, tdpartition *d8Dir, long numFlatD8, tdpartition *dinfDir, long numFlatDinf);
+
+//  AreaD8 (aread8.cpp) and AreaDinf (areadinf.cpp).  weightData is a float grid or NULL.
+void evaluateAreaD8(tdpartition *flowData, tdpartition *weightData, tdpartition *aread8, DATA_TYPE areaDatatype,
+	int useOutlets, int *outletsX, int *outletsY, int numOutlets, int usew, int contcheck);
+void evaluateAreaDinf(tdpartition *flowData, tdpartition *weightData, tdpartition *areadinf, DATA_TYPE areaDatatype,
+	int useOutlets, int *outletsX, int *outletsY, int numOutlets, int usew, int contcheck);
+
+//  GridNet (gridnet.cpp).  plen and tlen are float grids and gord a short grid.
+void evaluateGridNet(tdpartition *flowData, tdpartition *maskData, int thresh, int useOutlets,
+	int *outletsX, int *outletsY, int numOutlets, tdpartition *plen, tdpartition *tlen, tdpartition *gord);
+
+//  AreaD8 and GridNet in one sweep (d8accum.cpp), as evaluateAreaD8 and evaluateGridNet with no
+//  outlets and no mask.  aread8 is unweighted and ssa weighted by weightData, of areaDatatype and
+//  ssaDatatype.  aread8, ssa or all of plen, tlen and gord may be NULL to leave them out.
+void evaluateD8Accumulations(tdpartition *flowData, tdpartition *aread8, DATA_TYPE areaDatatype,
+	tdpartition *weightData, tdpartition *ssa, DATA_TYPE ssaDatatype,
+	tdpartition *plen, tdpartition *tlen, tdpartition *gord, int contcheck);
+
+//  PeukerDouglas (PeukerDouglas.cpp).  ss is a byte grid.  elev is smoothed in place.
+void evaluatePeukerDouglas(tdpartition *elev, tdpartition *ss, float *p);
+
+//  Threshold (Threshold.cpp).  ssaData is a float grid and src a byte grid.
+void evaluateThreshold(tdpartition *ssaData, tdpartition *maskData, tdpartition *src, float thresh);
+
+#endif
@@ -462,7 +462,7 @@ int netsetup(char *pfile,char *srcfile,char *ordfile,char *ad8file,char *elevfil
 
 			//Check if done
 			finished = que.empty();
-			finished = contribs->ringTerm(finished);
+			finished = contribs->collectiveTerm(finished);
 		}
 
 		// Timer lengtht
@@ -1248,7 +1248,7 @@ int netsetup(char *pfile,char *srcfile,char *ordfile,char *ad8file,char *elevfil
 			}
 			//Check if done
 			finished = que.empty();
-			finished = contribs->ringTerm(finished);
+			finished = contribs->collectiveTerm(finished);
 		}
 		// Timer - watershed label time
 		double wshedlabt = MPI_Wtime();
@@ -0,0 +1,100 @@
+/*  Taudem threaded queue evaluation
+
+  Evaluation of the cells on a queue in dependency order using the threads of a process.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#ifndef THREADQUEUE_H
+#define THREADQUEUE_H
+
+#include <queue>
+#include <vector>
+#include "commonLib.h"
+#include "linearpart.h"
+using namespace std;
+
+//  Evaluate the cells on que, and the cells downslope of them that become ready, using
+//  numThreads threads.  cells is an object with member functions
+//     void evaluate(long i, long j)           the flow algebra for cell (i,j) in the partition
+//     bool drainsTo(long i, long j, short k)  true if cell (i,j) drains to neighbor k
+//  The cells on que are shared out between threads.  After evaluating a cell a thread decrements
+//  the dependency counts in neighbor of the cells it drains to with atomic updates, and evaluates
+//  the cells it released the last dependency of itself, using its own stack.  Decrements of cells
+//  in the border rows are left in neighbor for addBorders, as in the serial loop.  que is empty
+//  on return.
+template <class cellType>
+void drainQueueThreaded(queue<node> &que, linearpart<short> *neighbor, cellType &cells, int numThreads)
+{
+	vector<node> ready;
+	while(!que.empty()) {
+		ready.push_back(que.front());
+		que.pop();
+	}
+	long numReady = ready.size();
+	long nx = neighbor->getnx();
+	long ny = neighbor->getny();
+
+	#pragma omp parallel num_threads(numThreads)
+	{
+		vector<node> stack;
+		node temp;
+		long i,j,in,jn;
+		short k;
+		#pragma omp for schedule(dynamic,64)
+		for(long r=0; r<numReady; r++) {
+			stack.push_back(ready[r]);
+			while(!stack.empty()) {
+				i = stack.back().x;
+				j = stack.back().y;
+				stack.pop_back();
+				if(neighbor->isInPartition(i,j))
+					cells.evaluate(i,j);
+				for(k=1; k<=8; k++) {
+					if(!cells.drainsTo(i,j,k)) continue;
+					in = i+d1[k];
+					jn = j+d2[k];
+					if(in < 0 || in >= nx || jn < -1 || jn > ny) continue;
+					if(neighbor->addToDataAtomic(in,jn,(short)-1) == 0 && neighbor->isInPartition(in,jn)) {
+						temp.x = in;
+						temp.y = jn;
+						stack.push_back(temp);
+					}
+				}
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,365 @@
+/*  Taudem TIFF compression codecs
+
+  Encoding and decoding of compressed TIFF strips and tiles and of the TIFF predictors.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "tiffCodec.h"
+using namespace std;
+
+bool codecAvailable(short compression)
+{
+	switch(compression) {
+	case COMPRESS_NONE:
+	case COMPRESS_LZW:
+	case COMPRESS_PACKBITS:
+		return true;
+#ifdef HAVE_ZLIB
+	case COMPRESS_DEFLATE:
+	case COMPRESS_ADOBE_DEFLATE:
+		return true;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+bool encoderAvailable(short compression)
+{
+	switch(compression) {
+#ifdef HAVE_ZLIB
+	case COMPRESS_DEFLATE:
+		return true;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+//  TIFF LZW: codes are read most significant bit first, starting at 9 bits and growing a code
+//  before the table fills (the TIFF "early change").  Every string in the table is the string
+//  of an earlier code plus one byte, and was written to out when its code was decoded, so the
+//  table only holds the position and length of each string in out.
+static bool decodeLZW(const unsigned char *in, long inLength, unsigned char *out, long outLength)
+{
+	const int clearCode = 256;
+	const int endCode = 257;
+	vector<long> start(4096), length(4096);
+	int codeBits = 9;
+	int next = 258;
+	long pos = 0;
+	long prevPos = 0, prevLen = 0;
+	unsigned long bitBuffer = 0;
+	int bitCount = 0;
+	long inPos = 0;
+
+	while(pos < outLength)
+	{
+		while(bitCount < codeBits && inPos < inLength)
+		{
+			bitBuffer = (bitBuffer << 8) | in[inPos++];
+			bitCount += 8;
+		}
+		if(bitCount < codeBits) break;
+		int code = (int)((bitBuffer >> (bitCount-codeBits)) & ((1 << codeBits)-1));
+		bitCount -= codeBits;
+
+		if(code == clearCode)
+		{
+			codeBits = 9;
+			next = 258;
+			prevLen = 0;
+			continue;
+		}
+		if(code == endCode) break;
+
+		long len;
+		if(code < 256)
+		{
+			out[pos] = (unsigned char)code;
+			len = 1;
+		}
+		else if(code < next)
+		{
+			len = length[code];
+			memcpy(out+pos, out+start[code], min(len, outLength-pos));
+		}
+		else if(code == next && prevLen > 0)
+		{
+			//  The string of the previous code plus its own first byte
+			len = prevLen+1;
+			memcpy(out+pos, out+prevPos, min(prevLen, outLength-pos));
+			if(pos+prevLen < outLength) out[pos+prevLen] = out[prevPos];
+		}
+		else
+			return false;
+
+		if(prevLen > 0 && next < 4096)
+		{
+			start[next] = prevPos;
+			length[next] = prevLen+1;
+			next++;
+			if(next+1 >= (1 << codeBits) && codeBits < 12) codeBits++;
+		}
+		prevPos = pos;
+		prevLen = len;
+		pos += len;
+	}
+	return pos >= outLength;
+}
+
+static bool decodePackBits(const unsigned char *in, long inLength, unsigned char *out, long outLength)
+{
+	long inPos = 0, pos = 0;
+	while(pos < outLength && inPos < inLength)
+	{
+		int n = (signed char)in[inPos++];
+		if(n >= 0)
+		{
+			//  n+1 literal bytes
+			long count = min((long)n+1, min(outLength-pos, inLength-inPos));
+			memcpy(out+pos, in+inPos, count);
+			pos += count;
+			inPos += n+1;
+		}
+		else if(n != -128 && inPos < inLength)
+		{
+			//  The next byte repeated 1-n times
+			long count = min((long)(1-n), outLength-pos);
+			memset(out+pos, in[inPos++], count);
+			pos += count;
+		}
+	}
+	return pos >= outLength;
+}
+
+#ifdef HAVE_ZLIB
+static bool decodeDeflate(const char *in, long inLength, char *out, long outLength)
+{
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if(inflateInit(&strm) != Z_OK) return false;
+	strm.next_in = (Bytef*)in;
+	strm.avail_in = (uInt)inLength;
+	strm.next_out = (Bytef*)out;
+	strm.avail_out = (uInt)outLength;
+	int ret = inflate(&strm, Z_FINISH);
+	long decoded = outLength - strm.avail_out;
+	inflateEnd(&strm);
+	//  Z_BUF_ERROR means out was filled before the end of the stream
+	return (ret == Z_STREAM_END || ret == Z_BUF_ERROR) && decoded == outLength;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static bool decodeZstd(const char *in, long inLength, char *out, long outLength)
+{
+	size_t decoded = ZSTD_decompress(out, outLength, in, inLength);
+	return !ZSTD_isError(decoded) && (long)decoded == outLength;
+}
+#endif
+
+bool encodeBlock(short compression, const char *in, long inLength, vector<char> &out)
+{
+	switch(compression) {
+	case COMPRESS_NONE:
+		out.assign(in, in+inLength);
+		return true;
+#ifdef HAVE_ZLIB
+	case COMPRESS_DEFLATE:
+		{
+		uLongf outLength = compressBound(inLength);
+		out.resize(outLength);
+		if(compress2((Bytef*)&out[0], &outLength, (const Bytef*)in, inLength, Z_DEFAULT_COMPRESSION) != Z_OK)
+			return false;
+		out.resize(outLength);
+		return true;
+		}
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD:
+		{
+		out.resize(ZSTD_compressBound(inLength));
+		size_t outLength = ZSTD_compress(&out[0], out.size(), in, inLength, 3);
+		if(ZSTD_isError(outLength))
+			return false;
+		out.resize(outLength);
+		return true;
+		}
+#endif
+	default:
+		return false;
+	}
+}
+
+bool decodeBlock(short compression, const char *in, long inLength, char *out, long outLength)
+{
+	switch(compression) {
+	case COMPRESS_NONE:
+		if(inLength < outLength) return false;
+		memcpy(out, in, outLength);
+		return true;
+	case COMPRESS_LZW:
+		return decodeLZW((const unsigned char*)in, inLength, (unsigned char*)out, outLength);
+	case COMPRESS_PACKBITS:
+		return decodePackBits((const unsigned char*)in, inLength, (unsigned char*)out, outLength);
+#ifdef HAVE_ZLIB
+	case COMPRESS_DEFLATE:
+	case COMPRESS_ADOBE_DEFLATE:
+		return decodeDeflate(in, inLength, out, outLength);
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD:
+		return decodeZstd(in, inLength, out, outLength);
+#endif
+	default:
+		return false;
+	}
+}
+
+//  Horizontal differencing: each cell after the first in a row holds the difference from the
+//  cell before, as an unsigned integer of the cell size
+template <class T>
+static void applyHorizontal(char *block, long numRows, long width)
+{
+	for(long r = 0; r < numRows; r++)
+	{
+		char *row = block + r*width*sizeof(T);
+		for(long k = width-1; k > 0; k--)
+		{
+			T val, prev;
+			memcpy(&val, row + k*sizeof(T), sizeof(T));
+			memcpy(&prev, row + (k-1)*sizeof(T), sizeof(T));
+			val = (T)(val - prev);
+			memcpy(row + k*sizeof(T), &val, sizeof(T));
+		}
+	}
+}
+
+template <class T>
+static void undoHorizontal(char *block, long numRows, long width)
+{
+	for(long r = 0; r < numRows; r++)
+	{
+		char *row = block + r*width*sizeof(T);
+		T prev, val;
+		memcpy(&prev, row, sizeof(T));
+		for(long k = 1; k < width; k++)
+		{
+			memcpy(&val, row + k*sizeof(T), sizeof(T));
+			prev = (T)(prev + val);
+			memcpy(row + k*sizeof(T), &prev, sizeof(T));
+		}
+	}
+}
+
+//  Floating point predictor: the bytes of a row are stored most significant byte of every
+//  cell first, then the next byte of every cell, and so on, and the bytes are then
+//  differenced along the row
+static void applyFloat(char *block, long numRows, long width, short dataSize)
+{
+	long rowBytes = width*dataSize;
+	vector<unsigned char> cells(rowBytes);
+	for(long r = 0; r < numRows; r++)
+	{
+		unsigned char *row = (unsigned char*)block + r*rowBytes;
+		memcpy(&cells[0], row, rowBytes);
+		for(long k = 0; k < width; k++)
+			for(short b = 0; b < dataSize; b++)
+				row[(dataSize-b-1)*width + k] = cells[k*dataSize + b];
+		for(long k = rowBytes-1; k > 0; k--)
+			row[k] = (unsigned char)(row[k] - row[k-1]);
+	}
+}
+
+static void undoFloat(char *block, long numRows, long width, short dataSize)
+{
+	long rowBytes = width*dataSize;
+	vector<unsigned char> planes(rowBytes);
+	for(long r = 0; r < numRows; r++)
+	{
+		unsigned char *row = (unsigned char*)block + r*rowBytes;
+		for(long k = 1; k < rowBytes; k++)
+			row[k] = (unsigned char)(row[k] + row[k-1]);
+		memcpy(&planes[0], row, rowBytes);
+		for(long k = 0; k < width; k++)
+			for(short b = 0; b < dataSize; b++)
+				row[k*dataSize + b] = planes[(dataSize-b-1)*width + k];
+	}
+}
+
+void applyPredictor(short predictor, char *block, long numRows, long width, short dataSize)
+{
+	if(predictor == PREDICTOR_HORIZONTAL)
+	{
+		if(dataSize == 1) applyHorizontal<uint8_t>(block, numRows, width);
+		else if(dataSize == 2) applyHorizontal<uint16_t>(block, numRows, width);
+		else if(dataSize == 4) applyHorizontal<uint32_t>(block, numRows, width);
+		else if(dataSize == 8) applyHorizontal<uint64_t>(block, numRows, width);
+	}
+	else if(predictor == PREDICTOR_FLOAT)
+		applyFloat(block, numRows, width, dataSize);
+}
+
+void undoPredictor(short predictor, char *block, long numRows, long width, short dataSize)
+{
+	if(predictor == PREDICTOR_HORIZONTAL)
+	{
+		if(dataSize == 1) undoHorizontal<uint8_t>(block, numRows, width);
+		else if(dataSize == 2) undoHorizontal<uint16_t>(block, numRows, width);
+		else if(dataSize == 4) undoHorizontal<uint32_t>(block, numRows, width);
+		else if(dataSize == 8) undoHorizontal<uint64_t>(block, numRows, width);
+	}
+	else if(predictor == PREDICTOR_FLOAT)
+		undoFloat(block, numRows, width, dataSize);
+}
@@ -0,0 +1,80 @@
+/*  Taudem TIFF compression codecs
+
+  Encoding and decoding of compressed TIFF strips and tiles and of the TIFF predictors.
+
+*/
+
+/*  Copyright (C) 2010  David Tarboton, Utah State University
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+David G. Tarboton
+Utah State University
+8200 Old Main Hill
+Logan, UT 84322-8200
+USA
+http://www.engineering.usu.edu/dtarb/
+email:  dtarb@usu.edu
+*/
+
+//  This software is distributed from http://hydrology.usu.edu/taudem/
+
+#ifndef TIFFCODEC_H
+#define TIFFCODEC_H
+
+#include <vector>
+using namespace std;
+
+//  TIFF Compression tag (259) values
+const short COMPRESS_NONE = 1;
+const short COMPRESS_LZW = 5;
+const short COMPRESS_DEFLATE = 8;
+const short COMPRESS_PACKBITS = (short)32773;
+const short COMPRESS_ADOBE_DEFLATE = (short)32946;
+const short COMPRESS_ZSTD = (short)50000;
+
+//  TIFF Predictor tag (317) values
+const short PREDICTOR_NONE = 1;
+const short PREDICTOR_HORIZONTAL = 2;
+const short PREDICTOR_FLOAT = 3;
+
+//  True if this build can decode data compressed with compression.  Deflate needs zlib
+//  (HAVE_ZLIB) and zstd needs libzstd (HAVE_ZSTD); LZW and PackBits are always available.
+bool codecAvailable(short compression);
+
+//  True if this build can write data compressed with compression, which is Deflate or zstd
+bool encoderAvailable(short compression);
+
+//  Decode the inLength bytes at in to exactly outLength bytes at out.  Returns false if the data
+//  are corrupt or decode to fewer than outLength bytes.  Data past outLength are ignored.
+bool decodeBlock(short compression, const char *in, long inLength, char *out, long outLength);
+
+//  Encode the inLength bytes at in, replacing the contents of out.  COMPRESS_NONE copies them.
+//  Returns false if compression is not COMPRESS_NONE or one that encoderAvailable accepts.
+bool encodeBlock(short compression, const char *in, long inLength, vector<char> &out);
+
+//  Apply the predictor to a block of numRows rows of width cells of dataSize bytes, in place
+void applyPredictor(short predictor, char *block, long numRows, long width, short dataSize);
+
+//  Undo the predictor on a decoded block of numRows rows of width cells of dataSize bytes,
+//  in place.  Data are little endian.
+void undoPredictor(short predictor, char *block, long numRows, long width, short dataSize);
+
+#endif
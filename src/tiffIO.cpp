@@ -41,9 +41,53 @@ email:  dtarb@usu.edu
 #include <mpi.h>
 #include <stdio.h>
 #include <memory>
+#include <vector>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "tiffIO.h"
+#include "tiffCodec.h"
 using namespace std;
 
+//  Value of a cell of file data with sampleFormat and dataSize
+static double fileValue(const void *value, short sampleFormat, short dataSize) {
+	if(sampleFormat == 1) {
+		if(dataSize == 1) return *(const uint8_t*)value;
+		if(dataSize == 2) return *(const uint16_t*)value;
+		if(dataSize == 4) return *(const uint32_t*)value;
+		return (double)*(const uint64_t*)value;
+	}
+	if(sampleFormat == 2) {
+		if(dataSize == 1) return *(const int8_t*)value;
+		if(dataSize == 2) return *(const int16_t*)value;
+		if(dataSize == 4) return *(const int32_t*)value;
+		return (double)*(const int64_t*)value;
+	}
+	if(dataSize == 4) return *(const float*)value;
+	return *(const double*)value;
+}
+
+//  New cell of file data with sampleFormat and dataSize holding value
+static void *newFileValue(double value, short sampleFormat, short dataSize) {
+	if(sampleFormat == 1) {
+		if(dataSize == 1) return new uint8_t((uint8_t)value);
+		if(dataSize == 2) return new uint16_t((uint16_t)value);
+		if(dataSize == 4) return new uint32_t((uint32_t)value);
+		return new uint64_t((uint64_t)value);
+	}
+	if(sampleFormat == 2) {
+		if(dataSize == 1) return new int8_t((int8_t)value);
+		if(dataSize == 2) return new int16_t((int16_t)value);
+		if(dataSize == 4) return new int32_t((int32_t)value);
+		return new int64_t((int64_t)value);
+	}
+	if(dataSize == 4) return new float((float)value);
+	return new double(value);
+}
+
 tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 	MPI_Status status;
 	MPI_Offset mpiOffset;
@@ -59,6 +103,9 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 		MPI_Abort(MCW,21);
 	}
 	strcpy(filename,fname);  // Copy file name
+	readBuffer = NULL;
+	readBufferSize = 0;
+	mappedGrid = NULL;
 			
 	//Generate datatype constants
 	datatype = newtype;
@@ -71,6 +118,15 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 	else if( datatype == FLOAT_TYPE) {
 		dataSizeObj = sizeof (float);
 	}
+	else if( datatype == BYTE_TYPE) {
+		dataSizeObj = sizeof (uint8_t);
+	}
+	else if( datatype == DOUBLE_TYPE) {
+		dataSizeObj = sizeof (double);
+	}
+	else if( datatype == INT64_TYPE) {
+		dataSizeObj = sizeof (int64_t);
+	}
 //	printf("dataSizeObj: %d.\n", dataSizeObj);
 
 	//Read byte order word
@@ -94,13 +150,6 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 		MPI_File_seek( fh, offset, MPI_SEEK_SET );
 	}
 	else if ( version == BIGTIFF ) {
-	
-		//Does not properly handle BIGTIFF right now, so throw error
-		printf("Not a geoTiff file %s\n", fname);
-		printf("TauDEM input files have to be GeoTiff files.\n");
-		printf("The BigTiff format for files greater than 4GB is not yet supported.\n");
-		MPI_Abort(MCW,-1);
-
 		//Read offset bytesize
 		short offsetByteSize;
 		MPI_File_read( fh, &offsetByteSize, 2, MPI_BYTE, &status);
@@ -133,7 +182,9 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 		MPI_File_read( fh, &numEntries, 2, MPI_BYTE, &status);
 	}
 	else {
-		MPI_File_read( fh, &numEntries, 8, MPI_BYTE, &status);
+		uint64_t numEntries8;
+		MPI_File_read( fh, &numEntries8, 8, MPI_BYTE, &status);
+		numEntries = (unsigned short) numEntries8;
 	}
 
 	//ifds = ( ifd*) malloc( sizeof(ifd) * numEntries );
@@ -150,7 +201,10 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 	int noDataDef = 0;
 	long rasterTypeIndex = 0;
 	int origRasterType = 0;
+	uint32_t rational[2];
 	tileOrRow = 0;
+	compression = COMPRESS_NONE;
+	predictor = PREDICTOR_NONE;
 	
 	filedata.geoKeySize =0;
 	filedata.geoDoubleSize=0;
@@ -171,7 +225,7 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 		case 258: //BitsPerSample, unsigned short
 			if( ifds[index].offset % 8 != 0 ) {
 				printf("Error opening file %s.\n", fname);
-				printf("Datasize is %d bits. Must be multiple of 8 (a byte)\n",ifds[index].offset);	
+				printf("Datasize is %d bits. Must be multiple of 8 (a byte)\n",(int)ifds[index].offset);	
 				printf("TauDEM input files have to be GeoTiff files.\n");
 				MPI_Abort(MCW,4);
 			}
@@ -179,31 +233,19 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 			dataSizeFileIn = (unsigned short) (ifds[index].offset/8); //always an unsigned short
 			break;
 		case 259: //Compression, unsigned short
-			if( ifds[index].offset != 1 ) {
+			compression = (short) ifds[index].offset;
+			if( !codecAvailable(compression) ) {
 				printf("Error opening file %s.\n", fname);
-				printf("Tiff file compressed. Unable to process compressed tiff files.\n");
+				printf("Tiff file compressed with compression type %d which this build is unable to read.\n", (unsigned short)compression);
+				printf("Supported compression types are LZW, PackBits, and Deflate and ZSTD when built with zlib and zstd.\n");
 				MPI_Abort(MCW,-4);
 			}
 			break;
-		case 273: //StripOffsets, unsigned short or long
+		case 273: //StripOffsets, unsigned short or long or long long
 			tileOrRow = 2;
-			//BT numOffsets = (unsigned long) (ifds[index].count);
-			//BT offsets = (unsigned long long*) malloc( 4*ifds[index].count);
 			numOffsets = ifds[index].count;
-			//SizeOf offsets = (long*) malloc( 4*ifds[index].count);
-			offsets = (uint32_t*) malloc(sizeof(uint32_t)*ifds[index].count);  //DGT
-			//if the stripoffset data is within the 4 bytes stored within the IFD
-			if( ifds[index].count == 1)
-				offsets[0] = ifds[index].offset;
-			//else use those 4 bytes to find the actual stripoffset data
-			else {
-				mpiOffset = ifds[index].offset;
-				MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-				//BT for(unsigned long long i=0; i<ifds[index].count;++i) {
-				for(unsigned long i=0; i<ifds[index].count;++i) {
-  					MPI_File_read( fh, &offsets[i], 4, MPI_BYTE, &status);
-				}
-			}
+			offsets = (uint64_t*) malloc(sizeof(uint64_t)*ifds[index].count);
+			readTagValues(ifds[index], offsets);
 			break;
 		case 277: //SamplesPerPixel, unsigned short
 			if( ifds[index].offset != 1 ) {
@@ -217,22 +259,28 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 			tileLength = ifds[index].offset;
 			tileWidth = totalX;
 			break;
-		case 282: //XResolution, rational
-			mpiOffset = ifds[index].offset;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			MPI_File_read( fh, &filedata.xresNum, 4, MPI_BYTE, &status);
-			MPI_File_read( fh, &filedata.xresDen, 4, MPI_BYTE, &status);
+		case 282: //XResolution, rational, held in the tag itself in BIGTIFF
+			readTagData( ifds[index], rational, 8);
+			filedata.xresNum = rational[0];
+			filedata.xresDen = rational[1];
 			break;
-		case 283: //YResolution, rational
-			mpiOffset = ifds[index].offset;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			MPI_File_read( fh, &filedata.yresNum, 4, MPI_BYTE, &status);
-			MPI_File_read( fh, &filedata.yresDen, 4, MPI_BYTE, &status);
+		case 283: //YResolution, rational, held in the tag itself in BIGTIFF
+			readTagData( ifds[index], rational, 8);
+			filedata.yresNum = rational[0];
+			filedata.yresDen = rational[1];
 			break;
 		case 284: //PlanarConfiguration, unsigned short
 			//BT filedata.planarConfig = (unsigned short) (ifds[index].offset);
 			filedata.planarConfig = (unsigned short) (ifds[index].offset);
 			break;
+		case 317: //Predictor, unsigned short
+			predictor = (short) ifds[index].offset;
+			if( predictor != PREDICTOR_NONE && predictor != PREDICTOR_HORIZONTAL && predictor != PREDICTOR_FLOAT ) {
+				printf("Error opening file %s.\n", fname);
+				printf("Unknown predictor %d.  Unable to interpret tiff\n", predictor);
+				MPI_Abort(MCW,-4);
+			}
+			break;
 		case 322: //TileWidth, unsigned short or long
 			//BT tileWidth = (unsigned long) (ifds[index].offset);
 			tileWidth = ifds[index].offset;
@@ -241,45 +289,16 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 			//BT tileLength = (unsigned long) (ifds[index].offset);
 			tileLength = ifds[index].offset;
 			break;
-		case 324: //TileOffsets, unsigned long
+		case 324: //TileOffsets, unsigned long or long long
 			tileOrRow = 1;
-			//BT numOffsets = (unsigned long) (ifds[index].count);
-			//BT offsets = (unsigned long long*) malloc( 4 * ifds[index].count );
 			numOffsets = ifds[index].count;
-			//SizeOf offsets = (long*) malloc( 4*ifds[index].count);
-			offsets = (uint32_t*) malloc(sizeof(uint32_t)*ifds[index].count);  //DGT
-			if( ifds[index].count == 1 )
-				offsets[0] = ifds[index].offset;
-			else {
-				mpiOffset = ifds[index].offset;
-				MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-				//BT for( unsigned long i=0; i<ifds[index].count; ++i ) {
-				for( unsigned long i=0; i<ifds[index].count; ++i ) {
-					MPI_File_read( fh, &offsets[i],4,MPI_BYTE, &status);
-				}
-			}
+			offsets = (uint64_t*) malloc(sizeof(uint64_t)*ifds[index].count);
+			readTagValues(ifds[index], offsets);
 			break;
-		case 279: //StripByteCounts, unsigned short or long
-		case 325: //TileByteCounts, unsigned short or long
-			//BT bytes = (unsigned long*) malloc( 4*ifds[index].count);
-			//SizeOf bytes = (long*) malloc( 4*ifds[index].count);
-			bytes = (uint32_t*) malloc(sizeof(uint32_t)*ifds[index].count);  //DGT
-			if( ifds[index].count == 1 )
-				bytes[0] = ifds[index].offset;
-			else if( ifds[index].type == 3 ) {
-				short s;
-				//BT for( unsigned long i=0; i<ifds[index].count; ++i) {
-				for( unsigned long i=0; i<ifds[index].count; ++i) {
-					MPI_File_read( fh, &s, 2, MPI_BYTE,&status);
-					bytes[i] = s;
-				}
-			}
-			else if( ifds[index].type == 4) {
-				//BT for( unsigned long i=0; i<ifds[index].count; ++i) {
-				for( unsigned long i=0; i<ifds[index].count; ++i) {
-					MPI_File_read( fh, &bytes[i], 4, MPI_BYTE,&status);
-				}
-			}
+		case 279: //StripByteCounts, unsigned short or long or long long
+		case 325: //TileByteCounts, unsigned short or long or long long
+			bytes = (uint64_t*) malloc(sizeof(uint64_t)*ifds[index].count);
+			readTagValues(ifds[index], bytes);
 			break;
 		case 339: //SampleFormat, unsigned short, 1=unsigned integer, 2=signed integer, 3=float, 4=undefined
 			if( ifds[index].count > 1) {
@@ -313,11 +332,9 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 			//BT filedata.geoKeyDir = (unsigned short *) malloc( 2*filedata.geoKeySize);
 			//SizeOf filedata.geoKeyDir = (short *) malloc( 2*filedata.geoKeySize);
 			filedata.geoKeyDir = (uint16_t *) malloc( sizeof(uint16_t) * filedata.geoKeySize);
-			mpiOffset = ifds[index].offset;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
+			readTagData( ifds[index], filedata.geoKeyDir, 2*filedata.geoKeySize);
 			//BT for( unsigned long i=0; i<filedata.geoKeySize; ++i) {
 			for( long i=0; i<filedata.geoKeySize; ++i) {
-				MPI_File_read( fh, &filedata.geoKeyDir[i], 2, MPI_BYTE, &status);
 				if (( i >= 4 ) && ( i % 4 == 0 ) && ( filedata.geoKeyDir[i] == 1025 )) {
 					rasterTypeIndex = i;
 				}
@@ -333,14 +350,7 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 			filedata.geoDoubleSize = ifds[index].count;
 			//SizeOf filedata.geoDoubleParams = (double*) malloc( 8*filedata.geoDoubleSize );
 			filedata.geoDoubleParams = (double*) malloc( sizeof(double) * filedata.geoDoubleSize );
-			mpiOffset = ifds[index].offset;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			//BT for( unsigned long i=0; i<filedata.geoDoubleSize; ++i) {
-			for( long i=0; i<filedata.geoDoubleSize; ++i) {
-				MPI_File_read( fh, &filedata.geoDoubleParams[i], 8, MPI_BYTE, &status);
-				//printf("%g,",filedata.geoDoubleParams[i]);
-			}
-			//printf("\n");
+			readTagData( ifds[index], filedata.geoDoubleParams, 8*filedata.geoDoubleSize);
 			break;
 		case 34737: //GeoTIFF-GeoAsciiParamsTag
 			//TODO Fix Type Cast of ifds[index].count
@@ -352,10 +362,7 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 				printf("Memory allocation error.\n");
 				MPI_Abort(MCW,-9);
 			}
-			mpiOffset = ifds[index].offset;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			//BT MPI_File_read( fh, filedata.geoAscii, (long) ifds[index].count, MPI_BYTE, &status);
-			MPI_File_read( fh, filedata.geoAscii, ifds[index].count, MPI_BYTE, &status);
+			readTagData( ifds[index], filedata.geoAscii, filedata.geoAsciiSize);
 			//filedata.geoAscii[ ifds[index].count ] = '\0';
 			//printf("%s\n",filedata.geoAscii);
 			break;	
@@ -369,9 +376,7 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 				MPI_Abort(MCW,-9);
 			}
 
-			mpiOffset = ifds[index].offset;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			MPI_File_read( fh, filedata.gdalAscii, (long) ifds[index].count, MPI_BYTE, &status);
+			readTagData( ifds[index], filedata.gdalAscii, filedata.gdalAsciiSize);
 //			printf("%s\n",filedata.gdalAscii);
 //			filedata.gdalAscii[ ifds[index].count ] = '\0';
 			break;
@@ -379,19 +384,10 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 			{
 			noDataDef = 1;
 			double noDataDiff=0.0;
-			//If 4 or less bytes of data in tag get nodata value from offset
-			char *noD;
-			if( ifds[index].count <=4 ) 
-				noD = (char*) &ifds[index].offset;
-			else{
-				//SizeOf char *noD = (char*) malloc(ifds[index].count+1);
-				noD = (char*) malloc( sizeof(char) * ifds[index].count+1 );
-				mpiOffset = ifds[index].offset;
-				MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-				//BT MPI_File_read( fh, noD, (int) ifds[index].count, MPI_BYTE, &status);
-				MPI_File_read( fh, noD, ifds[index].count, MPI_BYTE, &status);
-				noD[ ifds[index].count ] = '\0';
-			}
+			//  The nodata value is held in the tag if it fits in 4 bytes (8 for BIGTIFF)
+			char *noD = (char*) malloc( sizeof(char) * ifds[index].count+1 );
+			readTagData( ifds[index], noD, ifds[index].count);
+			noD[ ifds[index].count ] = '\0';
 			//  Set filenodata based on file data type
 			//  This assumes that sampleFormat and dataSizeFileIn have been read already
 			//  The conversions below using atoi are weak because return from atoi is an int.  
@@ -521,6 +517,22 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 					if(noDataDiff > 1e-6) (*((float*)nodata))=MISSINGFLOAT;
 				} 
 			}
+			else if( datatype == BYTE_TYPE) {
+				//  Byte grids keep the file no data value if it is a byte value, otherwise use 255
+				nodata = new uint8_t;
+				double fileNodata = fileValue(filenodata, sampleFormat, dataSizeFileIn);
+				if(fileNodata >= 0. && fileNodata <= 255. && fileNodata == floor(fileNodata))
+					*((uint8_t*)nodata) = (uint8_t)fileNodata;
+				else
+					*((uint8_t*)nodata) = 255;
+			}
+			else if( datatype == DOUBLE_TYPE) {
+				nodata = new double(fileValue(filenodata, sampleFormat, dataSizeFileIn));
+			}
+			else if( datatype == INT64_TYPE) {
+				nodata = new long long((long long)fileValue(filenodata, sampleFormat, dataSizeFileIn));
+			}
+			free(noD);
 			}
 			break;
 		default: 
@@ -594,6 +606,25 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 				*((short*)nodata)=(short)(*((double*)filenodata));
 			}
 			if(rank==0)printf("The value: %d will be used as representing missing data.\n",*((short*)nodata));
+		}else if(datatype == BYTE_TYPE)
+		{
+			//  255, or -128 in signed byte files
+			nodata = new uint8_t;
+			*((uint8_t*)nodata) = 255;
+			filenodata = newFileValue((sampleFormat == 2 && dataSizeFileIn == 1) ? -128. : 255., sampleFormat, dataSizeFileIn);
+			if(rank==0)printf("The value: %d will be used as representing missing data.\n",*((uint8_t*)nodata));
+		}else if(datatype == DOUBLE_TYPE || datatype == INT64_TYPE)
+		{
+			//  The values assumed for float grids of floating point files and long grids of integer files
+			double value;
+			if(sampleFormat == 3) value = MISSINGFLOAT;
+			else if(dataSizeFileIn == 1) value = (sampleFormat == 2) ? -128. : 255.;
+			else if(dataSizeFileIn == 2) value = (sampleFormat == 2) ? MISSINGSHORT : 32767.;
+			else value = (sampleFormat == 2) ? MISSINGLONG : 2147483647.;
+			filenodata = newFileValue(value, sampleFormat, dataSizeFileIn);
+			if(datatype == DOUBLE_TYPE) nodata = new double(value);
+			else nodata = new long long((long long)value);
+			if(rank==0)printf("The value: %g will be used as representing missing data.\n",value);
 		}else if(datatype == LONG_TYPE)
 		{
 			nodata = new long;
@@ -688,8 +719,83 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype){
 		}
 		//MPI_Abort(MCW,-5);
 	}
+
+	//  The first grid read sets the row split for balanced linear partitions
+	long firstRow, numRows;
+	if(getPartitionType() == BALANCED_PARTITION && !getRowSplit(totalY, rank, firstRow, numRows))
+		balanceRows();
+}
+
+//  Size of a cell of the storage type
+static int storageSize(DATA_TYPE datatype) {
+	if(datatype == SHORT_TYPE) return sizeof(short);
+	else if(datatype == LONG_TYPE) return sizeof(long);
+	else if(datatype == BYTE_TYPE) return sizeof(uint8_t);
+	else if(datatype == DOUBLE_TYPE) return sizeof(double);
+	else if(datatype == INT64_TYPE) return sizeof(long long);
+	return sizeof(float);
+}
+
+//  Set the row split for balanced linear partitions from the number of valid cells in each row.
+//  Each process counts the valid cells in an even share of the rows and the counts are gathered
+//  to all processes.  Nodata cells are still visited by each pass over the grid so are given a
+//  small weight.
+
+void tiffIO::balanceRows() {
+	long rowsPerProc = totalY/size;
+	long firstRow = rowsPerProc*rank;
+	long numRows = rowsPerProc;
+	if(rank == size-1) numRows += totalY%size;
+
+	int elementSize = storageSize(datatype);
+	long rowsPerRead = (16*1024*1024)/(totalX*elementSize);
+	if(rowsPerRead < 1) rowsPerRead = 1;
+	char *rowBuffer = new char[rowsPerRead*totalX*elementSize];
+	double *localWeight = new double[numRows > 0 ? numRows : 1];
+	for(long r = 0; r < numRows; r += rowsPerRead)
+	{
+		long n = rowsPerRead;
+		if(r + n > numRows) n = numRows - r;
+		read(0, firstRow+r, n, totalX, rowBuffer);
+		for(long k = 0; k < n; k++)
+		{
+			long valid = 0;
+			for(long i = 0; i < (long)totalX; i++)
+			{
+				long c = k*totalX+i;
+				if(datatype == SHORT_TYPE) valid += (((short*)rowBuffer)[c] != *((short*)nodata));
+				else if(datatype == LONG_TYPE) valid += (((long*)rowBuffer)[c] != *((long*)nodata));
+				else if(datatype == BYTE_TYPE) valid += (((uint8_t*)rowBuffer)[c] != *((uint8_t*)nodata));
+				else if(datatype == INT64_TYPE) valid += (((long long*)rowBuffer)[c] != *((long long*)nodata));
+				else if(datatype == DOUBLE_TYPE) valid += (fabs(((double*)rowBuffer)[c] - *((double*)nodata)) >= MINEPS);
+				else valid += (fabs(((float*)rowBuffer)[c] - *((float*)nodata)) >= MINEPS);
+			}
+			localWeight[r+k] = valid + 0.125*(totalX-valid);
+		}
+	}
+
+	int *counts = new int[size];
+	int *displs = new int[size];
+	for(int k = 0; k < size; k++)
+	{
+		counts[k] = rowsPerProc;
+		displs[k] = rowsPerProc*k;
+	}
+	counts[size-1] += totalY%size;
+	double *rowWeight = new double[totalY];
+	MPI_Allgatherv(localWeight, numRows, MPI_DOUBLE, rowWeight, counts, displs, MPI_DOUBLE, MCW);
+	setRowSplit(totalY, rowWeight);
+
+	delete [] rowBuffer;
+	delete [] localWeight;
+	delete [] counts;
+	delete [] displs;
+	delete [] rowWeight;
 }
 
+//  Width and length of the tiles of compressed output files when no tile size is set
+const long COMPRESSED_TILE_SIZE = 256;
+
 //Copy constructor.  Requires datatype in addition to the object to copy from.
 tiffIO::tiffIO(char *fname, DATA_TYPE newtype, void* nd, const tiffIO &copy) {
 	//MPI_Status status;
@@ -698,6 +804,10 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, void* nd, const tiffIO &copy) {
 	MPI_Comm_size(MCW, &size);
 	MPI_Comm_rank(MCW, &rank);
 	
+	readBuffer = NULL;
+	readBufferSize = 0;
+	mappedGrid = NULL;
+
 	//Create/open the output file
 	int file_error = MPI_File_open( MCW, fname, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh);
 	if(file_error != MPI_SUCCESS){
@@ -713,7 +823,9 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, void* nd, const tiffIO &copy) {
 	numOffsets = copy.numOffsets;
 	//don't need offset or byte arrays since copied file will never do a data read
 	version = copy.version;
-	tileOrRow = copy.tileOrRow;
+	tileOrRow = 2;
+	compression = COMPRESS_NONE;
+	predictor = PREDICTOR_NONE;
 	tileLength = copy.tileLength;
 	tileWidth = copy.tileWidth;
 	totalX = copy.totalX;
@@ -738,6 +850,18 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, void* nd, const tiffIO &copy) {
 		nodata = new float;
 		*((float*)nodata) = *((float*)nd);
 	}
+	else if( datatype == BYTE_TYPE) {
+		nodata = new uint8_t;
+		*((uint8_t*)nodata) = *((uint8_t*)nd);
+	}
+	else if( datatype == DOUBLE_TYPE) {
+		nodata = new double;
+		*((double*)nodata) = *((double*)nd);
+	}
+	else if( datatype == INT64_TYPE) {
+		nodata = new long long;
+		*((long long*)nodata) = *((long long*)nd);
+	}
 
 	filedata = copy.filedata;
 	if( filedata.geoAsciiSize > 0 ) {
@@ -774,6 +898,49 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, void* nd, const tiffIO &copy) {
 	else if( datatype == FLOAT_TYPE) {
 		dataSizeObj = sizeof (float);
 	}
+	else if( datatype == BYTE_TYPE) {
+		dataSizeObj = sizeof (uint8_t);
+	}
+	else if( datatype == DOUBLE_TYPE) {
+		dataSizeObj = sizeof (double);
+	}
+	else if( datatype == INT64_TYPE) {
+		dataSizeObj = sizeof (int64_t);
+	}
+	//  Rows per strip for the output.  Strips are made about the size of a file system stripe
+	//  (the striping_unit hint of the file, or 1 MB) so that writes of whole strips line up
+	//  with stripes.
+	long stripeSize = 1048576;
+	MPI_Info info;
+	char infoValue[MPI_MAX_INFO_VAL+1];
+	int infoFlag;
+	MPI_File_get_info(fh, &info);
+	MPI_Info_get(info, (char*)"striping_unit", MPI_MAX_INFO_VAL, infoValue, &infoFlag);
+	if(infoFlag && atol(infoValue) > 0) stripeSize = atol(infoValue);
+	MPI_Info_free(&info);
+	tileLength = stripeSize/((long)totalX*dataSizeObj);
+	if(tileLength < 1) tileLength = 1;
+	if(tileLength > totalY) tileLength = totalY;
+	tileWidth = totalX;
+	//  Tiled output is written as square tiles.  Compressed output is always tiled, with the
+	//  floating point predictor for float grids and horizontal differencing for integer grids.
+	long outputTileSize = getOutputTileSize();
+	if(getOutputCompression() != NO_COMPRESSION) {
+		compression = (getOutputCompression() == ZSTD_COMPRESSION) ? COMPRESS_ZSTD : COMPRESS_DEFLATE;
+		if(!encoderAvailable(compression)) {
+			printf("Error writing file %s.\n",fname);
+			printf("This build is unable to write %s compressed files.\n", (compression == COMPRESS_ZSTD) ? "zstd" : "Deflate");
+			MPI_Abort(MCW,22);
+		}
+		predictor = (datatype == FLOAT_TYPE || datatype == DOUBLE_TYPE) ? PREDICTOR_FLOAT : PREDICTOR_HORIZONTAL;
+		if(outputTileSize == 0) outputTileSize = COMPRESSED_TILE_SIZE;
+	}
+	if(outputTileSize > 0) {
+		tileOrRow = 1;
+		tileLength = outputTileSize;
+		tileWidth = outputTileSize;
+	}
+
 	//Update GeoTiff GeoKeyDirectoryTag to always output GTRasterTypeGeoKey as PixelIsArea
 	for ( long i=4; i<filedata.geoKeySize; i+=4) {
 		if ( filedata.geoKeyDir[i] == 1025 ) {
@@ -784,656 +951,432 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, void* nd, const tiffIO &copy) {
 
 tiffIO::~tiffIO(){
 	MPI_File_close(&fh);
+	delete [] readBuffer;
+}
+
+//  Convert n cells of file data at in to the storage type, replacing the file no data value
+//  with the storage no data value.  The loop has no dependencies between cells so that it can
+//  be vectorized.  memcpy is used because file data need not be aligned for TIn.
+template <class TIn, class TOut>
+static void convertCells(const char *in, TOut *out, long n, TIn fileNodata, TOut nodata)
+{
+	#pragma omp simd
+	for(long k = 0; k < n; k++)
+	{
+		TIn tempVal;
+		memcpy(&tempVal, in + k*sizeof(TIn), sizeof(TIn));
+		out[k] = (tempVal == fileNodata) ? nodata : (TOut)tempVal;
+	}
+}
+
+template <class TIn>
+static void convertCellsFrom(const char *in, void *dest, long destIndex, long n, void *filenodata, DATA_TYPE datatype, void *nodata)
+{
+	if(datatype == SHORT_TYPE)
+		convertCells(in, (short*)dest + destIndex, n, *(TIn*)filenodata, *(short*)nodata);
+	else if(datatype == LONG_TYPE)
+		convertCells(in, (long*)dest + destIndex, n, *(TIn*)filenodata, *(long*)nodata);
+	else if(datatype == FLOAT_TYPE)
+		convertCells(in, (float*)dest + destIndex, n, *(TIn*)filenodata, *(float*)nodata);
+	else if(datatype == BYTE_TYPE)
+		convertCells(in, (uint8_t*)dest + destIndex, n, *(TIn*)filenodata, *(uint8_t*)nodata);
+	else if(datatype == DOUBLE_TYPE)
+		convertCells(in, (double*)dest + destIndex, n, *(TIn*)filenodata, *(double*)nodata);
+	else if(datatype == INT64_TYPE)
+		convertCells(in, (long long*)dest + destIndex, n, *(TIn*)filenodata, *(long long*)nodata);
+}
+
+//  Convert n cells of file data at in to dest[destIndex] onwards.  Returns false if the file
+//  data type is not supported.
+bool tiffIO::convertData(const char *in, void *dest, long destIndex, long n) {
+	if((sampleFormat == 1) && (dataSizeFileIn == 1))
+		convertCellsFrom<uint8_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 1) && (dataSizeFileIn == 2))
+		convertCellsFrom<uint16_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 1) && (dataSizeFileIn == 4))
+		convertCellsFrom<uint32_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 1) && (dataSizeFileIn == 8))
+		convertCellsFrom<uint64_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 2) && (dataSizeFileIn == 1))
+		convertCellsFrom<int8_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 2) && (dataSizeFileIn == 2))
+		convertCellsFrom<int16_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 2) && (dataSizeFileIn == 4))
+		convertCellsFrom<int32_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 2) && (dataSizeFileIn == 8))
+		convertCellsFrom<int64_t>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 3) && (dataSizeFileIn == 4))
+		convertCellsFrom<float>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else if((sampleFormat == 3) && (dataSizeFileIn == 8))
+		convertCellsFrom<double>(in, dest, destIndex, n, filenodata, datatype, nodata);
+	else
+		return false;
+	return true;
+}
+
+//  A part of a TIFF strip or tile read from the file: rows r0 to r1-1 of block (band, bx),
+//  held at bufferPos in readBuffer
+struct readSpan {
+	MPI_Offset fileOffset;
+	long length;
+	long bufferPos;
+	long band, bx, r0, r1;
+};
+static bool spanFileOrder(const readSpan &a, const readSpan &b) {
+	return a.fileOffset < b.fileOffset;
+}
+
+//  Sort spans by file position, place them one after the other in readBuffer, enlarging it if
+//  needed, and read spans that follow on in the file with one MPI_File_read_at
+static void readFileSpans(MPI_File fh, vector<readSpan> &spans, char *&readBuffer, long &readBufferSize) {
+	MPI_Status status;
+	sort(spans.begin(), spans.end(), spanFileOrder);
+	long total = 0;
+	for(size_t s = 0; s < spans.size(); s++)
+	{
+		spans[s].bufferPos = total;
+		total += spans[s].length;
+	}
+	if(total > readBufferSize)
+	{
+		delete [] readBuffer;
+		readBuffer = new char[total];
+		readBufferSize = total;
+	}
+	for(size_t s = 0; s < spans.size(); )
+	{
+		size_t e = s+1;
+		long length = spans[s].length;
+		while(e < spans.size() && spans[e].fileOffset == spans[s].fileOffset+length)
+			length += spans[e++].length;
+		MPI_File_read_at(fh, spans[s].fileOffset, readBuffer+spans[s].bufferPos, length, MPI_BYTE, &status);
+		s = e;
+	}
 }
 
 //Read tiff file data/image values beginning at xstart, ystart (gridwide coordinates) for the numRows, and numCols indicated to memory locations specified by dest
+//  The rows are read in groups of up to readBufferMax bytes of file data.  The parts of the
+//  strips or tiles needed for a group are sorted by file position and parts that follow on in
+//  the file are read with one MPI_File_read_at into readBuffer, which is kept between reads.
+//  The data are then converted to the storage type a row of a strip or tile at a time.
 //BT void tiffIO::read(unsigned long long xstart, unsigned long long ystart, unsigned long long numRows, unsigned long long numCols, void* dest) {
 void tiffIO::read(long xstart, long ystart, long numRows, long numCols, void* dest) {
+	const long readBufferMax = 64*1024*1024;
+
+	if(numRows <= 0 || numCols <= 0) return;
+	//  Rows mapped by mapRows are already in dest
+	if((char*)dest == mappedGrid && ystart == mappedRow) return;
+	if(tileOrRow != 1 && tileOrRow != 2) {
+		printf("Error reading file %s.\n", filename);
+		printf("No strip or tile offsets found.\n");
+		MPI_Abort(MCW,-1);
+	}
+	if(compression != COMPRESS_NONE) {
+		readCompressed(xstart, ystart, numRows, numCols, dest);
+		return;
+	}
+	//  Strips are treated as tiles the width of the grid
+	long blockWidth = (tileOrRow == 1) ? tileWidth : totalX;
+	long blocksAcross = (totalX-1)/blockWidth+1;
+	long rowBytes = blockWidth*dataSizeFileIn;
+	long firstBx = xstart/blockWidth;
+	long lastBx = (xstart+numCols-1)/blockWidth;
+	long rowsPerRead = readBufferMax/(rowBytes*(lastBx-firstBx+1));
+	if(rowsPerRead < 1) rowsPerRead = 1;
+
+	vector<readSpan> spans;
+	for(long y0 = ystart; y0 < ystart+numRows; y0 += rowsPerRead)
+	{
+		long y1 = y0+rowsPerRead;
+		if(y1 > ystart+numRows) y1 = ystart+numRows;
 
-	//current code assumes Tiff uses Strips and Partition Type is Linear Partition; TODO - recode to eliminate these assumptions
+		//  Parts of the strips or tiles holding rows y0 to y1-1
+		spans.clear();
+		for(long band = y0/tileLength; band <= (y1-1)/tileLength; band++)
+			for(long bx = firstBx; bx <= lastBx; bx++)
+			{
+				readSpan s;
+				s.band = band;
+				s.bx = bx;
+				s.r0 = max(y0, band*(long)tileLength) - band*tileLength;
+				s.r1 = min(y1, (band+1)*(long)tileLength) - band*tileLength;
+				s.fileOffset = (MPI_Offset)offsets[band*blocksAcross+bx] + s.r0*rowBytes;
+				s.length = (s.r1-s.r0)*rowBytes;
+				spans.push_back(s);
+			}
+		readFileSpans(fh, spans, readBuffer, readBufferSize);
 
-	MPI_Status status;
-	MPI_Offset mpiOffset;
-	if(tileOrRow == 2)  
-	{  // Strips
-
- 	//Find the starting and ending indexes of the data requested
-//	long firstStripIndex = (long) floor(ystart/tileLength);  //index into tiff strip arrays of first strip to be read 
-//	long lastStripIndex = (long) floor((ystart + numRows)/tileLength ); //index into tiff strip arrays of the last strip to be read
-	long firstStripIndex = ystart/tileLength;  //index into tiff strip arrays of first strip to be read 
-	long lastStripIndex = (ystart + numRows-1)/tileLength ; //index into tiff strip arrays of the last strip to be read
-	long firstStripFirstRowIndex = ystart - ( firstStripIndex * tileLength); //index within the first tiff strip of the first row to be read
-	long lastStripLastRowIndex = ystart + numRows-1 - ( lastStripIndex * tileLength ); //index within the last tiff strip of the last row to be read
-
-	//Find the initial current strip indexes
-	long currentStripFirstRowIndex = firstStripFirstRowIndex;  //index of first row needed within current strip; start with first strip needed
-	long currentStripLastRowIndex;  // index of last row needed within current strip; start with first strip needed
-	if ((lastStripIndex - firstStripIndex) > 0) { //7/24/13 DGT added condition of firstStripIndex to account for partitions entirely within a strip
-		currentStripLastRowIndex = tileLength-1;
-	} else{
-		currentStripLastRowIndex = lastStripLastRowIndex;
-	}
-    //printf("Rank %d, firstSI %d, LastSI %d, firstrow %d, lastrow %d, ystart %d, numrows %d, tilelen %d, currstlastrow %d\n",rank,firstStripIndex,lastStripIndex,firstStripFirstRowIndex, 
-		//lastStripLastRowIndex,ystart,numRows,tileLength,currentStripLastRowIndex);
-	//loop through needed TIFF Strips
-	for( long i = firstStripIndex; i <= lastStripIndex; ++i ) {
-		mpiOffset = offsets[i];
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-		mpiOffset = dataSizeFileIn * tileWidth * currentStripFirstRowIndex;
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_CUR);
-		//loop through needed rows
-		for( long j = currentStripFirstRowIndex; j <= currentStripLastRowIndex; ++j) {
-			//  A separate block of code is needed for each supported input file type
-			//  because even if we read into a void variable we still need the logic that
-			//  determines how to interpret the read data to be able to typecast it onto
-			//  the output file type  
-			long rowbeginning=(j+(i*tileLength)-ystart)*tileWidth;
-			//printf("Rank %d, strip %d, striprow %d, rowbeginning %d\n",rank,i,j,rowbeginning);
-			//fflush(stdout);
-			if((sampleFormat == 1) && (dataSizeFileIn == 1)) {
-				uint8_t *tempDataRow= new uint8_t[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint8_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint8_t*)filenodata) 
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint8_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint8_t*)filenodata)  
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint8_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint8_t*)filenodata)  
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else if ((sampleFormat == 1) && (dataSizeFileIn == 2)) {
-				uint16_t *tempDataRow= new uint16_t[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint16_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint16_t*)filenodata) 
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint16_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint16_t*)filenodata)  
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint16_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint16_t*)filenodata)  
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else if ((sampleFormat == 1) && (dataSizeFileIn == 4)) {
-				uint32_t *tempDataRow= new uint32_t[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint32_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint32_t*)filenodata) 
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint32_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint32_t*)filenodata)  
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						uint32_t tempVal = tempDataRow[k];
-						if(tempVal == *(uint32_t*)filenodata)  
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else if ((sampleFormat == 2) && (dataSizeFileIn == 1)) {
-				int8_t* tempDataRow = new int8_t[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int8_t tempVal = tempDataRow[k];
-						if(tempVal == *(int8_t*)filenodata) 
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int8_t tempVal = tempDataRow[k];
-						if(tempVal == *(int8_t*)filenodata)  
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int8_t tempVal = tempDataRow[k];
-						if(tempVal == *(int8_t*)filenodata)  
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else if ((sampleFormat == 2) && (dataSizeFileIn == 2)) {
-				int16_t* tempDataRow = new int16_t[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int16_t tempVal = tempDataRow[k];
-						if(tempVal == *(int16_t*)filenodata) 
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int16_t tempVal = tempDataRow[k];
-						if(tempVal == *(int16_t*)filenodata)  
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int16_t tempVal = tempDataRow[k];
-						if(tempVal == *(int16_t*)filenodata)  
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else if ((sampleFormat == 2) && (dataSizeFileIn == 4)) {
-				int32_t* tempDataRow = new int32_t[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int32_t tempVal = tempDataRow[k];
-						if(tempVal == *(int32_t*)filenodata) 
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int32_t tempVal = tempDataRow[k];
-						if(tempVal == *(int32_t*)filenodata)  
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						int32_t tempVal = tempDataRow[k];
-						if(tempVal == *(int32_t*)filenodata)  
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else if ((sampleFormat == 3) && (dataSizeFileIn == 4)) {
-				float *tempDataRow= new float[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						float tempVal = tempDataRow[k];
-						if(tempVal == *(float*)filenodata)  // Risky conditional on float
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						float tempVal = tempDataRow[k];
-						if(tempVal == *(float*)filenodata)  // Risky conditional on float
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						float tempVal = tempDataRow[k];
-						if(tempVal == *(float*)filenodata)  // Risky conditional on float
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else if ((sampleFormat == 3) && (dataSizeFileIn == 8)) {
-				double *tempDataRow= new double[tileWidth];
-				MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileWidth, MPI_BYTE, &status);
-				if(datatype == SHORT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						double tempVal = tempDataRow[k];
-						if(tempVal == *(double*)filenodata)  // Risky conditional on float
-							((short*)dest)[rowbeginning+k]= *(short*)nodata;
-						else
-							((short*)dest)[rowbeginning+k]=(short)tempVal;
-					}
-				else if(datatype == LONG_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						double tempVal = tempDataRow[k];
-						if(tempVal == *(double*)filenodata)  // Risky conditional on float
-							((long*)dest)[rowbeginning+k]= *(long*)nodata;
-						else
-							((long*)dest)[rowbeginning+k]=(long)tempVal;
-					}
-				else if(datatype == FLOAT_TYPE)
-					for(long k = 0; k < tileWidth; k++)
-					{
-						double tempVal = tempDataRow[k];
-						if(tempVal == *(double*)filenodata)  // Risky conditional on float
-							((float*)dest)[rowbeginning+k]= *(float*)nodata;
-						else
-							((float*)dest)[rowbeginning+k]=(float)tempVal;
-					}
-				delete tempDataRow;
-			} else {
-				printf("Unsupported TIFF file type.  sampleFormat = %d, dataSizeFileIn = %d.\n", sampleFormat, dataSizeFileIn);
-				MPI_Abort(MCW,-1);
+		//  Convert the columns needed from each row of each part
+		for(size_t s = 0; s < spans.size(); s++)
+		{
+			long c0 = max(xstart, spans[s].bx*blockWidth);
+			long c1 = min(xstart+numCols, min((spans[s].bx+1)*blockWidth, (long)totalX));
+			for(long r = spans[s].r0; r < spans[s].r1; r++)
+			{
+				long y = spans[s].band*tileLength + r;
+				const char *in = readBuffer + spans[s].bufferPos + (r-spans[s].r0)*rowBytes + (c0-spans[s].bx*blockWidth)*dataSizeFileIn;
+				if(!convertData(in, dest, (y-ystart)*numCols + c0-xstart, c1-c0)) {
+					printf("Unsupported TIFF file type.  sampleFormat = %d, dataSizeFileIn = %d.\n", sampleFormat, dataSizeFileIn);
+					MPI_Abort(MCW,-1);
+				}
 			}
 		}
-		//update current strip indexes for next strip
-		currentStripFirstRowIndex = 0;
-		if ( i != lastStripIndex-1 ) {
-			currentStripLastRowIndex = tileLength-1;
-		}else {
-			currentStripLastRowIndex = lastStripLastRowIndex;
-		}
 	}
+}
+
+//  Rows of numCols cells of the storage type in about 64 MB, and at least one row
+long tiffIO::partitionBandRows(long numCols) {
+	const long bandMax = 64*1024*1024;
+	int elementSize = storageSize(datatype);
+	long bandRows = bandMax/(numCols*elementSize);
+	return (bandRows < 1) ? 1 : bandRows;
+}
+
+//  Read into part.  A partition without a grid pointer is read a band of rows at a time into a
+//  buffer, which is copied into the partition with putRows.
+void tiffIO::read(long xstart, long ystart, long numRows, long numCols, tdpartition *part) {
+	void *grid = part->getGridPointer();
+	if(grid != NULL) {
+		read(xstart, ystart, numRows, numCols, grid);
+		return;
 	}
-	else
-	{  // tiles.  The strategy is to read one row at a time reading the parts 
-		// of it that come from the appropriate tiles as blocks
-		uint32_t y, tileStart, tilesAcross, tileEnd, tile, rowInTile, tileCols, destOffset;
-
-		// tileStart - the first tile in the set being read from for row y
-		// tilesAcross - the number of tiles across the grid
-		// tileEnd - the last tile in the set being read form for row y
-		// tile - the active tile being read from
-		// rowInTile - the row in the tile corresponding to the tile being read
-		// tileCols - the number of columns in the tile that fall within the grid
-		//    This is either tileWidth or determined from totalX for the last tile
-		// destOffset - the offset within the destination partition of the row being read for a tile
-
-		tilesAcross=(totalX-1)/tileWidth+1;  // DGT 7/8/10 - was tilesAcross=totalX/tileWidth+1 which failed if totalX was a multiple of tileWidth
-		for(y=ystart; y<ystart+numRows; y++)
+	if(numRows <= 0 || numCols <= 0) return;
+	int elementSize = storageSize(datatype);
+	long bandRows = partitionBandRows(numCols);
+	vector<char> band((size_t)min(bandRows, numRows)*numCols*elementSize);
+	for(long y = 0; y < numRows; y += bandRows) {
+		long n = min(bandRows, numRows-y);
+		read(xstart, ystart+y, n, numCols, &band[0]);
+		part->putRows(y, n, &band[0]);
+	}
+}
+
+//  Map rows ystart-1 to ystart+numRows of the grid into memory for a linear partition, in place
+//  of allocating the partition and reading the rows.  This is only possible for uncompressed
+//  files with strips one after the other in the file, holding cells of the storage type with the
+//  storage no data value.  The mapping is private, so changes to the grid, such as setting the
+//  border rows, copy the pages changed rather than changing the file.  Border rows outside the
+//  grid are in anonymous memory around the mapped file data.  Returns the address of row
+//  ystart-1, and the mapping to unmap with unmapRows in mapBase and mapLength, or NULL if the
+//  file cannot be mapped.  A read of the rows into the mapping then returns without reading.
+char *tiffIO::mapRows(long ystart, long numRows, void *&mapBase, size_t &mapLength) {
+#ifdef _WIN32
+	return NULL;
+#else
+	if(compression != COMPRESS_NONE || tileOrRow != 2 || numRows <= 0) return NULL;
+	if(dataSizeFileIn != dataSizeObj || memcmp(filenodata, nodata, dataSizeObj) != 0) return NULL;
+	if(sampleFormat != ((datatype == FLOAT_TYPE || datatype == DOUBLE_TYPE) ? 3 : (datatype == BYTE_TYPE) ? 1 : 2)) return NULL;
+	long rowBytes = (long)totalX*dataSizeObj;
+	if(offsets[0] % dataSizeObj != 0) return NULL;
+	for(uint32_t i = 0; i+1 < numOffsets; i++)
+		if(offsets[i+1] != offsets[i] + (uint64_t)tileLength*rowBytes) return NULL;
+
+	//  Rows firstRow to lastRow are in the file, and before bytes of border row precede them
+	long pageSize = sysconf(_SC_PAGESIZE);
+	long firstRow = max(ystart-1, 0L);
+	long lastRow = min(ystart+numRows, (long)totalY-1);
+	long before = (firstRow-(ystart-1))*rowBytes;
+	uint64_t fileStart = offsets[0] + (uint64_t)firstRow*rowBytes;
+	uint64_t fileEnd = offsets[0] + (uint64_t)(lastRow+1)*rowBytes;
+	uint64_t pageStart = fileStart - fileStart % pageSize;
+
+	//  Reserve the rows and a page, then map the file over them with the file data at the same
+	//  position within a page as in the file
+	mapLength = (numRows+2)*rowBytes + pageSize;
+	char *base = (char*)mmap(NULL, mapLength, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(base == MAP_FAILED) return NULL;
+	char *rows = base + ((long)(fileStart % pageSize) - before % pageSize + pageSize) % pageSize;
+	void *mapped = MAP_FAILED;
+	int fd = open(filename, O_RDONLY);
+	if(fd >= 0) {
+		mapped = mmap(rows + before - fileStart % pageSize, fileEnd - pageStart, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, pageStart);
+		close(fd);
+	}
+	if(mapped == MAP_FAILED) {
+		munmap(base, mapLength);
+		return NULL;
+	}
+	mapBase = base;
+	mappedGrid = rows + rowBytes;
+	mappedRow = ystart;
+	return rows;
+#endif
+}
+
+void tiffIO::unmapRows(void *mapBase, size_t mapLength) {
+#ifndef _WIN32
+	munmap(mapBase, mapLength);
+#endif
+}
+
+//  Read from a compressed file.  Strips and tiles have to be decoded whole, so the rows are read
+//  in groups of whole bands of strips or tiles, and only the strips or tiles that hold some of
+//  the rows and columns asked for are read.  The compressed data for a group are read as for
+//  uncompressed data, then the strips or tiles are shared out between threads, each of which
+//  decodes a strip or tile into its own buffer, undoes the predictor on the rows needed and
+//  converts them to the storage type.
+void tiffIO::readCompressed(long xstart, long ystart, long numRows, long numCols, void* dest) {
+	const long readBufferMax = 64*1024*1024;
+	long blockWidth = (tileOrRow == 1) ? tileWidth : totalX;
+	long blocksAcross = (totalX-1)/blockWidth+1;
+	long rowBytes = blockWidth*dataSizeFileIn;
+	long firstBx = xstart/blockWidth;
+	long lastBx = (xstart+numCols-1)/blockWidth;
+	long firstBand = ystart/tileLength;
+	long lastBand = (ystart+numRows-1)/tileLength;
+	long bandsPerRead = readBufferMax/(rowBytes*tileLength*(lastBx-firstBx+1));
+	if(bandsPerRead < 1) bandsPerRead = 1;
+	int numThreads = getNumThreads();
+	long badBlock = -1;
+	bool badType = false;
+
+	vector<readSpan> spans;
+	for(long b0 = firstBand; b0 <= lastBand && badBlock < 0 && !badType; b0 += bandsPerRead)
+	{
+		long b1 = min(b0+bandsPerRead, lastBand+1);
+		spans.clear();
+		for(long band = b0; band < b1; band++)
+			for(long bx = firstBx; bx <= lastBx; bx++)
+			{
+				readSpan s;
+				s.band = band;
+				s.bx = bx;
+				s.r0 = max(ystart, band*(long)tileLength) - band*tileLength;
+				s.r1 = min(ystart+numRows, (band+1)*(long)tileLength) - band*tileLength;
+				s.fileOffset = offsets[band*blocksAcross+bx];
+				s.length = bytes[band*blocksAcross+bx];
+				spans.push_back(s);
+			}
+		readFileSpans(fh, spans, readBuffer, readBufferSize);
+
+		long numSpans = spans.size();
+		#pragma omp parallel num_threads(numThreads)
 		{
-			tileStart=y/tileLength*tilesAcross;  // First tile in the read of a row
-			if(tileStart > 0)
-				tileStart=tileStart;
-			tileEnd=tileStart+tilesAcross-1;   // Last tile in the read of a row
-			rowInTile=y-(tileStart/tilesAcross)*tileLength;
-			for(tile=tileStart; tile<=tileEnd;tile++)
+			vector<char> block(rowBytes*tileLength);
+			#pragma omp for schedule(dynamic)
+			for(long s = 0; s < numSpans; s++)
 			{
-				tileCols = tileWidth;
-				if(tile == tileEnd)tileCols=totalX-(tilesAcross-1)*tileWidth;
-				mpiOffset=offsets[tile]+rowInTile*tileWidth*dataSizeFileIn;
-				MPI_File_seek(fh,mpiOffset,MPI_SEEK_SET);
-				destOffset=(tile-tileStart)*tileWidth+(y-ystart)*numCols;
-				if((sampleFormat == 1) && (dataSizeFileIn == 1)) 
-				{
-					uint8_t *tempDataRow= new uint8_t[tileWidth];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint8_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint8_t*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint8_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint8_t*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint8_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint8_t*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
-				}
-				else if ((sampleFormat == 1) && (dataSizeFileIn == 2)) 
-				{
-					uint16_t *tempDataRow= new uint16_t[tileWidth];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint16_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint16_t*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint16_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint16_t*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint16_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint16_t*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
+				//  The last strip only holds the rows left
+				long blockRows = tileLength;
+				if(tileOrRow == 2 && (spans[s].band+1)*tileLength > totalY)
+					blockRows = totalY - spans[s].band*tileLength;
+				if(!decodeBlock(compression, readBuffer+spans[s].bufferPos, spans[s].length, &block[0], blockRows*rowBytes)) {
+					#pragma omp critical
+					badBlock = spans[s].band*blocksAcross+spans[s].bx;
+					continue;
 				}
-				else if ((sampleFormat == 1) && (dataSizeFileIn == 4)) 
-				{
-					uint32_t *tempDataRow= new uint32_t[tileWidth];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint32_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint32_t*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint32_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint32_t*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							uint32_t tempVal = tempDataRow[k];
-							if(tempVal == *(uint32_t*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
-				}
-				else if ((sampleFormat == 2) && (dataSizeFileIn == 1)) 
-				{
-					int8_t* tempDataRow = new int8_t[tileWidth];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int8_t tempVal = tempDataRow[k];
-							if(tempVal == *(int8_t*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int8_t tempVal = tempDataRow[k];
-							if(tempVal == *(int8_t*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int8_t tempVal = tempDataRow[k];
-							if(tempVal == *(int8_t*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
-				}
-				else if ((sampleFormat == 2) && (dataSizeFileIn == 2)) 
-				{
-					int16_t* tempDataRow = new int16_t[tileWidth];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int16_t tempVal = tempDataRow[k];
-							if(tempVal == *(int16_t*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int16_t tempVal = tempDataRow[k];
-							if(tempVal == *(int16_t*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int16_t tempVal = tempDataRow[k];
-							if(tempVal == *(int16_t*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
-				}
-				else if ((sampleFormat == 2) && (dataSizeFileIn == 4)) 
-				{
-					int32_t* tempDataRow = new int32_t[tileWidth];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int32_t tempVal = tempDataRow[k];
-							if(tempVal == *(int32_t*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int32_t tempVal = tempDataRow[k];
-							if(tempVal == *(int32_t*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							int32_t tempVal = tempDataRow[k];
-							if(tempVal == *(int32_t*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
-				}
-				else if(sampleFormat == 3 && dataSizeFileIn == 4)
-				{
-					float *tempDataRow=new float[tileCols];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							float tempVal = tempDataRow[k];
-							if(tempVal == *(float*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							float tempVal = tempDataRow[k];
-							if(tempVal == *(float*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							float tempVal = tempDataRow[k];
-							if(tempVal == *(float*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
-				} else if(sampleFormat == 3 && dataSizeFileIn == 8)
+				undoPredictor(predictor, &block[spans[s].r0*rowBytes], spans[s].r1-spans[s].r0, blockWidth, dataSizeFileIn);
+
+				long c0 = max(xstart, spans[s].bx*blockWidth);
+				long c1 = min(xstart+numCols, min((spans[s].bx+1)*blockWidth, (long)totalX));
+				for(long r = spans[s].r0; r < spans[s].r1; r++)
 				{
-					double *tempDataRow=new double[tileCols];
-					MPI_File_read( fh, tempDataRow, dataSizeFileIn * tileCols, MPI_BYTE, &status);
-
-					if(datatype == SHORT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							double tempVal = tempDataRow[k];
-							if(tempVal == *(double*)filenodata)  // Risky conditional on float
-								((short*)dest)[destOffset+k]= *(short*)nodata;
-							else
-								((short*)dest)[destOffset+k]=(short)tempVal;
-						}
-					else if(datatype == LONG_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							double tempVal = tempDataRow[k];
-							if(tempVal == *(double*)filenodata)  // Risky conditional on float
-								((long*)dest)[destOffset+k]= *(long*)nodata;
-							else
-								((long*)dest)[destOffset+k]=(long)tempVal;
-						}
-					else if(datatype == FLOAT_TYPE)
-						for(long k = 0; k < tileCols; k++)
-						{
-							double tempVal = tempDataRow[k];
-							if(tempVal == *(double*)filenodata)  // Risky conditional on float
-								((float*)dest)[destOffset+k]= *(float*)nodata;
-							else
-								((float*)dest)[destOffset+k]=(float)tempVal;
-						}
-					delete tempDataRow;
+					long y = spans[s].band*tileLength + r;
+					if(!convertData(&block[r*rowBytes + (c0-spans[s].bx*blockWidth)*dataSizeFileIn], dest, (y-ystart)*numCols + c0-xstart, c1-c0)) {
+						#pragma omp critical
+						badType = true;
+					}
 				}
 			}
 		}
 	}
+	if(badBlock >= 0) {
+		printf("Error reading file %s.\n", filename);
+		printf("Compressed strip or tile %ld could not be decoded.\n", badBlock);
+		MPI_Abort(MCW,-1);
+	}
+	if(badType) {
+		printf("Unsupported TIFF file type.  sampleFormat = %d, dataSizeFileIn = %d.\n", sampleFormat, dataSizeFileIn);
+		MPI_Abort(MCW,-1);
+	}
 }
 
 //Create/re-write tiff output file
 //BT void tiffIO::write(unsigned long long xstart, unsigned long long ystart, unsigned long long numRows, unsigned long long numCols, void* source) {
 void tiffIO::write(long xstart, long ystart, long numRows, long numCols, void* source) {
+	writeGrid(xstart, ystart, numRows, numCols, source, NULL);
+}
+
+//  Write from part.  The strips of a partition without a grid pointer are written a band of rows
+//  at a time.  Tiles are assembled from the whole block of a process, so for tiled output the
+//  rows of the partition are first copied into memory.  The tools refuse tiled output with
+//  cached partitions (-cache), which would be copied whole.
+void tiffIO::write(long xstart, long ystart, long numRows, long numCols, tdpartition *part) {
+	void *grid = part->getGridPointer();
+	if(grid != NULL)
+		writeGrid(xstart, ystart, numRows, numCols, grid, NULL);
+	else if(tileOrRow == 1) {
+		int elementSize = storageSize(datatype);
+		vector<char> block((size_t)numRows*numCols*elementSize + 1);
+		if(numRows > 0 && numCols > 0) part->getRows(0, numRows, &block[0]);
+		writeGrid(xstart, ystart, numRows, numCols, &block[0], NULL);
+	}
+	else
+		writeGrid(xstart, ystart, numRows, numCols, NULL, part);
+}
+
+//  Write the file, with the data of this process from source, or from part a band of rows at a
+//  time if source is NULL
+void tiffIO::writeGrid(long xstart, long ystart, long numRows, long numCols, void* source, tdpartition *part) {
 
 	MPI_Status status;
 	MPI_Offset mpiOffset;
 
+	void *buffer = source;
+	int32_t *longBuffer = NULL;
+	if( datatype == LONG_TYPE && source != NULL ) {
+/*  DGT This is ugly.  Internally we are using a long partition grid which in some implementations
+    is 4 bytes and other 8 bytes.  ArcGIS and GDAL apparrently do not read 8 byte tiff's.
+	We therefore coerce to int32_t which is fixed at 4 bytes.
+*/
+		longBuffer = new int32_t[numRows*numCols];
+		for(long k = 0; k < numRows*numCols; k++)
+			longBuffer[k] = (int32_t)(((long*)source)[k]);
+			//  Here we are ignoring the possibility of typecast changing the no data value
+			//  if it was outside the range of int32_t
+		buffer = longBuffer;
+	}
+
 	//Calculate parameters needed by multiple tags
-	//Calculate strip data offsets and sizes
-	numOffsets = (totalY + tileLength - 1)/tileLength;
-	//BT unsigned long long *dataOffsets;
-	//BT unsigned long long *sizeOffsets;
-	//BT dataOffsets = (unsigned long long*) malloc( 8 * numOffsets );
-	//BT sizeOffsets = (unsigned long long*) malloc( 8 * numOffsets );
-	//BT numOffsets = (totalY + tileLength - 1)/tileLength;
-	uint32_t *dataOffsets;  //DGT
-	uint32_t *sizeOffsets;  //DGT
-	//SizeOf dataOffsets = (long*) malloc( 4 * numOffsets );
-	//SizeOf sizeOffsets = (long*) malloc( 4 * numOffsets );
-	dataOffsets = (uint32_t*) malloc( sizeof(uint32_t) * numOffsets );  //DGT
-	sizeOffsets = (uint32_t*) malloc( sizeof(uint32_t) * numOffsets );  //DGT
-
-	//BT unsigned long long sizeofStrip = tileLength * tileWidth * dataSize;
-	//BT unsigned long long dataOffset = 8; //offset to beginning of image data block. Put it right after file header
-	//BT for( unsigned long long i = 0; i< numOffsets; i++ ) {
-	//  The below is hard coded for strips that inherit the tileLength of the copied object
-	uint32_t sizeofStrip = tileLength * totalX * dataSizeObj;  // DGT made uint32_t, was long
-	uint32_t dataOffset = 8; //offset to beginning of image data block. Put it right after file header  //DGT made uint32_t, was long
-	for( long i = 0; i< numOffsets; i++ ) {
-		sizeOffsets[i] = tileLength * totalX * dataSizeObj;
-		dataOffsets[i] = dataOffset + (i * sizeofStrip);
-	}
-	// Recalculate size of final, potentially partial strip
-	//DGT  Deleted dataOffset from line below
-	//sizeOffsets[numOffsets-1] = dataOffset + ((totalY - (tileLength * (numOffsets-1))) * totalX * dataSize);
-	sizeOffsets[numOffsets-1] = ((totalY - (tileLength * (numOffsets-1))) * totalX * dataSizeObj);
+	//  The file is written as BigTIFF, with 64 bit offsets, when it would be larger than the 4 GB
+	//  a TIFF file can address.  The choice is made by writeTiles for compressed files.
+	uint64_t *dataOffsets = NULL;
+	uint64_t *sizeOffsets = NULL;
+	uint64_t dataOffset = 8; //offset to beginning of image data block. Put it right after file header
+	uint64_t dataEnd;  //  offset of the end of the image data block
+	if(tileOrRow == 1) {
+		//  Tiles are written first, since the offsets of compressed tiles are only known once the tiles are compressed
+		writeTiles(xstart, ystart, numRows, numCols, buffer, dataOffsets, sizeOffsets, dataEnd);
+	}
+	else {
+		//Calculate strip data offsets and sizes
+		numOffsets = (totalY + tileLength - 1)/tileLength;
+		uint64_t dataBytes = (uint64_t)totalX * totalY * dataSizeObj;
+		version = needBigTiff(dataBytes) ? BIGTIFF : TIFF;
+		if(version == BIGTIFF) dataOffset = 16;
+		dataOffsets = (uint64_t*) malloc( sizeof(uint64_t) * numOffsets );
+		sizeOffsets = (uint64_t*) malloc( sizeof(uint64_t) * numOffsets );
+
+		//  The below is hard coded for strips that inherit the tileLength of the copied object
+		uint64_t sizeofStrip = (uint64_t)tileLength * totalX * dataSizeObj;
+		for( long i = 0; i< numOffsets; i++ ) {
+			sizeOffsets[i] = sizeofStrip;
+			dataOffsets[i] = dataOffset + (i * sizeofStrip);
+		}
+		// Recalculate size of final, potentially partial strip
+		sizeOffsets[numOffsets-1] = (uint64_t)(totalY - (tileLength * (numOffsets-1))) * totalX * dataSizeObj;
+		dataEnd = dataOffset + dataBytes;
+	}
 	//numEntries is the number of tags in the Oth (first and only) IFD
 	//Consider implementing additional tags in the future: 34735 - 34797 and 42112
 
 	numEntries = 14;
+	//  Tiles have Predictor, TileWidth, TileLength, TileOffsets and TileByteCounts tags in place
+	//  of StripOffsets, RowsPerStrip and StripByteCounts
+	if(tileOrRow == 1)
+	{
+		numEntries += 2;
+	}
 	//  DGT implementing spatial reference tag
 	if(filedata.geoKeySize > 0)
 	{
@@ -1459,8 +1402,7 @@ void tiffIO::write(long xstart, long ystart, long numRows, long numCols, void* s
 	if(rank==0) {
 		//nextAvailable is the offset of nextAvailable unallocated area in the output file
 		//initially set it to the offset of the beginning of the 0th (first) IFD
-		//BT unsigned long long nextAvailable = dataOffset + (totalX * totalY * dataSize);
-		uint32_t nextAvailable = dataOffset + (totalX * totalY * dataSizeObj);  //DGT made uint32_t, was long
+		uint64_t nextAvailable = (dataEnd + 1) & ~(uint64_t)1;  //  IFD starts on a word boundary
 		//printf("DataOffset: %lu, totalX: %lu, totalY: %lu, dataSize: %d\n",dataOffset, totalX, totalY, dataSizeObj);
 		//printf("Next available: %lu\n",nextAvailable);
 		//fflush(stdout);
@@ -1471,19 +1413,29 @@ void tiffIO::write(long xstart, long ystart, long numRows, long numCols, void* s
 		MPI_File_write( fh, &endian, 2, MPI_BYTE, &status);
 	
 		//Write the tiff file identifier 
-		short version = TIFF;
 		MPI_File_write( fh, &version,2, MPI_BYTE, &status);
 
 		//Write the offset of 0th (first and only) Image File Directory (IFD)
-		//BT unsigned long long tableOffset = nextAvailable;
-		uint32_t tableOffset = nextAvailable;  //DGT made uint32_t, was long
-		nextAvailable += (numEntries * 12)+6; //update to offset of first Tag data value block by adding 12 bytes for each tag and 6 bytes for the IFD header and footer
-		MPI_File_write( fh, &tableOffset, 4, MPI_BYTE, &status);
+		uint64_t tableOffset = nextAvailable;
+		if ( version == TIFF ) {
+			nextAvailable += (numEntries * 12)+6; //update to offset of first Tag data value block by adding 12 bytes for each tag and 6 bytes for the IFD header and footer
+			MPI_File_write( fh, &tableOffset, 4, MPI_BYTE, &status);
+		}
+		else {
+			//BIGTIFF has the offset bytesize (8) and an empty word before the offset
+			short offsetByteSize = 8;
+			short emptyWord = 0;
+			MPI_File_write( fh, &offsetByteSize, 2, MPI_BYTE, &status);
+			MPI_File_write( fh, &emptyWord, 2, MPI_BYTE, &status);
+			nextAvailable += (numEntries * 20)+16; //20 bytes for each tag and 16 bytes for the IFD header and footer
+			MPI_File_write( fh, &tableOffset, 8, MPI_BYTE, &status);
+		}
 
 		//Go to beginning of 0th (first and only) IFD
 		//Write Number of Directory Entries for 0th IFD
 		MPI_File_seek( fh, tableOffset, MPI_SEEK_SET );
-		MPI_File_write( fh, &numEntries, 2, MPI_BYTE, &status);
+		uint64_t numEntries8 = numEntries;
+		MPI_File_write( fh, &numEntries8, (version == TIFF) ? 2 : 8, MPI_BYTE, &status);
 		
 		ifd obj;
 
@@ -1514,7 +1466,7 @@ void tiffIO::write(long xstart, long ystart, long numRows, long numCols, void* s
 		obj.tag = 259;
 		obj.type = 3;
 		obj.count = 1;
-		obj.offset = 1;
+		obj.offset = (unsigned short)compression;
 		writeIfd( obj);
 	
 		//Entry 4 - Photometric Interpretation (1=Black Is Zero)
@@ -1524,342 +1476,467 @@ void tiffIO::write(long xstart, long ystart, long numRows, long numCols, void* s
 		obj.offset = 1;
 		writeIfd( obj);
 	
-		//Entry 5 - Strip Offsets (pointers to beginning of strips)
-		//DGT  This does not properly handle the case for only one strip
-		obj.tag = 273;
-		obj.type = 4;
-		obj.count = numOffsets;
-		//BT unsigned long long WRITEOFFSETS;  //  DGT insert to handle case for only one strip
-		unsigned long WRITEOFFSETS;  //  DGT insert to handle case for only one strip
-		if (numOffsets == 1)  
-		{
-			obj.offset=dataOffsets[0];
-		}
-		else
-		{
-			obj.offset = nextAvailable;
-			WRITEOFFSETS = nextAvailable;
-			nextAvailable += numOffsets*4;
-		}
-		writeIfd( obj);
+		//  Tag data that do not fit in the tag are written from nextAvailable on as each tag is written
+		if(tileOrRow != 1) {
+			//Entry 5 - Strip Offsets (pointers to beginning of strips)
+			obj.tag = 273;
+			obj.count = numOffsets;
+			writeOffsetsTag( obj, dataOffsets, nextAvailable);
 			
-		//Entry 6 - Samples per Pixel (always 1)
-		obj.tag = 277;
-		obj.type =3;
-		obj.count = 1;
-		obj.offset = 1;
-		writeIfd( obj);
+			//Entry 6 - Samples per Pixel (always 1)
+			obj.tag = 277;
+			obj.type =3;
+			obj.count = 1;
+			obj.offset = 1;
+			writeIfd( obj);
 	
-		//Entry 7 - Rows per Strip
-		obj.tag = 278;
-		obj.type =3;
-		obj.count = 1;
-		obj.offset = tileLength;
-		writeIfd( obj);
+			//Entry 7 - Rows per Strip
+			obj.tag = 278;
+			obj.type =4;
+			obj.count = 1;
+			obj.offset = tileLength;
+			writeIfd( obj);
 	
-		//Entry 8 - Strip Byte Counts
-		//DGT  This does not properly handle the case for only one strip
-		obj.tag = 279;
-		obj.type = 4;
-		obj.count = numOffsets;
-		//BT unsigned long long WRITESIZES;   //  DGT changes to handle case for only one strip
-		unsigned long WRITESIZES;   //  DGT changes to handle case for only one strip
-		if(numOffsets == 1)
-		{
-			obj.offset=sizeOffsets[0];
+			//Entry 8 - Strip Byte Counts
+			obj.tag = 279;
+			obj.count = numOffsets;
+			writeOffsetsTag( obj, sizeOffsets, nextAvailable);
+	
+			//Entry 9 - Planar Configuration (always 1)
+			obj.tag = 284;
+			obj.type =3;
+			obj.count = 1;
+			obj.offset = 1;
+			writeIfd( obj);
 		}
-		else
-		{
-			obj.offset = nextAvailable;
-			WRITESIZES = nextAvailable;
-			nextAvailable += numOffsets*4;
+		else {
+			//Samples per Pixel (always 1)
+			obj.tag = 277;
+			obj.type =3;
+			obj.count = 1;
+			obj.offset = 1;
+			writeIfd( obj);
+
+			//Planar Configuration (always 1)
+			obj.tag = 284;
+			obj.type =3;
+			obj.count = 1;
+			obj.offset = 1;
+			writeIfd( obj);
+
+			//Predictor (1=none, 2=horizontal differencing, 3=floating point)
+			obj.tag = 317;
+			obj.type =3;
+			obj.count = 1;
+			obj.offset = predictor;
+			writeIfd( obj);
+
+			//Tile Width
+			obj.tag = 322;
+			obj.type =4;
+			obj.count = 1;
+			obj.offset = tileWidth;
+			writeIfd( obj);
+
+			//Tile Length
+			obj.tag = 323;
+			obj.type =4;
+			obj.count = 1;
+			obj.offset = tileLength;
+			writeIfd( obj);
+
+			//Tile Offsets
+			obj.tag = 324;
+			obj.count = numOffsets;
+			writeOffsetsTag( obj, dataOffsets, nextAvailable);
+
+			//Tile Byte Counts
+			obj.tag = 325;
+			obj.count = numOffsets;
+			writeOffsetsTag( obj, sizeOffsets, nextAvailable);
 		}
-		writeIfd( obj);		
-	
-		//Entry 9 - Planar Configuration (always 1)
-		obj.tag = 284;
-		obj.type =3;
-		obj.count = 1;
-		obj.offset = 1;
-		writeIfd( obj);
-	
+
 		//Entry 10 - Sample format ( 1=unsigned integer, 2=signed integer, 3=IEEE floating point )
 		//Note that size/length of pixel is defined by the BitsPerSample field
 		obj.tag = 339;
 		obj.type =3;
 		obj.count = 1;
-		if( datatype == FLOAT_TYPE )
+		if( datatype == FLOAT_TYPE || datatype == DOUBLE_TYPE )
 			obj.offset = 3;
-		else obj.offset = 2;  // This assumes that all integer grids being written are signed
+		else if( datatype == BYTE_TYPE )
+			obj.offset = 1;
+		else obj.offset = 2;  // Other integer grids are signed
 		writeIfd( obj);
 		
 		//Entry 11 - Scale Tag
+		double dummy = 0;
+		double scale[3] = {dx, dy, dummy};
 		obj.tag = 33550;
 		obj.type = 12;
 		obj.count = 3;
-		obj.offset = nextAvailable;
-		writeIfd( obj);
-		//BT unsigned long long WRITESCALETAG = nextAvailable;
-		unsigned long WRITESCALETAG = nextAvailable;
-		nextAvailable += 24;
+		writeTagData( obj, scale, 24, nextAvailable);
 	
 		//Entry 12 - Model Tie Point Tag
+		double tiePoint[6] = {dummy, dummy, dummy, xleftedge, ytopedge, dummy};
 		obj.tag = 33922;
 		obj.type = 12;
 		obj.count = 6;
-		obj.offset = nextAvailable;
-		writeIfd( obj);
-		//BT unsigned long long WRITEMODEL = nextAvailable;
-		unsigned long WRITEMODEL = nextAvailable;
-		nextAvailable += 48;
+		writeTagData( obj, tiePoint, 48, nextAvailable);
 
 		//GeoTIFF-GeoKeyDirectoryTag (GeoKey index w/data when small)
-		unsigned long WRITEGEOKEY;
 		if(filedata.geoKeySize > 0)
 		{
 			obj.tag=34735;
 			obj.type=3;
-			obj.offset=nextAvailable;
 			obj.count=filedata.geoKeySize;  
-			WRITEGEOKEY = nextAvailable;
-			nextAvailable += obj.count * 2;  // 2 bytes per count since each is a short
-			writeIfd(obj);
+			writeTagData( obj, filedata.geoKeyDir, obj.count * 2, nextAvailable);  // 2 bytes per count since each is a short
 		}
 
 		//GeoTiff-GeoDoubleParamsTag (GeoKey double data values)
-		unsigned long WRITEGEODOUBLE;
 		if(filedata.geoDoubleSize > 0)
 		{
 			obj.tag=34736;
 			obj.type=12;
-			obj.offset=nextAvailable;
 			obj.count=filedata.geoDoubleSize;  
-			WRITEGEODOUBLE = nextAvailable;
-			nextAvailable += obj.count * 8; //8 bytes per count since each is a double
-			writeIfd(obj);
+			writeTagData( obj, filedata.geoDoubleParams, obj.count * 8, nextAvailable); //8 bytes per count since each is a double
 		}
 
 		//GeoTiff-GeoAsciiParamsTag (GeoKey ASCII data values)
-		unsigned long WRITEGEOASCII;
 		if(filedata.geoAsciiSize > 0)
 		{
 			obj.tag=34737;
 			obj.type=2;
-			obj.offset=nextAvailable;
 			obj.count=filedata.geoAsciiSize;  
-			WRITEGEOASCII = nextAvailable;
-			nextAvailable += obj.count;
-			writeIfd(obj);
+			writeTagData( obj, filedata.geoAscii, obj.count, nextAvailable);
 		}
 
 		//GDAL_ASCII Tag
-		unsigned long WRITEGDALASCII;
 		if(filedata.gdalAsciiSize > 0)
 		{
 			obj.tag=42112;
 			obj.type=2;
-			obj.offset=nextAvailable;
 			obj.count=filedata.gdalAsciiSize;  
-			WRITEGDALASCII = nextAvailable;
-			nextAvailable += obj.count;
-			writeIfd(obj);
+			writeTagData( obj, filedata.gdalAscii, obj.count, nextAvailable);
 		}
 
 		//Entry 13 - GDAL_NODATA Tag
+		char cnodata[25];
 		obj.tag = 42113;
 		obj.type = 2;
 		//  DGT additions to handle datatypes
-		if( datatype == SHORT_TYPE ) obj.count = 7;
-		else if( datatype == LONG_TYPE ) obj.count = 12;
-		else obj.count = 25;
-		obj.offset = nextAvailable;
-		writeIfd( obj);
-		//BT unsigned long long WRITENODATA = nextAvailable;
-		unsigned long WRITENODATA = nextAvailable;
-		nextAvailable += obj.count;  // DGT modified from 25
-
-		//Write Footer for this IFD
-		//Footer consists of the offset for the next IFD, but since this is the only and last IFD, write 4 or 8 bytes of 0's
-		if ( version = TIFF ) {
-			//BT MPI_File_write( fh, (unsigned long long)0, 4, MPI_BYTE, &status);
-			MPI_File_write( fh, (uint32_t)0, 4, MPI_BYTE, &status);  //DGT
-		}
-		else {
-			MPI_File_write( fh, (uint64_t)0, 8, MPI_BYTE, &status);   //DGT
-		}
-
-		//Write Tag Data Blocks for Tags with more data than will fit in the tag (4 or 8 bytes depending on TIFF/BIGTIFF)
-		//Write Data for Strip Offsets 		
-		//DGT  Only do this for numOffsets > 1
-		if(numOffsets > 1)
-		{
-			mpiOffset = WRITEOFFSETS;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET); 
-			MPI_File_write( fh, dataOffsets, 4*numOffsets, MPI_BYTE, &status);
-		
-			//Write Data for Strip Byte Counts
-			mpiOffset = WRITESIZES;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			MPI_File_write( fh, sizeOffsets, 4*numOffsets, MPI_BYTE, &status);
-		}
-	
-		//Write Data for Scale Tag
-		mpiOffset = WRITESCALETAG;
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-		MPI_File_write( fh, &dx, 8, MPI_BYTE, &status);
-		MPI_File_write( fh, &dy, 8, MPI_BYTE, &status);
-		double dummy = 0;
-		MPI_File_write( fh, &dummy, 8, MPI_BYTE, &status);
-	
-		//Write Data for Model Tie Point Tag
-		mpiOffset = WRITEMODEL;
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-		MPI_File_write( fh, &dummy, 8, MPI_BYTE, &status);
-		MPI_File_write( fh, &dummy, 8, MPI_BYTE, &status);
-		MPI_File_write( fh, &dummy, 8, MPI_BYTE, &status);
-		MPI_File_write( fh, &xleftedge, 8, MPI_BYTE, &status);
-		MPI_File_write( fh, &ytopedge, 8, MPI_BYTE, &status);
-		MPI_File_write( fh, &dummy, 8, MPI_BYTE, &status);
-
-		// Write Data for the GeoTIFF GeoKeyDirectoryTag tag
-		if(filedata.geoKeySize > 0)
-		{
-			mpiOffset = WRITEGEOKEY;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-		//	MPI_File_write( fh, &filedata.geoKeyDir, 2*filedata.geoKeySize, MPI_BYTE, &status);
-			for( long i=0; i<filedata.geoKeySize; ++i) {
-				MPI_File_write( fh, &filedata.geoKeyDir[i], 2, MPI_BYTE, &status);
-				//printf("%d,",filedata.geoKeyDir[i]);
-			}
-			//printf("\n");
-		}
-
-		//  Write Data for the GeoTIFF GeoDoubleParamsTag tag
-		if(filedata.geoDoubleSize > 0)
-		{
-			mpiOffset = WRITEGEODOUBLE;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			MPI_File_write (fh, filedata.geoDoubleParams,(int)filedata.geoDoubleSize*8, MPI_BYTE, &status);
-		}
-
-		//  Write Data for the GeoTIFF GeoAsciiParamsTag tag
-		if(filedata.geoAsciiSize > 0)
-		{
-			mpiOffset = WRITEGEOASCII;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			MPI_File_write (fh, filedata.geoAscii,(int)filedata.geoAsciiSize, MPI_BYTE, &status);
-		}
-
-		//  Write GDALASCII tag
-		if(filedata.gdalAsciiSize > 0)
-		{
-			mpiOffset = WRITEGDALASCII;
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			MPI_File_write (fh, filedata.gdalAscii,(int)filedata.gdalAsciiSize, MPI_BYTE, &status);
-		}
-
-		//Write Data for GDAL_NODATA Tag
-		mpiOffset = WRITENODATA;
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
 		if( datatype == SHORT_TYPE ) {
-			char cnodata[7];
+			obj.count = 7;
 			sprintf(cnodata,"%06d\x0",*(short*)nodata); 
-			MPI_File_write( fh, &cnodata, 7, MPI_BYTE, &status);
 		}
-		else if( datatype == LONG_TYPE) {
-			char cnodata[12];
+		else if( datatype == LONG_TYPE ) {
+			obj.count = 12;
 			sprintf(cnodata,"%011d\x0",*(long*)nodata); 
-			MPI_File_write( fh, &cnodata, 12, MPI_BYTE, &status);
 		}
-		else if( datatype == FLOAT_TYPE) {
-			char cnodata[25];
+		else if( datatype == BYTE_TYPE ) {
+			obj.count = 4;
+			sprintf(cnodata,"%03d\x0",*(uint8_t*)nodata);
+		}
+		else if( datatype == INT64_TYPE ) {
+			obj.count = 21;
+			sprintf(cnodata,"%020lld\x0",*(long long*)nodata);
+		}
+		else if( datatype == DOUBLE_TYPE ) {
+			obj.count = 25;
+			sprintf(cnodata,"%-24.16e\x0",*(double*)nodata);
+		}
+		else {
+			obj.count = 25;
 			//CPLString().Printf( "%.18g", dfNoData ).c_str() ); GDAL Code
 			//sprintf(cnodata,"%-24.16Le\x0",*(float*)nodata); Kim's Code
 			sprintf(cnodata,"%-24.16e\x0",*(float*)nodata);
-			MPI_File_write( fh, &cnodata, 25, MPI_BYTE, &status);
 		}
+		writeTagData( obj, cnodata, obj.count, nextAvailable);
 
+		//Write Footer for this IFD
+		//Footer consists of the offset for the next IFD, but since this is the only and last IFD, write 4 or 8 bytes of 0's
+		uint64_t nextIfd = 0;
+		MPI_File_write( fh, &nextIfd, (version == TIFF) ? 4 : 8, MPI_BYTE, &status);
 	}
 	
 
 	//Write data/image block
-	//BT unsigned long long next =0;
-	long next =0;
+	//  Rows of a partition without a grid pointer are copied out a band at a time and each band
+	//  is written with independent writes, since the number of bands differs between processes
+	if(tileOrRow != 1 && part != NULL && numRows > 0 && numCols > 0) {
+		int elementSize = storageSize(datatype);
+		long bandRows = partitionBandRows(numCols);
+		vector<char> band((size_t)min(bandRows, numRows)*numCols*elementSize);
+		vector<int32_t> longBand;
+		for(long y = 0; y < numRows; y += bandRows) {
+			long n = min(bandRows, numRows-y);
+			part->getRows(y, n, &band[0]);
+			const char *out = &band[0];
+			if( datatype == LONG_TYPE ) {
+				longBand.resize(n*numCols);
+				for(long k = 0; k < n*numCols; k++)
+					longBand[k] = (int32_t)(((long*)&band[0])[k]);
+				out = (const char*)&longBand[0];
+			}
+			//  Full rows are consecutive in the file
+			long rowsPerWrite = (numCols == (long)totalX) ? n : 1;
+			for(long r = 0; r < n; r += rowsPerWrite) {
+				mpiOffset = dataOffset + ((uint64_t)(ystart+y+r)*totalX + xstart)*dataSizeObj;
+				MPI_File_write_at(fh, mpiOffset, (void*)(out + r*numCols*dataSizeObj), rowsPerWrite*numCols*dataSizeObj, MPI_BYTE, &status);
+			}
+		}
+	}
+	//  Each process writes its block of the grid with one collective call through a file view
+	//  of the block, so the MPI library can combine the rows of all processes into large
+	//  contiguous writes.  Rows are written as a derived type so the count fits in an int.
+	else if(tileOrRow != 1 && part == NULL) {
+		MPI_Datatype etype, rowtype, filetype;
+		if( datatype == SHORT_TYPE ) 
+			etype = MPI_SHORT;
+		else if( datatype == LONG_TYPE )
+			etype = MPI_INT32_T;
+		else if( datatype == BYTE_TYPE )
+			etype = MPI_UINT8_T;
+		else if( datatype == DOUBLE_TYPE )
+			etype = MPI_DOUBLE;
+		else if( datatype == INT64_TYPE )
+			etype = MPI_INT64_T;
+		else
+			etype = MPI_FLOAT;
+		MPI_Type_contiguous(numCols, etype, &rowtype);
+		MPI_Type_commit(&rowtype);
+		if(numRows > 0 && numCols > 0) {
+			int sizes[2] = {(int)totalY, (int)totalX};
+			int subsizes[2] = {(int)numRows, (int)numCols};
+			int starts[2] = {(int)ystart, (int)xstart};
+			MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, etype, &filetype);
+		}
+		else
+			MPI_Type_contiguous(0, etype, &filetype);
+		MPI_Type_commit(&filetype);
+		mpiOffset = dataOffset;
+		MPI_File_set_view(fh, mpiOffset, etype, filetype, "native", MPI_INFO_NULL);
+		MPI_File_write_at_all(fh, 0, buffer, numRows, rowtype, &status);
+		MPI_File_set_view(fh, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+		MPI_Type_free(&filetype);
+		MPI_Type_free(&rowtype);
+	}
+	delete [] longBuffer;
+	free(dataOffsets);
+	free(sizeOffsets);
+}
 
-	if( datatype == SHORT_TYPE ) {
-		mpiOffset = dataOffset + (dataSizeObj*((totalX*ystart) + xstart));
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
+//  A rectangle of grid data held by this process: rows y0 to y1-1 and columns x0 to x1-1, with
+//  the cell at (x0,y0) at data and rows rowStride cells apart
+struct tilePiece {
+	long x0, x1, y0, y1;
+	const char *data;
+	long rowStride;
+};
+
+//  Write the grid as tiles, compressed unless compression is COMPRESS_NONE.  Each band of tiles
+//  (tileLength rows of the grid) is assembled by the process that holds the first row of the band
+//  at the left edge of the grid.  Rows of a band held by other processes are first sent to it
+//  with one MPI_Alltoallv, which for linear partitions only moves the rows of bands that straddle
+//  process boundaries.  Each process assembles and compresses its tiles using its threads, an
+//  MPI_Exscan of the tile sizes gives the offset of each process's tiles in the file, and the
+//  tiles, which are consecutive in the file for each process, are written with a collective
+//  write.  The tile offsets and sizes are gathered to process 0 in dataOffsets and sizeOffsets
+//  for the IFD, and version and dataEnd, the end of the tile data, are set on all processes.
+void tiffIO::writeTiles(long xstart, long ystart, long numRows, long numCols, void* source, uint64_t *&dataOffsets, uint64_t *&sizeOffsets, uint64_t &dataEnd) {
+	MPI_Status status;
+	long tileSize = tileLength;
+	long tilesAcross = (totalX + tileSize - 1)/tileSize;
+	long numBands = (totalY + tileSize - 1)/tileSize;
+	numOffsets = tilesAcross*numBands;
+	MPI_Datatype etype = MPI_FLOAT;
+	if(datatype == SHORT_TYPE) etype = MPI_SHORT;
+	else if(datatype == LONG_TYPE) etype = MPI_INT32_T;
+	else if(datatype == BYTE_TYPE) etype = MPI_UINT8_T;
+	else if(datatype == DOUBLE_TYPE) etype = MPI_DOUBLE;
+	else if(datatype == INT64_TYPE) etype = MPI_INT64_T;
+	if(numRows <= 0 || numCols <= 0) numRows = numCols = 0;
+
+	//  The block of the grid held by each process, and the process that compresses each band
+	long myBlock[4] = {xstart, ystart, numRows, numCols};
+	vector<long> blocks(4*size);
+	MPI_Allgather(myBlock, 4, MPI_LONG, &blocks[0], 4, MPI_LONG, MCW);
+	vector<int> bandOwner(numBands, -1);
+	for(int r = 0; r < size; r++)
+	{
+		if(blocks[4*r+2] == 0 || blocks[4*r] != 0) continue;
+		for(long b = (blocks[4*r+1] + tileSize - 1)/tileSize; b*tileSize < blocks[4*r+1] + blocks[4*r+2]; b++)
+			bandOwner[b] = r;
+	}
 
-		//BT for(unsigned long i=0; i<numRows; i++) {
-		for(long i=0; i<numRows; i++) {
-			MPI_File_write( fh, (void*)(((short*)source)+next), numCols, MPI_SHORT, &status);
-			mpiOffset += (numCols*dataSizeObj);
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			next+=numCols;
+	//  Rows of this process's block in the bands other processes own are sent to them, in band
+	//  order.  Rows of the bands this process owns are received from each process in band order.
+	vector<int> sendCounts(size, 0), sendDispls(size, 0), recvCounts(size, 0), recvDispls(size, 0);
+	vector<char> sendBuffer, recvBuffer;
+	vector<tilePiece> pieces;
+	for(int pass = 0; pass < 2; pass++)
+	{
+		long sendTotal = 0, recvTotal = 0;
+		for(int r = 0; r < size; r++)
+		{
+			sendDispls[r] = sendTotal;
+			recvDispls[r] = recvTotal;
+			for(long b = 0; b < numBands; b++)
+			{
+				long b0 = b*tileSize, b1 = min((b+1)*tileSize, (long)totalY);
+				if(bandOwner[b] == r && r != rank)
+				{
+					long y0 = max(b0, ystart), y1 = min(b1, ystart+numRows);
+					if(y1 > y0)
+					{
+						long n = (y1-y0)*numCols;
+						if(pass == 1)
+							memcpy(&sendBuffer[sendTotal*dataSizeObj], (char*)source + (y0-ystart)*numCols*dataSizeObj, n*dataSizeObj);
+						sendTotal += n;
+					}
+				}
+				if(bandOwner[b] == rank)
+				{
+					long rx = blocks[4*r], ry = blocks[4*r+1], rRows = blocks[4*r+2], rCols = blocks[4*r+3];
+					long y0 = max(b0, ry), y1 = min(b1, ry+rRows);
+					if(y1 > y0 && pass == 1)
+					{
+						tilePiece piece;
+						piece.x0 = rx;
+						piece.x1 = rx+rCols;
+						piece.y0 = y0;
+						piece.y1 = y1;
+						piece.rowStride = rCols;
+						if(r == rank)
+							piece.data = (char*)source + (y0-ystart)*numCols*dataSizeObj;
+						else
+							piece.data = &recvBuffer[recvTotal*dataSizeObj];
+						pieces.push_back(piece);
+					}
+					if(y1 > y0 && r != rank)
+						recvTotal += (y1-y0)*rCols;
+				}
+			}
+			sendCounts[r] = sendTotal - sendDispls[r];
+			recvCounts[r] = recvTotal - recvDispls[r];
+		}
+		if(pass == 0)
+		{
+			sendBuffer.resize(sendTotal*dataSizeObj + 1);
+			recvBuffer.resize(recvTotal*dataSizeObj + 1);
 		}
 	}
-	else if( datatype == LONG_TYPE ) {
-		mpiOffset = dataOffset + (dataSizeObj*((totalX*ystart) + xstart));
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-//		printf("dataSizeObj %d\n",dataSizeObj);
-		
-/*  DGT This is ugly.  Internally we are using a long partition grid which in some implementations
-    is 4 bytes and other 8 bytes.  ArcGIS and GDAL apparrently do not read 8 byte tiff's.
-	We therefore coerce to int32_t which is fixed at 4 bytes.  There is not a corresponding MPI type 
-	to use for writing so we write using MPI_BYTE.  This assumes that the byte order is correct.
-*/
-		int32_t* tempDataRow = new int32_t[numCols];
-		for(long i=0; i<numRows; i++) {
-			for(long k = 0; k < numCols; k++)
+	MPI_Alltoallv(&sendBuffer[0], &sendCounts[0], &sendDispls[0], etype, &recvBuffer[0], &recvCounts[0], &recvDispls[0], etype, MCW);
+	sendBuffer.clear();
+
+	//  Assemble and compress the tiles of the bands this process owns
+	vector<long> myTiles;
+	for(long b = 0; b < numBands; b++)
+		if(bandOwner[b] == rank)
+			for(long tx = 0; tx < tilesAcross; tx++)
+				myTiles.push_back(b*tilesAcross + tx);
+	long numTiles = myTiles.size();
+	vector< vector<char> > tileData(numTiles);
+	bool failed = false;
+	#pragma omp parallel num_threads(getNumThreads())
+	{
+		vector<char> tile(tileSize*tileSize*dataSizeObj);
+		#pragma omp for schedule(dynamic)
+		for(long t = 0; t < numTiles; t++)
+		{
+			long tx0 = (myTiles[t] % tilesAcross)*tileSize;
+			long ty0 = (myTiles[t] / tilesAcross)*tileSize;
+			//  Cells past the edge of the grid are left 0
+			memset(&tile[0], 0, tile.size());
+			for(size_t k = 0; k < pieces.size(); k++)
 			{
-					tempDataRow[k]=(int32_t) (*((long*)source+next+k));
-					//  Here we are ignoring the possibility of typecast changing the no data value
-					//  if it was outside the range of int32_t
+				long x0 = max(tx0, pieces[k].x0), x1 = min(tx0+tileSize, pieces[k].x1);
+				long y0 = max(ty0, pieces[k].y0), y1 = min(ty0+tileSize, pieces[k].y1);
+				if(x1 <= x0) continue;
+				for(long y = y0; y < y1; y++)
+					memcpy(&tile[((y-ty0)*tileSize + x0-tx0)*dataSizeObj], pieces[k].data + ((y-pieces[k].y0)*pieces[k].rowStride + x0-pieces[k].x0)*dataSizeObj, (x1-x0)*dataSizeObj);
 			}
-			MPI_File_write( fh, (void*)tempDataRow, numCols*dataSizeObj, MPI_BYTE, &status);
-			mpiOffset += (numCols*dataSizeObj);
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			next+=numCols;
-		}
-		delete tempDataRow;
-	}
-	else if( datatype == FLOAT_TYPE ) {
-		mpiOffset = dataOffset + (dataSizeObj*((totalX*ystart) + xstart));
-		//uint32_t check = dataOffset + (dataSizeObj*((totalX*ystart) + xstart));
-		//if (check != mpiOffset)
-		//{
-		//	printf("Tiffio offset overflow error: %ld, %ld\n",mpiOffset,check);
-		//	fflush(stdout);
-		//}
-		MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-		
-		//BT for(unsigned long i=0; i<numRows; i++) {
-		for(long i=0; i<numRows; i++) {
-			MPI_File_write( fh, (void*)(((float*)source)+next), numCols, MPI_FLOAT, &status);
-			mpiOffset += (numCols*dataSizeObj);
-			//check += (numCols*dataSizeObj);
-			//if (check != mpiOffset)
-			//{
-			//	printf("Offset overflow error 2nd posn: %ld, %ld\n",mpiOffset,check);
-			//	fflush(stdout);
-			//}
-			MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-			next+=numCols;
+			applyPredictor(predictor, &tile[0], tileSize, tileSize, dataSizeObj);
+			if(!encodeBlock(compression, &tile[0], tile.size(), tileData[t]))
+				failed = true;
 		}
+	}
+	if(failed) {
+		printf("Error writing file %s.\n", filename);
+		printf("Tile compression failed.\n");
+		MPI_Abort(MCW,-1);
+	}
+	recvBuffer.clear();
 
-		//mpiOffset = dataOffset + (tiff->dataSizeObj*((totalCols*ystart) + xstart));
-		//MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-		//
-		//for(int i=0; i<dy_grid; i++) {
-		//	MPI_File_write( fh, &farr.d[next], dx_grid, MPI_FLOAT, &status);
-		//	mpiOffset += (dx_grid*tiff->dataSizeObj);
-		//	MPI_File_seek( fh, mpiOffset, MPI_SEEK_SET);
-		//	next+=dx_grid;
-		//}
+	//  Place this process's tiles after those of lower ranks
+	long long myBytes = 0, myStart = 0, totalBytes;
+	vector<uint32_t> mySizes(numTiles + 1);
+	for(long t = 0; t < numTiles; t++)
+	{
+		mySizes[t] = tileData[t].size();
+		myBytes += tileData[t].size();
+	}
+	MPI_Exscan(&myBytes, &myStart, 1, MPI_LONG_LONG, MPI_SUM, MCW);
+	if(rank == 0) myStart = 0;
+	MPI_Allreduce(&myBytes, &totalBytes, 1, MPI_LONG_LONG, MPI_SUM, MCW);
+	version = needBigTiff(totalBytes) ? BIGTIFF : TIFF;
+	uint64_t dataStart = (version == BIGTIFF) ? 16 : 8;
+	dataEnd = dataStart + totalBytes;
+
+	//  Write the tiles in pieces of at most 1 GB, with the same number of collective calls on
+	//  all processes
+	vector<char> myData(myBytes + 1);
+	long long pos = 0;
+	for(long t = 0; t < numTiles; t++)
+	{
+		if(tileData[t].size() > 0) memcpy(&myData[pos], &tileData[t][0], tileData[t].size());
+		pos += tileData[t].size();
+		vector<char>().swap(tileData[t]);
+	}
+	const long long writeMax = 1024*1024*1024;
+	long long numWrites = (myBytes + writeMax - 1)/writeMax, maxWrites;
+	MPI_Allreduce(&numWrites, &maxWrites, 1, MPI_LONG_LONG, MPI_MAX, MCW);
+	for(long long k = 0; k < maxWrites; k++)
+	{
+		long long w0 = min(k*writeMax, myBytes), w1 = min((k+1)*writeMax, myBytes);
+		MPI_File_write_at_all(fh, (MPI_Offset)(dataStart + myStart + w0), &myData[w0], (int)(w1-w0), MPI_BYTE, &status);
+	}
 
+	//  Gather the tile sizes to process 0, which places each process's tiles after those of
+	//  lower ranks as above
+	int myCount = numTiles;
+	vector<int> counts(size), displs(size);
+	MPI_Gather(&myCount, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, MCW);
+	vector<uint32_t> allSizes(rank == 0 ? numOffsets + 1 : 1);
+	if(rank == 0)
+		for(int r = 1; r < size; r++)
+			displs[r] = displs[r-1] + counts[r-1];
+	MPI_Gatherv(&mySizes[0], myCount, MPI_UINT32_T, &allSizes[0], &counts[0], &displs[0], MPI_UINT32_T, 0, MCW);
+	if(rank == 0)
+	{
+		dataOffsets = (uint64_t*) malloc( sizeof(uint64_t) * numOffsets );
+		sizeOffsets = (uint64_t*) malloc( sizeof(uint64_t) * numOffsets );
+		uint64_t offset = dataStart;
+		long k = 0;
+		for(int r = 0; r < size; r++)
+			for(long b = 0; b < numBands; b++)
+				if(bandOwner[b] == r)
+					for(long tx = 0; tx < tilesAcross; tx++)
+					{
+						dataOffsets[b*tilesAcross + tx] = offset;
+						sizeOffsets[b*tilesAcross + tx] = allSizes[k];
+						offset += allSizes[k++];
+					}
 	}
 }
 
+//  A TIFF file can address 4 GB.  The IFD and the tag data are written after the image data,
+//  so these are allowed for along with the file header.
+bool tiffIO::needBigTiff(uint64_t dataBytes) {
+	uint64_t tagBytes = 1024 + 16*(uint64_t)numOffsets + 2*filedata.geoKeySize + 8*filedata.geoDoubleSize
+		+ filedata.geoAsciiSize + filedata.gdalAsciiSize;
+	return 8 + dataBytes + tagBytes > 4294967295ULL;
+}
+
 bool tiffIO::compareTiff(const tiffIO &comp){
 	double tol=0.0001;
 	if(totalX != comp.totalX)
@@ -1962,27 +2039,95 @@ bool tiffIO::compareTiff(const tiffIO &comp){
 	return true;
 }
 
+//  The count and the value or offset of a tag are 4 bytes in TIFF and 8 bytes in BIGTIFF
 void tiffIO::readIfd(ifd &obj ) {
 	MPI_Status status;
+	int fieldSize = (version == BIGTIFF) ? 8 : 4;
+	obj.count = 0;
+	obj.offset = 0;
 	MPI_File_read( fh, &obj.tag, 2, MPI_BYTE,&status);
 	MPI_File_read( fh, &obj.type, 2, MPI_BYTE,&status);
-	MPI_File_read( fh, &obj.count, 4, MPI_BYTE,&status);
-	MPI_File_read( fh, &obj.offset, 4, MPI_BYTE,&status);
+	MPI_File_read( fh, &obj.count, fieldSize, MPI_BYTE,&status);
+	MPI_File_read( fh, &obj.offset, fieldSize, MPI_BYTE,&status);
 }
 
 void tiffIO::writeIfd(ifd &obj) {
 	MPI_Status status;
+	int fieldSize = (version == BIGTIFF) ? 8 : 4;
 	MPI_File_write(fh, &obj.tag, 2, MPI_BYTE, &status);
 	MPI_File_write(fh, &obj.type, 2, MPI_BYTE, &status);
-	MPI_File_write(fh, &obj.count, 4, MPI_BYTE, &status);
-	MPI_File_write(fh, &obj.offset, 4, MPI_BYTE, &status);
+	MPI_File_write(fh, &obj.count, fieldSize, MPI_BYTE, &status);
+	MPI_File_write(fh, &obj.offset, fieldSize, MPI_BYTE, &status);
+}
+
+//  Read the length bytes of data of a tag, which are held in the tag itself when they fit in
+//  its 4 bytes (8 bytes for BIGTIFF)
+void tiffIO::readTagData(const ifd &obj, void *data, long length) {
+	MPI_Status status;
+	if( length <= ((version == BIGTIFF) ? 8 : 4) )
+		memcpy( data, &obj.offset, length);
+	else
+		MPI_File_read_at( fh, (MPI_Offset)obj.offset, data, length, MPI_BYTE, &status);
+}
+
+//  Read the values of an unsigned short, long or long long (BIGTIFF) tag such as the strip
+//  offsets
+void tiffIO::readTagValues(const ifd &obj, uint64_t *values) {
+	int valueSize = (obj.type == 3) ? 2 : ((obj.type == 16) ? 8 : 4);
+	vector<char> data(obj.count*valueSize + 1);
+	readTagData( obj, &data[0], obj.count*valueSize);
+	for( uint64_t i=0; i<obj.count; ++i) {
+		if( valueSize == 2 ) {
+			uint16_t value;
+			memcpy( &value, &data[i*2], 2);
+			values[i] = value;
+		}
+		else if( valueSize == 4 ) {
+			uint32_t value;
+			memcpy( &value, &data[i*4], 4);
+			values[i] = value;
+		}
+		else
+			memcpy( &values[i], &data[i*8], 8);
+	}
+}
+
+//  Write a tag with length bytes of data.  Data that fit in the tag (4 bytes, or 8 for BIGTIFF)
+//  are held in it, otherwise they are written at nextAvailable, which is moved past them.
+void tiffIO::writeTagData(ifd &obj, const void *data, long length, uint64_t &nextAvailable) {
+	MPI_Status status;
+	obj.offset = 0;
+	if( length <= ((version == BIGTIFF) ? 8 : 4) )
+		memcpy( &obj.offset, data, length);
+	else {
+		obj.offset = nextAvailable;
+		MPI_File_write_at( fh, (MPI_Offset)nextAvailable, (void*)data, length, MPI_BYTE, &status);
+		nextAvailable += length;
+	}
+	writeIfd( obj);
+}
+
+//  Write a strip or tile offsets or byte counts tag, as unsigned long long for BIGTIFF and
+//  unsigned long for TIFF
+void tiffIO::writeOffsetsTag(ifd &obj, const uint64_t *values, uint64_t &nextAvailable) {
+	if( version == BIGTIFF ) {
+		obj.type = 16;
+		writeTagData( obj, values, 8*obj.count, nextAvailable);
+	}
+	else {
+		obj.type = 4;
+		vector<uint32_t> values4(obj.count + 1);
+		for( uint64_t i=0; i<obj.count; ++i)
+			values4[i] = (uint32_t)values[i];
+		writeTagData( obj, &values4[0], 4*obj.count, nextAvailable);
+	}
 }
 
 void tiffIO::printIfd(ifd obj) {
 	printf("Tag: %hu\n",obj.tag);
 	printf("Type: %hu\n",obj.type);
-	printf("Value: %u\n",obj.count);
-	printf("offset: %u\n",obj.offset);
+	printf("Value: %llu\n",(unsigned long long)obj.count);
+	printf("offset: %llu\n",(unsigned long long)obj.offset);
 }
 
 //BT void tiffIO::geoToGlobalXY(double geoX, double geoY, unsigned long long &globalX, unsigned long long &globalY){
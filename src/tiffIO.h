@@ -50,7 +50,7 @@ email:  dtarb@usu.edu
 
 //Assumptions when using BIGTIFF - The BIGTIFF specification does not have these limitations, however this implementation does:
 // - The width and the height of the grid will be no more than 2^32 (4G) cells in either dimension
-// - No single TIFF strip or tile will contain more than 2^32 (4G) cells
+// - No single TIFF strip or tile will contain more than 2^32 (4G) bytes
 // - No single linear partition strip (process) will contain more than 2^32 (4G) cells
 // - No TIFF metadata tag may have more than 2^32 (4G) values
 
@@ -82,8 +82,8 @@ struct geotiff{
 struct ifd {
 	unsigned short tag;			//Tag ID#
 	unsigned short type;		//Datatype of Values (TIFF datatypes, not C++)
-	uint32_t count;	  //DGT	//Count of Values
-	uint32_t offset;	//DGT	// unsigned long long BT - Values (if fits in 4 bytes for TIFF or 8 for BIGTIFF else Offset to Values)
+	uint64_t count;		//Count of Values
+	uint64_t offset;	//Values (if fits in 4 bytes for TIFF or 8 for BIGTIFF else Offset to Values)
 };
 
 
@@ -95,13 +95,13 @@ class tiffIO{
 		short dataSizeFileIn;   //unsigned short BT - data value size of tiff file in bytes = BitsPerSample/8, not necessarily the same as the size of data in array
 		short dataSizeObj;      //unsigned short BT - data value size of each element in the storage array and of the output tiff file in bytes
 		short sampleFormat;     //unsigned short BT - data type of TIFF file: 1=unsigned interger, 2=signed interger, 3=float, 4=undefined
-		uint32_t *offsets;		//DGT	//unsigned long long BT - pointer to the array of tile/strip offsets into the TIFF data
+		uint64_t *offsets;		//pointer to the array of tile/strip offsets into the TIFF data
 		uint32_t numOffsets;	//DGT	//?? unsigned long BT - number of tiles/strips in the TIFF file, also the number of items in the numOffset and Bytes arrays
 		short tileOrRow;       	// unsigned short - NEED: TIFF 0=undefined, 1=tile, 2=row
 		uint32_t tileLength;	//DGT	// unsigned long - NEED: tile length
 		uint32_t tileWidth;		//DGT	// unsigned long - NEED: tile width
 
-		uint32_t *bytes;		//DGT	//unsigned long BT - ??pointer into an array of the number of bytes in each TIFF tile or strip
+		uint64_t *bytes;		//pointer into an array of the number of bytes in each TIFF tile or strip
 		unsigned short numEntries;		//?? unsigned long - number of TIFF metadata tags in the Oth IFD (the only one we read/write)
 		short version;			//TIFF Version Code, 42=TIFF/GeoTIFF, 43=BigTIFF
 		int rank, size;			//MPI rank & size, rank=number for this process, size=number of processes
@@ -113,10 +113,23 @@ class tiffIO{
 		double yllcenter;		//vertical center point of lower left grid cell in geographic coordinates, not grid coordinates
 		double xleftedge;		//horizontal coordinate of left edge of grid in geographic coordinates, not grid coordinates
 		double ytopedge;		//vertical coordinate of top edge of grid in geographic coordinates, not grid coordinates
-		DATA_TYPE datatype;		//datatype of the grid values and the nodata value: short, long, or float
+		DATA_TYPE datatype;		//datatype of the grid values and the nodata value: short, long, float, double, uint8_t or long long
 		void *nodata;			//pointer to the nodata value, the nodata value type is indicated by datatype
 		void *filenodata;       //pointer to no data value from the file.  This may be different from nodata because filedatatype and datatype are not equivalent 
 		char filename[MAXLN];  //  Save filename for error or warning writes
+		void balanceRows();     //  Set the row split for balanced linear partitions
+		char *readBuffer;       //  File data buffer kept between reads
+		long readBufferSize;    //  Size of readBuffer in bytes
+		bool convertData(const char *in, void *dest, long destIndex, long n);  //  Convert file data to the storage type
+		short compression;      //  TIFF compression code of the file data, 1=none
+		short predictor;        //  TIFF predictor of compressed file data, 1=none, 2=horizontal, 3=floating point
+		void readCompressed(long xstart, long ystart, long numRows, long numCols, void* dest);  //  read for compressed files
+		void writeTiles(long xstart, long ystart, long numRows, long numCols, void* source, uint64_t *&dataOffsets, uint64_t *&sizeOffsets, uint64_t &dataEnd);  //  write compressed tiles
+		bool needBigTiff(uint64_t dataBytes);  //  true if a file with dataBytes of image data has to be written as BigTIFF
+		void writeGrid(long xstart, long ystart, long numRows, long numCols, void* source, tdpartition *part);  //  write from source, or from part a band of rows at a time
+		long partitionBandRows(long numCols);  //  rows of numCols cells in a band for reading and writing partitions without a grid pointer
+		char *mappedGrid;       //  Grid rows mapped by mapRows, which read does not need to read
+		long mappedRow;         //  Grid row of mappedGrid
 //  Mappings
 
 
@@ -128,11 +141,21 @@ class tiffIO{
 		//BT void read(unsigned long long xstart, unsigned long long ystart, unsigned long long numRows, unsigned long long numCols, void* dest);
 		//BT void write(unsigned long long xstart, unsigned long long ystart, unsigned long long numRows, unsigned long long numCols, void* source);
 		void read(long xstart, long ystart, long numRows, long numCols, void* dest);
+		char *mapRows(long ystart, long numRows, void *&mapBase, size_t &mapLength);
+		static void unmapRows(void *mapBase, size_t mapLength);
 		void write(long xstart, long ystart, long numRows, long numCols, void* source);
+		//  Read into and write from a partition.  Partitions without a grid pointer (cachedpart) are
+		//  read and written a band of rows at a time.
+		void read(long xstart, long ystart, long numRows, long numCols, tdpartition *part);
+		void write(long xstart, long ystart, long numRows, long numCols, tdpartition *part);
 
 		bool compareTiff(const tiffIO &comp);
 		void readIfd(ifd &obj);
 		void writeIfd(ifd &obj);
+		void readTagData(const ifd &obj, void *data, long length);
+		void readTagValues(const ifd &obj, uint64_t *values);
+		void writeTagData(ifd &obj, const void *data, long length, uint64_t &nextAvailable);
+		void writeOffsetsTag(ifd &obj, const uint64_t *values, uint64_t &nextAvailable);
 		void printIfd(ifd obj);
 
 		//void geoToGlobalXY(double geoX, double geoY, unsigned long long &globalX, unsigned long long &globalY);